@@ -0,0 +1,224 @@
+/* time queries to a CSIMC node through csimcd, one at a time with csi_rix()
+ * and then pipelined with csi_send(), and count the system calls each takes.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "csiutil.h"
+
+#define NQ      1000        /* default number of queries */
+#define DEPTH   8           /* default requests outstanding when pipelined */
+
+static void usage (void);
+static void serial (int fd, int n);
+static void pipelined (int fd, int n, int depth);
+static void report (char *what, int n, double t0);
+static double now (void);
+
+static char *host = "127.0.0.1";    /* csimcd host */
+static int port = CSIMCPORT;        /* csimcd port */
+static char *expr = "=epos;";       /* query */
+
+/* system calls made since the last report().
+ * these wrap those of libc, so they count the ones made by csiutil too.
+ */
+static long nsys;
+
+ssize_t
+read (int fd, void *buf, size_t n)
+{
+    static ssize_t (*fp)(int, void *, size_t);
+
+    if (!fp)
+        fp = dlsym (RTLD_NEXT, "read");
+    nsys++;
+    return ((*fp) (fd, buf, n));
+}
+
+ssize_t
+write (int fd, const void *buf, size_t n)
+{
+    static ssize_t (*fp)(int, const void *, size_t);
+
+    if (!fp)
+        fp = dlsym (RTLD_NEXT, "write");
+    nsys++;
+    return ((*fp) (fd, buf, n));
+}
+
+ssize_t
+recv (int fd, void *buf, size_t n, int flags)
+{
+    static ssize_t (*fp)(int, void *, size_t, int);
+
+    if (!fp)
+        fp = dlsym (RTLD_NEXT, "recv");
+    nsys++;
+    return ((*fp) (fd, buf, n, flags));
+}
+
+int
+poll (struct pollfd *pfd, nfds_t n, int to)
+{
+    static int (*fp)(struct pollfd *, nfds_t, int);
+
+    if (!fp)
+        fp = dlsym (RTLD_NEXT, "poll");
+    nsys++;
+    return ((*fp) (pfd, n, to));
+}
+
+int
+main (int ac, char *av[])
+{
+    int n = NQ, depth = DEPTH;
+    int addr, fd;
+
+    while ((--ac > 0) && ((*++av)[0] == '-'))
+    {
+        char *s;
+        for (s = av[0]+1; *s != '\0'; s++)
+            switch (*s)
+            {
+                case 'd':
+                    if (ac < 2)
+                        usage();
+                    depth = atoi (*++av);
+                    --ac;
+                    break;
+                case 'e':
+                    if (ac < 2)
+                        usage();
+                    expr = *++av;
+                    --ac;
+                    break;
+                case 'i':
+                    if (ac < 3)
+                        usage();
+                    host = *++av;
+                    port = atoi(*++av);
+                    ac -= 2;
+                    break;
+                case 'n':
+                    if (ac < 2)
+                        usage();
+                    n = atoi (*++av);
+                    --ac;
+                    break;
+                default:
+                    usage();
+            }
+    }
+
+    /* ac remaining args starting at av[0] */
+    if (ac != 1 || n < 1 || depth < 1)
+        usage();
+    addr = strtol (av[0], NULL, 0);
+
+    fd = csi_open (host, port, addr);
+    if (fd < 0)
+    {
+        fprintf (stderr, "Node %d: %s\n", addr, strerror(errno));
+        exit (1);
+    }
+
+    serial (fd, n);
+    pipelined (fd, n, depth);
+
+    csi_close (fd);
+    return (0);
+}
+
+static void
+usage()
+{
+    fprintf(stderr, "csibench: [options] addr\n");
+    fprintf(stderr, "Purpose: time queries to the CSIMC node at addr\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, " -d n    keep <n> queries outstanding when pipelined; default is %d\n", DEPTH);
+    fprintf(stderr, " -e x    query with expression <x>; default is %s\n", expr);
+    fprintf(stderr, " -i h p  connect to host <h> with port <p>;\n");
+    fprintf(stderr, "         default is %s port %d\n", host, CSIMCPORT);
+    fprintf(stderr, " -n n    make <n> queries each way; default is %d\n", NQ);
+
+    exit (4);
+}
+
+/* n queries, each waiting for its reply before the next */
+static void
+serial (int fd, int n)
+{
+    double t0 = now();
+    int i;
+
+    nsys = 0;
+    for (i = 0; i < n; i++)
+        (void) csi_rix (fd, "%s", expr);
+    report ("csi_rix", n, t0);
+}
+
+/* n queries, keeping up to depth outstanding */
+static void
+pipelined (int fd, int n, int depth)
+{
+    int id[CSIMAXREQ];
+    char buf[128];
+    double t0 = now();
+    int sent, got;
+
+    if (depth > CSIMAXREQ)
+        depth = CSIMAXREQ;
+
+    nsys = 0;
+    for (sent = got = 0; got < n; got++)
+    {
+        while (sent < n && sent - got < depth)
+        {
+            id[sent % depth] = csi_send (fd, NULL, NULL, "%s", expr);
+            if (id[sent % depth] < 0)
+            {
+                fprintf (stderr, "csi_send: %s\n", strerror(errno));
+                exit (1);
+            }
+            sent++;
+        }
+        if (csi_wait (fd, id[got % depth], buf, sizeof(buf), NULL) < 0)
+        {
+            fprintf (stderr, "csi_wait: %s\n", strerror(errno));
+            exit (1);
+        }
+    }
+
+    sprintf (buf, "csi_send x%d", depth);
+    report (buf, n, t0);
+}
+
+/* print per-query time and system calls since t0 */
+static void
+report (char *what, int n, double t0)
+{
+    double dt = now() - t0;
+
+    printf ("%-14s %6d queries %9.1f us/query %6.1f syscalls/query\n", what,
+            n, 1e6*dt/n, (double)nsys/n);
+}
+
+/* return unix time now, secs */
+static double
+now()
+{
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+    return (tv.tv_sec + tv.tv_usec/1e6);
+}
@@ -56,6 +56,8 @@ static int addr;            /* if nflag address to connect */
 static int tflag;           /* initial connection to tty */
 static int lflag;           /* preload scripts on all nodes */
 static int rflag;           /* reboot all nodes on network */
+static int sflag;           /* show csimcd stats */
+static int secs;            /* if sflag seconds between updates */
 static int el;              /* set if using edit line */
 static char targs[32];          /* string to collect tflag args */
 
@@ -114,6 +116,13 @@ main (int ac, char *av[])
                 case 'r':
                     rflag++;
                     break;
+                case 's':
+                    if (ac < 2)
+                        usage();
+                    secs = atoi (*++av);
+                    --ac;
+                    sflag++;
+                    break;
                 case 't':
                     if (ac < 3)
                         usage();
@@ -136,6 +145,8 @@ main (int ac, char *av[])
 
     /* various setup */
     readCfg(cfg_fn);
+    if (sflag)
+        showStats (secs);
     signal (SIGPIPE, SIG_IGN);
     signal (SIGINT, onInt);
     signal (SIGCONT, onCont);
@@ -217,6 +228,7 @@ usage()
     fprintf(stderr, " -l      load all nodes as per config file\n");
     fprintf(stderr, " -n a    make initial connection to node <a>\n");
     fprintf(stderr, " -r      reboot all nodes on network\n");
+    fprintf(stderr, " -s n    show csimcd traffic every <n> secs until killed\n");
     fprintf(stderr, " -t n b  make initial connection to serial port on node <n> at baud rate <b>.\n");
     fprintf(stderr, " -v      verbose\n");
 
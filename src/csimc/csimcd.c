@@ -19,13 +19,18 @@
  * also serve as the token broker. The token is given in turn to each node
  * address (0..31) we have ever connected to. Then it is set to 32 which means
  * it is our turn to let our clients originate packets. We let each client
- * send up to one packet before we give up the token. Being token based,
- * all packets originating here are synchronous, so we can just wait around
- * for their ACK, making the code read more linearly. When a new connection
- * is made to us, we Ping the new target node to confirm it is alive hence we
- * only allow new connections while we have the token. Nodes can talk to us
- * (our clients) at any time though so we must always be listening to the LAN
- * tty connection.
+ * send up to TOKBUDGET packets before we give up the token, serving clients
+ * of the nodes named in PRIORITY first. Packets from different clients may be
+ * in flight at once, up to WINDOW of them; each is matched to its ACK by the
+ * node address and the 4-bit sequence so WINDOW may be at most 15. Each
+ * client has at most one packet in flight, since the nodes only remember the
+ * last sequence from each host for spotting dups. All are ACKed before the
+ * token moves on. Nodes without clients only get the token every IDLETOK
+ * trips around the ring, they have nothing to say but log messages. When a
+ * new connection is made to us, we Ping the new target node to confirm it is
+ * alive hence we only allow new connections while we have the token. Nodes
+ * can talk to us (our clients) at any time though so we must always be
+ * listening to the LAN tty connection.
  *
  */
 
@@ -37,6 +42,8 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <unistd.h>
+#include <poll.h>
+#include <time.h>
 #include <termios.h>
 #include <sys/ioctl.h>
 #include <sys/param.h>
@@ -47,14 +54,21 @@
 
 #include "telenv.h"
 #include "csiutil.h"
+#include "csistats.h"
 #include "configfile.h"
 #include "strops.h"
 
 #define SPEED       B38400      /* cflag for tty speed */
+#define BYTEUS      (10*1000000/38400)  /* us per byte at SPEED, 10 bits */
+#define LANBUF      1024        /* max bytes read from tty at once */
 #define MAXV        5       /* max verbose */
 #define SOPWAIT     50      /* socket open wait time, secs */
 
 #define TOKWT       5000        /* ms to wait for token back */
+#define MAXWIN      15      /* max packets in flight, unique 4-bit seqs */
+#define DEFWIN      1       /* default WINDOW */
+#define DEFBUDGET   4       /* default TOKBUDGET */
+#define DEFIDLETOK  10      /* default IDLETOK */
 
 typedef struct
 {
@@ -63,10 +77,20 @@ typedef struct
     int cfd;                /* client fd, if cfdset */
     int toaddr;             /* node address */
     OpenWhy why;            /* goal of connect */
+    int nsent;              /* packets sent while we hold the token */
 } CInfo;
 
+/* a packet sent and awaiting its ACK */
+typedef struct
+{
+    Byte pkt[PMXLEN];       /* the packet */
+    int tries;              /* times sent so far */
+    double sent;            /* when last sent, unix secs */
+} XSlot;
+
 static void usage ();
 static void initCfg(void);
+static void initStats(void);
 static int selectI(int n,fd_set *rp,fd_set *wp, fd_set *xp, struct timeval *tp);
 static size_t readI (int fd, void *buf, size_t n);
 static size_t writeI (int fd, const void *buf, size_t n);
@@ -76,6 +100,10 @@ static void mainLoop(void);
 static void reopenPty (int cfd);
 static void advanceToken (void);
 static void checkClients(void);
+static int prioCmp (const void *p1, const void *p2);
+static int nodePrio (int to);
+static int hasClients (int to);
+static int hostBusy (int ha);
 static void wait4TokenBack(void);
 static void newClient();
 static void newShell (CInfo *cip);
@@ -84,12 +112,21 @@ static void newBoot (CInfo *cip);
 static void newSerial (CInfo *cip, int baud);
 static int sendConfirmPing (CInfo *cip);
 static int readLANpacket(char *what, int nto, int from);
+static int frameLAN (int fr, int *needp);
+static int fillLAN (int ms, int need);
+static double now (void);
+static void countRpkt (void);
+static CsiHostStats *hostStats (int ha);
 static void rpktDispatch(void);
 
 static void initCInfo(void);
 static void sendAck (void);
 static int sendXpkt (void);
-static void buildCtrlPkt (int from, int to, PktType t);
+static void queueXpkt (void);
+static void awaitAck (void);
+static void flushWindow (void);
+static void restartNode (int to);
+static void buildCtrlPkt (Byte pkt[], int from, int to, PktType t);
 static void sendPkt(Byte pkt[], int retry);
 static void sendCurToken(void);
 static int chkSum (Byte p[], int n);
@@ -124,12 +161,27 @@ static int listenfd;        /* universal listening post */
 static int ttyfd;       /* tty fd once open */
 static Byte rpkt[PMXLEN];   /* packet being received from CSIMC network */
 static int rpktlen;     /* bytes in packet received so far */
+static double rpktwhen;     /* when rpkt arrived, unix secs */
+static Byte lanbuf[LANBUF]; /* bytes read from tty not yet framed */
+static int lanhead, lantail;    /* next byte to frame, end of lanbuf[] data */
+static double lanwhen;      /* when lanbuf[] was last read, unix secs */
 static Byte rseq[NADDR][NADDR]; /* seq of last rx packet acked, [fr][to] */
 static Byte xpkt[PMXLEN];   /* packet being transmitted to CSIMC network */
 static Byte xseq[NADDR];    /* sequence for next tx packet, per net addr. */
 static int verbose;     /* higher to log more details, up to MAXV */
 static char livenodes[NNODES];  /* set as discover each node */
 static int curtoken = BROKTOK;  /* current token */
+static int ringtrips;       /* times the token has been around the ring */
+static XSlot xwin[MAXWIN];  /* packets awaiting ACK, oldest first */
+static int nxwin;       /* entries in use in xwin[] */
+static int nrestarts[256];  /* times each address has been restarted */
+static int xwinmax = DEFWIN;    /* max packets in flight */
+static int tokbudget = DEFBUDGET;   /* max packets per client per token */
+static int idletok = DEFIDLETOK;    /* ring trips per token to idle nodes */
+static int nodeprio[NNODES];    /* service order, smaller first */
+static CsiStatShm statlocal;    /* counters if can not publish */
+static CsiStatShm *statp = &statlocal;  /* counters we publish */
+static double tokwhen;      /* when curtoken was sent, unix secs */
 
 /* connection info and handle conversions.
  * N.B. host address is index into cinfo[] biased by NNODES.
@@ -194,6 +246,7 @@ main (int ac, char *av[])
 
 	/* init defaults */
 	initCfg();
+	initStats();
 
 	/* open tty, announce socket, init any pty's */
 	openTTY();
@@ -236,12 +289,58 @@ usage ()
 static void
 initCfg(void)
 {
+	char prio[128], *pp, *tp;
+	int i, n;
+
 	read1CfgEntry (1, cfg, "TTY", CFG_STR, tty_def, sizeof(tty_def));
 	read1CfgEntry (1, cfg, "PORT", CFG_INT, &port, 0);
+
+	/* optional transport tuning */
+	(void) read1CfgEntry (0, cfg, "WINDOW", CFG_INT, &xwinmax, 0);
+	if (xwinmax < 1 || xwinmax > MAXWIN)
+	{
+		daemonLog ("%s: WINDOW must be 1..%d\n", cfg, MAXWIN);
+		xwinmax = xwinmax < 1 ? 1 : MAXWIN;
+	}
+	(void) read1CfgEntry (0, cfg, "TOKBUDGET", CFG_INT, &tokbudget, 0);
+	if (tokbudget < 1)
+		tokbudget = 1;
+	(void) read1CfgEntry (0, cfg, "IDLETOK", CFG_INT, &idletok, 0);
+	if (idletok < 1)
+		idletok = 1;
+
+	/* nodes named in PRIORITY are served first, in order given */
+	for (i = 0; i < NNODES; i++)
+		nodeprio[i] = NNODES;
+	if (!read1CfgEntry (0, cfg, "PRIORITY", CFG_STR, prio, sizeof(prio)))
+	{
+		for (i = 0, pp = prio; (tp = strtok (pp, " \t,")) != NULL; pp = NULL)
+		{
+			n = atoi (tp);
+			if (n < 0 || n > MAXNA)
+				daemonLog ("%s: PRIORITY node %d is not 0..%d\n", cfg, n,
+						   MAXNA);
+			else if (nodeprio[n] == NNODES)
+				nodeprio[n] = i++;
+		}
+	}
+
+	daemonLog ("WINDOW %d TOKBUDGET %d IDLETOK %d\n", xwinmax, tokbudget,
+			   idletok);
 }
 
 
 
+/* publish our counters, or at least keep them, if can not */
+static void
+initStats(void)
+{
+	if (csiStatOpen (port, 1, &statp) < 0)
+		daemonLog ("Can not publish stats: %s\n", strerror(errno));
+	statp->pid = getpid();
+	statp->start = time(NULL);
+}
+
 /* pty on cfd was closed by client.. reopen and reuse cfd.
  * exit (1) if trouble.
  */
@@ -384,8 +483,8 @@ openTTY()
     memset (&tio, 0, sizeof(tio));
     tio.c_cflag = CS8|CREAD|CLOCAL;
     tio.c_iflag = IGNPAR|IGNBRK;
-    tio.c_cc[VMIN] = 0;     /* start timer when call read() */
-    tio.c_cc[VTIME] = ACKWT/100;    /* wait up to n 1/10ths seconds */
+    tio.c_cc[VMIN] = 0;     /* read() just takes what is there .. */
+    tio.c_cc[VTIME] = 0;    /* .. fillLAN() waits with poll() */
     cfsetospeed (&tio, SPEED);
     cfsetispeed (&tio, SPEED);
     if (tcsetattr (ttyfd, TCSANOW, &tio) < 0)
@@ -429,9 +528,10 @@ announce()
  *     for each new client wanting to connect
  *        check that target has indeed been booted
  *        send PING; wait for ACK; repeat as required; handle
- *     for each existing client wanting to send
- *        read one packet's worth
- *        send packet; wait for ACK; repeat as required; handle
+ *     while existing clients want to send, up to TOKBUDGET each
+ *        read one packet's worth from each, PRIORITY nodes first
+ *        send packets, up to WINDOW awaiting ACK; repeat as required; handle
+ *     wait for all ACKs
  *   else
  *     send token to new owner
  *     do
@@ -441,6 +541,7 @@ announce()
 static void
 mainLoop()
 {
+    statp->update = now();
     advanceToken();
     if (isOurToken())
     {
@@ -457,6 +558,7 @@ mainLoop()
 
 /* set curtoken to next active address in ring,
  * or addr2tok(NNODES) if we're next.
+ * nodes without clients are only visited every idletok trips.
  */
 static void
 advanceToken (void)
@@ -466,8 +568,11 @@ advanceToken (void)
     do
     {
         a = (a + 1)%(NNODES+1);     /* yes .. NNODES means us */
+        if (a == NNODES)
+            statp->ringtrips = ++ringtrips;
     }
-    while (a != NNODES && !livenodes[a]);
+    while (a != NNODES && (!livenodes[a]
+                           || (!hasClients(a) && ringtrips%idletok)));
 
     curtoken = addr2tok(a);
 }
@@ -475,50 +580,127 @@ advanceToken (void)
 /* for each new client wanting to connect
  *   check that target has indeed been booted
  *   send PING; wait for ACK; repeat as required; handle
- * for each existing client wanting to send
- *   read one packet's worth
- *   send packet; wait for ACK; repeat as required; handle
+ * while existing clients want to send, up to tokbudget each
+ *   read one packet's worth from each, in order of nodeprio[]
+ *   send packets, up to xwinmax awaiting ACK; repeat as required; handle
+ * wait for all ACKs
  */
 static void
 checkClients(void)
 {
+    CInfo *ready[NHOSTS];
+    CInfo *cip;
     struct timeval tv;
     fd_set fs;
     int maxfs;
-    int fd;
-    int n;
+    int nready;
+    int i, n;
 
-    /* make copy so we can add listenfd */
-    fs = clset;
-    maxfs = maxclset;
-    FD_SET (listenfd, &fs);
-    if (listenfd > maxclset)
-        maxfs = listenfd;
+    for (cip = cinfo; cip < &cinfo[NHOSTS]; cip++)
+        cip->nsent = 0;
 
     /* poll .. must get back to passing token unless no clients now */
     tv.tv_sec = 0;
     tv.tv_usec = maxclset < 0 ? 10000 : 0;
 
-    /* the truth is out there */
-    n = selectI (maxfs+1, &fs, NULL, NULL, &tv);
-    if (n < 0)
+    while (1)
     {
-        daemonLog ("select(%d): %s\n", maxfs, strerror(errno));
-        return;
-    }
+        /* make copy so we can add listenfd */
+        fs = clset;
+        maxfs = maxclset;
+        FD_SET (listenfd, &fs);
+        if (listenfd > maxclset)
+            maxfs = listenfd;
+
+        /* the truth is out there */
+        n = selectI (maxfs+1, &fs, NULL, NULL, &tv);
+        if (n < 0)
+        {
+            daemonLog ("select(%d): %s\n", maxfs, strerror(errno));
+            break;
+        }
+        tv.tv_usec = 0;
 
-    /* handle the actions -- some may change clset */
-    for (fd = 0; n > 0 && fd <= maxfs; fd++)
-    {
-        if (FD_ISSET (fd, &fs))
+        /* new clients Ping synchronously, then look again */
+        if (FD_ISSET (listenfd, &fs))
+        {
+            flushWindow();
+            newClient();
+            continue;
+        }
+
+        /* collect clients with something to send and room to send it */
+        nready = 0;
+        for (cip = cinfo; cip < &cinfo[NHOSTS]; cip++)
+            if (cip->inuse && cip->cfdset && FD_ISSET (cip->cfd, &fs)
+                    && cip->nsent < tokbudget && !hostBusy(CIP2HA(cip)))
+                ready[nready++] = cip;
+        if (nready == 0)
         {
-            if (fd == listenfd)
-                newClient();
-            else if (FD_ISSET (fd, &clset))
-                clientMsg (fd);
-            --n;
+            if (nxwin == 0)
+                break;
+            awaitAck();     /* may free a client to send again */
+            continue;
+        }
+
+        /* send one from each, most important first.
+         * N.B. a restart while waiting for room may have closed some.
+         */
+        qsort (ready, nready, sizeof(ready[0]), prioCmp);
+        for (i = 0; i < nready; i++)
+        {
+            cip = ready[i];
+            if (cip->inuse && cip->cfdset)
+            {
+                cip->nsent++;
+                clientMsg (cip->cfd);
+            }
         }
     }
+
+    flushWindow();
+}
+
+/* qsort comparison of two CInfo* by service order */
+static int
+prioCmp (const void *p1, const void *p2)
+{
+    CInfo *c1 = *(CInfo **)p1;
+    CInfo *c2 = *(CInfo **)p2;
+    int d = nodePrio (c1->toaddr) - nodePrio (c2->toaddr);
+
+    return (d ? d : (int)(c1 - c2));
+}
+
+/* return service order of the given node address, smaller first */
+static int
+nodePrio (int to)
+{
+    return (to >= 0 && to < NNODES ? nodeprio[to] : NNODES);
+}
+
+/* return 1 if any client is connected to node to, else 0 */
+static int
+hasClients (int to)
+{
+    CInfo *cip;
+
+    for (cip = cinfo; cip < &cinfo[NHOSTS]; cip++)
+        if (cip->inuse && cip->toaddr == to)
+            return (1);
+    return (0);
+}
+
+/* return 1 if host address ha has a packet awaiting ACK, else 0 */
+static int
+hostBusy (int ha)
+{
+    int i;
+
+    for (i = 0; i < nxwin; i++)
+        if (xwin[i].pkt[PB_FR] == ha)
+            return (1);
+    return (0);
 }
 
 /* do
@@ -528,8 +710,16 @@ checkClients(void)
 static void
 wait4TokenBack(void)
 {
-    while (!readLANpacket("BROKTOK back", TOKWT/ACKWT, tok2addr(curtoken)))
+    int to = tok2addr(curtoken);
+    int n;
+
+    while (!(n = readLANpacket("BROKTOK back", TOKWT/ACKWT, to)))
         rpktDispatch();
+
+    if (n > 0)
+        csiHistAdd (&statp->node[to].tokus, 1e6*(rpktwhen - tokwhen));
+    else
+        statp->node[to].toklost++;
 }
 
 /* a new client just arrived on listenfd.
@@ -542,6 +732,7 @@ static void
 newClient()
 {
     Byte preamble[3];
+    CsiHostStats *hsp;
     CInfo *cip;
     OpenWhy why;
     int newcfd;
@@ -605,6 +796,11 @@ newClient()
     cip->cfd = newcfd;
     cip->toaddr = to;
     cip->why = why;
+    hsp = hostStats (CIP2HA(cip));
+    memset (hsp, 0, sizeof(*hsp));
+    hsp->inuse = 1;
+    hsp->toaddr = to;
+    hsp->why = why;
 
     switch (why)
     {
@@ -657,7 +853,7 @@ newReboot(CInfo *cip)
     if (verbose)
         daemonLog ("New ReBoot client request: fd %d host %d\n", fd, ha);
 
-    buildCtrlPkt (ha, BRDCA, PT_REBOOT);
+    buildCtrlPkt (xpkt, ha, BRDCA, PT_REBOOT);
 
     hachar = ha;
     if (writeI (fd, &hachar, 1) < 0)
@@ -761,7 +957,7 @@ sendConfirmPing (CInfo *cip)
     char hachar;
 
     rseq[to][ha] = -1;
-    buildCtrlPkt (ha, to, PT_PING);
+    buildCtrlPkt (xpkt, ha, to, PT_PING);
     if (sendXpkt() < 0)
         return(-1);             /* already closed + logged */
 
@@ -793,165 +989,258 @@ isTokPkt (Byte buf[2])
     return (buf[0] == PSYNC && (buf[1] == BROKTOK || ISNTOK(buf[1])));
 }
 
-/* read the next char from the lan.
- * return 0 if ok else -1 if time out after nto tries
+/* read from ttyfd into rpkt until we have a packet or see BROKTOK or timeout.
+ * nto is number of ACKWT periods of silence before considering it a timeout.
+ * "what" is a string of what we are hoping to read for printing and fr is
+ *    the node address from which we anticipate a packet, for verbose.
+ * rpktwhen is set to the time rpkt or BROKTOK arrived.
+ * return 0 if read normal packet, 1 if BROKTOK, else -1 if time out.
  */
 static int
-readLANchar (int nto, Byte *bp)
+readLANpacket(char *what, int nto, int fr)
 {
-    static Byte inbuf[100];
-    static int lastsent, ninbuf;
+    int need;
 
-    /* pull from inbuf first */
-    if (lastsent < ninbuf)
-    {
-        *bp = inbuf[lastsent++];
-        return (0);
-    }
+    /* new packet */
+    rpktlen = 0;
 
-    /* then try to read more, up to nto times */
-    while (nto-- > 0)
+    /* frame what we have, reading more as needed */
+    while (1)
     {
-        int n = readI (ttyfd, inbuf, sizeof(inbuf));
-        if (n < 0)
+        switch (frameLAN (fr, &need))
         {
-            daemonLog ("Read(%s): %s\n", tty, strerror(errno));
-            exit (1);
+            case 0:
+                rpktwhen = lanwhen;
+                countRpkt();
+                return (0);
+            case 1:
+                rpktwhen = lanwhen;
+                return (1);
         }
-        if (n > 0)
+
+        if (fillLAN (nto*ACKWT, need) < 0)
         {
-            /* suppres token traffic at level 2 */
-            if (verbose > 3 || (verbose > 2 && !isTokPkt(inbuf)))
-            {
-                daemonLog ("Read %d from %s.. rpktlen now %d\n",
-                           n, tty, rpktlen);
-                dump (inbuf, n);
-            }
-            ninbuf = n;
-            lastsent = 0;
-            return (readLANchar(nto, bp));
+            daemonLog ("Time out waiting for %s from %d\n", what, fr);
+            return (-1);
         }
     }
-
-    /* nothing */
-    return (-1);
 }
 
-/* read from ttyfd into rpkt until we have a packet or see BROKTOK or timeout.
- * nto is number of ACKWT periods to wait before considering it a timeout.
- * "what" is a string of what we are hoping to read for printing and fr is
- *    the node address from which we anticipate a packet, for verbose.
- * return 0 if read normal packet, else -1 if anything else.
+/* continue framing rpkt from lanbuf[].
+ * N.B. PSYNC never appears within a packet, any PESC escapes in data are
+ *   between client and node, so a PSYNC always starts over.
+ * return 0 when rpkt is a complete good packet, 1 if see BROKTOK, else -1
+ *   when lanbuf[] is used up with *needp set to bytes still due in rpkt.
  */
 static int
-readLANpacket(char *what, int nto, int fr)
+frameLAN (int fr, int *needp)
 {
     Byte d;
     int n;
 
-    /* new packet */
-    rpktlen = 0;
-
-    /* repeat until know what is going on */
-    while (1)
+    while (lanhead < lantail)
     {
-        if (readLANchar (nto, &d) < 0)
-        {
-            daemonLog ("Time out waiting for %s from %d\n", what, fr);
-            return (-1);
-        }
+        d = lanbuf[lanhead++];
 
         if (d == PSYNC)
         {
             /* saw SYNC -- always start over */
             rpkt[PB_SYNC] = PSYNC;
             rpktlen = 1;
+            continue;
         }
-        else
+
+        /* handle bytes subsequent to known-good SYNC */
+        switch (rpktlen)
         {
-            /* handle bytes subsequent to known-good SYNC */
-            switch (rpktlen)
-            {
-                case 0:             /* just garbage */
-                    break;
-                case 1:             /* To or token */
-                    if (d == BROKTOK)
-                    {
-                        if (verbose > 3)
-                            daemonLog ("Received BROKTOK back from %d\n", fr);
-                        return (-1);
-                    }
-                    if (ISNTOK(d))
-                    {
-                        rpktlen = 0;        /* start over */
-                    }
-                    else
-                    {
-                        rpkt[PB_TO] = d;    /* continue with normal pkt */
-                        rpktlen = 2;
-                    }
-                    break;
-                case 2:             /* From */
-                    rpkt[PB_FR] = d;
-                    rpktlen = 3;
-                    break;
-                case 3:             /* Info */
-                    rpkt[PB_INFO] = d;
-                    rpktlen = 4;
-                    break;
-                case 4:             /* Data Count */
-                    if (d > PMXDAT)
-                    {
-                        daemonLog ("Preposterous data count: %d\n", d);
-                        dump (rpkt, 5);
-                        rpktlen = 0;        /* must be illegal */
-                    }
-                    else
-                    {
-                        rpkt[PB_COUNT] = d;
-                        rpktlen = 5;
-                    }
-                    break;
-                case 5:             /* Header Checksum */
-                    rpkt[PB_HCHK] = d;      /* proposed header checksum */
-                    rpktlen = 6;
-                    n = chkSum (rpkt, PB_NHCHK);
-                    if (n == d)         /* if good checksum */
-                    {
-                        if (rpkt[PB_COUNT] == 0)/*   if control packet */
-                            return (0);     /*     good to go */
-                    }
+            case 0:             /* just garbage */
+                break;
+            case 1:             /* To or token */
+                if (d == BROKTOK)
+                {
+                    if (verbose > 3)
+                        daemonLog ("Received BROKTOK back from %d\n", fr);
+                    return (1);
+                }
+                if (ISNTOK(d))
+                {
+                    rpktlen = 0;        /* start over */
+                }
+                else
+                {
+                    rpkt[PB_TO] = d;    /* continue with normal pkt */
+                    rpktlen = 2;
+                }
+                break;
+            case 2:             /* From */
+                rpkt[PB_FR] = d;
+                rpktlen = 3;
+                break;
+            case 3:             /* Info */
+                rpkt[PB_INFO] = d;
+                rpktlen = 4;
+                break;
+            case 4:             /* Data Count */
+                if (d > PMXDAT)
+                {
+                    daemonLog ("Preposterous data count: %d\n", d);
+                    dump (rpkt, 5);
+                    rpktlen = 0;        /* must be illegal */
+                }
+                else
+                {
+                    rpkt[PB_COUNT] = d;
+                    rpktlen = 5;
+                }
+                break;
+            case 5:             /* Header Checksum */
+                rpkt[PB_HCHK] = d;      /* proposed header checksum */
+                rpktlen = 6;
+                n = chkSum (rpkt, PB_NHCHK);
+                if (n == d)         /* if good checksum */
+                {
+                    if (rpkt[PB_COUNT] == 0)/*   if control packet */
+                        return (0);     /*     good to go */
+                }
+                else
+                {
+                    daemonLog ("Bad header chksum: 0x%02x vs 0x%02x\n", n,
+                               rpkt[PB_HCHK]);
+                    statp->badhdr++;
+                    dump (rpkt, rpktlen);
+                    rpktlen = 0;        /* start over */
+                }
+                break;
+            case 6:             /* Data Checksum */
+                rpkt[PB_DCHK] = d;      /* claimed data checksum */
+                rpktlen = 7;        /* now collect data */
+                break;
+            default:            /* gathering data */
+                rpkt[rpktlen++] = d;    /* another byte of data */
+                if (rpktlen >= rpkt[PB_COUNT]+PB_DATA)   /* if have all */
+                {
+                    n = chkSum (&rpkt[PB_DATA], rpkt[PB_COUNT]);
+                    if (n == rpkt[PB_DCHK]) /* if good data */
+                        return(0);      /*   good to go */
                     else
                     {
-                        daemonLog ("Bad header chksum: 0x%02x vs 0x%02x\n", n,
-                                   rpkt[PB_HCHK]);
+                        daemonLog ("Bad data chksum from %d: 0x%02x vs 0x%02x\n",
+                                   rpkt[PB_FR], n, rpkt[PB_DCHK]);
+                        if (rpkt[PB_FR] <= MAXNA)
+                            statp->node[rpkt[PB_FR]].badchk++;
                         dump (rpkt, rpktlen);
                         rpktlen = 0;        /* start over */
                     }
-                    break;
-                case 6:             /* Data Checksum */
-                    rpkt[PB_DCHK] = d;      /* claimed data checksum */
-                    rpktlen = 7;        /* now collect data */
-                    break;
-                default:            /* gathering data */
-                    rpkt[rpktlen++] = d;    /* another byte of data */
-                    if (rpktlen >= rpkt[PB_COUNT]+PB_DATA)   /* if have all */
-                    {
-                        n = chkSum (&rpkt[PB_DATA], rpkt[PB_COUNT]);
-                        if (n == rpkt[PB_DCHK]) /* if good data */
-                            return(0);      /*   good to go */
-                        else
-                        {
-                            daemonLog ("Bad data chksum from %d: 0x%02x vs 0x%02x\n",
-                                       rpkt[PB_FR], n, rpkt[PB_DCHK]);
-                            dump (rpkt, rpktlen);
-                            rpktlen = 0;        /* start over */
-                        }
-                    }
-                    break;
-            }
+                }
+                break;
         }
     }
+
+    /* bytes due to finish rpkt, or a token if not started or just SYNC */
+    if (rpktlen < 2)
+        *needp = 2 - rpktlen;
+    else if (rpktlen < PB_HSZ)
+        *needp = PB_HSZ - rpktlen;
+    else
+        *needp = pktSize(rpkt) - rpktlen;
+    return (-1);
+}
+
+/* refill lanbuf[] with all that ttyfd has, waiting up to ms for it to start.
+ * need is the bytes due to finish the frame underway; if fewer have come we
+ *   let the rest arrive at SPEED and read them all at once rather than wake
+ *   for each one.
+ * return 0 if read some, -1 if time out. exit if trouble.
+ */
+static int
+fillLAN (int ms, int need)
+{
+    struct pollfd pfd;
+    struct timespec ts;
+    int n, m;
+
+    pfd.fd = ttyfd;
+    pfd.events = POLLIN;
+
+    do
+    {
+        while ((n = poll (&pfd, 1, ms)) < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            daemonLog ("poll(%s): %s\n", tty, strerror(errno));
+            exit (1);
+        }
+        if (n == 0)
+            return (-1);
+
+        n = readI (ttyfd, lanbuf, LANBUF);
+        if (n < 0)
+        {
+            daemonLog ("Read(%s): %s\n", tty, strerror(errno));
+            exit (1);
+        }
+    }
+    while (n == 0);
+
+    /* wait for the rest of the frame while it keeps coming */
+    for (m = n; n < need && m > 0; n += m)
+    {
+        ts.tv_sec = 0;
+        ts.tv_nsec = (need-n)*BYTEUS*1000L;
+        (void) nanosleep (&ts, NULL);
+        if ((m = readI (ttyfd, lanbuf+n, LANBUF-n)) < 0)
+            m = 0;
+    }
+
+    lanwhen = now();
+    lanhead = 0;
+    lantail = n;
+
+    /* suppres token traffic at level 2 */
+    if (verbose > 3 || (verbose > 2 && !isTokPkt(lanbuf)))
+    {
+        daemonLog ("Read %d from %s.. rpktlen now %d\n", n, tty, rpktlen);
+        dump (lanbuf, n);
+    }
+
+    return (0);
+}
+
+/* return current unix time, secs */
+static double
+now (void)
+{
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+    return (tv.tv_sec + tv.tv_usec/1e6);
+}
+
+/* count rpkt, just received, for its node and host */
+static void
+countRpkt (void)
+{
+    CsiHostStats *hsp;
+    int fr = rpkt[PB_FR];
+
+    if (fr <= MAXNA)
+    {
+        statp->node[fr].rpkts++;
+        statp->node[fr].rbytes += rpkt[PB_COUNT];
+    }
+    if ((hsp = hostStats (rpkt[PB_TO])) != NULL)
+    {
+        hsp->rpkts++;
+        hsp->rbytes += rpkt[PB_COUNT];
+    }
+}
+
+/* return the CsiHostStats of host address ha, or NULL if it is not one */
+static CsiHostStats *
+hostStats (int ha)
+{
+    return (ha >= NNODES && ha < NADDR ? &statp->host[ha-NNODES] : NULL);
 }
 
 /* rpkt from tty checksums ok .. dispatch to client.
@@ -1068,7 +1357,7 @@ rpktDispatch()
 }
 
 /* client, connected on cfd, wants to send something.
- * build xpkt from cfd and send it, wait for ACK.
+ * build xpkt from cfd and send it; its ACK is collected by checkClients().
  */
 static void
 clientMsg(int cfd)
@@ -1093,7 +1382,7 @@ clientMsg(int cfd)
             return;
     }
 
-    (void) sendXpkt();      /* closes if trouble and logs */
+    queueXpkt();
 }
 
 /* read client cfd with shell chat and create xpkt.
@@ -1313,120 +1602,241 @@ sendAck ()
     sendPkt (apkt, 0);
 }
 
-/* fill xpkt with one of the basic control packets that have no data */
+/* fill pkt with one of the basic control packets that have no data */
 static void
-buildCtrlPkt (int from, int to, PktType t)
+buildCtrlPkt (Byte pkt[], int from, int to, PktType t)
 {
-    xpkt[PB_SYNC] = PSYNC;
-    xpkt[PB_TO] = to;
-    xpkt[PB_FR] = from;
-    xpkt[PB_INFO] = t | (to == BRDCA ? 0 : XSEQ(to));
-    xpkt[PB_COUNT] = 0;
-    xpkt[PB_HCHK] = chkSum (xpkt, PB_NHCHK);
+    pkt[PB_SYNC] = PSYNC;
+    pkt[PB_TO] = to;
+    pkt[PB_FR] = from;
+    pkt[PB_INFO] = t | (to == BRDCA ? 0 : XSEQ(to));
+    pkt[PB_COUNT] = 0;
+    pkt[PB_HCHK] = chkSum (pkt, PB_NHCHK);
 }
 
-/* return 0 if rpkt is an ACK for xpkt, else -1 */
+/* return index of the xwin[] packet rpkt ACKs, else -1.
+ * a few ACKs inform their clients.
+ */
 static int
-ack4xpkt (void)
+ack4xwin (void)
 {
     int netaddr = rpkt[PB_FR];
     int haddr = rpkt[PB_TO];
     int seq = rpkt[PB_INFO] & PSQ_MASK;
     int t = rpkt[PB_INFO] & PT_MASK;
+    CsiHostStats *hsp;
+    CInfo *cip;
+    Byte *xp;
+    double us;
+    int i, ha;
 
     if (t != PT_ACK)
     {
         daemonLog ("Unexpected %s from %d to %d\n", p2tstr((Pkt *)rpkt),
                    netaddr, haddr);
+        return (-1);
     }
-    else if (netaddr == xpkt[PB_TO] && seq == (xpkt[PB_INFO]&PSQ_MASK))
-    {
-        /* yes, rpkt is ACK for xpkt.
-         * a few ACKs inform their clients.
-         */
 
+    /* sequences to any one node are unique within the window */
+    for (i = 0; i < nxwin; i++)
+        if (netaddr == xwin[i].pkt[PB_TO]
+                && seq == (xwin[i].pkt[PB_INFO]&PSQ_MASK))
+            break;
+    if (i == nxwin)
+    {
         if (verbose)
-            daemonLog ("Saw ACK packet: from %d to %d seq 0x%x\n",
+            daemonLog ("Stray ACK packet: from %d to %d seq 0x%x\n",
                        netaddr, haddr, seq >> PSQ_SHIFT);
+        return (-1);
+    }
 
-        /* if ack for BOOTREC from boot client, inform size as progress.
-         * N.B. first ack of FOR_BOOT is just the Ping confirm.
-         */
-        if (HA2CIP(haddr)->why == FOR_BOOT
-                && (xpkt[PB_INFO]&PT_MASK) == PT_BOOTREC)
+    us = 1e6*(rpktwhen - xwin[i].sent);
+    if (verbose)
+        daemonLog ("Saw ACK packet: from %d to %d seq 0x%x after %.1f ms\n",
+                   netaddr, haddr, seq >> PSQ_SHIFT, us/1e3);
+
+    /* client may be gone, eg after its KILL */
+    xp = xwin[i].pkt;
+    ha = xp[PB_FR];
+    if (netaddr <= MAXNA)
+        csiHistAdd (&statp->node[netaddr].ackus, us);
+    if ((hsp = hostStats (ha)) != NULL)
+        csiHistAdd (&hsp->ackus, us);
+    if (ha <= MAXNA || ha >= NADDR || !(cip = HA2CIP(ha))->inuse)
+        return (i);
+
+    /* if ack for BOOTREC from boot client, inform size as progress.
+     * N.B. first ack of FOR_BOOT is just the Ping confirm.
+     */
+    if (cip->why == FOR_BOOT && (xp[PB_INFO]&PT_MASK) == PT_BOOTREC)
+    {
+        int cfd = cip->cfd;
+        if (verbose)
+            daemonLog ("Telling host %d that its %d BOOTREC bytes were ACKed\n",
+                       haddr, xp[PB_COUNT]);
+        if (writeI (cfd, &xp[PB_COUNT], 1) < 0)
         {
-            int cfd = HA2CFD (haddr);
-            if (verbose)
-                daemonLog ("Telling host %d that its %d BOOTREC bytes were ACKed\n",
-                           haddr, xpkt[PB_COUNT]);
-            if (writeI (cfd, &xpkt[PB_COUNT], 1) < 0)
-            {
-                daemonLog("Boot client %d for %d disappeared! %s\n",
-                          haddr, netaddr, strerror(errno));
-                closecfd (cfd);
-            }
+            daemonLog("Boot client %d for %d disappeared! %s\n",
+                      haddr, netaddr, strerror(errno));
+            closecfd (cfd);
         }
+    }
 
-        /* if ack for INTR from SHELL client, send byte to sync. */
-        if (HA2CIP(haddr)->why == FOR_SHELL
-                && (xpkt[PB_INFO]&PT_MASK) == PT_INTR)
+    /* if ack for INTR from SHELL client, send byte to sync. */
+    if (cip->why == FOR_SHELL && (xp[PB_INFO]&PT_MASK) == PT_INTR)
+    {
+        int cfd = cip->cfd;
+        char zero = 0;
+        if (verbose)
+            daemonLog ("Telling host %d that its PT_INTR was ACKed\n",
+                       haddr);
+        if (writeI (cfd, &zero, 1) < 0)
         {
-            int cfd = HA2CFD (haddr);
-            char zero = 0;
-            if (verbose)
-                daemonLog ("Telling host %d that its PT_INTR was ACKed\n",
-                           haddr);
-            if (writeI (cfd, &zero, 1) < 0)
-            {
-                daemonLog("Shell client %d for %d disappeared! %s\n",
-                          haddr, netaddr, strerror(errno));
-                closecfd (cfd);
-            }
+            daemonLog("Shell client %d for %d disappeared! %s\n",
+                      haddr, netaddr, strerror(errno));
+            closecfd (cfd);
         }
-
-        /* rpkt is indeed an ack for xpkt */
-        return (0);
     }
 
-    /* rpkt is not an ack for xpkt */
-    return (-1);
+    return (i);
+}
+
+/* remove xwin[i] */
+static void
+dropXwin (int i)
+{
+    memmove (&xwin[i], &xwin[i+1], (--nxwin - i)*sizeof(XSlot));
 }
 
-/* wait for packet from LAN.
- * return 0 if ack for xpkt, else -1.
+/* wait for the next packet from LAN and retire the xwin[] entry it ACKs.
+ * if none arrives in ACKWT resend all of xwin[], restarting any node that
+ * has used up its retries.
  */
+static void
+awaitAck (void)
+{
+    XSlot *sp;
+    int i, j, n, to;
+
+    if (!readLANpacket("ACK", 1, xwin[0].pkt[PB_TO]))
+    {
+        if ((i = ack4xwin()) >= 0)
+            dropXwin (i);
+        return;
+    }
+
+    for (i = 0; i < nxwin; )
+    {
+        sp = &xwin[i];
+        if (sp->tries > MAXRTY)
+        {
+            /* carry on with the next not yet resent, allowing for those
+             * of the same node before it which go too.
+             */
+            to = sp->pkt[PB_TO];
+            for (j = n = 0; j < i; j++)
+                if (xwin[j].pkt[PB_TO] == to)
+                    n++;
+            restartNode (to);               /* drops from xwin[] */
+            i -= n;
+        }
+        else
+        {
+            sendPkt (sp->pkt, sp->tries++);
+            sp->sent = now();
+            i++;
+        }
+    }
+}
+
+/* wait until all of xwin[] is ACKed or given up */
+static void
+flushWindow (void)
+{
+    while (nxwin > 0)
+        awaitAck();
+}
+
+/* return 1 if pkt's node and sequence are already in flight, else 0 */
 static int
-wait4ACK(void)
+seqBusy (Byte pkt[])
 {
-    return (!readLANpacket("ACK", 1, xpkt[PB_TO]) && !ack4xpkt() ? 0 : -1);
+    int i;
+
+    for (i = 0; i < nxwin; i++)
+        if (xwin[i].pkt[PB_TO] == pkt[PB_TO]
+                && !((xwin[i].pkt[PB_INFO] ^ pkt[PB_INFO]) & PSQ_MASK))
+            return (1);
+    return (0);
+}
+
+/* send xpkt, first waiting for room in xwin[] and for any packet in flight
+ * with the same node and sequence, which would make its ACK ambiguous.
+ */
+static void
+queueXpkt (void)
+{
+    int to = xpkt[PB_TO];
+    int nr = nrestarts[to];
+    XSlot *sp;
+
+    if (nxwin >= xwinmax || seqBusy (xpkt))
+    {
+        /* waiting may reuse xpkt */
+        Byte pkt[PMXLEN];
+
+        memcpy (pkt, xpkt, pktSize(xpkt));
+        while (nxwin >= xwinmax || seqBusy (pkt))
+            awaitAck();
+        if (nrestarts[to] != nr)
+            return;             /* node is gone */
+        memcpy (xpkt, pkt, pktSize(pkt));
+    }
+
+    sp = &xwin[nxwin++];
+    memcpy (sp->pkt, xpkt, pktSize(xpkt));
+    sp->tries = 0;
+    sendPkt (sp->pkt, sp->tries++);
+    sp->sent = now();
 }
 
-/* send xpkt and wait for ACK, retrying as necessary.
- * if time out, break all its client connections and no longer live.
+/* send xpkt and wait for its ACK, and all others in flight, retrying as
+ * necessary. if time out its node is restarted.
  * return 0 if ok else -1.
  */
 static int
 sendXpkt (void)
 {
     int to = xpkt[PB_TO];
-    int i;
+    int nr = nrestarts[to];
 
-    /* send and retry as necessary */
-    for (i = 0; i <= MAXRTY; i++)
-    {
-        sendPkt (xpkt, i);
-        if (wait4ACK() == 0)
-            return (0);
-    }
+    queueXpkt();
+    flushWindow();
+    return (nrestarts[to] == nr ? 0 : -1);
+}
+
+/* node to has stopped ACKing: break all its client connections, forget all
+ * packets in flight to it, no longer live and tell it to reboot.
+ */
+static void
+restartNode (int to)
+{
+    Byte rbpkt[PB_HSZ];
+    int i;
 
-    /* sorry */
     daemonLog ("Restarting node %d after %d tries.\n", to, MAXRTY+1);
     breakConnections (to);
     livenodes[to] = 0;
-    buildCtrlPkt (MAXNA+1, to, PT_REBOOT);
-    sendPkt (xpkt, 0);
-    sendPkt (xpkt, 0);  /* no ACK so repeat for good measure */
-    return (-1);
+    nrestarts[to]++;
+    statp->node[to].restarts++;
+    for (i = 0; i < nxwin; )
+        if (xwin[i].pkt[PB_TO] == to)
+            dropXwin (i);
+        else
+            i++;
+    buildCtrlPkt (rbpkt, MAXNA+1, to, PT_REBOOT);
+    sendPkt (rbpkt, 0);
+    sendPkt (rbpkt, 0); /* no ACK so repeat for good measure */
 }
 
 /* return total Bytes in the given packet */
@@ -1469,6 +1879,8 @@ void
 sendPkt (Byte pkt[], int try)
 {
     int npkt = pktSize(pkt);
+    CsiHostStats *hsp;
+    CsiNodeStats *nsp;
 
     if (verbose)
     {
@@ -1481,6 +1893,22 @@ sendPkt (Byte pkt[], int try)
     }
 
     sendTTY (pkt, npkt);
+
+    if (pkt[PB_TO] <= MAXNA)
+    {
+        nsp = &statp->node[pkt[PB_TO]];
+        nsp->xpkts++;
+        nsp->xbytes += pkt[PB_COUNT];
+        if (try > 0)
+            nsp->retries++;
+    }
+    if ((hsp = hostStats (pkt[PB_FR])) != NULL)
+    {
+        hsp->xpkts++;
+        hsp->xbytes += pkt[PB_COUNT];
+        if (try > 0)
+            hsp->retries++;
+    }
 }
 
 /* send curtoken onto the LAN.
@@ -1498,6 +1926,8 @@ sendCurToken()
         daemonLog ("Sending token to node %d\n", tok2addr(curtoken));
 
     sendTTY (tpkt, 2);
+    tokwhen = now();
+    statp->node[tok2addr(curtoken)].tokens++;
 }
 
 /* close the client file descriptor cfd and associated bookkeeping */
@@ -1520,6 +1950,7 @@ closecfd (int cfd)
     /* close real fd */
     (void) close (cfd);
     cip->inuse = 0;
+    hostStats (CIP2HA(cip))->inuse = 0;
 
     /* remove from clset, if claims to be in */
     if (cip->cfdset)
@@ -1681,12 +2112,13 @@ onExit(void)
 static void
 onBye (int signo)
 {
+    statp->pid = 0;
     if (signo < 0)
         daemonLog ("Exit: first rebooting all nodes\n");
     else
         daemonLog ("Signal %d: first rebooting all nodes", signo);
 
-    buildCtrlPkt (MAXNA+1, BRDCA, PT_REBOOT);
+    buildCtrlPkt (xpkt, MAXNA+1, BRDCA, PT_REBOOT);
     sendPkt (xpkt, 0);  /* get no ACKs from BRDCA */
     sendPkt (xpkt, 0);  /* repeat for good measure */
 
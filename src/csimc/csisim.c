@@ -0,0 +1,1026 @@
+/* simulate a network of CSIMC nodes on a pty, to exercise csimcd and its
+ * clients without hardware.
+ *
+ * Point csimcd's TTY at the pty slave, or at the symlink made with -t, and
+ * it drives us just as it would the real network. Each node we simulate
+ * ACKs the packets sent to it, sends any shell output when it gets the token
+ * and then passes the token back to the broker. Each client connection has
+ * its own shell, which runs a little of the CSIMC language: assignments and
+ * queries of epos, mpos, mtvel, mvel, clock, toffset, timeout, etpos and
+ * mtpos, and etrack()/mtrack() profiles, all with integer arithmetic. Other
+ * names are kept as plain variables; other statements are ignored.
+ *
+ * Bytes take their time on the line at the given baud rate, half duplex,
+ * and packets may be lost or corrupted at random to exercise the retries.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/time.h>
+
+#include "csiutil.h"
+
+#define MAXSIM      8       /* max simulated nodes */
+#define NOUTQ       64      /* max shell packets queued by each node */
+#define SHLEN       4096    /* max chars in one shell statement */
+#define NVARS       32      /* max plain variables per node */
+#define MAXTRK      512     /* max points in a tracking profile */
+#define ACKTO       100     /* ms to wait for an ACK while holding token */
+#define PERTOK      4       /* max packets sent per token */
+#define MAXVEL      50000   /* steps/sec when moving to etpos or mtpos */
+
+/* how the motor is moving */
+typedef enum
+{
+    MD_VEL, MD_TARGET, MD_TRACK
+} MotMode;
+
+/* a plain variable */
+typedef struct
+{
+    char name[16];
+    long v;
+} Var;
+
+/* one client's shell on a node */
+typedef struct
+{
+    char buf[SHLEN];        /* statement so far */
+    int len;                /* chars in buf[] */
+    int depth;              /* {} nesting */
+    int inq;                /* set while within "" */
+    Byte rseq;              /* last sequence from this host, to spot dups */
+    Byte xseq;              /* sequence of next packet to this host */
+} Shell;
+
+/* one simulated node */
+typedef struct
+{
+    int addr;               /* node address */
+    Shell sh[NHOSTS];       /* shell for each host address */
+    Byte outq[NOUTQ][PMXLEN];   /* shell output awaiting ACK, oldest first */
+    int nout;               /* packets in outq[] */
+    int hsent;              /* set once outq[0] has been sent */
+
+    MotMode mode;           /* how the motor is moving */
+    double pos;             /* position, steps */
+    double vel;             /* velocity, steps/sec */
+    double t;               /* when pos was last updated, unix secs */
+    double clock0;          /* when clock was 0, unix secs */
+    double target;          /* etpos or mtpos, steps */
+    long mtvel;             /* commanded velocity, steps/sec */
+    long toffset;           /* added to tracking profile, steps */
+    long timeout;           /* as set, not used */
+    long trk[MAXTRK];       /* tracking profile, steps */
+    int ntrk;               /* points in trk[] */
+    long trk0, trkdt;       /* clock at trk[0] and between points, ms */
+
+    Var var[NVARS];         /* plain variables */
+    int nvar;               /* vars in use */
+} Node;
+
+static void usage (void);
+static void openPty (char *link);
+static void service (void);
+static void rxByte (Byte d);
+static void rxToken (Byte t);
+static void rxPacket (void);
+static void sendNext (void);
+static void sendAck (Node *np, int ha, Byte seq);
+static void xmit (Byte p[], int n);
+static void reply (Node *np, int ha, char *s, int n);
+static void shellIn (Node *np, int ha, Byte *p, int n);
+static void doStmt (Node *np, int ha, char *s);
+static void doCall (Node *np, char *name, char *args);
+static long expr (Node *np, char **spp);
+static long term (Node *np, char **spp);
+static long factor (Node *np, char **spp);
+static int ident (char **spp, char name[], int len);
+static long getVar (Node *np, char *name);
+static void setVar (Node *np, char *name, long v);
+static void motion (Node *np);
+static double trackPos (Node *np, double ms);
+static void resetNode (Node *np);
+static Node *findNode (int addr);
+static int chkSum (Byte p[], int n);
+static int pktSize (Byte pkt[]);
+static void sleepUntil (double t);
+static double now (void);
+
+static Node node[MAXSIM];   /* the simulated nodes */
+static int nnode;           /* entries in node[] */
+static int mfd;             /* pty master */
+static double bytet;        /* secs per byte on the line, 0 for no delay */
+static double errp;         /* chance a packet is lost or corrupted */
+static int verbose;         /* more chatter */
+static double linefree;     /* when the line is next idle, unix secs */
+static Byte rpkt[PMXLEN];   /* packet being received */
+static int rpktlen;         /* bytes in rpkt so far, 0 when hunting SYNC */
+static Node *holder;        /* node holding the token, else NULL */
+static int nsent;           /* packets holder has sent with this token */
+static double ackdue;       /* when holder gives up waiting for an ACK */
+
+int
+main (int ac, char *av[])
+{
+    char addrs[128] = "0,1,2";
+    char *link = NULL;
+    long seed = 1;
+    int baud = 38400;
+    char *tp;
+
+    while ((--ac > 0) && ((*++av)[0] == '-'))
+    {
+        char *s;
+        for (s = av[0]+1; *s != '\0'; s++)
+            switch (*s)
+            {
+                case 'a':
+                    if (ac < 2)
+                        usage();
+                    strncpy (addrs, *++av, sizeof(addrs)-1);
+                    --ac;
+                    break;
+                case 'b':
+                    if (ac < 2)
+                        usage();
+                    baud = atoi (*++av);
+                    --ac;
+                    break;
+                case 'e':
+                    if (ac < 2)
+                        usage();
+                    errp = atof (*++av);
+                    --ac;
+                    break;
+                case 's':
+                    if (ac < 2)
+                        usage();
+                    seed = atol (*++av);
+                    --ac;
+                    break;
+                case 't':
+                    if (ac < 2)
+                        usage();
+                    link = *++av;
+                    --ac;
+                    break;
+                case 'v':
+                    verbose++;
+                    break;
+                default:
+                    usage();
+            }
+    }
+    if (ac > 0 || baud < 0 || errp < 0 || errp >= 1)
+        usage();
+
+    /* nodes to simulate */
+    for (tp = strtok (addrs, " ,"); tp; tp = strtok (NULL, " ,"))
+    {
+        int a = atoi (tp);
+        if (a < 0 || a > MAXNA || findNode (a) || nnode == MAXSIM)
+        {
+            fprintf (stderr, "Bad or too many node addresses: %s\n", tp);
+            usage();
+        }
+        node[nnode].addr = a;
+        resetNode (&node[nnode++]);
+    }
+
+    bytet = baud > 0 ? 10.0/baud : 0;   /* 8N1 */
+    srand48 (seed);
+    openPty (link);
+
+    while (1)
+        service();
+
+    return (0);
+}
+
+static void
+usage()
+{
+    fprintf(stderr, "csisim: [options]\n");
+    fprintf(stderr, "Purpose: simulate CSIMC nodes on a pty for csimcd\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, " -a a,b   simulate nodes with addresses a,b..; default is 0,1,2\n");
+    fprintf(stderr, " -b baud  time bytes on the line at <baud>, 0 for none; default is 38400\n");
+    fprintf(stderr, " -e p     lose or corrupt each packet with probability <p>; default is 0\n");
+    fprintf(stderr, " -s seed  seed for -e; default is 1\n");
+    fprintf(stderr, " -t path  also make symlink <path> to the pty, eg for csimcd's TTY\n");
+    fprintf(stderr, " -v       verbose; more for more\n");
+
+    exit (1);
+}
+
+/* open a pty master in mfd, make its slave raw, report and link its name.
+ * we keep the slave open too so mfd stays usable between csimcd runs.
+ * exit if trouble.
+ */
+static void
+openPty (char *link)
+{
+    struct termios tio;
+    char *sname;
+    int sfd;
+
+    mfd = posix_openpt (O_RDWR|O_NOCTTY);
+    if (mfd < 0 || grantpt (mfd) < 0 || unlockpt (mfd) < 0
+            || !(sname = ptsname (mfd)))
+    {
+        fprintf (stderr, "pty: %s\n", strerror(errno));
+        exit (1);
+    }
+
+    sfd = open (sname, O_RDWR|O_NOCTTY);
+    if (sfd < 0)
+    {
+        fprintf (stderr, "%s: %s\n", sname, strerror(errno));
+        exit (1);
+    }
+    tcgetattr (sfd, &tio);
+    cfmakeraw (&tio);
+    tcsetattr (sfd, TCSANOW, &tio);
+
+    if (link)
+    {
+        (void) unlink (link);
+        if (symlink (sname, link) < 0)
+        {
+            fprintf (stderr, "%s: %s\n", link, strerror(errno));
+            exit (1);
+        }
+    }
+
+    printf ("%s\n", sname);
+    fflush (stdout);
+}
+
+/* wait for bytes from csimcd, or for the token holder's ACK to time out,
+ * and handle them.
+ */
+static void
+service()
+{
+    struct pollfd pfd;
+    Byte buf[1024];
+    int ms, n, i;
+
+    ms = -1;
+    if (holder)
+    {
+        ms = (int)((ackdue - now())*1000 + 1);
+        if (ms < 0)
+            ms = 0;
+    }
+
+    pfd.fd = mfd;
+    pfd.events = POLLIN;
+    n = poll (&pfd, 1, ms);
+    if (n < 0)
+    {
+        if (errno == EINTR)
+            return;
+        fprintf (stderr, "poll: %s\n", strerror(errno));
+        exit (1);
+    }
+
+    if (n == 0)
+    {
+        /* no ACK: keep the packet for next time and pass the token on */
+        if (verbose)
+            fprintf (stderr, "Node %d: no ACK from %d\n", holder->addr,
+                     holder->outq[0][PB_TO]);
+        nsent = PERTOK;
+        sendNext();
+        return;
+    }
+
+    n = read (mfd, buf, sizeof(buf));
+    if (n < 0)
+    {
+        fprintf (stderr, "read: %s\n", strerror(errno));
+        exit (1);
+    }
+
+    /* they are not here until they have crossed the line */
+    if (bytet > 0)
+    {
+        double t = linefree > now() ? linefree : now();
+        linefree = t + n*bytet;
+        sleepUntil (linefree);
+    }
+
+    for (i = 0; i < n; i++)
+        rxByte (buf[i]);
+}
+
+/* frame the next byte from the line, handling each token and good packet */
+static void
+rxByte (Byte d)
+{
+    if (d == PSYNC)
+    {
+        rpkt[PB_SYNC] = d;
+        rpktlen = 1;
+        return;
+    }
+
+    switch (rpktlen)
+    {
+        case 0:             /* hunting for SYNC */
+            return;
+
+        case 1:             /* To or token */
+            if (d == BROKTOK || ISNTOK(d))
+            {
+                rpktlen = 0;
+                rxToken (d);
+                return;
+            }
+            break;
+
+        case PB_COUNT:
+            if (d > PMXDAT)
+            {
+                rpktlen = 0;
+                return;
+            }
+            break;
+    }
+
+    rpkt[rpktlen++] = d;
+
+    if (rpktlen == PB_HSZ)
+    {
+        if (chkSum (rpkt, PB_NHCHK) != rpkt[PB_HCHK])
+        {
+            if (verbose)
+                fprintf (stderr, "Bad header checksum\n");
+            rpktlen = 0;
+            return;
+        }
+        if (rpkt[PB_COUNT] == 0)
+        {
+            rpktlen = 0;
+            rxPacket();
+        }
+    }
+    else if (rpktlen > PB_HSZ && rpktlen == pktSize (rpkt))
+    {
+        rpktlen = 0;
+        if (chkSum (&rpkt[PB_DATA], rpkt[PB_COUNT]) != rpkt[PB_DCHK])
+        {
+            if (verbose)
+                fprintf (stderr, "Bad data checksum\n");
+            return;
+        }
+        rxPacket();
+    }
+}
+
+/* the broker passed token t */
+static void
+rxToken (Byte t)
+{
+    Node *np = findNode (tok2addr(t));
+
+    if (verbose > 2)
+        fprintf (stderr, "Token for %d\n", tok2addr(t));
+
+    if (np)
+    {
+        holder = np;
+        nsent = 0;
+        sendNext();
+    }
+}
+
+/* rpkt is a good packet, see whether it is for one of our nodes */
+static void
+rxPacket()
+{
+    int to = rpkt[PB_TO];
+    int ha = rpkt[PB_FR] - NNODES;
+    int t = rpkt[PB_INFO] & PT_MASK;
+    Byte seq = rpkt[PB_INFO] & PSQ_MASK;
+    Node *np;
+    Shell *sp;
+    int i;
+
+    if (to == BRDCA && t == PT_REBOOT)
+    {
+        if (verbose)
+            fprintf (stderr, "Rebooting all\n");
+        for (i = 0; i < nnode; i++)
+            resetNode (&node[i]);
+        return;
+    }
+
+    np = findNode (to);
+    if (!np || ha < 0 || ha >= NHOSTS)
+        return;
+
+    if (errp > 0 && drand48() < errp)
+    {
+        if (verbose)
+            fprintf (stderr, "Node %d: losing packet from %d\n", to, ha+NNODES);
+        return;
+    }
+
+    if (verbose > 1)
+        fprintf (stderr, "Node %d: type %d from %d seq 0x%x count %d\n", to,
+                 t, ha+NNODES, seq>>PSQ_SHIFT, rpkt[PB_COUNT]);
+
+    sp = &np->sh[ha];
+    switch (t)
+    {
+        case PT_ACK:
+            if (np->nout > 0 && np->hsent && np->outq[0][PB_TO] == ha+NNODES
+                    && (np->outq[0][PB_INFO] & PSQ_MASK) == seq)
+            {
+                memmove (np->outq[0], np->outq[1], --np->nout*PMXLEN);
+                np->hsent = 0;
+                if (holder == np)
+                    sendNext();
+            }
+            break;
+
+        case PT_REBOOT:
+            resetNode (np);
+            break;
+
+        case PT_PING:
+            sendAck (np, ha, seq);
+            sp->rseq = 0xff;
+            break;
+
+        case PT_SHELL:
+            sendAck (np, ha, seq);
+            if (seq != sp->rseq)
+            {
+                sp->rseq = seq;
+                shellIn (np, ha, &rpkt[PB_DATA], rpkt[PB_COUNT]);
+            }
+            break;
+
+        case PT_INTR:   /* FALLTHRU */
+        case PT_KILL:
+            sendAck (np, ha, seq);
+            sp->len = sp->depth = sp->inq = 0;
+            break;
+
+        default:
+            sendAck (np, ha, seq);
+            break;
+    }
+}
+
+/* the holder sends its next packet, or passes the token back if done */
+static void
+sendNext()
+{
+    Node *np = holder;
+
+    if (!np)
+        return;
+
+    if (np->nout > 0 && nsent < PERTOK)
+    {
+        xmit (np->outq[0], pktSize (np->outq[0]));
+        np->hsent = 1;
+        nsent++;
+        ackdue = now() + ACKTO/1000.0;
+    }
+    else
+    {
+        Byte tpkt[2];
+
+        tpkt[0] = PSYNC;
+        tpkt[1] = BROKTOK;
+        holder = NULL;
+        xmit (tpkt, 2);
+    }
+}
+
+/* np ACKs the packet in rpkt from host index ha */
+static void
+sendAck (Node *np, int ha, Byte seq)
+{
+    Byte apkt[PB_HSZ];
+
+    apkt[PB_SYNC] = PSYNC;
+    apkt[PB_TO] = ha + NNODES;
+    apkt[PB_FR] = np->addr;
+    apkt[PB_INFO] = PT_ACK | seq;
+    apkt[PB_COUNT] = 0;
+    apkt[PB_HCHK] = chkSum (apkt, PB_NHCHK);
+    xmit (apkt, PB_HSZ);
+}
+
+/* send n bytes of p onto the line, a byte at a time at the baud rate.
+ * packets, but not tokens, may be corrupted.
+ */
+static void
+xmit (Byte p[], int n)
+{
+    Byte bad[PMXLEN];
+    double t0;
+    int i;
+
+    if (n > 2 && errp > 0 && drand48() < errp)
+    {
+        memcpy (bad, p, n);
+        i = 1 + (int)(drand48()*(n-1));
+        if ((bad[i] ^= 1) == PSYNC)
+            bad[i] ^= 3;
+        if (verbose)
+            fprintf (stderr, "Corrupting byte %d of packet to %d\n", i, p[PB_TO]);
+        p = bad;
+    }
+
+    if (bytet == 0)
+    {
+        if (write (mfd, p, n) != n)
+            fprintf (stderr, "write: %s\n", strerror(errno));
+        return;
+    }
+
+    t0 = linefree > now() ? linefree : now();
+    for (i = 0; i < n; i++)
+    {
+        sleepUntil (t0 + (i+1)*bytet);
+        if (write (mfd, &p[i], 1) != 1)
+            fprintf (stderr, "write: %s\n", strerror(errno));
+    }
+    linefree = t0 + n*bytet;
+}
+
+/* queue n chars of s from np to host index ha, adding to the last packet
+ * if it is for ha, has room and has not yet been sent.
+ */
+static void
+reply (Node *np, int ha, char *s, int n)
+{
+    Shell *sp = &np->sh[ha];
+    Byte *pp;
+    int m;
+
+    while (n > 0)
+    {
+        pp = np->nout > 0 ? np->outq[np->nout-1] : NULL;
+        if (!pp || pp[PB_TO] != ha+NNODES || pp[PB_COUNT] == PMXDAT
+                || (np->nout == 1 && np->hsent))
+        {
+            if (np->nout == NOUTQ)
+            {
+                fprintf (stderr, "Node %d: output to %d overflows\n",
+                         np->addr, ha+NNODES);
+                return;
+            }
+            pp = np->outq[np->nout++];
+            pp[PB_SYNC] = PSYNC;
+            pp[PB_TO] = ha + NNODES;
+            pp[PB_FR] = np->addr;
+            pp[PB_INFO] = PT_SHELL | ((++sp->xseq << PSQ_SHIFT) & PSQ_MASK);
+            pp[PB_COUNT] = 0;
+        }
+
+        m = PMXDAT - pp[PB_COUNT];
+        if (m > n)
+            m = n;
+        memcpy (&pp[PB_DATA+pp[PB_COUNT]], s, m);
+        pp[PB_COUNT] += m;
+        pp[PB_HCHK] = chkSum (pp, PB_NHCHK);
+        pp[PB_DCHK] = chkSum (&pp[PB_DATA], pp[PB_COUNT]);
+        s += m;
+        n -= m;
+    }
+}
+
+/* n more chars p for host index ha's shell on np; run each whole statement */
+static void
+shellIn (Node *np, int ha, Byte *p, int n)
+{
+    Shell *sp = &np->sh[ha];
+    int c, end;
+
+    while (n-- > 0)
+    {
+        c = *p++;
+        if (sp->len < SHLEN-1)
+            sp->buf[sp->len++] = c;
+
+        end = 0;
+        if (c == '"')
+            sp->inq = !sp->inq;
+        else if (sp->inq)
+            continue;
+        else if (c == '{')
+            sp->depth++;
+        else if (c == '}')
+            end = sp->depth > 0 && --sp->depth == 0;
+        else if (c == ';')
+            end = sp->depth == 0;
+
+        if (end)
+        {
+            sp->buf[sp->len] = '\0';
+            doStmt (np, ha, sp->buf);
+            sp->len = 0;
+        }
+    }
+}
+
+/* run statement s from host index ha on np */
+static void
+doStmt (Node *np, int ha, char *s)
+{
+    char name[16], buf[32];
+    long v;
+
+    if (verbose > 1)
+        fprintf (stderr, "Node %d: %s\n", np->addr, s);
+
+    while (isspace(*s))
+        s++;
+
+    if (*s == '=')
+    {
+        s++;
+        v = expr (np, &s);
+        reply (np, ha, buf, sprintf (buf, "%ld\n", v));
+        return;
+    }
+
+    if (!ident (&s, name, sizeof(name)))
+        return;
+    while (isspace(*s))
+        s++;
+
+    if (s[0] == '(')
+        doCall (np, name, s+1);
+    else if (s[0] == '=' && s[1] != '=')
+    {
+        s += 1;
+        setVar (np, name, expr (np, &s));
+    }
+    else if ((s[0] == '+' || s[0] == '-') && s[1] == '=')
+    {
+        int neg = s[0] == '-';
+        s += 2;
+        v = expr (np, &s);
+        setVar (np, name, getVar (np, name) + (neg ? -v : v));
+    }
+
+    /* anything else is not for us */
+}
+
+/* call function name with the given args on np.
+ * only etrack() and mtrack() do anything.
+ */
+static void
+doCall (Node *np, char *name, char *args)
+{
+    long a[MAXTRK+2];
+    int n;
+
+    if (strcmp (name, "etrack") && strcmp (name, "mtrack"))
+        return;
+
+    for (n = 0; n < MAXTRK+2; n++)
+    {
+        while (isspace(*args))
+            args++;
+        if (*args == ')' || !*args)
+            break;
+        a[n] = expr (np, &args);
+        while (isspace(*args))
+            args++;
+        if (*args == ',')
+            args++;
+    }
+    if (n < 3 || a[1] <= 0)
+        return;
+
+    motion (np);
+    np->trk0 = a[0];
+    np->trkdt = a[1];
+    np->ntrk = n - 2;
+    memcpy (np->trk, &a[2], np->ntrk*sizeof(long));
+    np->mode = MD_TRACK;
+}
+
+/* expr: term {+|- term} */
+static long
+expr (Node *np, char **spp)
+{
+    long v = term (np, spp);
+
+    while (1)
+    {
+        while (isspace(**spp))
+            (*spp)++;
+        if (**spp == '+')
+        {
+            (*spp)++;
+            v += term (np, spp);
+        }
+        else if (**spp == '-')
+        {
+            (*spp)++;
+            v -= term (np, spp);
+        }
+        else
+            return (v);
+    }
+}
+
+/* term: factor {*|/|% factor} */
+static long
+term (Node *np, char **spp)
+{
+    long v = factor (np, spp);
+    long f;
+    int op;
+
+    while (1)
+    {
+        while (isspace(**spp))
+            (*spp)++;
+        op = **spp;
+        if (op != '*' && op != '/' && op != '%')
+            return (v);
+        (*spp)++;
+        f = factor (np, spp);
+        if (op == '*')
+            v *= f;
+        else if (f != 0)
+            v = op == '/' ? v/f : v%f;
+    }
+}
+
+/* factor: number | name | (expr) | -factor */
+static long
+factor (Node *np, char **spp)
+{
+    char name[16];
+    long v;
+
+    while (isspace(**spp))
+        (*spp)++;
+
+    if (**spp == '(')
+    {
+        (*spp)++;
+        v = expr (np, spp);
+        while (isspace(**spp))
+            (*spp)++;
+        if (**spp == ')')
+            (*spp)++;
+        return (v);
+    }
+    if (**spp == '-')
+    {
+        (*spp)++;
+        return (-factor (np, spp));
+    }
+    if (**spp == '+')
+    {
+        (*spp)++;
+        return (factor (np, spp));
+    }
+    if (isdigit(**spp))
+        return (strtol (*spp, spp, 0));
+    if (ident (spp, name, sizeof(name)))
+        return (getVar (np, name));
+    return (0);
+}
+
+/* copy the identifier at *spp to name[len] and advance *spp past it.
+ * return 1 if found one, else 0.
+ */
+static int
+ident (char **spp, char name[], int len)
+{
+    char *s = *spp;
+    int n = 0;
+
+    if (!isalpha(*s) && *s != '_')
+        return (0);
+    while (isalnum(*s) || *s == '_')
+    {
+        if (n < len-1)
+            name[n++] = *s;
+        s++;
+    }
+    name[n] = '\0';
+    *spp = s;
+    return (1);
+}
+
+/* return the value of variable name on np, 0 if never set */
+static long
+getVar (Node *np, char *name)
+{
+    int i;
+
+    motion (np);
+
+    if (!strcmp (name, "epos") || !strcmp (name, "mpos"))
+        return ((long)(np->pos + (np->pos < 0 ? -.5 : .5)));
+    if (!strcmp (name, "mvel"))
+        return ((long)(np->vel + (np->vel < 0 ? -.5 : .5)));
+    if (!strcmp (name, "clock"))
+        return ((long)((now() - np->clock0)*1000));
+    if (!strcmp (name, "mtvel"))
+        return (np->mtvel);
+    if (!strcmp (name, "toffset"))
+        return (np->toffset);
+    if (!strcmp (name, "timeout"))
+        return (np->timeout);
+    if (!strcmp (name, "etpos") || !strcmp (name, "mtpos"))
+        return ((long)np->target);
+
+    for (i = 0; i < np->nvar; i++)
+        if (!strcmp (name, np->var[i].name))
+            return (np->var[i].v);
+    return (0);
+}
+
+/* set variable name on np to v */
+static void
+setVar (Node *np, char *name, long v)
+{
+    int i;
+
+    motion (np);
+
+    if (!strcmp (name, "epos") || !strcmp (name, "mpos"))
+        np->pos = v;
+    else if (!strcmp (name, "clock"))
+        np->clock0 = now() - v/1000.0;
+    else if (!strcmp (name, "mtvel"))
+    {
+        np->mtvel = v;
+        np->mode = MD_VEL;
+    }
+    else if (!strcmp (name, "toffset"))
+        np->toffset = v;
+    else if (!strcmp (name, "timeout"))
+        np->timeout = v;
+    else if (!strcmp (name, "etpos") || !strcmp (name, "mtpos"))
+    {
+        np->target = v;
+        np->mode = MD_TARGET;
+    }
+    else
+    {
+        for (i = 0; i < np->nvar; i++)
+            if (!strcmp (name, np->var[i].name))
+                break;
+        if (i == NVARS)
+            return;
+        if (i == np->nvar)
+        {
+            strcpy (np->var[i].name, name);
+            np->nvar++;
+        }
+        np->var[i].v = v;
+    }
+}
+
+/* bring np's motor up to now */
+static void
+motion (Node *np)
+{
+    double t = now();
+    double dt = t - np->t;
+    double p0 = np->pos;
+    double d, step;
+
+    switch (np->mode)
+    {
+        case MD_VEL:
+            np->pos += np->mtvel*dt;
+            break;
+        case MD_TARGET:
+            d = np->target - np->pos;
+            step = MAXVEL*dt;
+            if (d > step)
+                np->pos += step;
+            else if (d < -step)
+                np->pos -= step;
+            else
+                np->pos = np->target;
+            break;
+        case MD_TRACK:
+            np->pos = trackPos (np, (t - np->clock0)*1000) + np->toffset;
+            break;
+    }
+
+    if (dt > 0)
+        np->vel = (np->pos - p0)/dt;
+    np->t = t;
+}
+
+/* return np's tracking profile at clock ms, held at each end */
+static double
+trackPos (Node *np, double ms)
+{
+    double x = (ms - np->trk0)/np->trkdt;
+    int i = (int)x;
+
+    if (x <= 0)
+        return (np->trk[0]);
+    if (i >= np->ntrk-1)
+        return (np->trk[np->ntrk-1]);
+    return (np->trk[i] + (x-i)*(np->trk[i+1] - np->trk[i]));
+}
+
+/* power up np */
+static void
+resetNode (Node *np)
+{
+    int addr = np->addr;
+    int i;
+
+    if (holder == np)
+        holder = NULL;
+    memset (np, 0, sizeof(*np));
+    np->addr = addr;
+    np->mode = MD_VEL;
+    np->t = np->clock0 = now();
+    for (i = 0; i < NHOSTS; i++)
+        np->sh[i].rseq = 0xff;
+}
+
+/* return the node we simulate at addr, else NULL */
+static Node *
+findNode (int addr)
+{
+    int i;
+
+    for (i = 0; i < nnode; i++)
+        if (node[i].addr == addr)
+            return (&node[i]);
+    return (NULL);
+}
+
+/* compute check sum on the given array, as csimcd */
+static int
+chkSum (Byte p[], int n)
+{
+    Word sum;
+
+    for (sum = 0; n > 0; --n)
+        sum += *p++;
+    while (sum > 255)
+        sum = (sum & 0xff) + (sum >> 8);
+    if (sum == PSYNC)
+        sum = 1;
+    return (sum);
+}
+
+/* return total Bytes in the given packet */
+static int
+pktSize (Byte pkt[])
+{
+    /* 1 for PB_DCHK too when finite COUNT */
+    return (pkt[PB_COUNT] ? PB_HSZ+1+pkt[PB_COUNT] : PB_HSZ);
+}
+
+/* sleep until unix time t */
+static void
+sleepUntil (double t)
+{
+    double dt = t - now();
+    struct timespec ts;
+
+    if (dt <= 0)
+        return;
+    ts.tv_sec = (time_t)dt;
+    ts.tv_nsec = (long)((dt - ts.tv_sec)*1e9);
+    while (nanosleep (&ts, &ts) < 0 && errno == EINTR)
+        continue;
+}
+
+/* return unix time now, secs */
+static double
+now()
+{
+    struct timeval tv;
+
+    gettimeofday (&tv, NULL);
+    return (tv.tv_sec + tv.tv_usec/1e6);
+}
@@ -9,6 +9,9 @@ extern void loadAllCfg (char *cfn);
 extern int loadOneCfg(int addr, char *fn);
 extern int loadFirmware (int addr, char *fn);
 
+/* stats.c */
+extern void showStats (int secs);
+
 /* eintrio.c */
 extern int selectI (int n, fd_set *rp, fd_set *wp, fd_set *xp,
                     struct timeval *tp);
@@ -0,0 +1,151 @@
+/* show the traffic counters csimcd publishes, as rates, until killed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "csiutil.h"
+#include "csistats.h"
+
+#include "mc.h"
+
+static void showNodes (CsiStatShm *now, CsiStatShm *then, double dt);
+static void showHosts (CsiStatShm *now, CsiStatShm *then, double dt);
+static char *why2str (int why);
+
+/* every secs show the rates of each node and client of the csimcd on port
+ * since the time before, and their ACK and token times.
+ * never returns; exit if no csimcd has run on port.
+ */
+void
+showStats (int secs)
+{
+    static CsiStatShm then, now;
+    CsiStatShm *sp;
+    int tty = isatty (1);
+    double dt;
+    long up;
+
+    if (csiStatOpen (port, 0, &sp) < 0)
+    {
+        fprintf (stderr, "No csimcd stats for port %d: %s\n", port,
+                 strerror(errno));
+        exit (1);
+    }
+    if (secs < 1)
+        secs = 1;
+
+    memcpy (&then, sp, sizeof(then));
+    while (1)
+    {
+        sleep (secs);
+        memcpy (&now, sp, sizeof(now));
+        if (now.start != then.start)
+        {
+            /* csimcd restarted, counts start over */
+            memset (&then, 0, sizeof(then));
+            then.update = now.start;
+        }
+        dt = now.update - then.update;
+        if (dt <= 0)
+            dt = secs;
+
+        if (tty)
+            printf ("\033[H\033[J");
+        up = (now.pid ? time(NULL) : (long)now.update) - now.start;
+        printf ("csimcd pid %d %s %ld:%02ld:%02ld  %.1f ring trips/s  %.1f bad headers/s\n",
+                now.pid, now.pid ? "up" : "exited after", up/3600,
+                up/60%60, up%60, (now.ringtrips-then.ringtrips)/dt,
+                (now.badhdr-then.badhdr)/dt);
+        showNodes (&now, &then, dt);
+        showHosts (&now, &then, dt);
+        if (!tty)
+            printf ("\n");
+        fflush (stdout);
+
+        then = now;
+    }
+}
+
+/* show each node csimcd has ever spoken with */
+static void
+showNodes (CsiStatShm *now, CsiStatShm *then, double dt)
+{
+    CsiNodeStats *np, *tp;
+    CsiHist ack, tok;
+    int i;
+
+    printf ("\nNode  Tx/s  Rx/s TxB/s RxB/s Retry/s BadChk/s Restarts Tok/s Lost/s  ACK ms p50   p99   max  Tok ms p50   p99\n");
+    for (i = 0; i < NNODES; i++)
+    {
+        np = &now->node[i];
+        tp = &then->node[i];
+        if (!np->xpkts && !np->tokens)
+            continue;
+
+        csiHistDiff (&np->ackus, &tp->ackus, &ack);
+        csiHistDiff (&np->tokus, &tp->tokus, &tok);
+        printf ("%4d %5.1f %5.1f %5.0f %5.0f %7.1f %8.1f %8u %5.1f %6.1f %10.1f %5.1f %5.1f %10.1f %5.1f\n",
+                i, (np->xpkts-tp->xpkts)/dt, (np->rpkts-tp->rpkts)/dt,
+                (np->xbytes-tp->xbytes)/dt, (np->rbytes-tp->rbytes)/dt,
+                (np->retries-tp->retries)/dt, (np->badchk-tp->badchk)/dt,
+                np->restarts, (np->tokens-tp->tokens)/dt,
+                (np->toklost-tp->toklost)/dt,
+                csiHistPct (&ack, 50)/1e3, csiHistPct (&ack, 99)/1e3,
+                ack.max/1e3, csiHistPct (&tok, 50)/1e3,
+                csiHistPct (&tok, 99)/1e3);
+    }
+}
+
+/* show each client connected now or during the interval */
+static void
+showHosts (CsiStatShm *now, CsiStatShm *then, double dt)
+{
+    CsiHostStats *hp, *tp;
+    CsiHist ack;
+    int i;
+
+    printf ("\nHost Node Why        Tx/s  Rx/s TxB/s RxB/s Retry/s  ACK ms p50   p99   max\n");
+    for (i = 0; i < NHOSTS; i++)
+    {
+        hp = &now->host[i];
+        tp = &then->host[i];
+        if (!hp->inuse && hp->xpkts == tp->xpkts)
+            continue;
+
+        /* a new client since then counts from 0 */
+        if ((hp->inuse && !tp->inuse) || hp->xpkts < tp->xpkts)
+            tp = memset (tp, 0, sizeof(*tp));
+
+        csiHistDiff (&hp->ackus, &tp->ackus, &ack);
+        printf ("%4d %4d %-10s %5.1f %5.1f %5.0f %5.0f %7.1f %10.1f %5.1f %5.1f\n",
+                i+NNODES, hp->toaddr, why2str (hp->why),
+                (hp->xpkts-tp->xpkts)/dt, (hp->rpkts-tp->rpkts)/dt,
+                (hp->xbytes-tp->xbytes)/dt, (hp->rbytes-tp->rbytes)/dt,
+                (hp->retries-tp->retries)/dt, csiHistPct (&ack, 50)/1e3,
+                csiHistPct (&ack, 99)/1e3, ack.max/1e3);
+    }
+}
+
+/* given an OpenWhy return a short description */
+static char *
+why2str (int why)
+{
+    switch (why)
+    {
+        case FOR_SHELL:
+            return ("Shell");
+        case FOR_BOOT:
+            return ("Boot");
+        case FOR_REBOOT:
+            return ("Reboot");
+        case FOR_SERIAL:
+            return ("Serial");
+        default:
+            return ("?");
+    }
+}
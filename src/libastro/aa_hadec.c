@@ -7,7 +7,8 @@
 #include "P_.h"
 #include "astro.h"
 
-static void aaha_aux P_((double lat, double x, double y, double *p, double *q));
+static void aaha_aux P_((AstroCtx *ac, double lat, double x, double y,
+                         double *p, double *q));
 
 /* given geographical latitude (n+, radians), lat, altitude (up+, radians),
  * alt, and azimuth (angle round to the east from north+, radians),
@@ -19,7 +20,18 @@ double lat;
 double alt, az;
 double *ha, *dec;
 {
-    aaha_aux (lat, az, alt, ha, dec);
+    aa_hadec_r (astro_defctx(), lat, alt, az, ha, dec);
+}
+
+/* same as aa_hadec() but using context *ac */
+void
+aa_hadec_r (ac, lat, alt, az, ha, dec)
+AstroCtx *ac;
+double lat;
+double alt, az;
+double *ha, *dec;
+{
+    aaha_aux (ac, lat, az, alt, ha, dec);
     if (*ha > PI)
         *ha -= 2*PI;
 }
@@ -34,7 +46,18 @@ double lat;
 double ha, dec;
 double *alt, *az;
 {
-    aaha_aux (lat, ha, dec, az, alt);
+    hadec_aa_r (astro_defctx(), lat, ha, dec, alt, az);
+}
+
+/* same as hadec_aa() but using context *ac */
+void
+hadec_aa_r (ac, lat, ha, dec, alt, az)
+AstroCtx *ac;
+double lat;
+double ha, dec;
+double *alt, *az;
+{
+    aaha_aux (ac, lat, ha, dec, az, alt);
 }
 
 #ifdef NEED_GEOC
@@ -55,22 +78,22 @@ double phi;
  * N.B. all arguments are in radians.
  */
 static void
-aaha_aux (lat, x, y, p, q)
+aaha_aux (ac, lat, x, y, p, q)
+AstroCtx *ac;
 double lat;
 double x, y;
 double *p, *q;
 {
-    static double last_lat = -3434, slat, clat;
     double cap, B;
 
-    if (lat != last_lat)
+    if (lat != ac->aa_lat)
     {
-        slat = sin(lat);
-        clat = cos(lat);
-        last_lat = lat;
+        ac->aa_slat = sin(lat);
+        ac->aa_clat = cos(lat);
+        ac->aa_lat = lat;
     }
 
-    solve_sphere (-x, PI/2-y, slat, clat, &cap, &B);
+    solve_sphere (-x, PI/2-y, ac->aa_slat, ac->aa_clat, &cap, &B);
     *p = B;
     *q = PI/2 - acos(cap);
 }
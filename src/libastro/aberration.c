@@ -19,8 +19,8 @@
 #define AB_ECL_EOD  0
 #define AB_EQ_EOD   1
 
-static void ab_aux P_((double mjd, double *x, double *y, double lsn,
-                       int mode));
+static void ab_aux P_((AstroCtx *ac, double mjd, double *x, double *y,
+                       double lsn, int mode));
 
 /* apply aberration correction to ecliptical coordinates *lam and *bet
  * (in radians) for a given time mjd and handily supplied longitude of sun,
@@ -30,7 +30,16 @@ void
 ab_ecl (mjd, lsn, lam, bet)
 double mjd, lsn, *lam, *bet;
 {
-    ab_aux(mjd, lam, bet, lsn, AB_ECL_EOD);
+    ab_aux(astro_defctx(), mjd, lam, bet, lsn, AB_ECL_EOD);
+}
+
+/* same as ab_ecl() but using context *ac */
+void
+ab_ecl_r (ac, mjd, lsn, lam, bet)
+AstroCtx *ac;
+double mjd, lsn, *lam, *bet;
+{
+    ab_aux(ac, mjd, lam, bet, lsn, AB_ECL_EOD);
 }
 
 /* apply aberration correction to equatoreal coordinates *ra and *dec
@@ -41,7 +50,16 @@ void
 ab_eq (mjd, lsn, ra, dec)
 double mjd, lsn, *ra, *dec;
 {
-    ab_aux(mjd, ra, dec, lsn, AB_EQ_EOD);
+    ab_aux(astro_defctx(), mjd, ra, dec, lsn, AB_EQ_EOD);
+}
+
+/* same as ab_eq() but using context *ac */
+void
+ab_eq_r (ac, mjd, lsn, ra, dec)
+AstroCtx *ac;
+double mjd, lsn, *ra, *dec;
+{
+    ab_aux(ac, mjd, ra, dec, lsn, AB_EQ_EOD);
 }
 
 /* because the e-terms are secular, keep the real transformation for both
@@ -50,25 +68,26 @@ double mjd, lsn, *ra, *dec;
  * mode == AB_EQ_EOD:   x = ra,  y = dec    (equatoreal)
  */
 static void
-ab_aux (mjd, x, y, lsn, mode)
+ab_aux (ac, mjd, x, y, lsn, mode)
+AstroCtx *ac;
 double mjd, *x, *y, lsn;
 int mode;
 {
-    static double lastmjd = -10000;
-    static double eexc; /* earth orbit excentricity */
-    static double leperi;   /* ... and longitude of perihelion */
-    static char dirty = 1;  /* flag for cached trig terms */
+    double eexc;        /* earth orbit excentricity */
+    double leperi;      /* ... and longitude of perihelion */
 
-    if (mjd != lastmjd)
+    if (mjd != ac->ab_mjd)
     {
         double T;       /* centuries since J2000 */
 
         T = (mjd - J2000)/36525.;
-        eexc = 0.016708617 - (42.037e-6 + 0.1236e-6 * T) * T;
-        leperi = degrad(102.93735 + (0.71953 + 0.00046 * T) * T);
-        lastmjd = mjd;
-        dirty = 1;
+        ac->ab_eexc = 0.016708617 - (42.037e-6 + 0.1236e-6 * T) * T;
+        ac->ab_leperi = degrad(102.93735 + (0.71953 + 0.00046 * T) * T);
+        ac->ab_mjd = mjd;
+        ac->ab_dirty = 1;   /* flag for cached trig terms */
     }
+    eexc = ac->ab_eexc;
+    leperi = ac->ab_leperi;
 
     switch (mode)
     {
@@ -92,20 +111,24 @@ int mode;
         {
             double *ra = x, *dec = y;
             double sr, cr, sd, cd, sls, cls;/* trig values coords */
-            static double cp, sp, ce, se;   /* .. and perihel/eclipic */
+            double cp, sp, ce, se;          /* .. and perihel/eclipic */
             double dra, ddec;       /* changes in ra and dec */
 
-            if (dirty)
+            if (ac->ab_dirty)
             {
                 double eps;
 
-                cp = cos(leperi);
-                sp = sin(leperi);
-                obliquity(mjd, &eps);
-                se = sin(eps);
-                ce = cos(eps);
-                dirty = 0;
+                ac->ab_cp = cos(leperi);
+                ac->ab_sp = sin(leperi);
+                obliquity_r(ac, mjd, &eps);
+                ac->ab_se = sin(eps);
+                ac->ab_ce = cos(eps);
+                ac->ab_dirty = 0;
             }
+            cp = ac->ab_cp;
+            sp = ac->ab_sp;
+            ce = ac->ab_ce;
+            se = ac->ab_se;
 
             sr = sin(*ra);
             cr = cos(*ra);
@@ -42,17 +42,82 @@
 #define J2000 (2451545.0 - MJD0)      /* let compiler optimise */
 
 
+/* the values libastro remembers from one call to the next to avoid repeating
+ * work when called again for the same date or location.
+ * a thread that computes in parallel with others gives itself one of these,
+ * prepared with astro_ctx_init(), and calls the _r form of each function.
+ * the plain forms all share the one from astro_defctx() so only one thread at
+ * a time may use them.
+ */
+typedef struct
+{
+    /* obliquity() */
+    double obl_mjd, obl_eps;
+
+    /* nutation() */
+    double nut_mjd, nut_deps, nut_dpsi;
+
+    /* nut_eq() */
+    double nuq_mjd, nuq_a[3][3];
+
+    /* precess() */
+    double pre_mjd1, pre_yr1;
+    double pre_mjd2, pre_yr2;
+
+    /* eq_ecl(), ecl_eq() */
+    double ecl_mjd, ecl_seps, ecl_ceps;
+
+    /* ab_ecl(), ab_eq() */
+    double ab_mjd, ab_eexc, ab_leperi;
+    double ab_cp, ab_sp, ab_ce, ab_se;
+    int ab_dirty;
+
+    /* sunpos() */
+    double sun_mjd, sun_lsn, sun_rsn, sun_bsn;
+
+    /* plans() */
+    double pl_mjd, pl_xsn, pl_ysn, pl_zsn;
+
+    /* deltat() */
+    double dt_mjd, dt_ans;
+
+    /* utc_gst(), gst_utc() */
+    double ug_mjd, ug_t0;
+    double gu_mjd, gu_t0;
+
+    /* ta_par() */
+    double par_phi, par_ht, par_xobs, par_zobs;
+
+    /* aa_hadec(), hadec_aa() */
+    double aa_lat, aa_slat, aa_clat;
+
+    /* now_lst() */
+    double lst_mjd, lst_lng, lst_lst;
+} AstroCtx;
+
 /* global function declarations */
 
+/* astroctx.c */
+extern void astro_ctx_init P_((AstroCtx *ac));
+extern AstroCtx *astro_defctx P_((void));
+
 /* aa_hadec.c */
 extern void aa_hadec P_((double lat, double alt, double az, double *ha,
                          double *dec));
 extern void hadec_aa P_((double lat, double ha, double dec, double *alt,
                          double *az));
+extern void aa_hadec_r P_((AstroCtx *ac, double lat, double alt, double az,
+                           double *ha, double *dec));
+extern void hadec_aa_r P_((AstroCtx *ac, double lat, double ha, double dec,
+                           double *alt, double *az));
 
 /* aberration.c */
 extern void ab_ecl P_((double mjd, double lsn, double *lam, double *bet));
 extern void ab_eq P_((double mjd, double lsn, double *ra, double *dec));
+extern void ab_ecl_r P_((AstroCtx *ac, double mjd, double lsn, double *lam,
+                         double *bet));
+extern void ab_eq_r P_((AstroCtx *ac, double mjd, double lsn, double *ra,
+                        double *dec));
 
 /* airmass.c */
 extern void airmass P_((double aa, double *Xp));
@@ -70,15 +135,33 @@ extern int chap95 P_((double mjd, int obj, double prec, double *ret));
 extern void comet P_((double mjd, double ep, double inc, double ap, double qp,
                       double om, double *lpd, double *psi, double *rp, double *rho, double *lam,
                       double *bet));
+extern void comet_r P_((AstroCtx *ac, double mjd, double ep, double inc,
+                        double ap, double qp, double om, double *lpd, double *psi, double *rp,
+                        double *rho, double *lam, double *bet));
 
 /* deltat.c */
 extern double deltat P_((double mjd));
+extern double deltat_r P_((AstroCtx *ac, double mjd));
+
+/* ephcache.c */
+extern int ephc_setup P_((double mjd0, double span, double tol));
+extern void ephc_bypass P_((int on));
+extern void ephc_sync P_((void));
+extern int ephc_moon P_((double mjd, double *lam, double *bet, double *rho,
+                         double *msp, double *mdp));
+extern int ephc_sun P_((double mjd, double *lsn, double *rsn, double *bsn));
+extern int ephc_plans P_((double mjd, int p, double *lpd0, double *psi0,
+                          double *rp0, double *rho0, double *lam, double *bet));
 
 /* eq_ecl.c */
 extern void eq_ecl P_((double mjd, double ra, double dec, double *lat,
                        double *lng));
 extern void ecl_eq P_((double mjd, double lat, double lng, double *ra,
                        double *dec));
+extern void eq_ecl_r P_((AstroCtx *ac, double mjd, double ra, double dec,
+                         double *lat, double *lng));
+extern void ecl_eq_r P_((AstroCtx *ac, double mjd, double lat, double lng,
+                         double *ra, double *dec));
 
 /* eq_gal.c */
 extern void eq_gal P_((double mjd, double ra, double dec, double *lat,
@@ -139,21 +222,32 @@ extern void moon_colong P_((double jd, double lt, double lg, double *cp, double
 /* nutation.c */
 extern void nutation P_((double mjd, double *deps, double *dpsi));
 extern void nut_eq P_((double mjd, double *ra, double *dec));
+extern void nutation_r P_((AstroCtx *ac, double mjd, double *deps,
+                           double *dpsi));
+extern void nut_eq_r P_((AstroCtx *ac, double mjd, double *ra, double *dec));
 
 /* obliq.c */
 extern void obliquity P_((double mjd, double *eps));
+extern void obliquity_r P_((AstroCtx *ac, double mjd, double *eps));
 
 /* parallax.c */
 extern void ta_par P_((double tha, double tdec, double phi, double ht,
                        double *rho, double *aha, double *adec));
+extern void ta_par_r P_((AstroCtx *ac, double tha, double tdec, double phi,
+                         double ht, double *rho, double *aha, double *adec));
 
 /* plans.c */
 extern void plans P_((double mjd, int p, double *lpd0, double *psi0,
                       double *rp0, double *rho0, double *lam, double *bet, double *dia,
                       double *mag));
+extern void plans_r P_((AstroCtx *ac, double mjd, int p, double *lpd0,
+                        double *psi0, double *rp0, double *rho0, double *lam, double *bet,
+                        double *dia, double *mag));
 
 /* precess.c */
 extern void precess P_((double mjd1, double mjd2, double *ra, double *dec));
+extern void precess_r P_((AstroCtx *ac, double mjd1, double mjd2, double *ra,
+                          double *dec));
 
 /* reduce.c */
 extern void reduce_elements P_((double mjd0, double mjd, double inc0,
@@ -175,10 +269,14 @@ extern void cartsph P_((double x, double y, double z, double *l, double *b,
 
 /* sun.c */
 extern void sunpos P_((double mjd, double *lsn, double *rsn, double *bsn));
+extern void sunpos_r P_((AstroCtx *ac, double mjd, double *lsn, double *rsn,
+                         double *bsn));
 
 /* utc_gst.c */
 extern void utc_gst P_((double mjd, double utc, double *gst));
 extern void gst_utc P_((double mjd, double gst, double *utc));
+extern void utc_gst_r P_((AstroCtx *ac, double mjd, double utc, double *gst));
+extern void gst_utc_r P_((AstroCtx *ac, double mjd, double gst, double *utc));
 
 /* vsop87.c */
 extern int vsop87 P_((double mjd, int obj, double prec, double *ret));
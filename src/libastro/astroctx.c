@@ -0,0 +1,58 @@
+/* AstroCtx: the memos libastro keeps between calls, so that threads which
+ * compute in parallel may each have their own.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "P_.h"
+#include "astro.h"
+
+/* an mjd, latitude or longitude no caller ever uses */
+#define NOTYET  (-1e30)
+
+static void defctx_init P_((void));
+
+static AstroCtx defctx;             /* used by all the non-_r functions */
+static pthread_once_t defctx_once = PTHREAD_ONCE_INIT;
+
+/* prepare *ac for its first use.
+ */
+void
+astro_ctx_init (ac)
+AstroCtx *ac;
+{
+    ac->obl_mjd = NOTYET;
+    ac->nut_mjd = NOTYET;
+    ac->nuq_mjd = NOTYET;
+    ac->pre_mjd1 = NOTYET;
+    ac->pre_mjd2 = NOTYET;
+    ac->ecl_mjd = NOTYET;
+    ac->ab_mjd = NOTYET;
+    ac->ab_dirty = 1;
+    ac->sun_mjd = NOTYET;
+    ac->pl_mjd = NOTYET;
+    ac->dt_mjd = NOTYET;
+    ac->ug_mjd = NOTYET;
+    ac->gu_mjd = NOTYET;
+    ac->par_phi = NOTYET;
+    ac->par_ht = NOTYET;
+    ac->aa_lat = NOTYET;
+    ac->lst_mjd = NOTYET;
+    ac->lst_lng = NOTYET;
+}
+
+/* return the context shared by the functions without an AstroCtx argument.
+ */
+AstroCtx *
+astro_defctx ()
+{
+    pthread_once (&defctx_once, defctx_init);
+    return (&defctx);
+}
+
+static void
+defctx_init ()
+{
+    astro_ctx_init (&defctx);
+}
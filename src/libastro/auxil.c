@@ -47,5 +47,14 @@ Now *np;
     return (mjd + deltat(mjd)/86400.0);
 }
 
+/* same as mm_mjed() but using context *ac */
+double
+mm_mjed_r (ac, np)
+AstroCtx *ac;
+Now *np;
+{
+    return (mjd + deltat_r(ac, mjd)/86400.0);
+}
+
 /* For RCS Only -- Do Not Edit */
 static char *rcsid[2] = {(char *)rcsid, "@(#) $RCSfile: auxil.c,v $ $Date: 2001/04/19 21:12:13 $ $Revision: 1.1.1.1 $ $Name:  $"};
@@ -11,6 +11,8 @@
 #if defined(__STDC__)
 #include <stdlib.h>
 #endif
+#include <unistd.h>
+#include <pthread.h>
 
 #include "P_.h"
 #include "astro.h"
@@ -18,21 +20,59 @@
 #include "preferences.h"
 
 
-static int obj_planet P_((Now *np, Obj *op));
-static int obj_fixed P_((Now *np, Obj *op));
-static int obj_elliptical P_((Now *np, Obj *op));
-static int obj_hyperbolic P_((Now *np, Obj *op));
-static int obj_parabolic P_((Now *np, Obj *op));
-static int sun_cir P_((Now *np, Obj *op));
-static int moon_cir P_((Now *np, Obj *op));
-static void cir_sky P_((Now *np, double lpd, double psi, double rp, double *rho,
-                        double lam, double bet, double lsn, double rsn, Obj *op));
-static void cir_pos P_((Now *np, double bet, double lam, double *rho, Obj *op));
+static int obj_planet P_((AstroCtx *ac, Now *np, Obj *op));
+static int obj_fixed P_((AstroCtx *ac, Now *np, Obj *op));
+static int obj_elliptical P_((AstroCtx *ac, Now *np, Obj *op));
+static int obj_hyperbolic P_((AstroCtx *ac, Now *np, Obj *op));
+static int obj_parabolic P_((AstroCtx *ac, Now *np, Obj *op));
+static int sun_cir P_((AstroCtx *ac, Now *np, Obj *op));
+static int moon_cir P_((AstroCtx *ac, Now *np, Obj *op));
+static void cir_sky P_((AstroCtx *ac, Now *np, double lpd, double psi,
+                        double rp, double *rho, double lam, double bet, double lsn,
+                        double rsn, Obj *op));
+static void cir_pos P_((AstroCtx *ac, Now *np, double bet, double lam,
+                        double *rho, Obj *op));
 static void elongation P_((double lam, double bet, double lsn, double *el));
-static void deflect P_((double mjd1, double lpd, double psi, double rsn,
-                        double lsn, double rho, double *ra, double *dec));
+static void deflect P_((AstroCtx *ac, double mjd1, double lpd, double psi,
+                        double rsn, double lsn, double rho, double *ra,
+                        double *dec));
 static double h_albsize P_((double H));
 
+/* obj_cir_batch() tuning */
+#define CIRB_MINTHREAD  1024    /* fewest fixed objects worth threading */
+#define CIRB_MAXTHREAD  8       /* most threads */
+#define CIRB_NEPOCH     8       /* most distinct catalog epochs per batch */
+#define CIRB_BLK        256     /* objects per SoA block */
+
+/* the epoch-dependent state shared by all fixed objects in obj_cir_batch() */
+typedef struct
+{
+    Now *np;                    /* circumstances */
+    double lsn;                 /* true geoc lng of sun */
+    double ab[3];               /* aberration displacement, true equator */
+    double hmat[3][3];          /* true equator of date to alt/az */
+    int nep;                    /* distinct catalog epochs in use */
+    float ep[CIRB_NEPOCH];      /* each catalog epoch */
+    double pmat[CIRB_NEPOCH][3][3]; /* catalog to true equator of date */
+    double qmat[CIRB_NEPOCH][3][3]; /* catalog to mean ecliptic of date */
+} CirBatch;
+
+/* one thread's share of the fixed objects */
+typedef struct
+{
+    CirBatch *bp;               /* shared state */
+    Obj **opp;                  /* objects */
+    char *eix;                  /* index into bp->pmat/qmat for each */
+    char *redo;                 /* set if must use obj_fixed() after all */
+    int n;                      /* number of each */
+} CirBWork;
+
+static void cirb_mat P_((AstroCtx *ac, Now *np, int which, double arg,
+                         double m[3][3]));
+static void cirb_ab P_((AstroCtx *ac, Now *np, double lsn, double v[3]));
+static void cirb_mul P_((double a[3][3], double b[3][3], double c[3][3]));
+static void *cirb_work P_((void *wp));
+
 /* given a Now and an Obj, fill in the approprirate s_* fields within Obj.
  * return 0 if all ok, else -1.
  */
@@ -40,21 +80,34 @@ int
 obj_cir (np, op)
 Now *np;
 Obj *op;
+{
+    return (obj_cir_r (astro_defctx(), np, op));
+}
+
+/* same as obj_cir() but using context *ac.
+ * N.B. the moon and earth satellites are computed with per-thread scratch
+ *   storage so these too are safe from several threads at once.
+ */
+int
+obj_cir_r (ac, np, op)
+AstroCtx *ac;
+Now *np;
+Obj *op;
 {
     switch (op->o_type)
     {
         case FIXED:
-            return (obj_fixed (np, op));
+            return (obj_fixed (ac, np, op));
         case ELLIPTICAL:
-            return (obj_elliptical (np, op));
+            return (obj_elliptical (ac, np, op));
         case HYPERBOLIC:
-            return (obj_hyperbolic (np, op));
+            return (obj_hyperbolic (ac, np, op));
         case PARABOLIC:
-            return (obj_parabolic (np, op));
+            return (obj_parabolic (ac, np, op));
         case EARTHSAT:
-            return (obj_earthsat (np, op));
+            return (obj_earthsat_r (ac, np, op));
         case PLANET:
-            return (obj_planet (np, op));
+            return (obj_planet (ac, np, op));
         default:
             printf ("obj_cir() called with type %d\n", op->o_type);
             exit(1);
@@ -62,8 +115,374 @@ Obj *op;
     }
 }
 
+/* compute the s_* fields for the n objects at op[] all at the same *np.
+ * fixed objects share one set of precession, nutation, aberration and alt/az
+ *   transforms computed once here, applied to them a block at a time as unit
+ *   vectors, on several threads if there are many. others just use obj_cir().
+ * return 0 if all ok, else -1 if any failed.
+ */
+int
+obj_cir_batch (np, op, n)
+Now *np;
+Obj *op;
+int n;
+{
+    return (obj_cir_batch_r (astro_defctx(), np, op, n));
+}
+
+/* same as obj_cir_batch() but using context *ac */
+int
+obj_cir_batch_r (ac, np, op, n)
+AstroCtx *ac;
+Now *np;
+Obj *op;
+int n;
+{
+    pthread_t tid[CIRB_MAXTHREAD];
+    CirBWork work[CIRB_MAXTHREAD];
+    CirBatch b;
+    double nmat[3][3], emat[3][3];
+    double rsn;
+    Obj **fop = NULL;
+    char *eix = NULL, *redo = NULL;
+    int nfixed, nthr, i, t;
+    int ret = 0;
+
+    /* the non-fixed objects are done one at a time */
+    nfixed = 0;
+    for (i = 0; i < n; i++)
+    {
+        if (op[i].o_type == FIXED)
+            nfixed++;
+        else if (obj_cir_r (ac, np, &op[i]) < 0)
+            ret = -1;
+    }
+    if (nfixed == 0)
+        return (ret);
+
+    fop = (Obj **) malloc (nfixed * sizeof(Obj *));
+    eix = (char *) malloc (nfixed);
+    redo = (char *) calloc (nfixed, 1);
+    if (!fop || !eix || !redo)
+    {
+        /* just do it the slow way */
+        for (i = 0; i < n; i++)
+            if (op[i].o_type == FIXED && obj_fixed (ac, np, &op[i]) < 0)
+                ret = -1;
+        goto out;
+    }
+
+    /* shared transforms */
+    b.np = np;
+    sunpos_r (ac, mm_mjed_r(ac, np), &b.lsn, &rsn, NULL);
+    cirb_mat (ac, np, 1, 0.0, nmat);
+    cirb_mat (ac, np, 2, 0.0, emat);
+    cirb_mat (ac, np, 3, 0.0, b.hmat);
+    cirb_ab (ac, np, b.lsn, b.ab);
+    b.nep = 0;
+
+    /* collect the fixed objects, moving any to the desired epoch as does
+     * obj_fixed(), and find the transform for each catalog epoch.
+     */
+    nfixed = 0;
+    for (i = 0; i < n; i++)
+    {
+        Obj *fp = &op[i];
+        int e;
+
+        if (fp->o_type != FIXED)
+            continue;
+
+        if (epoch != EOD && (float)epoch != fp->f_epoch)
+        {
+            double tra = fp->f_RA, tdec = fp->f_dec;
+            float tepoch = (float)epoch;
+            precess_r (ac, fp->f_epoch, tepoch, &tra, &tdec);
+            fp->f_epoch = tepoch;
+            fp->f_RA = (float)tra;
+            fp->f_dec = (float)tdec;
+        }
+
+        for (e = 0; e < b.nep; e++)
+            if (b.ep[e] == fp->f_epoch)
+                break;
+        if (e == b.nep && e < CIRB_NEPOCH)
+        {
+            double pmat[3][3];
+
+            cirb_mat (ac, np, 0, fp->f_epoch, pmat);
+            cirb_mul (nmat, pmat, b.pmat[e]);
+            cirb_mul (emat, pmat, b.qmat[e]);
+            b.ep[e] = fp->f_epoch;
+            b.nep++;
+        }
+        if (e == CIRB_NEPOCH)
+        {
+            /* too many different epochs, just do this one alone */
+            if (obj_fixed (ac, np, fp) < 0)
+                ret = -1;
+            continue;
+        }
+
+        fop[nfixed] = fp;
+        eix[nfixed] = (char)e;
+        nfixed++;
+    }
+
+    /* split among threads if worth it */
+    nthr = 1;
+    if (nfixed >= CIRB_MINTHREAD)
+    {
+        long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+        nthr = ncpu < 1 ? 1 : (ncpu > CIRB_MAXTHREAD ? CIRB_MAXTHREAD : ncpu);
+        if (nthr > nfixed/(CIRB_MINTHREAD/4))
+            nthr = nfixed/(CIRB_MINTHREAD/4);
+    }
+    for (t = 0; t < nthr; t++)
+    {
+        int i0 = (int)((long)nfixed*t/nthr);
+        int i1 = (int)((long)nfixed*(t+1)/nthr);
+
+        work[t].bp = &b;
+        work[t].opp = fop + i0;
+        work[t].eix = eix + i0;
+        work[t].redo = redo + i0;
+        work[t].n = i1 - i0;
+    }
+    for (t = 1; t < nthr; t++)
+        if (pthread_create (&tid[t], NULL, cirb_work, (void *)&work[t]) != 0)
+            tid[t] = pthread_self();
+    cirb_work ((void *)&work[0]);
+    for (t = 1; t < nthr; t++)
+    {
+        if (pthread_equal (tid[t], pthread_self()))
+            cirb_work ((void *)&work[t]);
+        else
+            pthread_join (tid[t], NULL);
+    }
+
+    /* the few near the sun need light deflection, so do them the long way */
+    for (i = 0; i < nfixed; i++)
+        if (redo[i] && obj_fixed (ac, np, fop[i]) < 0)
+            ret = -1;
+
+out:
+    if (fop) free ((void *)fop);
+    if (eix) free ((void *)eix);
+    if (redo) free ((void *)redo);
+    return (ret);
+}
+
+/* find the linear transform m of unit vectors at *np equivalent to:
+ *   which 0: precess from catalog epoch arg to mjd, mean equator
+ *   which 1: nut_eq(), mean to true equator of date
+ *   which 2: eq_ecl(), mean equator to mean ecliptic of date
+ *   which 3: true equator of date to alt/az (x north, y east, z up)
+ * each is found by applying the scalar function to the three basis vectors so
+ *   the result agrees with it exactly.
+ */
+static void
+cirb_mat (ac, np, which, arg, m)
+AstroCtx *ac;
+Now *np;
+int which;
+double arg;
+double m[3][3];
+{
+    static double bra[3] = {0, PI/2, 0};
+    static double bdec[3] = {0, 0, PI/2};
+    double lst;
+    int k;
+
+    if (which == 3)
+        now_lst_r (ac, np, &lst);
+
+    for (k = 0; k < 3; k++)
+    {
+        double a = bra[k], d = bdec[k];
+        double x, y;
+
+        switch (which)
+        {
+            case 0:
+                precess_r (ac, arg, mjd, &a, &d);
+                break;
+            case 1:
+                nut_eq_r (ac, mjd, &a, &d);
+                break;
+            case 2:
+                eq_ecl_r (ac, mjd, a, d, &y, &x);
+                a = x;
+                d = y;
+                break;
+            case 3:
+                hadec_aa_r (ac, lat, hrrad(lst) - a, d, &y, &x);
+                a = x;
+                d = y;
+                break;
+        }
+
+        m[0][k] = cos(d)*cos(a);
+        m[1][k] = cos(d)*sin(a);
+        m[2][k] = sin(d);
+    }
+}
+
+/* ab_eq() is not a rotation but to first order it moves each unit vector p to
+ *   p + v - (p.v)p, with v the earth's velocity in units of c. find v at *np
+ *   with sun longitude lsn from what ab_eq() does at two points on the equator.
+ */
+static void
+cirb_ab (ac, np, lsn, v)
+AstroCtx *ac;
+Now *np;
+double lsn;
+double v[3];
+{
+    double ra, dec;
+
+    /* at ra 0 east is +y and north is +z; at ra 90 east is -x */
+    ra = 0; dec = 0;
+    ab_eq_r (ac, mjd, lsn, &ra, &dec);
+    if (ra > PI)
+        ra -= 2*PI;
+    v[1] = ra;
+    v[2] = dec;
+    ra = PI/2; dec = 0;
+    ab_eq_r (ac, mjd, lsn, &ra, &dec);
+    v[0] = -(ra - PI/2);
+}
+
+/* c = a * b */
+static void
+cirb_mul (a, b, c)
+double a[3][3], b[3][3], c[3][3];
+{
+    int i, j;
+
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+            c[i][j] = a[i][0]*b[0][j] + a[i][1]*b[1][j] + a[i][2]*b[2][j];
+}
+
+/* thread to reduce one CirBWork's share of fixed objects as per obj_fixed().
+ */
+static void *
+cirb_work (wp)
+void *wp;
+{
+    CirBWork *w = (CirBWork *)wp;
+    CirBatch *bp = w->bp;
+    Now *np = bp->np;
+    double x[CIRB_BLK], y[CIRB_BLK], z[CIRB_BLK];   /* catalog */
+    double ax[CIRB_BLK], ay[CIRB_BLK], az[CIRB_BLK];/* apparent */
+    double ex[CIRB_BLK], ey[CIRB_BLK], ez[CIRB_BLK];/* ecliptic */
+    double *ab = bp->ab;
+    int b0;
+
+    for (b0 = 0; b0 < w->n; b0 += CIRB_BLK)
+    {
+        int nb = w->n - b0 < CIRB_BLK ? w->n - b0 : CIRB_BLK;
+        Obj **opp = w->opp + b0;
+        char *eix = w->eix + b0;
+        int i;
+
+        /* unit vectors from catalog */
+        for (i = 0; i < nb; i++)
+        {
+            double ra = opp[i]->f_RA, dec = opp[i]->f_dec;
+            double cd = cos(dec);
+
+            x[i] = cd*cos(ra);
+            y[i] = cd*sin(ra);
+            z[i] = sin(dec);
+        }
+
+        /* rotate to true equator and to mean ecliptic of date */
+        for (i = 0; i < nb; i++)
+        {
+            double (*p)[3] = bp->pmat[(int)eix[i]];
+            double (*q)[3] = bp->qmat[(int)eix[i]];
+
+            ax[i] = p[0][0]*x[i] + p[0][1]*y[i] + p[0][2]*z[i];
+            ay[i] = p[1][0]*x[i] + p[1][1]*y[i] + p[1][2]*z[i];
+            az[i] = p[2][0]*x[i] + p[2][1]*y[i] + p[2][2]*z[i];
+            ex[i] = q[0][0]*x[i] + q[0][1]*y[i] + q[0][2]*z[i];
+            ey[i] = q[1][0]*x[i] + q[1][1]*y[i] + q[1][2]*z[i];
+            ez[i] = q[2][0]*x[i] + q[2][1]*y[i] + q[2][2]*z[i];
+        }
+
+        /* aberration */
+        for (i = 0; i < nb; i++)
+        {
+            double pv = ax[i]*ab[0] + ay[i]*ab[1] + az[i]*ab[2];
+            double r;
+
+            ax[i] += ab[0] - pv*ax[i];
+            ay[i] += ab[1] - pv*ay[i];
+            az[i] += ab[2] - pv*az[i];
+            r = sqrt(ax[i]*ax[i] + ay[i]*ay[i] + az[i]*az[i]);
+            ax[i] /= r;
+            ay[i] /= r;
+            az[i] /= r;
+        }
+
+        /* back to angles */
+        for (i = 0; i < nb; i++)
+        {
+            Obj *op = opp[i];
+            double (*h)[3] = bp->hmat;
+            double lam, bet, el, ra, dec, alt, azim, hx, hy, hz;
+
+            /* ecliptic lat/long for elongation and deflection test */
+            lam = atan2 (ey[i], ex[i]);
+            range (&lam, 2*PI);
+            bet = asin (ez[i] > 1 ? 1 : (ez[i] < -1 ? -1 : ez[i]));
+            elongation (lam, bet, bp->lsn-PI, &el);
+            el = fabs(el);
+            if (el >= degrad(170) && el <= degrad(179.75))
+            {
+                w->redo[b0+i] = 1;
+                continue;
+            }
+
+            ra = atan2 (ay[i], ax[i]);
+            range (&ra, 2*PI);
+            dec = asin (az[i]);
+            op->s_gaera = (float)ra;
+            op->s_gaedec = (float)dec;
+            if (epoch == EOD)
+            {
+                op->s_ra = (float)ra;
+                op->s_dec = (float)dec;
+            }
+            else
+            {
+                op->s_ra = op->f_RA;
+                op->s_dec = op->f_dec;
+            }
+
+            elongation (lam, bet, bp->lsn, &el);
+            op->s_elong = (float)raddeg(el);
+
+            hx = h[0][0]*ax[i] + h[0][1]*ay[i] + h[0][2]*az[i];
+            hy = h[1][0]*ax[i] + h[1][1]*ay[i] + h[1][2]*az[i];
+            hz = h[2][0]*ax[i] + h[2][1]*ay[i] + h[2][2]*az[i];
+            azim = atan2 (hy, hx);
+            range (&azim, 2*PI);
+            alt = asin (hz > 1 ? 1 : (hz < -1 ? -1 : hz));
+            refract (pressure, temp, alt, &alt);
+            op->s_alt = alt;
+            op->s_az = azim;
+        }
+    }
+
+    return (NULL);
+}
+
 static int
-obj_planet (np, op)
+obj_planet (ac, np, op)
+AstroCtx *ac;
 Now *np;
 Obj *op;
 {
@@ -84,20 +503,21 @@ Obj *op;
         exit(1);
     }
     else if (p == SUN)
-        return (sun_cir (np, op));
+        return (sun_cir (ac, np, op));
     else if (p == MOON)
-        return (moon_cir (np, op));
+        return (moon_cir (ac, np, op));
 
     /* find solar ecliptical longitude and distance to sun from earth */
-    sunpos (mjed, &lsn, &rsn, 0);
+    sunpos_r (ac, mm_mjed_r(ac, np), &lsn, &rsn, 0);
 
     /* find helio long/lat; sun/planet and earth/plant dist; ecliptic
      * long/lat; diameter and mag.
      */
-    plans(mjed, p, &lpd, &psi, &rp, &rho, &lam, &bet, &dia, &mag);
+    plans_r(ac, mm_mjed_r(ac, np), p, &lpd, &psi, &rp, &rho, &lam, &bet, &dia,
+            &mag);
 
     /* fill in all of op->s_* stuff except s_size and s_mag */
-    cir_sky (np, lpd, psi, rp, &rho, lam, bet, lsn, rsn, op);
+    cir_sky (ac, np, lpd, psi, rp, &rho, lam, bet, lsn, rsn, op);
 
     /* compute magnitude and angular size */
     f = op->s_phase ? 5*log10(rp*rho) - 5*log10(op->s_phase/100) : 100;
@@ -108,7 +528,8 @@ Obj *op;
 }
 
 static int
-obj_fixed (np, op)
+obj_fixed (ac, np, op)
+AstroCtx *ac;
 Now *np;
 Obj *op;
 {
@@ -128,7 +549,7 @@ Obj *op;
          */
         double tra = op->f_RA, tdec = op->f_dec;
         float tepoch = (float)epoch;    /* compare w/float precision */
-        precess (op->f_epoch, tepoch, &tra, &tdec);
+        precess_r (ac, op->f_epoch, tepoch, &tra, &tdec);
         op->f_epoch = tepoch;
         op->f_RA = (float)tra;
         op->f_dec = (float)tdec;
@@ -137,24 +558,24 @@ Obj *op;
     /* set ra/dec to astrometric @ epoch of date */
     ra = op->f_RA;
     dec = op->f_dec;
-    precess (op->f_epoch, mjd, &ra, &dec);
+    precess_r (ac, op->f_epoch, mjd, &ra, &dec);
 
     /* convert equatoreal ra/dec to mean geocentric ecliptic lat/long */
-    eq_ecl (mjd, ra, dec, &bet, &lam);
+    eq_ecl_r (ac, mjd, ra, dec, &bet, &lam);
 
     /* find solar ecliptical long.(mean equinox) and distance from earth */
-    sunpos (mjed, &lsn, &rsn, NULL);
+    sunpos_r (ac, mm_mjed_r(ac, np), &lsn, &rsn, NULL);
 
     /* allow for relativistic light bending near the sun */
-    deflect (mjd, lam, bet, lsn, rsn, 1e10, &ra, &dec);
+    deflect (ac, mjd, lam, bet, lsn, rsn, 1e10, &ra, &dec);
 
     /* TODO: correction for annual parallax would go here */
 
     /* correct EOD equatoreal for nutation/aberation to form apparent
      * geocentric
      */
-    nut_eq(mjd, &ra, &dec);
-    ab_eq(mjd, lsn, &ra, &dec);
+    nut_eq_r(ac, mjd, &ra, &dec);
+    ab_eq_r(ac, mjd, lsn, &ra, &dec);
     op->s_gaera = (float)ra;
     op->s_gaedec = (float)dec;
 
@@ -184,9 +605,9 @@ Obj *op;
     */
 
     /* alt, az: correct for refraction; use eod ra/dec. */
-    now_lst (np, &lst);
+    now_lst_r (ac, np, &lst);
     ha = hrrad(lst) - ra;
-    hadec_aa (lat, ha, dec, &alt, &az);
+    hadec_aa_r (ac, lat, ha, dec, &alt, &az);
     refract (pressure, temp, alt, &alt);
     op->s_alt = alt;
     op->s_az = az;
@@ -197,7 +618,8 @@ Obj *op;
 /* compute sky circumstances of an object in heliocentric elliptic orbit at *np.
  */
 static int
-obj_elliptical (np, op)
+obj_elliptical (ac, np, op)
+AstroCtx *ac;
 Now *np;
 Obj *op;
 {
@@ -226,7 +648,7 @@ Obj *op;
     int pass;
 
     /* find location of earth from sun now */
-    sunpos (mjed, &lsn, &rsn, 0);
+    sunpos_r (ac, mm_mjed_r(ac, np), &lsn, &rsn, 0);
     lg = lsn + PI;
 
     /* faster access to eccentricty */
@@ -247,7 +669,7 @@ Obj *op;
                          degrad (op->e_om), degrad (op->e_Om),
                          &inc, &om, &Om);
 
-        ma = degrad (op->e_M + (mjed - op->e_cepoch - dt) * e_n);
+        ma = degrad (op->e_M + (mm_mjed_r(ac, np) - op->e_cepoch - dt) * e_n);
         anomaly (ma, e, &nu, &ea);
         rp = op->e_a * (1-e*e) / (1+e*cos(nu));
         lo = nu + om;
@@ -280,7 +702,7 @@ Obj *op;
     bet = atan(rpd*spsi*sin(lam-lpd)/(cpsi*rsn*sll));
 
     /* fill in all of op->s_* stuff except s_size and s_mag */
-    cir_sky (np, lpd, psi, rp, &rho, lam, bet, lsn, rsn, op);
+    cir_sky (ac, np, lpd, psi, rp, &rho, lam, bet, lsn, rsn, op);
 
     /* compute magnitude and size */
     if (op->e_mag.whichm == MAG_HG)
@@ -310,7 +732,8 @@ Obj *op;
 /* compute sky circumstances of an object in heliocentric hyperbolic orbit.
  */
 static int
-obj_hyperbolic (np, op)
+obj_hyperbolic (ac, np, op)
+AstroCtx *ac;
 Now *np;
 Obj *op;
 {
@@ -340,7 +763,7 @@ Obj *op;
     int pass;
 
     /* find solar ecliptical longitude and distance to sun from earth */
-    sunpos (mjed, &lsn, &rsn, 0);
+    sunpos_r (ac, mm_mjed_r(ac, np), &lsn, &rsn, 0);
 
     lg = lsn + PI;
     e = op->h_e;
@@ -359,7 +782,7 @@ Obj *op;
                          degrad (op->h_om), degrad (op->h_Om),
                          &inc, &om, &Om);
 
-        ma = degrad ((mjed - op->h_ep - dt) * n);
+        ma = degrad ((mm_mjed_r(ac, np) - op->h_ep - dt) * n);
         anomaly (ma, e, &nu, &ea);
         rp = a * (e*e-1.0) / (1.0+e*cos(nu));
         lo = nu + om;
@@ -392,7 +815,7 @@ Obj *op;
     bet = atan(rpd*spsi*sin(lam-lpd)/(cpsi*rsn*sll));
 
     /* fill in all of op->s_* stuff except s_size and s_mag */
-    cir_sky (np, lpd, psi, rp, &rho, lam, bet, lsn, rsn, op);
+    cir_sky (ac, np, lpd, psi, rp, &rho, lam, bet, lsn, rsn, op);
 
     /* compute magnitude and size */
     gk_mag (op->h_g, op->h_k, rp, rho, &mag);
@@ -405,7 +828,8 @@ Obj *op;
 /* compute sky circumstances of an object in heliocentric hyperbolic orbit.
  */
 static int
-obj_parabolic (np, op)
+obj_parabolic (ac, np, op)
+AstroCtx *ac;
 Now *np;
 Obj *op;
 {
@@ -419,7 +843,7 @@ Obj *op;
     int pass;
 
     /* find solar ecliptical longitude and distance to sun from earth */
-    sunpos (mjed, &lsn, &rsn, 0);
+    sunpos_r (ac, mm_mjed_r(ac, np), &lsn, &rsn, 0);
 
     /* two passes to correct lam and bet for light travel time. */
     dt = 0.0;
@@ -427,13 +851,13 @@ Obj *op;
     {
         reduce_elements (op->p_epoch, mjd-dt, degrad(op->p_inc),
                          degrad(op->p_om), degrad(op->p_Om), &inc, &om, &Om);
-        comet (mjed-dt, op->p_ep, inc, om, op->p_qp, Om,
-               &lpd, &psi, &rp, &rho, &lam, &bet);
+        comet_r (ac, mm_mjed_r(ac, np)-dt, op->p_ep, inc, om, op->p_qp, Om,
+                 &lpd, &psi, &rp, &rho, &lam, &bet);
         dt = rho*LTAU/3600.0/24.0;  /* light travel time, in days / AU */
     }
 
     /* fill in all of op->s_* stuff except s_size and s_mag */
-    cir_sky (np, lpd, psi, rp, &rho, lam, bet, lsn, rsn, op);
+    cir_sky (ac, np, lpd, psi, rp, &rho, lam, bet, lsn, rsn, op);
 
     /* compute magnitude and size */
     gk_mag (op->p_g, op->p_k, rp, rho, &mag);
@@ -446,7 +870,8 @@ Obj *op;
 /* find sun's circumstances now.
  */
 static int
-sun_cir (np, op)
+sun_cir (ac, np, op)
+AstroCtx *ac;
 Now *np;
 Obj *op;
 {
@@ -454,7 +879,8 @@ Obj *op;
     double bsn;     /* true latitude beta of sun */
     double dhlong;
 
-    sunpos (mjed, &lsn, &rsn, &bsn);/* sun's true coordinates; mean ecl. */
+    /* sun's true coordinates; mean ecl. */
+    sunpos_r (ac, mm_mjed_r(ac, np), &lsn, &rsn, &bsn);
 
     op->s_sdist = 0.0;
     op->s_elong = 0.0;
@@ -466,7 +892,7 @@ Obj *op;
     op->s_hlat = (float)(-bsn);
 
     /* fill sun's ra/dec, alt/az in op */
-    cir_pos (np, bsn, lsn, &rsn, op);
+    cir_pos (ac, np, bsn, lsn, &rsn, op);
     op->s_edist = (float)rsn;
     op->s_size = (float)(raddeg(4.65242e-3/rsn)*3600*2);
 
@@ -476,7 +902,8 @@ Obj *op;
 /* find moon's circumstances now.
  */
 static int
-moon_cir (np, op)
+moon_cir (ac, np, op)
+AstroCtx *ac;
 Now *np;
 Obj *op;
 {
@@ -489,8 +916,9 @@ Obj *op;
     double md;      /* moon's mean anomaly */
     double i;
 
-    moon (mjed, &lam, &bet, &edistau, &ms, &md);    /* mean ecliptic & EOD*/
-    sunpos (mjed, &lsn, &rsn, NULL);        /* mean ecliptic & EOD*/
+    /* mean ecliptic & EOD */
+    moon (mm_mjed_r(ac, np), &lam, &bet, &edistau, &ms, &md);
+    sunpos_r (ac, mm_mjed_r(ac, np), &lsn, &rsn, NULL);
 
     op->s_hlong = (float)lam;       /* save geo in helio fields */
     op->s_hlat = (float)bet;
@@ -511,7 +939,7 @@ Obj *op;
     op->s_phase = (float)((1+cos(PI-el-degrad(i)))/2*100);
 
     /* fill moon's ra/dec, alt/az in op and update for topo dist */
-    cir_pos (np, bet, lam, &edistau, op);
+    cir_pos (ac, np, bet, lam, &edistau, op);
 
     op->s_edist = (float)edistau;
     op->s_size = (float)(3600*2.0*raddeg(asin(MRAD/MAU/edistau)));
@@ -524,7 +952,8 @@ Obj *op;
  * this is used for sol system objects (except sun and moon); never FIXED.
  */
 static void
-cir_sky (np, lpd, psi, rp, rho, lam, bet, lsn, rsn, op)
+cir_sky (ac, np, lpd, psi, rp, rho, lam, bet, lsn, rsn, op)
+AstroCtx *ac;
 Now *np;
 double lpd, psi;    /* heliocentric ecliptic long and lat */
 double rp;      /* dist from sun */
@@ -548,7 +977,7 @@ Obj *op;
     op->s_hlat = (float)psi;
 
     /* fill solar sys body's ra/dec, alt/az in op */
-    cir_pos (np, bet, lam, rho, op);        /* updates rho */
+    cir_pos (ac, np, bet, lam, rho, op);        /* updates rho */
 
     /* set earth/planet and sun/planet distance */
     op->s_edist = (float)(*rho);
@@ -582,7 +1011,8 @@ Obj *op;
  *   refract    --> alt/az  observed --> output
  */
 static void
-cir_pos (np, bet, lam, rho, op)
+cir_pos (ac, np, bet, lam, rho, op)
+AstroCtx *ac;
 Now *np;
 double bet, lam;/* geo lat/long (mean ecliptic of date) */
 double *rho;    /* in: geocentric dist in AU; out: geo- or topocentic dist */
@@ -599,34 +1029,34 @@ Obj *op;    /* object to set s_ra/dec as per epoch */
     double rho_topo;        /* topocentric distance in earth radii */
 
     /* convert to equatoreal [mean equator, with mean obliquity] */
-    ecl_eq (mjd, bet, lam, &ra, &dec);
+    ecl_eq_r (ac, mjd, bet, lam, &ra, &dec);
     tra = ra;   /* keep mean coordinates */
     tdec = dec;
 
     /* get sun position */
-    sunpos(mjed, &lsn, &rsn, NULL);
+    sunpos_r(ac, mm_mjed_r(ac, np), &lsn, &rsn, NULL);
 
     /* allow for relativistic light bending near the sun.
      * (avoid calling deflect() for the sun itself).
      */
     if (!is_planet(op,SUN) && !is_planet(op,MOON))
-        deflect (mjd, op->s_hlong, op->s_hlat, lsn, rsn, *rho, &ra, &dec);
+        deflect (ac, mjd, op->s_hlong, op->s_hlat, lsn, rsn, *rho, &ra, &dec);
 
     /* correct ra/dec to form geocentric apparent */
-    nut_eq (mjd, &ra, &dec);
+    nut_eq_r (ac, mjd, &ra, &dec);
     if (!is_planet(op,MOON))
-        ab_eq (mjd, lsn, &ra, &dec);
+        ab_eq_r (ac, mjd, lsn, &ra, &dec);
     op->s_gaera = (float)ra;
     op->s_gaedec = (float)dec;
 
     /* find parallax correction for equatoreal coords */
-    now_lst (np, &lst);
+    now_lst_r (ac, np, &lst);
     ha_in = hrrad(lst) - ra;
     rho_topo = *rho * MAU/ERAD;             /* convert to earth radii */
-    ta_par (ha_in, dec, lat, elev, &rho_topo, &ha_out, &dec_out);
+    ta_par_r (ac, ha_in, dec, lat, elev, &rho_topo, &ha_out, &dec_out);
 
     /* transform into alt/az and apply refraction */
-    hadec_aa (lat, ha_out, dec_out, &alt, &az);
+    hadec_aa_r (ac, lat, ha_out, dec_out, &alt, &az);
     refract (pressure, temp, alt, &alt);
     op->s_alt = alt;
     op->s_az = az;
@@ -659,7 +1089,7 @@ Obj *op;    /* object to set s_ra/dec as per epoch */
     {
         ra = tra + dra;
         dec = tdec + ddec;
-        precess (mjd, epoch, &ra, &dec);
+        precess_r (ac, mjd, epoch, &ra, &dec);
     }
     range(&ra, 2*PI);
     op->s_ra = (float)ra;
@@ -705,7 +1135,8 @@ double *el;
  * not the "inertial" J2000 frame.
  */
 static void
-deflect (mjd1, lpd, psi, lsn, rsn, rho, ra, dec)
+deflect (ac, mjd1, lpd, psi, lsn, rsn, rho, ra, dec)
+AstroCtx *ac;
 double mjd1;        /* epoch */
 double lpd, psi;    /* heliocentric ecliptical long / lat */
 double rsn, lsn;    /* distance and longitude of sun */
@@ -741,10 +1172,10 @@ double *ra, *dec;   /* geocentric equatoreal */
     /* get cartesian vectors */
     sphcart(*ra, *dec, rho, u, u+1, u+2);
 
-    ecl_eq(mjd1, psi, lpd, &hra, &hdec);
+    ecl_eq_r(ac, mjd1, psi, lpd, &hra, &hdec);
     sphcart(hra, hdec, 1.0, q, q+1, q+2);
 
-    ecl_eq(mjd1, 0.0, lsn-PI, &hra, &hdec);
+    ecl_eq_r(ac, mjd1, 0.0, lsn-PI, &hra, &hdec);
     sphcart(hra, hdec, 1.0, e, e+1, e+2);
 
     /* evaluate scalar products */
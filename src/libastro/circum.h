@@ -404,6 +404,29 @@ typedef struct
 #define RS_SETERR   (0x0200|RS_ERROR) /* error computing set */
 #define RS_TRANSERR (0x0400|RS_ERROR) /* error computing transit */
 
+/* one night's grid of times, from vis_night().
+ */
+typedef struct
+{
+    double vn_dusk;     /* mjd when evening twilight ends */
+    double vn_dawn;     /* mjd when morning twilight begins */
+    int vn_flags;       /* RS_* flags from finding them */
+    double vn_t0;       /* mjd of first grid step, at dusk */
+    double vn_dt;       /* grid step, days */
+    int vn_nt;          /* number of grid steps */
+} VisNight;
+
+/* one object's visibility through a night, from vis_objs().
+ */
+typedef struct
+{
+    RiseSet vi_rs;      /* rise, set and transit as from riset_cir() */
+    float vi_maxalt;    /* highest apparent altitude on the grid, rads */
+    float vi_moonsep;   /* angle from the moon at middle of night, rads */
+    int vi_up0;         /* first grid step at or above minalt, else -1 */
+    int vi_up1;         /* last grid step at or above minalt, else -1 */
+} VisInfo;
+
 #define is_type(op,m)   ((1<<(op)->o_type) & (m))
 #define is_planet(op,p) (is_type(op,PLANETM) && ((ObjPl *)op)->pl_code==(p))
 #define is_ssobj(op)    is_type(op,PLANETM|HYPERBOLICM|PARABOLICM|ELLIPTICALM)
@@ -429,12 +452,17 @@ extern void as_ap P_(( Now *np, double Mjd, double *rap, double *decp));
 
 /* aux.c */
 extern double mm_mjed P_((Now *np));
+extern double mm_mjed_r P_((AstroCtx *ac, Now *np));
 
 /* circum.c */
 extern int obj_cir P_((Now *np, Obj *op));
+extern int obj_cir_batch P_((Now *np, Obj *op, int n));
+extern int obj_cir_r P_((AstroCtx *ac, Now *np, Obj *op));
+extern int obj_cir_batch_r P_((AstroCtx *ac, Now *np, Obj *op, int n));
 
 /* earthsat.c */
 extern int obj_earthsat P_((Now *np, Obj *op));
+extern int obj_earthsat_r P_((AstroCtx *ac, Now *np, Obj *op));
 
 /* dbfmt.c */
 extern int db_crack_line P_((char s[], Obj *op, char whynot[]));
@@ -446,6 +474,7 @@ extern int db_tle P_((char *name, char *l1, char *l2, Obj *op));
 
 /* misc.c */
 extern void now_lst P_((Now *np, double *lstp));
+extern void now_lst_r P_((AstroCtx *ac, Now *np, double *lstp));
 extern void radec2ha P_((Now *np, double ra, double dec, double *hap));
 extern char *obj_description P_((Obj *op));
 extern int is_deepsky P_((Obj *op));
@@ -455,8 +484,17 @@ extern double moonPhase(Now* np);
 
 /* riset_cir.c */
 extern void riset_cir P_((Now *np, Obj *op, double dis, RiseSet *rp));
+extern void riset_cir_r P_((AstroCtx *ac, Now *np, Obj *op, double dis,
+                            RiseSet *rp));
 extern void twilight_cir P_((Now *np, double dis, double *dawn, double *dusk,
                              int *status));
+extern void twilight_cir_r P_((AstroCtx *ac, Now *np, double dis, double *dawn,
+                               double *dusk, int *status));
+
+/* visibility.c */
+extern int vis_night P_((Now *np, double dis, double step, VisNight *vp));
+extern int vis_objs P_((Now *np, VisNight *vp, Obj *op, int n, double dis,
+                        double minalt, VisInfo *vip, float *alt));
 
 
 /* For RCS Only -- Do Not Edit
@@ -33,6 +33,18 @@ comet (mjd, ep, inc, ap, qp, om, lpd, psi, rp, rho, lam, bet)
 double mjd;
 double ep, inc, ap, qp, om;
 double *lpd, *psi, *rp, *rho, *lam, *bet;
+{
+    comet_r (astro_defctx(), mjd, ep, inc, ap, qp, om, lpd, psi, rp, rho, lam,
+             bet);
+}
+
+/* same as comet() but using context *ac */
+void
+comet_r (ac, mjd, ep, inc, ap, qp, om, lpd, psi, rp, rho, lam, bet)
+AstroCtx *ac;
+double mjd;
+double ep, inc, ap, qp, om;
+double *lpd, *psi, *rp, *rho, *lam, *bet;
 {
     double w, s, s2;
     double l, sl, cl, y;
@@ -68,7 +80,7 @@ double *lpd, *psi, *rp, *rho, *lam, *bet;
     if (cl<0) *lpd += PI;
     range (lpd, 2*PI);
     rd = *rp * cpsi;
-    sunpos (mjd, &lsn, &rsn, 0);
+    sunpos_r (ac, mjd, &lsn, &rsn, 0);
     lg = lsn+PI;
     re = rsn;
     ll = *lpd - lg;
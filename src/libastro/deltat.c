@@ -74,6 +74,7 @@
  *   - replaced treatment after TABEND by linear extrapolation instead
  *  of second order version
  *   - installed lastmjd cache (made ans static)
+ *   - moved the cache into AstroCtx for deltat_r()
  *
  *   - no changes to table interpolation scheme and past extrapolations */
 
@@ -84,6 +85,8 @@
 #define TABEND 2006.0
 #define TABSIZ 387
 
+static double deltat_calc P_((double mjd));
+
 /* Note, Stephenson and Morrison's table starts at the year 1630.
  * The Chapronts' table does not agree with the Almanac prior to 1630.
  * The actual accuracy decreases rapidly prior to 1780.
@@ -163,20 +166,32 @@ static short dt[TABSIZ] =
  */
 double deltat(mjd)
 double mjd;
+{
+    return (deltat_r (astro_defctx(), mjd));
+}
+
+/* same as deltat() but using context *ac */
+double deltat_r(ac, mjd)
+AstroCtx *ac;
+double mjd;
+{
+    if (mjd != ac->dt_mjd)
+    {
+        ac->dt_ans = deltat_calc (mjd);
+        ac->dt_mjd = mjd;
+    }
+    return (ac->dt_ans);
+}
+
+static double deltat_calc(mjd)
+double mjd;
 {
     double Y;
     double p, B;
     int d[6];
     int i, iy, k;
     double floor();
-    static double ans;
-    static double lastmjd = -10000;
-
-    if (mjd == lastmjd)
-    {
-        return(ans);
-    }
-    lastmjd = mjd;
+    double ans;
 
     Y = 2000.0 + (mjd - J2000)/365.25;
 
@@ -102,29 +102,33 @@ static void GetPrecession P_((double SemiMajorAxis, double Eccentricity,
 #define SunRadius 695000
 #define SunSemiMajorAxis  149598845.0       /* Kilometers          */
 
+/* N.B. all the following are set up afresh for each obj_earthsat() call; they
+ * are per-thread so several threads may compute satellites at once.
+ */
+
 /*  Keplerian Elements and misc. data for the satellite              */
-static double  EpochDay;                   /* time of epoch                 */
-static double EpochMeanAnomaly;            /* Mean Anomaly at epoch         */
-static long EpochOrbitNum;                 /* Integer orbit # of epoch      */
-static double EpochRAAN;                   /* RAAN at epoch                 */
-static double epochMeanMotion;             /* Revolutions/day               */
-static double OrbitalDecay;                /* Revolutions/day^2             */
-static double EpochArgPerigee;             /* argument of perigee at epoch  */
-static double Eccentricity;
-static double Inclination;
+static _Thread_local double  EpochDay;     /* time of epoch                 */
+static _Thread_local double EpochMeanAnomaly;/* Mean Anomaly at epoch       */
+static _Thread_local long EpochOrbitNum;   /* Integer orbit # of epoch      */
+static _Thread_local double EpochRAAN;     /* RAAN at epoch                 */
+static _Thread_local double epochMeanMotion;/* Revolutions/day              */
+static _Thread_local double OrbitalDecay;  /* Revolutions/day^2             */
+static _Thread_local double EpochArgPerigee;/* argument of perigee at epoch */
+static _Thread_local double Eccentricity;
+static _Thread_local double Inclination;
 
 /* Site Parameters */
-static double SiteLat,SiteLong,SiteAltitude;
+static _Thread_local double SiteLat,SiteLong,SiteAltitude;
 
 
-static double SidDay,SidReference;  /* Date and sidereal time   */
+static _Thread_local double SidDay,SidReference;/* Date and sidereal time */
 
 /* Keplerian elements for the sun */
-static double SunEpochTime,SunInclination,SunRAAN,SunEccentricity,
-SunArgPerigee,SunMeanAnomaly,SunMeanMotion;
+static _Thread_local double SunEpochTime,SunInclination,SunRAAN,
+SunEccentricity,SunArgPerigee,SunMeanAnomaly,SunMeanMotion;
 
 /* values for shadow geometry */
-static double SinPenumbra,CosPenumbra;
+static _Thread_local double SinPenumbra,CosPenumbra;
 
 
 /* given a Now and an Obj with info about an earth satellite in the es_* fields
@@ -137,6 +141,16 @@ int
 obj_earthsat (np, op)
 Now *np;
 Obj *op;
+{
+    return (obj_earthsat_r (astro_defctx(), np, op));
+}
+
+/* same as obj_earthsat() but using context *ac */
+int
+obj_earthsat_r (ac, np, op)
+AstroCtx *ac;
+Now *np;
+Obj *op;
 {
     double Radius;              /* From geocenter                  */
     double SatX,SatY,SatZ;      /* In Right Ascension based system */
@@ -243,8 +257,8 @@ Obj *op;
     if (pref_get(PREF_EQUATORIAL) == PREF_TOPO)
     {
         double ha, lst;
-        aa_hadec (lat, (double)op->s_alt, (double)op->s_az, &ha, &dec);
-        now_lst (np, &lst);
+        aa_hadec_r (ac, lat, (double)op->s_alt, (double)op->s_az, &ha, &dec);
+        now_lst_r (ac, np, &lst);
         ra = hrrad(lst) - ha;
         range (&ra, 2*PI);
     }
@@ -254,7 +268,7 @@ Obj *op;
         dec = op->s_gaedec;
     }
     if (epoch != EOD)
-        precess (mjd, epoch, &ra, &dec);
+        precess_r (ac, mjd, epoch, &ra, &dec);
     op->s_ra = (float)ra;
     op->s_dec = (float)dec;
 
@@ -620,10 +634,12 @@ double *SiteX,*SiteY,*SiteZ,*SiteVX,*SiteVY;
 MAT3x3 SiteMatrix;
 
 {
-    static double G1,G2; /* Used to correct for flattening of the Earth */
-    static double CosLat,SinLat;
-    static double OldSiteLat = -100000;  /* Used to avoid unneccesary recomputation */
-    static double OldSiteElevation = -100000;
+    /* Used to correct for flattening of the Earth */
+    static _Thread_local double G1,G2;
+    static _Thread_local double CosLat,SinLat;
+    /* Used to avoid unneccesary recomputation */
+    static _Thread_local double OldSiteLat = -100000;
+    static _Thread_local double OldSiteElevation = -100000;
     double Lat;
     double SiteRA;  /* Right Ascension of site          */
     double CosRA,SinRA;
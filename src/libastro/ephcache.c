@@ -0,0 +1,601 @@
+/* ephc_setup() etc: cache of the Sun, Moon and planet positions as piecewise
+ *   Chebyshev polynomials, so moon(), plans() and sunpos() need not evaluate
+ *   their full series at every call while tracking or planning a night.
+ *
+ * Time is cut into spans of a given length aligned to a given mjd. Each span of
+ * each body is fit by a background thread the first time it is asked for, and
+ * again for the following span when asks reach the last tenth of one. Until a
+ * fit is ready the callers just compute the full series as always.
+ * A span is fit as equal segments each with one polynomial per value of
+ * degree EPHC_DEG, from the full series at the Chebyshev nodes. Every segment
+ * is then checked against the full series at the points midway between its
+ * nodes and at its ends; if any differs by more than half the tolerance the
+ * whole span is fit again with twice as many segments. Angles are in error by
+ * no more than tol radians, distances by no more than tol times themselves.
+ * A span which can not meet the tolerance even with EPHC_MAXSEG segments is
+ * never cached.
+ * Published fits are never changed so the readers only share a read lock with
+ * the thread adding and retiring them. All entry points are thread safe.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "P_.h"
+#include "astro.h"
+
+#define EPHC_DEG    12      /* degree of each polynomial */
+#define EPHC_N      (EPHC_DEG+1)    /* nodes, and coefficients, per segment */
+#define EPHC_NB     (MOON+1)        /* bodies, MERCURY .. MOON */
+#define EPHC_MAXV   6       /* most values of any body */
+#define EPHC_NTAB   2       /* spans kept per body */
+#define EPHC_MAXSEG 1024    /* most segments per span */
+#define EPHC_QLEN   32      /* max pending fits */
+
+/* kinds of value */
+#define EV_ANG      0       /* angle, 0 .. 2*PI */
+#define EV_LAT      1       /* angle, near 0 */
+#define EV_DIST     2       /* distance */
+
+/* one span of one body */
+typedef struct
+{
+    long k;                 /* span number */
+    double t0;              /* mjd at start of span */
+    double h;               /* segment length, days */
+    int nseg;               /* segments, or 0 if could not be fit */
+    double *c;              /* coefficients: nseg x nv x EPHC_N */
+} EphcTab;
+
+/* one pending fit */
+typedef struct
+{
+    int body;
+    long k;
+    int gen;
+} EphcJob;
+
+static int ephc_get P_((int body, double mjd, double v[]));
+static void ephc_want P_((int body, long k));
+static void ephc_full P_((AstroCtx *ac, int body, double mjd, double v[]));
+static EphcTab *ephc_fit P_((AstroCtx *ac, int body, long k, double t0,
+                             double span, double tol));
+static void *ephc_thread P_((void *dummy));
+
+/* values of each body, and the longest segment worth trying */
+static int ephc_nv[EPHC_NB] = {6, 6, 6, 6, 6, 6, 6, 6, 3, 5};
+static char ephc_kind[EPHC_NB][EPHC_MAXV] =
+{
+    /* planets: lpd0 psi0 rp0 rho0 lam bet */
+    {EV_ANG, EV_LAT, EV_DIST, EV_DIST, EV_ANG, EV_LAT},
+    {EV_ANG, EV_LAT, EV_DIST, EV_DIST, EV_ANG, EV_LAT},
+    {EV_ANG, EV_LAT, EV_DIST, EV_DIST, EV_ANG, EV_LAT},
+    {EV_ANG, EV_LAT, EV_DIST, EV_DIST, EV_ANG, EV_LAT},
+    {EV_ANG, EV_LAT, EV_DIST, EV_DIST, EV_ANG, EV_LAT},
+    {EV_ANG, EV_LAT, EV_DIST, EV_DIST, EV_ANG, EV_LAT},
+    {EV_ANG, EV_LAT, EV_DIST, EV_DIST, EV_ANG, EV_LAT},
+    {EV_ANG, EV_LAT, EV_DIST, EV_DIST, EV_ANG, EV_LAT},
+    /* sun: lsn rsn bsn */
+    {EV_ANG, EV_DIST, EV_LAT},
+    /* moon: lam bet rho msp mdp */
+    {EV_ANG, EV_LAT, EV_DIST, EV_ANG, EV_ANG},
+};
+static double ephc_hmax[EPHC_NB] = {2, 4, 8, 16, 16, 16, 16, 16, 8, 0.5};
+
+static pthread_rwlock_t ephclock = PTHREAD_RWLOCK_INITIALIZER;
+static double ephcmjd0;             /* spans start here .. */
+static double ephcspan;             /* .. and are this long, or 0 if off */
+static double ephctol;              /* error bound */
+static int ephcgen;                 /* changes with each setup */
+static EphcTab *ephctab[EPHC_NB][EPHC_NTAB];   /* published fits */
+
+static pthread_mutex_t ephcqlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ephcqcond = PTHREAD_COND_INITIALIZER;
+static EphcJob ephcq[EPHC_QLEN];    /* pending fits, oldest first */
+static int ephcqn;                  /* entries in ephcq[] */
+static int ephcbusy;                /* set while a fit is in progress */
+static EphcJob ephccur;             /* the fit in progress */
+static int ephcrunning;             /* set once thread is started */
+
+static _Thread_local int ephc_nocache;  /* set for this thread to bypass */
+
+/* cache positions for spans of span days starting at mjd0, good to tol.
+ * span 0 turns off the cache and discards all fits. fits for the previous
+ * setup are also discarded unless all three are the same.
+ * return 0 if ok, else -1 if span or tol is unreasonable.
+ */
+int
+ephc_setup (mjd0, span, tol)
+double mjd0, span, tol;
+{
+    EphcTab *old[EPHC_NB][EPHC_NTAB];
+    int b, i;
+
+    if (span < 0 || (span > 0 && tol <= 0))
+        return (-1);
+
+    pthread_rwlock_wrlock (&ephclock);
+    if (mjd0 == ephcmjd0 && span == ephcspan && tol == ephctol)
+    {
+        pthread_rwlock_unlock (&ephclock);
+        return (0);
+    }
+    ephcmjd0 = mjd0;
+    ephcspan = span;
+    ephctol = tol;
+    ephcgen++;
+    memcpy ((void *)old, (void *)ephctab, sizeof(old));
+    memset ((void *)ephctab, 0, sizeof(ephctab));
+    pthread_rwlock_unlock (&ephclock);
+
+    for (b = 0; b < EPHC_NB; b++)
+        for (i = 0; i < EPHC_NTAB; i++)
+            if (old[b][i])
+            {
+                if (old[b][i]->c)
+                    free ((void *)old[b][i]->c);
+                free ((void *)old[b][i]);
+            }
+
+    return (0);
+}
+
+/* set whether the calling thread bypasses the cache, as when it wants the
+ * full series to compare.
+ */
+void
+ephc_bypass (on)
+int on;
+{
+    ephc_nocache = on;
+}
+
+/* wait until all pending fits are finished.
+ */
+void
+ephc_sync ()
+{
+    pthread_mutex_lock (&ephcqlock);
+    while (ephcqn > 0 || ephcbusy)
+        pthread_cond_wait (&ephcqcond, &ephcqlock);
+    pthread_mutex_unlock (&ephcqlock);
+}
+
+/* as moon() from the cache.
+ * return 0 if found, else -1 and the caller must compute them.
+ */
+int
+ephc_moon (mjd, lam, bet, rho, msp, mdp)
+double mjd;
+double *lam, *bet, *rho, *msp, *mdp;
+{
+    double v[EPHC_MAXV];
+
+    if (ephc_get (MOON, mjd, v) < 0)
+        return (-1);
+    *lam = v[0];
+    *bet = v[1];
+    *rho = v[2];
+    *msp = v[3];
+    *mdp = v[4];
+    return (0);
+}
+
+/* as sunpos() from the cache; bsn may be NULL.
+ * return 0 if found, else -1 and the caller must compute them.
+ */
+int
+ephc_sun (mjd, lsn, rsn, bsn)
+double mjd;
+double *lsn, *rsn, *bsn;
+{
+    double v[EPHC_MAXV];
+
+    if (ephc_get (SUN, mjd, v) < 0)
+        return (-1);
+    *lsn = v[0];
+    *rsn = v[1];
+    if (bsn) *bsn = v[2];
+    return (0);
+}
+
+/* as plans() from the cache, less dia and mag.
+ * return 0 if found, else -1 and the caller must compute them.
+ */
+int
+ephc_plans (mjd, p, lpd0, psi0, rp0, rho0, lam, bet)
+double mjd;
+int p;
+double *lpd0, *psi0, *rp0, *rho0, *lam, *bet;
+{
+    double v[EPHC_MAXV];
+
+    if (p < MERCURY || p > PLUTO || ephc_get (p, mjd, v) < 0)
+        return (-1);
+    *lpd0 = v[0];
+    *psi0 = v[1];
+    *rp0 = v[2];
+    *rho0 = v[3];
+    *lam = v[4];
+    *bet = v[5];
+    return (0);
+}
+
+/* evaluate the values of body at mjd into v[] from its fit.
+ * if there is none yet ask for one; if near the end of the span also ask for
+ * the next.
+ * return 0 if found, else -1.
+ */
+static int
+ephc_get (body, mjd, v)
+int body;
+double mjd;
+double v[];
+{
+    EphcTab *tp = NULL;
+    long k;
+    int want = 0;
+    int i;
+
+    if (ephc_nocache)
+        return (-1);
+
+    pthread_rwlock_rdlock (&ephclock);
+    if (ephcspan == 0)
+    {
+        pthread_rwlock_unlock (&ephclock);
+        return (-1);
+    }
+
+    k = (long) floor ((mjd - ephcmjd0)/ephcspan);
+    for (i = 0; i < EPHC_NTAB; i++)
+        if (ephctab[body][i] && ephctab[body][i]->k == k)
+            tp = ephctab[body][i];
+
+    if (!tp)
+        want = 1;
+    else
+    {
+        double u = mjd - tp->t0;
+
+        if (u > 0.9*ephcspan)
+        {
+            want = 2;
+            for (i = 0; i < EPHC_NTAB; i++)
+                if (ephctab[body][i] && ephctab[body][i]->k == k+1)
+                    want = 0;
+        }
+
+        if (tp->nseg > 0)
+        {
+            int nv = ephc_nv[body];
+            int s = (int)(u/tp->h);
+            double x, *c;
+
+            if (s >= tp->nseg)
+                s = tp->nseg - 1;
+            x = 2*(u - s*tp->h)/tp->h - 1;
+            c = tp->c + (long)s*nv*EPHC_N;
+
+            /* Clenshaw */
+            for (i = 0; i < nv; i++, c += EPHC_N)
+            {
+                double b1 = 0, b2 = 0, t;
+                int j;
+
+                for (j = EPHC_N-1; j > 0; j--)
+                {
+                    t = 2*x*b1 - b2 + c[j];
+                    b2 = b1;
+                    b1 = t;
+                }
+                v[i] = x*b1 - b2 + c[0];
+                if (ephc_kind[body][i] == EV_ANG)
+                    range (&v[i], 2*PI);
+            }
+        }
+        else
+            tp = NULL;
+    }
+    pthread_rwlock_unlock (&ephclock);
+
+    if (want)
+        ephc_want (body, want == 1 ? k : k+1);
+
+    return (tp ? 0 : -1);
+}
+
+/* queue a fit of span k of body, unless it is already pending.
+ * if too many are pending the oldest is dropped.
+ */
+static void
+ephc_want (body, k)
+int body;
+long k;
+{
+    EphcJob *jp;
+    int gen, i;
+
+    pthread_rwlock_rdlock (&ephclock);
+    gen = ephcgen;
+    pthread_rwlock_unlock (&ephclock);
+
+    pthread_mutex_lock (&ephcqlock);
+
+    if (ephcbusy && ephccur.body == body && ephccur.k == k
+                                                && ephccur.gen == gen)
+    {
+        pthread_mutex_unlock (&ephcqlock);
+        return;
+    }
+    for (i = 0; i < ephcqn; i++)
+        if (ephcq[i].body == body && ephcq[i].k == k && ephcq[i].gen == gen)
+        {
+            pthread_mutex_unlock (&ephcqlock);
+            return;
+        }
+
+    if (!ephcrunning)
+    {
+        pthread_t t;
+        pthread_attr_t a;
+        int s;
+
+        pthread_attr_init (&a);
+        pthread_attr_setdetachstate (&a, PTHREAD_CREATE_DETACHED);
+        s = pthread_create (&t, &a, ephc_thread, NULL);
+        pthread_attr_destroy (&a);
+        if (s != 0)
+        {
+            /* just never cache */
+            pthread_mutex_unlock (&ephcqlock);
+            return;
+        }
+        ephcrunning = 1;
+    }
+
+    if (ephcqn == EPHC_QLEN)
+    {
+        memmove ((void *)&ephcq[0], (void *)&ephcq[1],
+                 (EPHC_QLEN-1)*sizeof(EphcJob));
+        ephcqn--;
+    }
+    jp = &ephcq[ephcqn++];
+    jp->body = body;
+    jp->k = k;
+    jp->gen = gen;
+
+    pthread_cond_broadcast (&ephcqcond);
+    pthread_mutex_unlock (&ephcqlock);
+}
+
+/* fit thread: fit each queued span and publish it in place of the one
+ * farthest from it, or of itself if fit twice.
+ */
+static void *
+ephc_thread (dummy)
+void *dummy;
+{
+    AstroCtx ac;
+
+    astro_ctx_init (&ac);
+    ephc_nocache = 1;
+
+    for (;;)
+    {
+        double mjd0, span, tol;
+        EphcTab *tp, *oldtp;
+        EphcJob j;
+        int gen, i;
+
+        pthread_mutex_lock (&ephcqlock);
+        while (ephcqn == 0)
+            pthread_cond_wait (&ephcqcond, &ephcqlock);
+        j = ephcq[0];
+        memmove ((void *)&ephcq[0], (void *)&ephcq[1],
+                 (--ephcqn)*sizeof(EphcJob));
+        ephccur = j;
+        ephcbusy = 1;
+        pthread_mutex_unlock (&ephcqlock);
+
+        pthread_rwlock_rdlock (&ephclock);
+        mjd0 = ephcmjd0;
+        span = ephcspan;
+        tol = ephctol;
+        gen = ephcgen;
+        pthread_rwlock_unlock (&ephclock);
+
+        tp = NULL;
+        if (j.gen == gen && span > 0)
+            tp = ephc_fit (&ac, j.body, j.k, mjd0 + j.k*span, span, tol);
+
+        oldtp = tp;
+        if (tp)
+        {
+            pthread_rwlock_wrlock (&ephclock);
+            if (gen == ephcgen)
+            {
+                EphcTab **tpp = &ephctab[j.body][0];
+                long far = -1;
+
+                for (i = 0; i < EPHC_NTAB; i++)
+                {
+                    EphcTab *p = ephctab[j.body][i];
+                    long d = !p ? LONG_MAX-1
+                               : p->k == j.k ? LONG_MAX : labs(p->k - j.k);
+
+                    if (d > far)
+                    {
+                        far = d;
+                        tpp = &ephctab[j.body][i];
+                    }
+                }
+                oldtp = *tpp;
+                *tpp = tp;
+            }
+            pthread_rwlock_unlock (&ephclock);
+        }
+        if (oldtp)
+        {
+            if (oldtp->c)
+                free ((void *)oldtp->c);
+            free ((void *)oldtp);
+        }
+
+        pthread_mutex_lock (&ephcqlock);
+        ephcbusy = 0;
+        pthread_cond_broadcast (&ephcqcond);
+        pthread_mutex_unlock (&ephcqlock);
+    }
+
+    return (NULL);
+}
+
+/* compute the full series values of body at mjd into v[].
+ */
+static void
+ephc_full (ac, body, mjd, v)
+AstroCtx *ac;
+int body;
+double mjd;
+double v[];
+{
+    double dia, mag;
+
+    switch (body)
+    {
+    case SUN:
+        sunpos_r (ac, mjd, &v[0], &v[1], &v[2]);
+        break;
+    case MOON:
+        moon (mjd, &v[0], &v[1], &v[2], &v[3], &v[4]);
+        break;
+    default:
+        plans_r (ac, mjd, body, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5],
+                 &dia, &mag);
+        break;
+    }
+}
+
+/* fit span k of body, starting at t0 and span days long, good to tol.
+ * return a new table, with nseg 0 if the tolerance can not be met, or NULL if
+ * no memory.
+ */
+static EphcTab *
+ephc_fit (ac, body, k, t0, span, tol)
+AstroCtx *ac;
+int body;
+long k;
+double t0, span, tol;
+{
+    int nv = ephc_nv[body];
+    EphcTab *tp;
+    int nseg;
+
+    tp = (EphcTab *) calloc (1, sizeof(EphcTab));
+    if (!tp)
+        return (NULL);
+    tp->k = k;
+    tp->t0 = t0;
+
+    nseg = (int) ceil (span/ephc_hmax[body]);
+    if (nseg < 1)
+        nseg = 1;
+
+    for (; nseg <= EPHC_MAXSEG; nseg *= 2)
+    {
+        double h = span/nseg;
+        double *c;
+        int s, ok = 1;
+
+        c = (double *) malloc ((long)nseg*nv*EPHC_N*sizeof(double));
+        if (!c)
+        {
+            free ((void *)tp);
+            return (NULL);
+        }
+
+        for (s = 0; ok && s < nseg; s++)
+        {
+            double f[EPHC_N][EPHC_MAXV];
+            double *cs = c + (long)s*nv*EPHC_N;
+            double tm = t0 + (s + 0.5)*h;
+            int i, j, m;
+
+            /* values at the nodes, angles kept continuous */
+            for (j = 0; j < EPHC_N; j++)
+            {
+                ephc_full (ac, body, tm + cos(PI*(j+0.5)/EPHC_N)*h/2, f[j]);
+                if (j > 0)
+                    for (i = 0; i < nv; i++)
+                        if (ephc_kind[body][i] == EV_ANG)
+                            f[j][i] += 2*PI*floor((f[j-1][i]-f[j][i])/(2*PI)
+                                                                    + 0.5);
+            }
+
+            /* coefficients */
+            for (i = 0; i < nv; i++)
+                for (m = 0; m < EPHC_N; m++)
+                {
+                    double sum = 0;
+
+                    for (j = 0; j < EPHC_N; j++)
+                        sum += f[j][i]*cos(PI*m*(j+0.5)/EPHC_N);
+                    cs[i*EPHC_N+m] = (m == 0 ? 1.0 : 2.0)*sum/EPHC_N;
+                }
+
+            /* check midway between the nodes and at both ends */
+            for (j = 0; j <= EPHC_N && ok; j++)
+            {
+                double v[EPHC_MAXV];
+                double x = j == EPHC_N ? -1 : cos(PI*j/EPHC_N);
+
+                ephc_full (ac, body, tm + x*h/2, v);
+                for (i = 0; i < nv; i++)
+                {
+                    double *ci = cs + i*EPHC_N;
+                    double b1 = 0, b2 = 0, t, e;
+
+                    for (m = EPHC_N-1; m > 0; m--)
+                    {
+                        t = 2*x*b1 - b2 + ci[m];
+                        b2 = b1;
+                        b1 = t;
+                    }
+                    e = v[i] - (x*b1 - b2 + ci[0]);
+                    switch (ephc_kind[body][i])
+                    {
+                    case EV_ANG:
+                        e -= 2*PI*floor(e/(2*PI) + 0.5);
+                        e = fabs(e);
+                        break;
+                    case EV_LAT:
+                        e = fabs(e);
+                        break;
+                    case EV_DIST:
+                        e = fabs(e/v[i]);
+                        break;
+                    }
+                    if (e > tol/2)
+                        ok = 0;
+                }
+            }
+        }
+
+        if (ok)
+        {
+            tp->nseg = nseg;
+            tp->h = h;
+            tp->c = c;
+            return (tp);
+        }
+        free ((void *)c);
+    }
+
+    /* can not be done */
+    return (tp);
+}
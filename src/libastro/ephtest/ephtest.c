@@ -0,0 +1,219 @@
+/* check the ephemeris cache against the full series over one span.
+ * see README.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "P_.h"
+#include "astro.h"
+
+#define NVMAX   6       /* most values of any body */
+
+static void one (int body, double mjd0, double span, double tol, int n);
+static void full (int body, double t, double v[]);
+static int cached (int body, double t, double v[]);
+static double nsecs (void);
+static void usage (void);
+
+static char *pname;
+
+/* names of each body and its values, '*' marking distances */
+static char *bname[MOON+1] =
+{
+    "Mercury", "Venus", "Mars", "Jupiter", "Saturn", "Uranus", "Neptune",
+    "Pluto", "Sun", "Moon"
+};
+static char *vname[MOON+1] =
+{
+    "lpd0 psi0 *rp0 *rho0 lam bet", "lpd0 psi0 *rp0 *rho0 lam bet",
+    "lpd0 psi0 *rp0 *rho0 lam bet", "lpd0 psi0 *rp0 *rho0 lam bet",
+    "lpd0 psi0 *rp0 *rho0 lam bet", "lpd0 psi0 *rp0 *rho0 lam bet",
+    "lpd0 psi0 *rp0 *rho0 lam bet", "lpd0 psi0 *rp0 *rho0 lam bet",
+    "lsn *rsn bsn", "lam bet *rho msp mdp"
+};
+
+int
+main (int ac, char *av[])
+{
+    double span = 1.0;          /* days */
+    double tolas = 0.001;       /* arcsec */
+    int n = 2000;               /* test times per body */
+    double mjd0;
+    int b;
+
+    pname = av[0];
+
+    while ((--ac > 0) && ((*++av)[0] == '-'))
+    {
+        char *s;
+        for (s = av[0]+1; *s != '\0'; s++)
+            switch (*s)
+            {
+                case 's':
+                    if (ac < 2)
+                        usage();
+                    span = atof (*++av);
+                    ac--;
+                    break;
+                case 't':
+                    if (ac < 2)
+                        usage();
+                    tolas = atof (*++av);
+                    ac--;
+                    break;
+                case 'n':
+                    if (ac < 2)
+                        usage();
+                    n = atoi (*++av);
+                    ac--;
+                    break;
+                default:
+                    usage();
+            }
+    }
+
+    /* ac remaining args starting at av[0] */
+    if (ac > 1 || span <= 0 || tolas <= 0 || n < 1)
+        usage();
+    mjd0 = ac == 1 ? atof (av[0]) : 25567.5 + time(NULL)/86400.0;
+
+    printf ("MJD %.5f + %g days, tolerance %g arcsec\n", mjd0, span, tolas);
+    if (ephc_setup (mjd0, span, degrad(tolas/3600.0)) < 0)
+    {
+        fprintf (stderr, "ephc_setup failed\n");
+        exit (1);
+    }
+
+    for (b = MERCURY; b <= MOON; b++)
+        one (b, mjd0, span, degrad(tolas/3600.0), n);
+
+    return (0);
+}
+
+/* fit body for the span starting at mjd0 then compare n times across it.
+ */
+static void
+one (int body, double mjd0, double span, double tol, int n)
+{
+    double emax[NVMAX];
+    double tfull = 0, tcache = 0, tfit;
+    char names[64], *vn[NVMAX];
+    int nv, nmiss = 0, ok = 1;
+    int i, j;
+
+    strcpy (names, vname[body]);
+    nv = 0;
+    for (vn[0] = strtok (names, " "); vn[nv]; vn[nv] = strtok (NULL, " "))
+        nv++;
+
+    /* ask for the span and wait for it */
+    tfit = nsecs();
+    (void) cached (body, mjd0, emax);
+    ephc_sync();
+    tfit = nsecs() - tfit;
+    for (i = 0; i < nv; i++)
+        emax[i] = 0;
+
+    for (j = 0; j < n; j++)
+    {
+        /* stay clear of the end so the next span is not fit too */
+        double t = mjd0 + 0.9*span*(j + 0.5)/n;
+        double vf[NVMAX], vc[NVMAX];
+        double t1;
+
+        t1 = nsecs();
+        full (body, t, vf);
+        tfull += nsecs() - t1;
+        t1 = nsecs();
+        if (cached (body, t, vc) < 0)
+        {
+            nmiss++;
+            continue;
+        }
+        tcache += nsecs() - t1;
+
+        for (i = 0; i < nv; i++)
+        {
+            double e = vc[i] - vf[i];
+
+            if (vn[i][0] == '*')
+                e /= vf[i];
+            else
+            {
+                e -= 2*PI*floor(e/(2*PI) + 0.5);
+                e = raddeg(e)*3600.0;
+            }
+            if (fabs(e) > emax[i])
+                emax[i] = fabs(e);
+        }
+    }
+
+    printf ("%-8s fit %7.1f ms, full %8.0f ns, cached %5.0f ns:", bname[body],
+            tfit/1e6, tfull/n, n > nmiss ? tcache/(n-nmiss) : 0.0);
+    for (i = 0; i < nv; i++)
+    {
+        double lim = vn[i][0] == '*' ? tol : raddeg(tol)*3600.0;
+
+        printf (" %s %.2e", vn[i][0] == '*' ? vn[i]+1 : vn[i], emax[i]);
+        if (emax[i] > lim)
+            ok = 0;
+    }
+    if (nmiss > 0)
+    {
+        printf (" %d misses", nmiss);
+        ok = 0;
+    }
+    printf (" %s\n", ok ? "ok" : "FAILED");
+}
+
+/* values of body at t from the full series */
+static void
+full (int body, double t, double v[])
+{
+    double dia, mag;
+
+    ephc_bypass (1);
+    if (body == SUN)
+        sunpos (t, &v[0], &v[1], &v[2]);
+    else if (body == MOON)
+        moon (t, &v[0], &v[1], &v[2], &v[3], &v[4]);
+    else
+        plans (t, body, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &dia, &mag);
+    ephc_bypass (0);
+}
+
+/* values of body at t from the cache, or -1 if not there */
+static int
+cached (int body, double t, double v[])
+{
+    if (body == SUN)
+        return (ephc_sun (t, &v[0], &v[1], &v[2]));
+    if (body == MOON)
+        return (ephc_moon (t, &v[0], &v[1], &v[2], &v[3], &v[4]));
+    return (ephc_plans (t, body, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]));
+}
+
+static double
+nsecs ()
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec*1e9 + ts.tv_nsec);
+}
+
+static void
+usage()
+{
+    fprintf (stderr, "%s: [options] [mjd]\n", pname);
+    fprintf (stderr, "  -s days: length of the span. default is 1\n");
+    fprintf (stderr, "  -t as  : tolerance, arcsec. default is .001\n");
+    fprintf (stderr, "  -n n   : times to compare per body. default is 2000\n");
+    fprintf (stderr, "mjd is the start of the span. default is now.\n");
+
+    exit (1);
+}
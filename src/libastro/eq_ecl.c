@@ -4,8 +4,8 @@
 #include "P_.h"
 #include "astro.h"
 
-static void ecleq_aux P_((int sw, double mjd, double x, double y,
-                          double *p, double *q));
+static void ecleq_aux P_((AstroCtx *ac, int sw, double mjd, double x,
+                          double y, double *p, double *q));
 
 #define EQtoECL 1
 #define ECLtoEQ (-1)
@@ -23,7 +23,18 @@ double mjd;
 double ra, dec;
 double *lat, *lng;
 {
-    ecleq_aux (EQtoECL, mjd, ra, dec, lng, lat);
+    ecleq_aux (astro_defctx(), EQtoECL, mjd, ra, dec, lng, lat);
+}
+
+/* same as eq_ecl() but using context *ac */
+void
+eq_ecl_r (ac, mjd, ra, dec, lat, lng)
+AstroCtx *ac;
+double mjd;
+double ra, dec;
+double *lat, *lng;
+{
+    ecleq_aux (ac, EQtoECL, mjd, ra, dec, lng, lat);
 }
 
 /* given the modified Julian date, mjd, and a geocentric ecliptic latitude,
@@ -38,28 +49,41 @@ double mjd;
 double lat, lng;
 double *ra, *dec;
 {
-    ecleq_aux (ECLtoEQ, mjd, lng, lat, ra, dec);
+    ecleq_aux (astro_defctx(), ECLtoEQ, mjd, lng, lat, ra, dec);
+}
+
+/* same as ecl_eq() but using context *ac */
+void
+ecl_eq_r (ac, mjd, lat, lng, ra, dec)
+AstroCtx *ac;
+double mjd;
+double lat, lng;
+double *ra, *dec;
+{
+    ecleq_aux (ac, ECLtoEQ, mjd, lng, lat, ra, dec);
 }
 
 static void
-ecleq_aux (sw, mjd, x, y, p, q)
+ecleq_aux (ac, sw, mjd, x, y, p, q)
+AstroCtx *ac;
 int sw;         /* +1 for eq to ecliptic, -1 for vv. */
 double mjd;
 double x, y;        /* sw==1: x==ra, y==dec.  sw==-1: x==lng, y==lat. */
 double *p, *q;      /* sw==1: p==lng, q==lat. sw==-1: p==ra, q==dec. */
 {
-    static double lastmjd = -10000; /* last mjd calculated */
-    static double seps, ceps;   /* sin and cos of mean obliquity */
+    double seps, ceps;  /* sin and cos of mean obliquity */
     double sx, cx, sy, cy, ty;
 
-    if (mjd != lastmjd)
+    if (mjd != ac->ecl_mjd)
     {
         double eps;
-        obliquity (mjd, &eps);      /* mean obliquity for date */
-        seps = sin(eps);
-        ceps = cos(eps);
-        lastmjd = mjd;
+        obliquity_r (ac, mjd, &eps);    /* mean obliquity for date */
+        ac->ecl_seps = sin(eps);
+        ac->ecl_ceps = cos(eps);
+        ac->ecl_mjd = mjd;
     }
+    seps = ac->ecl_seps;
+    ceps = ac->ecl_ceps;
 
     sy = sin(y);
     cy = cos(y);                /* always non-negative */
@@ -134,27 +134,36 @@ now_lst (np, lstp)
 Now *np;
 double *lstp;
 {
-    static double last_mjd = -23243, last_lng = 121212, last_lst;
+    now_lst_r (astro_defctx(), np, lstp);
+}
+
+/* same as now_lst() but using context *ac */
+void
+now_lst_r (ac, np, lstp)
+AstroCtx *ac;
+Now *np;
+double *lstp;
+{
     double eps, lst, deps, dpsi;
 
-    if (last_mjd == mjd && last_lng == lng)
+    if (ac->lst_mjd == mjd && ac->lst_lng == lng)
     {
-        *lstp = last_lst;
+        *lstp = ac->lst_lst;
         return;
     }
 
-    utc_gst (mjd_day(mjd), mjd_hr(mjd), &lst);
+    utc_gst_r (ac, mjd_day(mjd), mjd_hr(mjd), &lst);
     lst += radhr(lng);
 
-    obliquity(mjd, &eps);
-    nutation(mjd, &deps, &dpsi);
+    obliquity_r(ac, mjd, &eps);
+    nutation_r(ac, mjd, &deps, &dpsi);
     lst += radhr(dpsi*cos(eps+deps));
 
     range (&lst, 24.0);
 
-    last_mjd = mjd;
-    last_lng = lng;
-    *lstp = last_lst = lst;
+    ac->lst_mjd = mjd;
+    ac->lst_lng = lng;
+    *lstp = ac->lst_lst = lst;
 }
 
 /* convert ra to ha, in range -PI .. PI.
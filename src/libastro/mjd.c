@@ -1,4 +1,6 @@
-/* functions to manipulate the modified-julian-date used throughout xephem. */
+/* functions to manipulate the modified-julian-date used throughout xephem.
+ * these keep nothing between calls so any thread may use them.
+ */
 
 #include <stdio.h>
 #include <math.h>
@@ -16,17 +18,9 @@ int mn, yr;
 double dy;
 double *mjd;
 {
-    static double last_mjd, last_dy;
-    static int last_mn, last_yr;
     int b, d, m, y;
     long c;
 
-    if (mn == last_mn && yr == last_yr && dy == last_dy)
-    {
-        *mjd = last_mjd;
-        return;
-    }
-
     m = mn;
     y = (yr < 0) ? yr + 1 : yr;
     if (mn < 3)
@@ -52,11 +46,6 @@ double *mjd;
     d = (int)(30.6001*(m+1));
 
     *mjd = b + c + d + dy - 0.5;
-
-    last_mn = mn;
-    last_dy = dy;
-    last_yr = yr;
-    last_mjd = *mjd;
 }
 
 /* given the modified Julian date (number of days elapsed since 1900 jan 0.5,),
@@ -68,8 +57,6 @@ double mjd;
 int *mn, *yr;
 double *dy;
 {
-    static double last_mjd, last_dy;
-    static int last_mn, last_yr;
     double d, f;
     double i, a, b, ce, g;
 
@@ -84,14 +71,6 @@ double *dy;
         return;
     }
 
-    if (mjd == last_mjd)
-    {
-        *mn = last_mn;
-        *yr = last_yr;
-        *dy = last_dy;
-        return;
-    }
-
     d = mjd + 0.5;
     i = floor(d);
     f = d-i;
@@ -120,11 +99,6 @@ double *dy;
         *yr = (int)(b + 1900);
     if (*yr < 1)
         *yr -= 1;
-
-    last_mn = *mn;
-    last_dy = *dy;
-    last_yr = *yr;
-    last_mjd = mjd;
 }
 
 /* given an mjd, set *dow to 0..6 according to which day of the week it falls
@@ -199,25 +173,15 @@ mjd_year (mjd, yr)
 double mjd;
 double *yr;
 {
-    static double last_mjd, last_yr;
     int m, y;
     double d;
     double e0, e1;  /* mjd of start of this year, start of next year */
 
-    if (mjd == last_mjd)
-    {
-        *yr = last_yr;
-        return;
-    }
-
     mjd_cal (mjd, &m, &d, &y);
     if (y == -1) y = -2;
     cal_mjd (1, 1.0, y, &e0);
     cal_mjd (1, 1.0, y+1, &e1);
     *yr = y + (mjd - e0)/(e1 - e0);
-
-    last_mjd = mjd;
-    last_yr = *yr;
 }
 
 /* given a decimal year, return mjd */
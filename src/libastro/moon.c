@@ -101,19 +101,22 @@ static int gecmoon P_((double J, struct plantbl *lrtab,
 #define MOSHIER_END   (2798525.5 - MJD0) /* 2950.0; from libration table */
 
 
-static double Args[NARGS];
-static double LP_equinox;
-static double NF_arcsec;
-static double Ea_arcsec;
-static double pA_precession;
+/* N.B. the following are scratch for one moon() call; they are per-thread so
+ * several threads may compute the moon at once.
+ */
+static _Thread_local double Args[NARGS];
+static _Thread_local double LP_equinox;
+static _Thread_local double NF_arcsec;
+static _Thread_local double Ea_arcsec;
+static _Thread_local double pA_precession;
 
 
 /* This storage ought to be allocated dynamically.  */
-double ss[NARGS][30];
-double cc[NARGS][30];
+static _Thread_local double ss[NARGS][30];
+static _Thread_local double cc[NARGS][30];
 
 /* Time, in units of 10,000 Julian years from JED 2451545.0.  */
-static double T;
+static _Thread_local double T;
 
 /* Conversion factors between degrees and radians */
 #define DTR 1.7453292519943295769e-2
@@ -3461,6 +3464,7 @@ double *msp, *mdp;
  *   further correct for parallax and refraction.
  * NB:  Do NOT correct for aberration - the geocentric moon frame moves
  *  along with the earth.
+ * answered from the ephemeris cache when ephc_setup() has turned it on.
  */
 void
 moon (mjd, lam, bet, rho, msp, mdp)
@@ -3471,6 +3475,9 @@ double *msp, *mdp;
     double pobj[3], dt;
     double hp;
 
+    if (ephc_moon (mjd, lam, bet, rho, msp, mdp) == 0)
+        return;
+
     if (mjd >= MOSHIER_BEGIN && mjd <= MOSHIER_END)
     {
         /* retard for light time */
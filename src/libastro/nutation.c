@@ -280,20 +280,31 @@ double mjd;
 double *deps;   /* on input:  precision parameter in arc seconds */
 double *dpsi;
 {
-    static double lastmjd = -10000, lastdeps, lastdpsi;
+    nutation_r (astro_defctx(), mjd, deps, dpsi);
+}
+
+/* same as nutation() but using context *ac */
+void
+nutation_r (ac, mjd, deps, dpsi)
+AstroCtx *ac;
+double mjd;
+double *deps;   /* on input:  precision parameter in arc seconds */
+double *dpsi;
+{
+    double lastdeps, lastdpsi;
     double T, T2, T3, T10;          /* jul cent since J2000 */
     double prec;                /* series precis in arc sec */
     int i, isecul;              /* index in term table */
-    static double delcache[5][2*NUT_MAXMUL+1];
+    double delcache[5][2*NUT_MAXMUL+1];
     /* cache for multiples of delaunay args
      * [M',M,F,D,Om][-min*x, .. , 0, .., max*x]
-     * make static to have unfilled fields cleared on init
+     * every field is filled below before use
      */
 
-    if (mjd == lastmjd)
+    if (mjd == ac->nut_mjd)
     {
-        *deps = lastdeps;
-        *dpsi = lastdpsi;
+        *deps = ac->nut_deps;
+        *dpsi = ac->nut_dpsi;
         return;
     }
 
@@ -371,9 +382,9 @@ double *dpsi;
     lastdpsi = degrad(lastdpsi/3600./NUT_SCALE);
     lastdeps = degrad(lastdeps/3600./NUT_SCALE);
 
-    lastmjd = mjd;
-    *deps = lastdeps;
-    *dpsi = lastdpsi;
+    ac->nut_mjd = mjd;
+    *deps = ac->nut_deps = lastdeps;
+    *dpsi = ac->nut_dpsi = lastdpsi;
 }
 
 /* given the modified JD, mjd, correct, IN PLACE, the right ascension *ra
@@ -383,17 +394,25 @@ void
 nut_eq (mjd, ra, dec)
 double mjd, *ra, *dec;
 {
-    static double lastmjd = -10000;
-    static double a[3][3];      /* rotation matrix */
+    nut_eq_r (astro_defctx(), mjd, ra, dec);
+}
+
+/* same as nut_eq() but using context *ac */
+void
+nut_eq_r (ac, mjd, ra, dec)
+AstroCtx *ac;
+double mjd, *ra, *dec;
+{
+    double (*a)[3] = ac->nuq_a; /* rotation matrix */
     double xold, yold, zold, x, y, z;
 
-    if (mjd != lastmjd)
+    if (mjd != ac->nuq_mjd)
     {
         double epsilon, dpsi, deps;
         double se, ce, sp, cp, sede, cede;
 
-        obliquity(mjd, &epsilon);
-        nutation(mjd, &deps, &dpsi);
+        obliquity_r(ac, mjd, &epsilon);
+        nutation_r(ac, mjd, &deps, &dpsi);
 
         /* the rotation matrix a applies the nutation correction to
          * a vector of equatoreal coordinates Xeq to Xeq' by 3 subsequent
@@ -438,7 +457,7 @@ double mjd, *ra, *dec;
         a[2][1] = sede*cp*ce-cede*se;
         a[2][2] = sede*cp*se+cede*ce;
 
-        lastmjd = mjd;
+        ac->nuq_mjd = mjd;
     }
 
     sphcart(*ra, *dec, 1.0, &xold, &yold, &zold);
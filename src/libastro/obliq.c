@@ -13,18 +13,26 @@ obliquity (mjd, eps)
 double mjd;
 double *eps;
 {
-    static double lastmjd = -16347, lasteps;
+    obliquity_r (astro_defctx(), mjd, eps);
+}
 
-    if (mjd != lastmjd)
+/* same as obliquity() but using context *ac */
+void
+obliquity_r (ac, mjd, eps)
+AstroCtx *ac;
+double mjd;
+double *eps;
+{
+    if (mjd != ac->obl_mjd)
     {
         double t = (mjd - J2000)/36525.;    /* centuries from J2000 */
-        lasteps = degrad(23.4392911 +   /* 23^ 26' 21".448 */
-                         t * (-46.8150 +
-                              t * ( -0.00059 +
-                                    t * (  0.001813 )))/3600.0);
-        lastmjd = mjd;
+        ac->obl_eps = degrad(23.4392911 +   /* 23^ 26' 21".448 */
+                             t * (-46.8150 +
+                                  t * ( -0.00059 +
+                                        t * (  0.001813 )))/3600.0);
+        ac->obl_mjd = mjd;
     }
-    *eps = lasteps;
+    *eps = ac->obl_eps;
 }
 
 /* For RCS Only -- Do Not Edit */
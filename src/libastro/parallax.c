@@ -17,11 +17,20 @@ ta_par (tha, tdec, phi, ht, rho, aha, adec)
 double tha, tdec, phi, ht, *rho;
 double *aha, *adec;
 {
-    static double last_phi = 1000.0, last_ht = -1000.0, xobs, zobs;
+    ta_par_r (astro_defctx(), tha, tdec, phi, ht, rho, aha, adec);
+}
+
+/* same as ta_par() but using context *ac */
+void
+ta_par_r (ac, tha, tdec, phi, ht, rho, aha, adec)
+AstroCtx *ac;
+double tha, tdec, phi, ht, *rho;
+double *aha, *adec;
+{
     double x, y, z; /* obj cartesian coord, in Earth radii */
 
     /* avoid calcs involving the same phi and ht */
-    if (phi != last_phi || ht != last_ht)
+    if (phi != ac->par_phi || ht != ac->par_ht)
     {
         double cphi, sphi, robs, e2 = (2 - 1/298.257)/298.257;
         cphi = cos(phi);
@@ -29,14 +38,14 @@ double *aha, *adec;
         robs = 1/sqrt(1 - e2 * sphi * sphi);
 
         /* observer coordinates: x to meridian, y east, z north */
-        xobs = (robs + ht) * cphi;
-        zobs = (robs*(1-e2) + ht) * sphi;
-        last_phi  =  phi;
-        last_ht  =  ht;
+        ac->par_xobs = (robs + ht) * cphi;
+        ac->par_zobs = (robs*(1-e2) + ht) * sphi;
+        ac->par_phi  =  phi;
+        ac->par_ht  =  ht;
     }
 
     sphcart(-tha, tdec, *rho, &x, &y, &z);
-    cartsph(x - xobs, y, z - zobs, aha, adec, rho);
+    cartsph(x - ac->par_xobs, y, z - ac->par_zobs, aha, adec, rho);
     *aha *= -1;
     range (aha, 2*PI);
 }
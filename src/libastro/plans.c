@@ -10,8 +10,9 @@
 #include "chap95.h"
 
 static void pluto_ell P_((double mjd, double *ret));
-static void chap_trans P_((double mjd, double *ret));
-static void planpos P_((double mjd, int obj, double prec, double *ret));
+static void chap_trans P_((AstroCtx *ac, double mjd, double *ret));
+static void planpos P_((AstroCtx *ac, double mjd, int obj, double prec,
+                        double *ret));
 
 /* coordinate transformation
  * from:
@@ -20,7 +21,8 @@ static void planpos P_((double mjd, int obj, double prec, double *ret));
  *  mean equinox of date spherical ecliptical   ret[{0,1,2}] = {l,b,r}
  */
 static void
-chap_trans (mjd, ret)
+chap_trans (ac, mjd, ret)
+AstroCtx *ac;
 double mjd; /* destination epoch */
 double *ret;    /* vector to be transformed _IN PLACE_ */
 {
@@ -28,8 +30,8 @@ double *ret;    /* vector to be transformed _IN PLACE_ */
     double sr, cr, sd, cd, se, ce;
 
     cartsph(ret[0], ret[1], ret[2], &ra, &dec, &r);
-    precess(J2000, mjd, &ra, &dec);
-    obliquity(mjd, &eps);
+    precess_r(ac, J2000, mjd, &ra, &dec);
+    obliquity_r(ac, mjd, &eps);
     sr = sin(ra);
     cr = cos(ra);
     sd = sin(dec);
@@ -83,7 +85,8 @@ double *ret;    /* ecliptic coordinates {l,b,r} at equinox of date */
  * (not corrected for light-time)
  */
 static void
-planpos (mjd, obj, prec, ret)
+planpos (ac, mjd, obj, prec, ret)
+AstroCtx *ac;
 double mjd;
 int obj;
 double prec;
@@ -94,7 +97,7 @@ double *ret;
         if (obj >= JUPITER)         /* prefer Chapront */
         {
             chap95(mjd, obj, prec, ret);
-            chap_trans (mjd, ret);
+            chap_trans (ac, mjd, ret);
         }
         else                  /* VSOP for inner planets */
         {
@@ -152,6 +155,8 @@ static double vis_elements[8][2] =
  *   and DEC calculated from the fully-corrected ecliptic coordinates are then
  *   the apparent geocentric coordinates. Further corrections can be made, if
  *   required, for atmospheric refraction and geocentric parallax.
+ *
+ * answered from the ephemeris cache when ephc_setup() has turned it on.
  */
 void
 plans (mjd, p, lpd0, psi0, rp0, rho0, lam, bet, dia, mag)
@@ -159,21 +164,43 @@ double mjd;
 int p;
 double *lpd0, *psi0, *rp0, *rho0, *lam, *bet, *dia, *mag;
 {
-    static double lastmjd = -10000;
-    static double lsn, bsn, rsn;    /* geometric geocentric coords of sun */
-    static double xsn, ysn, zsn;
+    plans_r (astro_defctx(), mjd, p, lpd0, psi0, rp0, rho0, lam, bet, dia,
+             mag);
+}
+
+/* same as plans() but using context *ac */
+void
+plans_r (ac, mjd, p, lpd0, psi0, rp0, rho0, lam, bet, dia, mag)
+AstroCtx *ac;
+double mjd;
+int p;
+double *lpd0, *psi0, *rp0, *rho0, *lam, *bet, *dia, *mag;
+{
+    double xsn, ysn, zsn;       /* geometric geocentric coords of sun */
     double lp, bp, rp;      /* heliocentric coords of planet */
     double xp, yp, zp, rho;     /* rect. coords and geocentric dist. */
     double dt;          /* light time */
     int pass;
 
+    if (ephc_plans (mjd, p, lpd0, psi0, rp0, rho0, lam, bet) == 0)
+    {
+        *dia = vis_elements[p][0];
+        *mag = vis_elements[p][1];
+        return;
+    }
+
     /* get sun cartesian; needed only once at mjd */
-    if (mjd != lastmjd)
+    if (mjd != ac->pl_mjd)
     {
-        sunpos (mjd, &lsn, &rsn, &bsn);
-        sphcart (lsn, bsn, rsn, &xsn, &ysn, &zsn);
-        lastmjd = mjd;
+        double lsn, bsn, rsn;
+
+        sunpos_r (ac, mjd, &lsn, &rsn, &bsn);
+        sphcart (lsn, bsn, rsn, &ac->pl_xsn, &ac->pl_ysn, &ac->pl_zsn);
+        ac->pl_mjd = mjd;
     }
+    xsn = ac->pl_xsn;
+    ysn = ac->pl_ysn;
+    zsn = ac->pl_zsn;
 
     /* first find the true position of the planet at mjd.
      * then repeat a second time for a slightly different time based
@@ -189,7 +216,7 @@ double *lpd0, *psi0, *rp0, *rho0, *lam, *bet, *dia, *mag;
          * retarded for light time in second pass;
          * alternative option:  vsop allows calculating rates.
          */
-        planpos(mjd - dt, p, 0.0, ret);
+        planpos(ac, mjd - dt, p, 0.0, ret);
 
         lp = ret[0];
         bp = ret[1];
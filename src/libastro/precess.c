@@ -4,8 +4,8 @@
 #include "P_.h"
 #include "astro.h"
 
-static void precess_hiprec P_((double mjd1, double mjd2, double *ra,
-                               double *dec));
+static void precess_hiprec P_((AstroCtx *ac, double mjd1, double mjd2,
+                               double *ra, double *dec));
 
 
 #define DCOS(x)     cos(degrad(x))
@@ -22,7 +22,17 @@ precess (mjd1, mjd2, ra, dec)
 double mjd1, mjd2;  /* initial and final epoch modified JDs */
 double *ra, *dec;   /* ra/dec for mjd1 in, for mjd2 out */
 {
-    precess_hiprec (mjd1, mjd2, ra, dec);
+    precess_hiprec (astro_defctx(), mjd1, mjd2, ra, dec);
+}
+
+/* same as precess() but using context *ac */
+void
+precess_r (ac, mjd1, mjd2, ra, dec)
+AstroCtx *ac;
+double mjd1, mjd2;  /* initial and final epoch modified JDs */
+double *ra, *dec;   /* ra/dec for mjd1 in, for mjd2 out */
+{
+    precess_hiprec (ac, mjd1, mjd2, ra, dec);
 }
 
 /*
@@ -41,12 +51,11 @@ double *ra, *dec;   /* ra/dec for mjd1 in, for mjd2 out */
  * 96-06-20 Hayo Hase <hase@wettzell.ifag.de>: theta_a corrected
  */
 static void
-precess_hiprec (mjd1, mjd2, ra, dec)
+precess_hiprec (ac, mjd1, mjd2, ra, dec)
+AstroCtx *ac;
 double mjd1, mjd2;  /* initial and final epoch modified JDs */
 double *ra, *dec;   /* ra/dec for mjd1 in, for mjd2 out */
 {
-    static double last_mjd1 = -213.432, last_from;
-    static double last_mjd2 = -213.432, last_to;
     double zeta_A, z_A, theta_A;
     double T;
     double A, B, C;
@@ -58,21 +67,21 @@ double *ra, *dec;   /* ra/dec for mjd1 in, for mjd2 out */
     /* convert mjds to years;
      * avoid the remarkably expensive calls to mjd_year()
      */
-    if (last_mjd1 == mjd1)
-        from_equinox = last_from;
+    if (ac->pre_mjd1 == mjd1)
+        from_equinox = ac->pre_yr1;
     else
     {
         mjd_year (mjd1, &from_equinox);
-        last_mjd1 = mjd1;
-        last_from = from_equinox;
+        ac->pre_mjd1 = mjd1;
+        ac->pre_yr1 = from_equinox;
     }
-    if (last_mjd2 == mjd2)
-        to_equinox = last_to;
+    if (ac->pre_mjd2 == mjd2)
+        to_equinox = ac->pre_yr2;
     else
     {
         mjd_year (mjd2, &to_equinox);
-        last_mjd2 = mjd2;
-        last_to = to_equinox;
+        ac->pre_mjd2 = mjd2;
+        ac->pre_yr2 = to_equinox;
     }
 
     /* convert coords in rads to degs */
@@ -3,7 +3,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-#include "../satspec.h"
+#include "satspec.h"
 
 static void extract(char *str1, char *str2, int start, int n)
 {
@@ -209,7 +209,7 @@ static int tle_checksum(char *str)
 int readtle(char *line1, char *line2, SatElem *elem)
 {
     int fel;
-    unsigned int yr, launch, piece, catno, elnum, ephtype, orbit;
+    unsigned int yr, launch, piece = 0, catno, elnum, ephtype, orbit;
     double tmp;
     char epoch_yr[4];
     char epoch_frac[16];
@@ -539,7 +539,9 @@ int writetle(SatElem *el, char *line1, char *line2)
 
     sprintf(tmpstr, "%+10.8f", dtmp);
 
+#ifdef TLE_DEBUG
     printf("tmpstr = \"%s\"\n", tmpstr);
+#endif
 
     if (tmpstr[0] == '-')
         line1[33] = '-';
@@ -550,7 +552,9 @@ int writetle(SatElem *el, char *line1, char *line2)
 
     dtmp = el->se_XNDD60 / TWOPI * XMNPDA * XMNPDA * XMNPDA;
 
+#ifdef TLE_DEBUG
     printf("dtmp = %f\n", dtmp);
+#endif
     writeexp(dtmp, tmpstr);
 
     sprintf(line1 + 43, " %-8.8s", tmpstr);
@@ -561,7 +565,9 @@ int writetle(SatElem *el, char *line1, char *line2)
 
     sprintf(line1 + 61, " %1.1d", el->se_id.ephtype);
 
+#ifdef TLE_DEBUG
     printf("elnum = %d\n", el->se_id.elnum);
+#endif
     sprintf(line1 + 63, "  %3.3d", el->se_id.elnum);
 
     /*
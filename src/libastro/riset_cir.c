@@ -13,11 +13,13 @@
 
 #define TMACC   (10./3600./24.0)    /* convergence accuracy, days */
 
-static void e_riset_cir P_((Now *np, Obj *op, double dis, RiseSet *rp));
-static int find_0alt P_((double dt, double dis, Now *np, Obj *op));
-static int find_transit P_((double dt, Now *np, Obj *op));
-static int find_max P_((Now *np, Obj *op, double tr, double ts, double *tp,
-                        double *alp));
+static void e_riset_cir P_((AstroCtx *ac, Now *np, Obj *op, double dis,
+                            RiseSet *rp));
+static int find_0alt P_((AstroCtx *ac, double dt, double dis, Now *np,
+                         Obj *op));
+static int find_transit P_((AstroCtx *ac, double dt, Now *np, Obj *op));
+static int find_max P_((AstroCtx *ac, Now *np, Obj *op, double tr, double ts,
+                        double *tp, double *alp));
 
 /* find where and when an object, op, will rise and set and
  *   it's transit circumstances. all times are utc mjd, angles rads e of n.
@@ -30,6 +32,18 @@ Now *np;
 Obj *op;
 double dis;
 RiseSet *rp;
+{
+    riset_cir_r (astro_defctx(), np, op, dis, rp);
+}
+
+/* same as riset_cir() but using context *ac */
+void
+riset_cir_r (ac, np, op, dis, rp)
+AstroCtx *ac;
+Now *np;
+Obj *op;
+double dis;
+RiseSet *rp;
 {
     double mjdn;    /* mjd of local noon */
     double lstn;    /* lst at local noon */
@@ -50,7 +64,7 @@ RiseSet *rp;
      */
     if (op->o_type == EARTHSAT && op->es_n > FAST_SAT_RPD)
     {
-        e_riset_cir (&n, &o, dis, rp);
+        e_riset_cir (ac, &n, &o, dis, rp);
         return;
     }
 
@@ -60,7 +74,7 @@ RiseSet *rp;
     /* start the iteration at local noon */
     mjdn = mjd_day(mjd - tz/24.0) + tz/24.0 + 0.5;
     n.n_mjd = mjdn;
-    now_lst (&n, &lstn);
+    now_lst_r (ac, &n, &lstn);
 
     /* first approximation is to find rise/set times of a fixed object
      * at the current epoch in its position at local noon.
@@ -68,7 +82,7 @@ RiseSet *rp;
      *   passes, real code does refraction rigorously.
      */
     n.n_mjd = mjdn;
-    if (obj_cir (&n, &o) < 0)
+    if (obj_cir_r (ac, &n, &o) < 0)
     {
         rp->rs_flags = RS_ERROR;
         return;
@@ -92,7 +106,7 @@ RiseSet *rp;
 
     /* iterate to find better rise time */
     n.n_mjd = mjdn;
-    switch (find_0alt ((lr - lstn)/SIDRATE, dis, &n, &o))
+    switch (find_0alt (ac, (lr - lstn)/SIDRATE, dis, &n, &o))
     {
         case 0: /* ok */
             rp->rs_risetm = n.n_mjd;
@@ -109,7 +123,7 @@ RiseSet *rp;
 
     /* iterate to find better set time */
     n.n_mjd = mjdn;
-    switch (find_0alt ((ls - lstn)/SIDRATE, dis, &n, &o))
+    switch (find_0alt (ac, (ls - lstn)/SIDRATE, dis, &n, &o))
     {
         case 0: /* ok */
             rp->rs_settm = n.n_mjd;
@@ -127,7 +141,7 @@ RiseSet *rp;
     /* can try transit even if rise or set failed */
 dotransit:
     n.n_mjd = mjdn;
-    switch (find_transit ((radhr(ran) - lstn)/SIDRATE, &n, &o))
+    switch (find_transit (ac, (radhr(ran) - lstn)/SIDRATE, &n, &o))
     {
         case 0: /* ok */
             rp->rs_trantm = n.n_mjd;
@@ -159,6 +173,18 @@ Now *np;
 double dis;
 double *dawn, *dusk;
 int *status;
+{
+    twilight_cir_r (astro_defctx(), np, dis, dawn, dusk, status);
+}
+
+/* same as twilight_cir() but using context *ac */
+void
+twilight_cir_r (ac, np, dis, dawn, dusk, status)
+AstroCtx *ac;
+Now *np;
+double dis;
+double *dawn, *dusk;
+int *status;
 {
     RiseSet rs;
     Obj o;
@@ -166,7 +192,7 @@ int *status;
     o.o_type = PLANET;
     o.pl.pl_code = SUN;
     (void) strcpy (o.o_name, "Sun");
-    riset_cir (np, &o, dis, &rs);
+    riset_cir_r (ac, np, &o, dis, &rs);
     *dawn = rs.rs_risetm;
     *dusk = rs.rs_settm;
     *status = rs.rs_flags;
@@ -181,7 +207,8 @@ int *status;
  * N.B. we assume *np and *op are working copies we can mess up.
  */
 static void
-e_riset_cir (np, op, dis, rp)
+e_riset_cir (ac, np, op, dis, rp)
+AstroCtx *ac;
 Now *np;
 Obj *op;
 double dis;
@@ -200,7 +227,7 @@ RiseSet *rp;
     rise = set = 0;
     rp->rs_flags = 0;
 
-    if (obj_cir (np, op) < 0)
+    if (obj_cir_r (ac, np, op) < 0)
     {
         rp->rs_flags |= RS_ERROR;
         return;
@@ -212,7 +239,7 @@ RiseSet *rp;
     for (i = 0; i < steps && (!rise || !set); i++)
     {
         mjd = t1 = t0 + dt;
-        if (obj_cir (np, op) < 0)
+        if (obj_cir_r (ac, np, op) < 0)
         {
             rp->rs_flags |= RS_ERROR;
             return;
@@ -222,7 +249,7 @@ RiseSet *rp;
         if (a0 < 0 && a1 > 0 && !rise)
         {
             /* found a rise event -- interate to refine */
-            switch (find_0alt (0.0, dis, np, op))
+            switch (find_0alt (ac, 0.0, dis, np, op))
             {
                 case 0: /* ok */
                     rp->rs_risetm = np->n_mjd;
@@ -241,7 +268,7 @@ RiseSet *rp;
         else if (a0 > 0 && a1 < 0 && !set)
         {
             /* found a setting event -- interate to refine */
-            switch (find_0alt (0.0, dis, np, op))
+            switch (find_0alt (ac, 0.0, dis, np, op))
             {
                 case 0: /* ok */
                     rp->rs_settm = np->n_mjd;
@@ -269,7 +296,7 @@ RiseSet *rp;
     if (rise && set && rp->rs_risetm < rp->rs_settm)
     {
         double tt, al;
-        if (find_max (np, op, rp->rs_risetm, rp->rs_settm, &tt, &al) < 0)
+        if (find_max (ac, np, op, rp->rs_risetm, rp->rs_settm, &tt, &al) < 0)
         {
             rp->rs_flags |= RS_TRANSERR;
             return;
@@ -306,7 +333,8 @@ RiseSet *rp;
  * return -3: if does not converge at all (probably circumpolar or never up);
  */
 static int
-find_0alt (dt, dis, np, op)
+find_0alt (ac, dt, dis, np, op)
+AstroCtx *ac;
 double dt;  /* hours from noon to first guess at event */
 double dis; /* horizon displacement, rads */
 Now *np;    /* working Now -- starts with mjd is noon, returns as answer */
@@ -335,7 +363,7 @@ Obj *op;    /* working object -- returns as answer */
         double a1;
 
         mjd += dt;
-        if (obj_cir (np, op) < 0)
+        if (obj_cir_r (ac, np, op) < 0)
             return (-1);
         a1 = op->s_alt;
 
@@ -361,7 +389,8 @@ Obj *op;    /* working object -- returns as answer */
  * N.B. we assume np is passed set to local noon.
  */
 static int
-find_transit (dt, np, op)
+find_transit (ac, dt, np, op)
+AstroCtx *ac;
 double dt;
 Now *np;
 Obj *op;
@@ -382,9 +411,9 @@ Obj *op;
     do
     {
         mjd += dt/24.0;
-        if (obj_cir (np, op) < 0)
+        if (obj_cir_r (ac, np, op) < 0)
             return (-1);
-        now_lst (np, &lst);
+        now_lst_r (ac, np, &lst);
         dt = (radhr(op->s_gaera) - lst);
         if (dt < -12.0)
             dt += 24.0;
@@ -408,14 +437,15 @@ Obj *op;
  * return 0 if ok, else -1.
  */
 static int
-find_max (np, op, tr, ts, tp, alp)
+find_max (ac, np, op, tr, ts, tp, alp)
+AstroCtx *ac;
 Now *np;
 Obj *op;
 double tr, ts;      /* times of rise and set */
 double *tp, *alp;   /* time of max altitude, and that altitude */
 {
     mjd = (ts + tr)/2;
-    if (obj_cir (np, op) < 0)
+    if (obj_cir_r (ac, np, op) < 0)
         return (-1);
     *tp = mjd;
     *alp = op->s_alt;
@@ -0,0 +1,474 @@
+/* satb_new() etc: propagate a whole catalog of element sets at once.
+ *
+ * sgp4() and sdp4() work on one SatData at a time and obj_earthsat() sets one
+ * up afresh for each call, so screening thousands of satellites at each of
+ * many times redoes all the initialization every time. Here each element set
+ * is initialized once by satb_new(). The near-earth ones, which are nearly
+ * all of a typical catalog, are then kept as one array per SGP4 term so
+ * satb_prop() can run each stage of the model down all of them in turn; the
+ * deep-space ones each keep their own SatData for sdp4(). Large catalogs are
+ * split among threads.
+ *
+ * The near-earth arithmetic is that of sgp4() step for step, so the results
+ * are the same to the last bit when both are compiled alike. A deep-space
+ * satellite continues its resonance integration from the time of the previous
+ * call rather than from epoch, which may differ from a fresh sdp4() by well
+ * under a millimeter.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "P_.h"
+#include "sattypes.h"
+#include "vector.h"
+#include "satspec.h"
+
+#define SATB_MINTHREAD  1024    /* fewest satellites worth threading */
+#define SATB_MAXTHREAD  8       /* most threads */
+#define SATB_BLK        256     /* satellites per block */
+
+#define CK2  (5.413080e-04)
+#define E6A (1.E-6)
+#define TWOPI (6.2831853)
+#define XKE (.743669161E-1)
+#define XMNPDA (1440.0)
+
+/* same test for deep space as esat_prop() */
+#define SATB_DEEP(sep)  ((sep)->se_XNO < (1.0/225.0))
+
+/* the near-earth terms, one array each */
+enum
+{
+    NT_XMO, NT_XNODEO, NT_OMEGAO, NT_EO, NT_XINCL, NT_BSTAR, NT_EPOCH,
+    NT_SIMPLE, NT_AODP, NT_AYCOF, NT_C1, NT_C4, NT_C5, NT_COSIO, NT_D2, NT_D3,
+    NT_D4, NT_DELMO, NT_ETA, NT_OMGCOF, NT_OMGDOT, NT_SINIO, NT_SINMO, NT_T2COF,
+    NT_T3COF, NT_T4COF, NT_T5COF, NT_X1MTH2, NT_X3THM1, NT_X7THM1, NT_XLCOF,
+    NT_XMCOF, NT_XMDOT, NT_XNODCF, NT_XNODOT, NT_XNODP,
+    NT_N
+};
+
+struct _SatBatch
+{
+    int n;                  /* total satellites */
+    int nnear;              /* near-earth satellites .. */
+    int *nix;               /* .. their index in the caller's list */
+    double *nt[NT_N];       /* .. and their terms, nnear each */
+    int ndeep;              /* deep-space satellites .. */
+    int *dix;               /* .. their index in the caller's list */
+    SatElem *delem;         /* .. their elements */
+    SatData *dsat;          /* .. and their SatData */
+    double *depoch;         /* .. and their epochs, mjd */
+};
+
+/* what one thread does for satb_prop() */
+typedef struct
+{
+    SatBatch *bp;
+    double mjd;             /* time to propagate to */
+    int n0, n1;             /* range of near-earth satellites */
+    int d0, d1;             /* range of deep-space satellites */
+    Vec3 *pos, *dpos;       /* results, by caller's index */
+} SatBWork;
+
+static void *satb_work P_((void *wp));
+
+/* convert an element set epoch, packed as yr*1000 + day of year, to mjd.
+ * yr is years since 1900, or just the last two digits of the year in which
+ * case 0 .. 49 are taken to be 2000 .. 2049.
+ */
+double
+satb_epoch (EPOCH)
+double EPOCH;
+{
+    int yr = (int)((EPOCH + 2E-7) / 1000);
+    double dy = EPOCH - yr * 1000;
+
+    yr %= 100;
+    if (yr < 50)
+        yr += 100;
+
+    /* mjd 0 is 1899 Dec 31 noon; 1900 was not a leap year */
+    return (365.0*yr + (yr-1)/4 - 0.5 + dy);
+}
+
+/* prepare the n element sets in el[] for satb_prop().
+ * return a new SatBatch, or NULL if no memory.
+ */
+SatBatch *
+satb_new (el, n)
+SatElem *el;
+int n;
+{
+    SatBatch *bp;
+    int nd, i, j, k;
+
+    bp = (SatBatch *) calloc (1, sizeof(SatBatch));
+    if (!bp)
+        return (NULL);
+
+    for (nd = i = 0; i < n; i++)
+        nd += SATB_DEEP(&el[i]);
+    bp->n = n;
+    bp->nnear = n - nd;
+    bp->ndeep = nd;
+    bp->nix = (int *) malloc ((bp->nnear+1)*sizeof(int));
+    bp->nt[0] = (double *) malloc ((NT_N*bp->nnear+1)*sizeof(double));
+    bp->dix = (int *) malloc ((nd+1)*sizeof(int));
+    bp->delem = (SatElem *) malloc ((nd+1)*sizeof(SatElem));
+    bp->dsat = (SatData *) calloc (nd+1, sizeof(SatData));
+    bp->depoch = (double *) malloc ((nd+1)*sizeof(double));
+    if (!bp->nix || !bp->nt[0] || !bp->dix || !bp->delem || !bp->dsat
+                                                            || !bp->depoch)
+    {
+        satb_free (bp);
+        return (NULL);
+    }
+    for (k = 1; k < NT_N; k++)
+        bp->nt[k] = bp->nt[0] + k*bp->nnear;
+
+    for (i = j = k = 0; i < n; i++)
+    {
+        SatElem *sep = &el[i];
+
+        if (SATB_DEEP(sep))
+        {
+            SatData *sp = &bp->dsat[k];
+            Vec3 pos, dpos;
+
+            bp->dix[k] = i;
+            bp->delem[k] = *sep;
+            bp->depoch[k] = satb_epoch (sep->se_EPOCH);
+            sp->elem = &bp->delem[k];
+            sdp4 (sp, &pos, &dpos, 0.0);
+            k++;
+        }
+        else
+        {
+            struct sgp4_data *gp;
+            double **nt = bp->nt;
+            SatData sd;
+            Vec3 pos, dpos;
+
+            /* let sgp4() work out the terms */
+            memset ((void *)&sd, 0, sizeof(sd));
+            sd.elem = sep;
+            sgp4 (&sd, &pos, &dpos, 0.0);
+            gp = sd.prop.sgp4;
+
+            bp->nix[j] = i;
+            nt[NT_XMO][j] = sep->se_XMO;
+            nt[NT_XNODEO][j] = sep->se_XNODEO;
+            nt[NT_OMEGAO][j] = sep->se_OMEGAO;
+            nt[NT_EO][j] = sep->se_EO;
+            nt[NT_XINCL][j] = sep->se_XINCL;
+            nt[NT_BSTAR][j] = sep->se_BSTAR;
+            nt[NT_EPOCH][j] = satb_epoch (sep->se_EPOCH);
+            nt[NT_SIMPLE][j] = (gp->sgp4_flags & SGP4_SIMPLE) ? 1 : 0;
+            nt[NT_AODP][j] = gp->sgp4_AODP;
+            nt[NT_AYCOF][j] = gp->sgp4_AYCOF;
+            nt[NT_C1][j] = gp->sgp4_C1;
+            nt[NT_C4][j] = gp->sgp4_C4;
+            nt[NT_C5][j] = gp->sgp4_C5;
+            nt[NT_COSIO][j] = gp->sgp4_COSIO;
+            nt[NT_D2][j] = gp->sgp4_D2;
+            nt[NT_D3][j] = gp->sgp4_D3;
+            nt[NT_D4][j] = gp->sgp4_D4;
+            nt[NT_DELMO][j] = gp->sgp4_DELMO;
+            nt[NT_ETA][j] = gp->sgp4_ETA;
+            nt[NT_OMGCOF][j] = gp->sgp4_OMGCOF;
+            nt[NT_OMGDOT][j] = gp->sgp4_OMGDOT;
+            nt[NT_SINIO][j] = gp->sgp4_SINIO;
+            nt[NT_SINMO][j] = gp->sgp4_SINMO;
+            nt[NT_T2COF][j] = gp->sgp4_T2COF;
+            nt[NT_T3COF][j] = gp->sgp4_T3COF;
+            nt[NT_T4COF][j] = gp->sgp4_T4COF;
+            nt[NT_T5COF][j] = gp->sgp4_T5COF;
+            nt[NT_X1MTH2][j] = gp->sgp4_X1MTH2;
+            nt[NT_X3THM1][j] = gp->sgp4_X3THM1;
+            nt[NT_X7THM1][j] = gp->sgp4_X7THM1;
+            nt[NT_XLCOF][j] = gp->sgp4_XLCOF;
+            nt[NT_XMCOF][j] = gp->sgp4_XMCOF;
+            nt[NT_XMDOT][j] = gp->sgp4_XMDOT;
+            nt[NT_XNODCF][j] = gp->sgp4_XNODCF;
+            nt[NT_XNODOT][j] = gp->sgp4_XNODOT;
+            nt[NT_XNODP][j] = gp->sgp4_XNODP;
+            free ((void *)gp);
+            j++;
+        }
+    }
+
+    return (bp);
+}
+
+/* free a SatBatch from satb_new().
+ */
+void
+satb_free (bp)
+SatBatch *bp;
+{
+    int k;
+
+    if (!bp)
+        return;
+    if (bp->dsat)
+        for (k = 0; k < bp->ndeep; k++)
+        {
+            if (bp->dsat[k].prop.sdp4)
+                free ((void *)bp->dsat[k].prop.sdp4);
+            if (bp->dsat[k].deep)
+                free ((void *)bp->dsat[k].deep);
+        }
+    if (bp->nix) free ((void *)bp->nix);
+    if (bp->nt[0]) free ((void *)bp->nt[0]);
+    if (bp->dix) free ((void *)bp->dix);
+    if (bp->delem) free ((void *)bp->delem);
+    if (bp->dsat) free ((void *)bp->dsat);
+    if (bp->depoch) free ((void *)bp->depoch);
+    free ((void *)bp);
+}
+
+/* return the number of satellites in bp.
+ */
+int
+satb_n (bp)
+SatBatch *bp;
+{
+    return (bp->n);
+}
+
+/* find the position and velocity of each satellite in bp at mjd, in the same
+ * order and units as sgp4(), ie, earth radii and earth radii per minute.
+ * dpos may be NULL if velocities are not wanted.
+ */
+void
+satb_prop (bp, mjd, pos, dpos)
+SatBatch *bp;
+double mjd;
+Vec3 *pos, *dpos;
+{
+    pthread_t tid[SATB_MAXTHREAD];
+    SatBWork work[SATB_MAXTHREAD];
+    int nthr, t;
+
+    /* split among threads if worth it */
+    nthr = 1;
+    if (bp->n >= SATB_MINTHREAD)
+    {
+        long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+        nthr = ncpu < 1 ? 1 : (ncpu > SATB_MAXTHREAD ? SATB_MAXTHREAD : ncpu);
+        if (nthr > bp->n/(SATB_MINTHREAD/4))
+            nthr = bp->n/(SATB_MINTHREAD/4);
+    }
+    for (t = 0; t < nthr; t++)
+    {
+        work[t].bp = bp;
+        work[t].mjd = mjd;
+        work[t].n0 = (int)((long)bp->nnear*t/nthr);
+        work[t].n1 = (int)((long)bp->nnear*(t+1)/nthr);
+        work[t].d0 = (int)((long)bp->ndeep*t/nthr);
+        work[t].d1 = (int)((long)bp->ndeep*(t+1)/nthr);
+        work[t].pos = pos;
+        work[t].dpos = dpos;
+    }
+    for (t = 1; t < nthr; t++)
+        if (pthread_create (&tid[t], NULL, satb_work, (void *)&work[t]) != 0)
+            tid[t] = pthread_self();
+    satb_work ((void *)&work[0]);
+    for (t = 1; t < nthr; t++)
+    {
+        if (pthread_equal (tid[t], pthread_self()))
+            satb_work ((void *)&work[t]);
+        else
+            pthread_join (tid[t], NULL);
+    }
+}
+
+/* propagate the satellites given by *wp.
+ * the near-earth ones are done SATB_BLK at a time, each stage of sgp4() down
+ * the whole block before the next.
+ */
+static void *
+satb_work (wp)
+void *wp;
+{
+    SatBWork *w = (SatBWork *)wp;
+    SatBatch *bp = w->bp;
+    double **nt = bp->nt;
+    double A[SATB_BLK], E[SATB_BLK], XLT[SATB_BLK];
+    double XNODE[SATB_BLK], AXN[SATB_BLK], AYN[SATB_BLK], XN[SATB_BLK];
+    double SINEPW[SATB_BLK], COSEPW[SATB_BLK];
+    int b, k;
+
+    for (b = w->n0; b < w->n1; b += SATB_BLK)
+    {
+        int nb = w->n1 - b < SATB_BLK ? w->n1 - b : SATB_BLK;
+        int i;
+
+        /* secular gravity, atmospheric drag and long period periodics */
+        for (i = 0; i < nb; i++)
+        {
+            int j = b + i;
+            double TSINCE = (w->mjd - nt[NT_EPOCH][j]) * XMNPDA;
+            double XMDF, OMGADF, XNODDF, OMEGA, XMP, TSQ, TEMPA, TEMPE, TEMPL;
+            double XL, BETA, TEMP, XLL, AYNL;
+
+            XMDF = nt[NT_XMO][j] + nt[NT_XMDOT][j] * TSINCE;
+            OMGADF = nt[NT_OMEGAO][j] + nt[NT_OMGDOT][j] * TSINCE;
+            XNODDF = nt[NT_XNODEO][j] + nt[NT_XNODOT][j] * TSINCE;
+            OMEGA = OMGADF;
+            XMP = XMDF;
+            TSQ = TSINCE * TSINCE;
+            XNODE[i] = XNODDF + nt[NT_XNODCF][j] * TSQ;
+            TEMPA = 1.0 - nt[NT_C1][j] * TSINCE;
+            TEMPE = nt[NT_BSTAR][j] * nt[NT_C4][j] * TSINCE;
+            TEMPL = nt[NT_T2COF][j] * TSQ;
+            if (!nt[NT_SIMPLE][j])
+            {
+                double DELOMG, DELM, TCUBE, TFOUR;
+
+                DELOMG = nt[NT_OMGCOF][j] * TSINCE;
+                DELM = nt[NT_XMCOF][j] * (pow(1.0 + nt[NT_ETA][j] * cos(XMDF), 3)
+                                          - nt[NT_DELMO][j]);
+                TEMP = DELOMG + DELM;
+                XMP = XMDF + TEMP;
+                OMEGA = OMGADF - TEMP;
+                TCUBE = TSQ * TSINCE;
+                TFOUR = TSINCE * TCUBE;
+                TEMPA = TEMPA - nt[NT_D2][j] * TSQ - nt[NT_D3][j] * TCUBE
+                        - nt[NT_D4][j] * TFOUR;
+                TEMPE = TEMPE + nt[NT_BSTAR][j] * nt[NT_C5][j]
+                        * (sin(XMP) - nt[NT_SINMO][j]);
+                TEMPL = TEMPL + nt[NT_T3COF][j] * TCUBE
+                        + TFOUR * (nt[NT_T4COF][j] + TSINCE * nt[NT_T5COF][j]);
+            }
+
+            A[i] = nt[NT_AODP][j] * TEMPA * TEMPA;
+            E[i] = nt[NT_EO][j] - TEMPE;
+            XL = XMP + OMEGA + XNODE[i] + nt[NT_XNODP][j] * TEMPL;
+            BETA = sqrt(1.0 - E[i] * E[i]);
+            XN[i] = XKE / pow(A[i], 1.5);
+
+            AXN[i] = E[i] * cos(OMEGA);
+            TEMP = 1.0 / (A[i] * BETA * BETA);
+            XLL = TEMP * nt[NT_XLCOF][j] * AXN[i];
+            AYNL = TEMP * nt[NT_AYCOF][j];
+            XLT[i] = XL + XLL;
+            AYN[i] = E[i] * sin(OMEGA) + AYNL;
+        }
+
+        /* Kepler's equation */
+        for (i = 0; i < nb; i++)
+        {
+            double CAPU = fmod(XLT[i] - XNODE[i], TWOPI);
+            double TEMP2 = CAPU, EPW;
+            int it;
+
+            for (it = 0; it < 10; it++)
+            {
+                SINEPW[i] = sin(TEMP2);
+                COSEPW[i] = cos(TEMP2);
+                EPW = (CAPU - AYN[i] * COSEPW[i] + AXN[i] * SINEPW[i] - TEMP2)
+                      / (1.0 - AXN[i] * COSEPW[i] - AYN[i] * SINEPW[i]) + TEMP2;
+                if (fabs(EPW - TEMP2) <= E6A)
+                    break;
+                TEMP2 = EPW;
+            }
+        }
+
+        /* short period periodics and orientation */
+        for (i = 0; i < nb; i++)
+        {
+            int j = b + i;
+            double COSIO = nt[NT_COSIO][j], SINIO = nt[NT_SINIO][j];
+            double X1MTH2 = nt[NT_X1MTH2][j], X3THM1 = nt[NT_X3THM1][j];
+            double TEMP, TEMP1, TEMP2, TEMP3, TEMP4, TEMP5, TEMP6;
+            double ECOSE, ESINE, ELSQ, PL, R, RDOT, RFDOT, BETAL, COSU, SINU;
+            double U, SIN2U, COS2U, RK, UK, XNODEK, XINCK, RDOTK, RFDOTK;
+            double SINUK, COSUK, SINIK, COSIK, SINNOK, COSNOK;
+            double XMX, XMY, UX, UY, UZ, VX, VY, VZ;
+            Vec3 *pp;
+
+            TEMP3 = AXN[i] * SINEPW[i];
+            TEMP4 = AYN[i] * COSEPW[i];
+            TEMP5 = AXN[i] * COSEPW[i];
+            TEMP6 = AYN[i] * SINEPW[i];
+            ECOSE = TEMP5 + TEMP6;
+            ESINE = TEMP3 - TEMP4;
+            ELSQ = AXN[i] * AXN[i] + AYN[i] * AYN[i];
+            TEMP = 1.0 - ELSQ;
+            PL = A[i] * TEMP;
+            R = A[i] * (1.0 - ECOSE);
+
+            TEMP1 = 1.0 / R;
+            RDOT = XKE * sqrt(A[i]) * ESINE * TEMP1;
+            RFDOT = XKE * sqrt(PL) * TEMP1;
+            TEMP2 = A[i] * TEMP1;
+            BETAL = sqrt(TEMP);
+            TEMP3 = 1.0 / (1.0 + BETAL);
+
+            COSU = TEMP2 * (COSEPW[i] - AXN[i] + AYN[i] * ESINE * TEMP3);
+            SINU = TEMP2 * (SINEPW[i] - AYN[i] - AXN[i] * ESINE * TEMP3);
+            U = actan(SINU, COSU);
+            SIN2U = 2.0 * SINU * COSU;
+            COS2U = 2.0 * COSU * COSU - 1.0;
+
+            TEMP = 1.0 / PL;
+            TEMP1 = CK2 * TEMP;
+            TEMP2 = TEMP1 * TEMP;
+
+            RK = R * (1.0 - 1.5 * TEMP2 * BETAL * X3THM1) +
+                 .5 * TEMP1 * X1MTH2 * COS2U;
+            UK = U - .25 * TEMP2 * nt[NT_X7THM1][j] * SIN2U;
+            XNODEK = XNODE[i] + 1.5 * TEMP2 * COSIO * SIN2U;
+            XINCK = nt[NT_XINCL][j] + 1.5 * TEMP2 * COSIO * SINIO * COS2U;
+            RDOTK = RDOT - XN[i] * TEMP1 * X1MTH2 * SIN2U;
+            RFDOTK = RFDOT + XN[i] * TEMP1 * (X1MTH2 * COS2U + 1.5 * X3THM1);
+
+            SINUK = sin(UK);
+            COSUK = cos(UK);
+            SINIK = sin(XINCK);
+            COSIK = cos(XINCK);
+            SINNOK = sin(XNODEK);
+            COSNOK = cos(XNODEK);
+
+            XMX = -SINNOK * COSIK;
+            XMY = COSNOK * COSIK;
+            UX = XMX * SINUK + COSNOK * COSUK;
+            UY = XMY * SINUK + SINNOK * COSUK;
+            UZ = SINIK * SINUK;
+
+            pp = &w->pos[bp->nix[j]];
+            pp->x = RK * UX;
+            pp->y = RK * UY;
+            pp->z = RK * UZ;
+
+            if (w->dpos)
+            {
+                VX = XMX * COSUK - COSNOK * SINUK;
+                VY = XMY * COSUK - SINNOK * SINUK;
+                VZ = SINIK * COSUK;
+                pp = &w->dpos[bp->nix[j]];
+                pp->x = RDOTK * UX + RFDOTK * VX;
+                pp->y = RDOTK * UY + RFDOTK * VY;
+                pp->z = RDOTK * UZ + RFDOTK * VZ;
+            }
+        }
+    }
+
+    /* deep space ones each the long way */
+    for (k = w->d0; k < w->d1; k++)
+    {
+        Vec3 dp;
+        int i = bp->dix[k];
+
+        sdp4 (&bp->dsat[k], &w->pos[i], w->dpos ? &w->dpos[i] : &dp,
+              (w->mjd - bp->depoch[k]) * XMNPDA);
+    }
+
+    return (NULL);
+}
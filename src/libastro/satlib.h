@@ -208,6 +208,15 @@ void sgp4(SatData *sat, Vec3 *pos, Vec3 *dpos, double t);
 
 void sdp4(SatData *sat, Vec3 *pos, Vec3 *dpos, double TSINCE);
 
+/* many element sets at once, see satbatch.c */
+typedef struct _SatBatch SatBatch;
+
+double satb_epoch(double EPOCH);
+SatBatch *satb_new(SatElem *el, int n);
+void satb_free(SatBatch *bp);
+int satb_n(SatBatch *bp);
+void satb_prop(SatBatch *bp, double when, Vec3 *pos, Vec3 *dpos);
+
 #endif /* __SATLIB_H */
 
 /* For RCS Only -- Do Not Edit
@@ -12,6 +12,7 @@ extern void init_deep(struct deep_data *deep);
 void init_sdp4(struct sdp4_data *sdp);
 char *tleerr(int);
 int readtle(char *, char *, SatElem *);
+int writetle(SatElem *el, char *line1, char *line2);
 
 double current_jd();
 
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <math.h>
+
+#include "../vector.h"
+#include "../sattypes.h"
+#include "../satlib.h"
+
+#include "proto.h"
+
+#define IS_L1(S) ((S)[0]=='1'&&(S)[1]==' ')
+#define IS_L2(S) ((S)[0]=='2'&&(S)[1]==' ')
+#define IS_SAME(A,B) ((A)[2]==(B)[2]&&(A)[3]==(B)[3]&&(A)[4]==(B)[4]&&(A)[5]==(B)[5]&&(A)[6]==(B)[6])
+
+#define XKMPER 6378.135
+#define DEEP_SPACE (1.0/225.0)
+#define MPD (1440.0)
+#define NSETS 1000
+#define GEO_XNO (1.0027*2*M_PI/MPD)
+
+static int readsets(char *fn, SatElem *sep, int max);
+static void single(SatElem *sep, double mjd, Vec3 *p);
+static double secs(void);
+
+/*
+ * Check satb_prop() against sgp4()/sdp4(), and against the reference sets.
+ *
+ * The <test> set is propagated in a batch to the epoch of each <tles> set and
+ * compared with that set, as prop2 does. Then <copies> copies of all the
+ * <tles> sets are propagated together at a few times, every other copy made
+ * deep-space by slowing it to once a day, and compared with propagating each
+ * one by itself the way obj_earthsat() does.
+ */
+int main(int argc, char **argv)
+{
+    SatElem set, *sep, *all;
+    SatBatch *bp;
+    Vec3 *pos, p;
+    double dmax, dnear, ddeep, t0, tb, ts;
+    int nsets, copies, n, i, j;
+
+    if (argc < 3 || argc > 4)
+    {
+        fprintf(stderr, "Arguments: <test> <tles> [<copies>]\n");
+        fprintf(stderr, "  e.g. batch test.tle ref.tle 200\n");
+        exit(2);
+    }
+    copies = argc == 4 ? atoi(argv[3]) : 200;
+
+    if (readsets(argv[1], &set, 1) != 1)
+        exit(2);
+    sep = (SatElem *) malloc(NSETS * sizeof(SatElem));
+    nsets = readsets(argv[2], sep, NSETS);
+    if (nsets < 1)
+        exit(2);
+
+    /* the test set against the reference sets */
+    bp = satb_new(&set, 1);
+    printf("   tdiff (days)   dist (km)   batch-single (km)\n");
+    dmax = 0;
+    for (i = 0; i < nsets; i++)
+    {
+        double mjd = satb_epoch(sep[i].se_EPOCH);
+        double d;
+        Vec3 pb;
+
+        satb_prop(bp, mjd, &pb, NULL);
+        single(&sep[i], mjd, &p);
+        d = sqrt((pb.x-p.x)*(pb.x-p.x) + (pb.y-p.y)*(pb.y-p.y)
+                 + (pb.z-p.z)*(pb.z-p.z)) * XKMPER;
+        single(&set, mjd, &p);
+        printf("%15.8f %11.3f %19.3e\n", mjd - satb_epoch(set.se_EPOCH), d,
+               sqrt((pb.x-p.x)*(pb.x-p.x) + (pb.y-p.y)*(pb.y-p.y)
+                    + (pb.z-p.z)*(pb.z-p.z)) * XKMPER);
+        if (d > dmax)
+            dmax = d;
+    }
+    printf("largest distance from reference: %.3f km\n\n", dmax);
+    satb_free(bp);
+
+    /* a whole catalog's worth, batch against one at a time */
+    n = nsets * copies;
+    all = (SatElem *) malloc(n * sizeof(SatElem));
+    pos = (Vec3 *) malloc(n * sizeof(Vec3));
+    for (i = 0; i < n; i++)
+    {
+        all[i] = sep[i % nsets];
+        if ((i / nsets) & 1)
+            all[i].se_XNO = GEO_XNO;
+    }
+
+    t0 = secs();
+    bp = satb_new(all, n);
+    printf("%d sets, %d deep space, setup %.3f s\n", n,
+           (n/nsets/2)*nsets, secs() - t0);
+
+    dnear = ddeep = tb = ts = 0;
+    for (j = 0; j < 4; j++)
+    {
+        double mjd = satb_epoch(sep[0].se_EPOCH) + j*j*0.9;
+
+        t0 = secs();
+        satb_prop(bp, mjd, pos, NULL);
+        tb += secs() - t0;
+
+        t0 = secs();
+        for (i = 0; i < n; i++)
+        {
+            double d;
+
+            single(&all[i], mjd, &p);
+            d = fabs(pos[i].x-p.x) + fabs(pos[i].y-p.y) + fabs(pos[i].z-p.z);
+            if (all[i].se_XNO < DEEP_SPACE)
+            {
+                if (d > ddeep)
+                    ddeep = d;
+            }
+            else if (d > dnear)
+                dnear = d;
+        }
+        ts += secs() - t0;
+    }
+
+    printf("largest batch-single difference: near %.3e km, deep %.3e km\n",
+           dnear * XKMPER, ddeep * XKMPER);
+    printf("per set and time: batch %.3f us, single %.3f us\n",
+           tb/(4.0*n)*1e6, ts/(4.0*n)*1e6);
+    satb_free(bp);
+
+    return (dnear*XKMPER > 1e-6 || ddeep*XKMPER > 1e-6);
+}
+
+/* read up to max element sets from fn into sep[], return how many.
+ */
+static int readsets(char *fn, SatElem *sep, int max)
+{
+    char l0[256], l1[256], l2[256], *p0, *p1, *p2, *tmp;
+    FILE *fp;
+    int n = 0;
+
+    fp = fopen(fn, "r");
+    if (!fp)
+    {
+        perror(fn);
+        return (-1);
+    }
+
+    p0 = l0;
+    p1 = l1;
+    p2 = l2;
+    *p0 = *p1 = *p2 = '\0';
+
+    while (n < max && fgets(p2, 256, fp))
+    {
+        if (IS_L1(p1) && IS_L2(p2) && IS_SAME(p1, p2))
+        {
+            memset(&sep[n], 0, sizeof(SatElem));
+            if (readtle(p1, p2, &sep[n]) == 0)
+                n++;
+        }
+
+        tmp = p0;
+        p0 = p1;
+        p1 = p2;
+        p2 = tmp;
+    }
+
+    fclose(fp);
+    if (n == 0)
+        fprintf(stderr, "%s: no element sets\n", fn);
+    return (n);
+}
+
+/* propagate one set to mjd by itself.
+ */
+static void single(SatElem *sep, double mjd, Vec3 *p)
+{
+    SatData sd;
+    Vec3 dp;
+
+    memset(&sd, 0, sizeof(sd));
+    sd.elem = sep;
+    if (sep->se_XNO >= DEEP_SPACE)
+        sgp4(&sd, p, &dp, (mjd - satb_epoch(sep->se_EPOCH)) * MPD);
+    else
+        sdp4(&sd, p, &dp, (mjd - satb_epoch(sep->se_EPOCH)) * MPD);
+    if (sd.prop.sgp4)
+        free(sd.prop.sgp4);
+    if (sd.deep)
+        free(sd.deep);
+}
+
+static double secs(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + tv.tv_usec/1e6);
+}
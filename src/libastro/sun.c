@@ -14,34 +14,53 @@
  * if the APPARENT ecliptic longitude is required, correct the longitude for
  *   nutation to the true equinox of date and for aberration (light travel time,
  *   approximately  -9.27e7/186000/(3600*24*365)*2*pi = -9.93e-5 radians).
+ *
+ * answered from the ephemeris cache when ephc_setup() has turned it on.
  */
 void
 sunpos (mjd, lsn, rsn, bsn)
 double mjd;
 double *lsn, *rsn, *bsn;
 {
-    static double last_mjd = -3691, last_lsn, last_rsn, last_bsn;
+    sunpos_r (astro_defctx(), mjd, lsn, rsn, bsn);
+}
+
+/* same as sunpos() but using context *ac */
+void
+sunpos_r (ac, mjd, lsn, rsn, bsn)
+AstroCtx *ac;
+double mjd;
+double *lsn, *rsn, *bsn;
+{
     double ret[6];
 
-    if (mjd == last_mjd)
+    if (mjd == ac->sun_mjd)
     {
-        *lsn = last_lsn;
-        *rsn = last_rsn;
-        if (bsn) *bsn = last_bsn;
+        *lsn = ac->sun_lsn;
+        *rsn = ac->sun_rsn;
+        if (bsn) *bsn = ac->sun_bsn;
         return;
     }
 
-    vsop87(mjd, SUN, 0.0, ret); /* full precision earth pos */
+    if (ephc_sun (mjd, &ac->sun_lsn, &ac->sun_rsn, &ac->sun_bsn) == 0)
+    {
+        *lsn = ac->sun_lsn;
+        *rsn = ac->sun_rsn;
+    }
+    else
+    {
+        vsop87(mjd, SUN, 0.0, ret); /* full precision earth pos */
 
-    *lsn = ret[0] - PI;     /* revert to sun pos */
-    range (lsn, 2*PI);      /* normalise */
+        *lsn = ret[0] - PI;     /* revert to sun pos */
+        range (lsn, 2*PI);      /* normalise */
 
-    last_lsn = *lsn;        /* memorise */
-    last_rsn = *rsn = ret[2];
-    last_bsn = -ret[1];
-    last_mjd = mjd;
+        ac->sun_lsn = *lsn;     /* memorise */
+        ac->sun_rsn = *rsn = ret[2];
+        ac->sun_bsn = -ret[1];
+    }
+    ac->sun_mjd = mjd;
 
-    if (bsn) *bsn = last_bsn;   /* assign only if non-NULL pointer */
+    if (bsn) *bsn = ac->sun_bsn;/* assign only if non-NULL pointer */
 }
 
 /* For RCS Only -- Do Not Edit */
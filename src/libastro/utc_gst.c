@@ -13,15 +13,23 @@ double mjd;
 double utc;
 double *gst;
 {
-    static double lastmjd = -18981;
-    static double t0;
+    utc_gst_r (astro_defctx(), mjd, utc, gst);
+}
 
-    if (mjd != lastmjd)
+/* same as utc_gst() but using context *ac */
+void
+utc_gst_r (ac, mjd, utc, gst)
+AstroCtx *ac;
+double mjd;
+double utc;
+double *gst;
+{
+    if (mjd != ac->ug_mjd)
     {
-        t0 = gmst0(mjd);
-        lastmjd = mjd;
+        ac->ug_t0 = gmst0(mjd);
+        ac->ug_mjd = mjd;
     }
-    *gst = (1.0/SIDRATE)*utc + t0;
+    *gst = (1.0/SIDRATE)*utc + ac->ug_t0;
     range (gst, 24.0);
 }
 
@@ -35,15 +43,23 @@ double mjd;
 double gst;
 double *utc;
 {
-    static double lastmjd = -10000;
-    static double t0;
+    gst_utc_r (astro_defctx(), mjd, gst, utc);
+}
 
-    if (mjd != lastmjd)
+/* same as gst_utc() but using context *ac */
+void
+gst_utc_r (ac, mjd, gst, utc)
+AstroCtx *ac;
+double mjd;
+double gst;
+double *utc;
+{
+    if (mjd != ac->gu_mjd)
     {
-        t0 = gmst0 (mjd);
-        lastmjd = mjd;
+        ac->gu_t0 = gmst0 (mjd);
+        ac->gu_mjd = mjd;
     }
-    *utc = gst - t0;
+    *utc = gst - ac->gu_t0;
     range (utc, 24.0);
     *utc *= SIDRATE;
 }
@@ -0,0 +1,528 @@
+/* vis_night() and vis_objs(): tabulate the visibility of many objects through
+ *   one night for planning.
+ *
+ * vis_night() finds when twilight ends and begins and lays a grid of times
+ * between. vis_objs() then finds for each object its rise, set and transit as
+ * riset_cir() would, its apparent altitude at each grid time, from which
+ * airmass() gives airmass, and its distance from the moon.
+ *
+ * Fixed objects are reduced once for the middle of the night by
+ * obj_cir_batch(); their place moves too little in a night to matter so the
+ * rest follows in closed form from the sidereal time at each step. Solar
+ * system objects are reduced with obj_cir() at nodes an hour apart, whose
+ * topocentric places are interpolated for each step, and riset_cir() is used
+ * for their rise and set; the planets come from the ephemeris cache if
+ * ephc_setup() has been called. Earth satellites move too fast for either
+ * and are reduced at every step. The objects are shared among threads, each
+ * with its own AstroCtx.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#if defined(__STDC__)
+#include <stdlib.h>
+#endif
+#include <unistd.h>
+#include <pthread.h>
+
+#include "P_.h"
+#include "astro.h"
+#include "circum.h"
+
+#define VIS_MINTHREAD   64      /* fewest objects worth threading */
+#define VIS_MAXTHREAD   8       /* most threads */
+#define VIS_NODEDT      (1./24.)    /* solar system node spacing, days */
+#define VIS_MAXNODE     64      /* most nodes */
+
+/* what all threads share */
+typedef struct
+{
+    Now *np;                    /* circumstances */
+    VisNight *vp;               /* grid */
+    Obj *op;                    /* objects */
+    int n;                      /* number of objects */
+    double dis;                 /* horizon displacement, rads */
+    double minalt;              /* lowest useful altitude, rads */
+    VisInfo *vip;               /* answers, n */
+    float *alt;                 /* altitudes, n * vp->vn_nt, or NULL */
+    double *lst;                /* local sidereal time at each step, rads */
+    double mjdn, lstn;          /* mjd and lst, hours, at local noon */
+    double mx, my, mz;          /* topocentric moon unit vector at mid night */
+} VisBatch;
+
+/* one thread's share */
+typedef struct
+{
+    VisBatch *bp;               /* shared state */
+    int t0, dt;                 /* objects t0, t0+dt, ... */
+    int ret;                    /* 0 if all ok, -1 if any failed */
+} VisWork;
+
+static void *vis_work P_((void *wp));
+static int vis_fixed P_((VisBatch *bp, Obj *op, VisInfo *vip, float *alt));
+static int vis_ss P_((AstroCtx *ac, VisBatch *bp, Obj *op, VisInfo *vip,
+                      float *alt));
+static int vis_sat P_((AstroCtx *ac, VisBatch *bp, Obj *op, VisInfo *vip,
+                       float *alt));
+static int vis_topo P_((AstroCtx *ac, Now *np, Obj *op, double *rap,
+                        double *decp));
+static void vis_step P_((VisBatch *bp, VisInfo *vip, float *alt, int k,
+                        double a));
+static double vis_sep P_((VisBatch *bp, double ra, double dec));
+static double vis_lsthr P_((double dlst));
+
+/* find the night that begins with twilight on the local day of *np: the mjds
+ *   when the sun is dis rads below the horizon in the evening and again the
+ *   next morning. set up vp with a grid of times between every step days.
+ * where the sun does not rise on one day or the other the night is taken to
+ *   start or end at local noon.
+ * return 0 if ok, else -1 if no dark time then or error.
+ */
+int
+vis_night (np, dis, step, vp)
+Now *np;
+double dis;
+double step;
+VisNight *vp;
+{
+    Now n;
+    double dawn, dusk, mjdn;
+    int st1, st2;
+
+    memset ((void *)vp, 0, sizeof(*vp));
+    if (step <= 0)
+        return (-1);
+
+    (void) memcpy ((void *)&n, (void *)np, sizeof(n));
+    twilight_cir (&n, dis, &dawn, &dusk, &st1);
+    vp->vn_dusk = dusk;
+    n.n_mjd += 1.0;
+    twilight_cir (&n, dis, &dawn, &dusk, &st2);
+    vp->vn_dawn = dawn;
+    vp->vn_flags = st1 | st2;
+
+    /* local noon */
+    mjdn = mjd_day(mjd - tz/24.0) + tz/24.0 + 0.5;
+    if (st1 & RS_NEVERUP)
+        vp->vn_dusk = mjdn;
+    else if (st1 & (RS_ERROR|RS_CIRCUMPOLAR|RS_NOSET))
+        return (-1);
+    if (st2 & RS_NEVERUP)
+        vp->vn_dawn = mjdn + 1.0;
+    else if (st2 & (RS_ERROR|RS_CIRCUMPOLAR|RS_NORISE))
+        return (-1);
+    if (vp->vn_dawn <= vp->vn_dusk)
+        return (-1);
+
+    vp->vn_t0 = vp->vn_dusk;
+    vp->vn_dt = step;
+    vp->vn_nt = (int)floor((vp->vn_dawn - vp->vn_dusk)/step) + 1;
+    return (0);
+}
+
+/* find the visibility of the n objects at op[] through the night *vp from
+ *   vis_night() for the same *np.
+ * for each set vip[i] with its rise, set and transit on the local day of *np
+ *   as riset_cir() for horizon displacement dis, its highest altitude on the
+ *   grid and first and last steps at or above minalt, and its angle from the
+ *   moon at the middle of the night.
+ * if alt is not NULL also set alt[i*vp->vn_nt + k] to the apparent altitude
+ *   of object i at grid step k.
+ * the s_* fields of fixed objects are left as for the middle of the night.
+ * return 0 if all ok, else -1 if any failed, for which vi_rs has RS_ERROR.
+ */
+int
+vis_objs (np, vp, op, n, dis, minalt, vip, alt)
+Now *np;
+VisNight *vp;
+Obj *op;
+int n;
+double dis;
+double minalt;
+VisInfo *vip;
+float *alt;
+{
+    AstroCtx *ac = astro_defctx();
+    pthread_t tid[VIS_MAXTHREAD];
+    VisWork work[VIS_MAXTHREAD];
+    VisBatch b;
+    Now nm;
+    Obj moon;
+    double tmid, mra, mdec;
+    int nthr, i, j, k, t;
+    int ret = 0;
+
+    if (n <= 0 || vp->vn_nt <= 0)
+        return (0);
+
+    b.np = np;
+    b.vp = vp;
+    b.op = op;
+    b.n = n;
+    b.dis = dis;
+    b.minalt = minalt;
+    b.vip = vip;
+    b.alt = alt;
+    b.lst = (double *) malloc (vp->vn_nt * sizeof(double));
+    if (!b.lst)
+        return (-1);
+
+    /* sidereal time at each step, and at noon as riset_cir() starts */
+    (void) memcpy ((void *)&nm, (void *)np, sizeof(nm));
+    for (k = 0; k < vp->vn_nt; k++)
+    {
+        nm.n_mjd = vp->vn_t0 + k*vp->vn_dt;
+        now_lst_r (ac, &nm, &b.lst[k]);
+        b.lst[k] = hrrad(b.lst[k]);
+    }
+    b.mjdn = mjd_day(mjd - tz/24.0) + tz/24.0 + 0.5;
+    nm.n_mjd = b.mjdn;
+    now_lst_r (ac, &nm, &b.lstn);
+
+    /* fixed objects all at the middle of the night, a run at a time */
+    tmid = vp->vn_t0 + (vp->vn_nt-1)*vp->vn_dt/2;
+    nm.n_mjd = tmid;
+    for (i = 0; i < n; i = j)
+    {
+        for (j = i; j < n && op[j].o_type == FIXED; j++)
+            continue;
+        if (j > i)
+            (void) obj_cir_batch_r (ac, &nm, &op[i], j - i);
+        else
+            j++;
+    }
+
+    /* moon then */
+    memset ((void *)&moon, 0, sizeof(moon));
+    moon.o_type = PLANET;
+    moon.pl.pl_code = MOON;
+    (void) strcpy (moon.o_name, "Moon");
+    if (vis_topo (ac, &nm, &moon, &mra, &mdec) < 0)
+        mra = mdec = 0;
+    b.mx = cos(mdec)*cos(mra);
+    b.my = cos(mdec)*sin(mra);
+    b.mz = sin(mdec);
+
+    /* the rest, on several threads if worth it */
+    nthr = 1;
+    if (n >= VIS_MINTHREAD)
+    {
+        long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+        nthr = ncpu < 1 ? 1 : (ncpu > VIS_MAXTHREAD ? VIS_MAXTHREAD : ncpu);
+        if (nthr > n/(VIS_MINTHREAD/4))
+            nthr = n/(VIS_MINTHREAD/4);
+    }
+    for (t = 0; t < nthr; t++)
+    {
+        work[t].bp = &b;
+        work[t].t0 = t;
+        work[t].dt = nthr;
+        work[t].ret = 0;
+    }
+    for (t = 1; t < nthr; t++)
+        if (pthread_create (&tid[t], NULL, vis_work, (void *)&work[t]) != 0)
+            tid[t] = pthread_self();
+    vis_work ((void *)&work[0]);
+    for (t = 1; t < nthr; t++)
+    {
+        if (pthread_equal (tid[t], pthread_self()))
+            vis_work ((void *)&work[t]);
+        else
+            pthread_join (tid[t], NULL);
+    }
+    for (t = 0; t < nthr; t++)
+        if (work[t].ret < 0)
+            ret = -1;
+
+    free ((void *)b.lst);
+    return (ret);
+}
+
+/* thread to do one VisWork's share of the objects.
+ */
+static void *
+vis_work (wp)
+void *wp;
+{
+    VisWork *w = (VisWork *)wp;
+    VisBatch *bp = w->bp;
+    int nt = bp->vp->vn_nt;
+    AstroCtx ac;
+    int i;
+
+    astro_ctx_init (&ac);
+
+    for (i = w->t0; i < bp->n; i += w->dt)
+    {
+        Obj *op = &bp->op[i];
+        VisInfo *vip = &bp->vip[i];
+        float *alt = bp->alt ? bp->alt + (long)i*nt : NULL;
+        int s;
+
+        memset ((void *)vip, 0, sizeof(*vip));
+        vip->vi_maxalt = (float)(-PI/2);
+        vip->vi_up0 = vip->vi_up1 = -1;
+        switch (op->o_type)
+        {
+            case FIXED:
+                s = vis_fixed (bp, op, vip, alt);
+                break;
+            case EARTHSAT:
+                s = vis_sat (&ac, bp, op, vip, alt);
+                break;
+            default:
+                s = vis_ss (&ac, bp, op, vip, alt);
+                break;
+        }
+        if (s < 0)
+        {
+            vip->vi_rs.rs_flags |= RS_ERROR;
+            vip->vi_up0 = vip->vi_up1 = -1;
+            vip->vi_maxalt = (float)(-PI/2);
+            if (alt)
+            {
+                int k;
+                for (k = 0; k < nt; k++)
+                    alt[k] = (float)(-PI/2);
+            }
+            w->ret = -1;
+        }
+    }
+
+    return (NULL);
+}
+
+/* a fixed object already reduced for the middle of the night.
+ * return 0.
+ */
+static int
+vis_fixed (bp, op, vip, alt)
+VisBatch *bp;
+Obj *op;
+VisInfo *vip;
+float *alt;
+{
+    Now *np = bp->np;
+    RiseSet *rp = &vip->vi_rs;
+    double ra = op->s_gaera, dec = op->s_gaedec;
+    double slat = sin(lat), clat = cos(lat);
+    double sdec = sin(dec), cdec = cos(dec);
+    double h0, lr, ls, ar, as, ta;
+    int rss, k;
+
+    /* rise and set where the apparent altitude is -dis */
+    unrefract (pressure, temp, -bp->dis, &h0);
+    riset (ra, dec, lat, -h0, &lr, &ls, &ar, &as, &rss);
+    switch (rss)
+    {
+        case 0:
+            rp->rs_risetm = bp->mjdn + vis_lsthr (lr - bp->lstn)/24.0;
+            rp->rs_riseaz = ar;
+            rp->rs_settm = bp->mjdn + vis_lsthr (ls - bp->lstn)/24.0;
+            rp->rs_setaz = as;
+            if (rp->rs_settm < rp->rs_risetm)
+                rp->rs_settm += 1.0;
+            break;
+        case 1:
+            rp->rs_flags = RS_NEVERUP;
+            break;
+        case -1:
+            rp->rs_flags = RS_CIRCUMPOLAR;
+            break;
+    }
+    if (!(rp->rs_flags & RS_NEVERUP))
+    {
+        rp->rs_trantm = bp->mjdn + vis_lsthr (radhr(ra) - bp->lstn)/24.0;
+        refract (pressure, temp, PI/2 - fabs(lat - dec), &ta);
+        rp->rs_tranalt = ta;
+    }
+
+    /* altitude at each step */
+    for (k = 0; k < bp->vp->vn_nt; k++)
+    {
+        double sa = slat*sdec + clat*cdec*cos(bp->lst[k] - ra);
+
+        refract (pressure, temp, asin(sa), &ta);
+        vis_step (bp, vip, alt, k, ta);
+    }
+
+    vip->vi_moonsep = (float)vis_sep (bp, ra, dec);
+    return (0);
+}
+
+/* a sun, moon, planet or other solar system object.
+ * return 0 if ok, else -1.
+ */
+static int
+vis_ss (ac, bp, op, vip, alt)
+AstroCtx *ac;
+VisBatch *bp;
+Obj *op;
+VisInfo *vip;
+float *alt;
+{
+    Now n, *np = &n;
+    Obj o;
+    double tn[VIS_MAXNODE], ran[VIS_MAXNODE], decn[VIS_MAXNODE];
+    double t0 = bp->vp->vn_t0, dt = bp->vp->vn_dt;
+    double span = (bp->vp->vn_nt - 1)*dt;
+    double slat, clat;
+    int nn, j, k;
+
+    (void) memcpy ((void *)&n, (void *)bp->np, sizeof(n));
+    (void) memcpy ((void *)&o, (void *)op, sizeof(o));
+    riset_cir_r (ac, &n, &o, bp->dis, &vip->vi_rs);
+    if (vip->vi_rs.rs_flags & RS_ERROR)
+        return (-1);
+
+    /* topocentric place at each node, ra kept continuous */
+    nn = (int)ceil(span/VIS_NODEDT) + 1;
+    if (nn < 3)
+        nn = 3;
+    if (nn > VIS_MAXNODE)
+        nn = VIS_MAXNODE;
+    for (j = 0; j < nn; j++)
+    {
+        tn[j] = t0 + span*j/(nn-1);
+        n.n_mjd = tn[j];
+        if (vis_topo (ac, &n, &o, &ran[j], &decn[j]) < 0)
+            return (-1);
+        if (j > 0)
+        {
+            while (ran[j] - ran[j-1] > PI) ran[j] -= 2*PI;
+            while (ran[j] - ran[j-1] < -PI) ran[j] += 2*PI;
+        }
+    }
+
+    /* interpolate at each step from the three nodes about it */
+    slat = sin(lat);
+    clat = cos(lat);
+    for (k = 0; k < bp->vp->vn_nt; k++)
+    {
+        double t = t0 + k*dt;
+        double x, l0, l1, l2, ra, dec, sa, ta;
+
+        j = span > 0 ? (int)floor((t - t0)/span*(nn-1) + 0.5) : 1;
+        if (j < 1) j = 1;
+        if (j > nn-2) j = nn-2;
+        x = span > 0 ? (t - tn[j])/(tn[j+1] - tn[j]) : 0;
+        l0 = x*(x-1)/2;
+        l1 = 1 - x*x;
+        l2 = x*(x+1)/2;
+        ra = l0*ran[j-1] + l1*ran[j] + l2*ran[j+1];
+        dec = l0*decn[j-1] + l1*decn[j] + l2*decn[j+1];
+        sa = slat*sin(dec) + clat*cos(dec)*cos(bp->lst[k] - ra);
+        refract (pressure, temp, asin(sa), &ta);
+        vis_step (bp, vip, alt, k, ta);
+        if (k == (bp->vp->vn_nt-1)/2)
+            vip->vi_moonsep = (float)vis_sep (bp, ra, dec);
+    }
+
+    return (0);
+}
+
+/* an earth satellite, reduced at every step.
+ * return 0 if ok, else -1.
+ */
+static int
+vis_sat (ac, bp, op, vip, alt)
+AstroCtx *ac;
+VisBatch *bp;
+Obj *op;
+VisInfo *vip;
+float *alt;
+{
+    Now n;
+    Obj o;
+    double ra, dec;
+    int k;
+
+    (void) memcpy ((void *)&n, (void *)bp->np, sizeof(n));
+    (void) memcpy ((void *)&o, (void *)op, sizeof(o));
+    riset_cir_r (ac, &n, &o, bp->dis, &vip->vi_rs);
+    if (vip->vi_rs.rs_flags & RS_ERROR)
+        return (-1);
+
+    for (k = 0; k < bp->vp->vn_nt; k++)
+    {
+        n.n_mjd = bp->vp->vn_t0 + k*bp->vp->vn_dt;
+        if (obj_cir_r (ac, &n, &o) < 0)
+            return (-1);
+        vis_step (bp, vip, alt, k, o.s_alt);
+        if (k == (bp->vp->vn_nt-1)/2 && vis_topo (ac, &n, &o, &ra, &dec) == 0)
+            vip->vi_moonsep = (float)vis_sep (bp, ra, dec);
+    }
+
+    return (0);
+}
+
+/* find the topocentric geometric ra and dec of date of op at *np, from its
+ *   unrefracted alt and az.
+ * return 0 if ok, else -1.
+ */
+static int
+vis_topo (ac, np, op, rap, decp)
+AstroCtx *ac;
+Now *np;
+Obj *op;
+double *rap, *decp;
+{
+    double alt, ha, lst;
+
+    if (obj_cir_r (ac, np, op) < 0)
+        return (-1);
+    unrefract (pressure, temp, op->s_alt, &alt);
+    aa_hadec_r (ac, lat, alt, op->s_az, &ha, decp);
+    now_lst_r (ac, np, &lst);
+    *rap = hrrad(lst) - ha;
+    range (rap, 2*PI);
+    return (0);
+}
+
+/* note apparent altitude a at grid step k */
+static void
+vis_step (bp, vip, alt, k, a)
+VisBatch *bp;
+VisInfo *vip;
+float *alt;
+int k;
+double a;
+{
+    if (alt)
+        alt[k] = (float)a;
+    if (a > vip->vi_maxalt)
+        vip->vi_maxalt = (float)a;
+    if (a >= bp->minalt)
+    {
+        if (vip->vi_up0 < 0)
+            vip->vi_up0 = k;
+        vip->vi_up1 = k;
+    }
+}
+
+/* return the angle from the moon of ra and dec */
+static double
+vis_sep (bp, ra, dec)
+VisBatch *bp;
+double ra, dec;
+{
+    double c = bp->mx*cos(dec)*cos(ra) + bp->my*cos(dec)*sin(ra)
+                                                    + bp->mz*sin(dec);
+
+    return (c >= 1 ? 0 : (c <= -1 ? PI : acos(c)));
+}
+
+/* return the hours from noon to when lst has changed by dlst hours from noon,
+ *   or by a day more or less, picking the one riset_cir() would find.
+ */
+static double
+vis_lsthr (dlst)
+double dlst;
+{
+    if (dlst/SIDRATE < -12.0)
+        dlst += 24.0;
+    else if (dlst/SIDRATE > 12.0)
+        dlst -= 24.0;
+    return (dlst*SIDRATE);
+}
@@ -17,3 +17,46 @@ extern int GSCFetch (double ra0, double dec0, double fov, double fmag,
 extern int USNOSetup (char *cdpath, int wantgsc, char *msg);
 extern int USNOFetch (double ra0, double dec0, double fov, double fmag,
                       FieldStar **spp, char msg[]);
+
+extern int FSCSetup (char *fn, char msg[]);
+extern int FSCFetch (double ra0, double dec0, double fov, double fmag,
+                     FieldStar **spp, int nspp, char msg[]);
+extern int FSCWrite (char *fn, FieldStar *sp, int n, int order, char *src,
+                     char msg[]);
+
+/* catalogs sharing the region cache */
+#define FSC_GSC         0   /* GSC small regions */
+#define FSC_USNO        1   /* USNO zone RA chunks, including GSC stars */
+#define FSC_USNONOGSC   2   /* USNO zone RA chunks, excluding GSC stars */
+#define FSC_FSCAT       3   /* leaf cells of the FSCSetup() catalog */
+
+typedef struct _FSRegion FSRegion;
+
+extern void FSCacheSetup (long maxbytes);
+extern void FSCacheFlush (int cat);
+extern FSRegion *FSCacheFind (int cat, int id, FieldStar **spp,
+                               double **xyzp, int *np);
+extern FSRegion *FSCacheAdd (int cat, int id, FieldStar **spp, double **xyzp,
+                              int *np);
+extern void FSCacheRelease (FSRegion *rp);
+extern int FSPrefetch (double ra0, double dec0, double fov, int wantusno,
+                       char msg[]);
+
+/* a cone on the sky for selecting stars by unit vector */
+typedef struct
+{
+    double ra, dec;     /* center, rads */
+    double rov;         /* radius, rads */
+    double x, y, z;     /* center unit vector */
+    double crov;        /* cos(rov) */
+} FSCone;
+
+#define FSCONEBLK   256 /* stars per block in FSConeSelect() */
+
+extern void FSConeSetup (FSCone *cp, double ra, double dec, double fov);
+extern void FSUnitVecs (FieldStar *sp, int n, double *x, double *y,
+                        double *z);
+extern int FSConeSelect (FSCone *cp, double *x, double *y, double *z, int n,
+                         int idx[]);
+extern int FSConeRARange (FSCone *cp, double fr[2], double lr[2]);
+extern void FSConeDecRange (FSCone *cp, double *fd, double *ld);
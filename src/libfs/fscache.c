@@ -0,0 +1,368 @@
+/* FSCacheFind() etc: memory cache of decoded catalog regions shared by the
+ *   GSC, USNO and FSC fetchers.
+ * FSPrefetch(): warm the cache for an upcoming field from a background thread.
+ *
+ * Each region is one small GSC region, one 15 minute RA chunk of a USNO
+ * zone or one leaf cell of the FSC catalog, decoded once into a FieldStar
+ * array holding every star it contains along with their unit vectors for
+ * FSConeSelect().
+ * Regions are found by hashing their catalog and id and are kept on a list in
+ * order of use; when the total size exceeds the budget the least recently used
+ * ones not currently held by a caller are freed. All entry points are thread
+ * safe.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "P_.h"
+#include "astro.h"
+#include "circum.h"
+#include "fieldstar.h"
+
+#define FSCDEFMAX   (32L<<20)   /* default budget, bytes */
+#define FSCNHASH    1024        /* hash table size, power of 2 */
+#define FSPQLEN     8           /* max pending prefetch requests */
+
+struct _FSRegion
+{
+    struct _FSRegion *prev, *next;  /* use list, most recent first */
+    struct _FSRegion *hnext;    /* hash chain */
+    int cat;                    /* FSC_* catalog, or -1 once flushed */
+    int id;                     /* region id within cat */
+    int refs;                   /* callers currently holding it */
+    int n;                      /* stars in sp[] */
+    FieldStar *sp;              /* malloced stars */
+    double *xyz;                /* malloced unit vectors: n x's, y's, z's */
+};
+
+/* one pending prefetch */
+typedef struct
+{
+    double ra, dec, fov;        /* field, rads */
+    int wantusno;               /* also warm USNO */
+} FSPReq;
+
+static void fscUnlink (FSRegion *rp);
+static void fscPurge (void);
+static void *fspThread (void *dummy);
+
+static pthread_mutex_t fsclock = PTHREAD_MUTEX_INITIALIZER;
+static FSRegion *fschash[FSCNHASH]; /* region lookup */
+static FSRegion *fscmru, *fsclru;   /* ends of use list */
+static long fscbytes;               /* total bytes in cached stars */
+static long fscmax = FSCDEFMAX;     /* budget */
+
+static pthread_mutex_t fsplock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fspcond = PTHREAD_COND_INITIALIZER;
+static FSPReq fspq[FSPQLEN];        /* ring of pending requests */
+static int fsphead, fspn;           /* oldest and count in fspq[] */
+static int fsprunning;              /* set once thread is started */
+
+#define FSCHASH(c,i)    ((unsigned)((i)*4 + (c)) & (FSCNHASH-1))
+
+/* set the cache budget to maxbytes; 0 effectively disables caching.
+ */
+void
+FSCacheSetup (long maxbytes)
+{
+    pthread_mutex_lock (&fsclock);
+    fscmax = maxbytes;
+    fscPurge();
+    pthread_mutex_unlock (&fsclock);
+}
+
+/* forget all regions of catalog cat, or all regions if cat < 0.
+ * regions held by callers are freed when released.
+ */
+void
+FSCacheFlush (int cat)
+{
+    FSRegion *rp, *nrp;
+
+    pthread_mutex_lock (&fsclock);
+    for (rp = fscmru; rp; rp = nrp)
+    {
+        nrp = rp->next;
+        if (cat >= 0 && rp->cat != cat)
+            continue;
+        if (rp->refs > 0)
+        {
+            /* just make it unfindable */
+            FSRegion **hpp = &fschash[FSCHASH(rp->cat,rp->id)];
+            while (*hpp != rp)
+                hpp = &(*hpp)->hnext;
+            *hpp = rp->hnext;
+            rp->hnext = NULL;
+            rp->cat = -1;
+        }
+        else
+            fscUnlink (rp);
+    }
+    pthread_mutex_unlock (&fsclock);
+}
+
+/* look up region id of catalog cat.
+ * if found set *spp and *np to its stars, and *xyzp to their unit vectors, and
+ * return a handle which must be passed to FSCacheRelease() when finished with
+ * them, else return NULL.
+ */
+FSRegion *
+FSCacheFind (int cat, int id, FieldStar **spp, double **xyzp, int *np)
+{
+    FSRegion *rp;
+
+    pthread_mutex_lock (&fsclock);
+    for (rp = fschash[FSCHASH(cat,id)]; rp; rp = rp->hnext)
+        if (rp->cat == cat && rp->id == id)
+            break;
+    if (rp)
+    {
+        /* move to front of use list */
+        if (rp != fscmru)
+        {
+            rp->prev->next = rp->next;
+            if (rp->next)
+                rp->next->prev = rp->prev;
+            else
+                fsclru = rp->prev;
+            rp->prev = NULL;
+            rp->next = fscmru;
+            fscmru->prev = rp;
+            fscmru = rp;
+        }
+        rp->refs++;
+        *spp = rp->sp;
+        *xyzp = rp->xyz;
+        *np = rp->n;
+    }
+    pthread_mutex_unlock (&fsclock);
+
+    return (rp);
+}
+
+/* add the n decoded stars in malloced *spp as region id of catalog cat and
+ * set *xyzp to their unit vectors.
+ * the cache takes over the memory; if another thread added the same region
+ * meanwhile ours is freed and *spp, *xyzp and *np are changed to that one.
+ * return a handle as for FSCacheFind(), or NULL if no memory in which case
+ * *spp is still the caller's.
+ */
+FSRegion *
+FSCacheAdd (int cat, int id, FieldStar **spp, double **xyzp, int *np)
+{
+    FSRegion *rp, *newrp;
+    FieldStar *sp;
+    double *xyz;
+    int n;
+
+    rp = FSCacheFind (cat, id, &sp, &xyz, &n);
+    if (rp)
+    {
+        if (*spp)
+            free ((void *)*spp);
+        *spp = sp;
+        *xyzp = xyz;
+        *np = n;
+        return (rp);
+    }
+
+    n = *np;
+    newrp = (FSRegion *) calloc (1, sizeof(FSRegion));
+    xyz = (double *) malloc ((3*n+1)*sizeof(double));
+    if (!newrp || !xyz)
+    {
+        if (newrp) free ((void *)newrp);
+        if (xyz) free ((void *)xyz);
+        return (NULL);
+    }
+    FSUnitVecs (*spp, n, xyz, xyz+n, xyz+2*n);
+
+    pthread_mutex_lock (&fsclock);
+
+    /* check again now that we hold the lock */
+    for (rp = fschash[FSCHASH(cat,id)]; rp; rp = rp->hnext)
+        if (rp->cat == cat && rp->id == id)
+            break;
+    if (rp)
+    {
+        rp->refs++;
+        pthread_mutex_unlock (&fsclock);
+        free ((void *)newrp);
+        free ((void *)xyz);
+        if (*spp)
+            free ((void *)*spp);
+        *spp = rp->sp;
+        *xyzp = rp->xyz;
+        *np = rp->n;
+        return (rp);
+    }
+
+    rp = newrp;
+    rp->cat = cat;
+    rp->id = id;
+    rp->refs = 1;
+    rp->n = n;
+    rp->sp = *spp;
+    rp->xyz = xyz;
+    *xyzp = xyz;
+    rp->hnext = fschash[FSCHASH(cat,id)];
+    fschash[FSCHASH(cat,id)] = rp;
+    rp->next = fscmru;
+    if (fscmru)
+        fscmru->prev = rp;
+    else
+        fsclru = rp;
+    fscmru = rp;
+    fscbytes += (long)rp->n*(sizeof(FieldStar) + 3*sizeof(double));
+    fscPurge();
+
+    pthread_mutex_unlock (&fsclock);
+
+    return (rp);
+}
+
+/* caller is finished with a region found or added above.
+ */
+void
+FSCacheRelease (FSRegion *rp)
+{
+    if (!rp)
+        return;
+
+    pthread_mutex_lock (&fsclock);
+    if (--rp->refs == 0)
+    {
+        if (rp->cat < 0)
+            fscUnlink (rp);
+        else
+            fscPurge();
+    }
+    pthread_mutex_unlock (&fsclock);
+}
+
+/* arrange for the catalog regions covering the given field to be read into
+ * the cache in the background, such as for the next target on a schedule.
+ * requests are handled in order; if too many are pending the oldest is
+ * dropped. USNO is included if wantusno. GSCSetup() and/or USNOSetup() must
+ * have been called.
+ * return 0 if queued, else -1 with excuse in msg[].
+ */
+int
+FSPrefetch (double ra0, double dec0, double fov, int wantusno, char msg[])
+{
+    FSPReq *qp;
+
+    pthread_mutex_lock (&fsplock);
+
+    if (!fsprunning)
+    {
+        pthread_t t;
+        pthread_attr_t a;
+        int s;
+
+        pthread_attr_init (&a);
+        pthread_attr_setdetachstate (&a, PTHREAD_CREATE_DETACHED);
+        s = pthread_create (&t, &a, fspThread, NULL);
+        pthread_attr_destroy (&a);
+        if (s != 0)
+        {
+            pthread_mutex_unlock (&fsplock);
+            sprintf (msg, "Can not start prefetch thread: %s", strerror(s));
+            return (-1);
+        }
+        fsprunning = 1;
+    }
+
+    if (fspn == FSPQLEN)
+    {
+        fsphead = (fsphead + 1) % FSPQLEN;
+        fspn--;
+    }
+    qp = &fspq[(fsphead + fspn++) % FSPQLEN];
+    qp->ra = ra0;
+    qp->dec = dec0;
+    qp->fov = fov;
+    qp->wantusno = wantusno;
+
+    pthread_cond_signal (&fspcond);
+    pthread_mutex_unlock (&fsplock);
+
+    return (0);
+}
+
+/* remove rp from the use list and hash table and free it.
+ * N.B. call with fsclock held.
+ */
+static void
+fscUnlink (FSRegion *rp)
+{
+    if (rp->cat >= 0)
+    {
+        FSRegion **hpp = &fschash[FSCHASH(rp->cat,rp->id)];
+        while (*hpp != rp)
+            hpp = &(*hpp)->hnext;
+        *hpp = rp->hnext;
+    }
+
+    if (rp->prev)
+        rp->prev->next = rp->next;
+    else
+        fscmru = rp->next;
+    if (rp->next)
+        rp->next->prev = rp->prev;
+    else
+        fsclru = rp->prev;
+
+    fscbytes -= (long)rp->n*(sizeof(FieldStar) + 3*sizeof(double));
+    if (rp->sp)
+        free ((void *)rp->sp);
+    free ((void *)rp->xyz);
+    free ((void *)rp);
+}
+
+/* free least recently used regions not held by anyone until within budget.
+ * N.B. call with fsclock held.
+ */
+static void
+fscPurge ()
+{
+    FSRegion *rp, *prp;
+
+    for (rp = fsclru; rp && fscbytes > fscmax; rp = prp)
+    {
+        prp = rp->prev;
+        if (rp->refs == 0)
+            fscUnlink (rp);
+    }
+}
+
+/* prefetch thread: fetch each queued field just for the side effect of
+ * loading its regions into the cache.
+ */
+static void *
+fspThread (void *dummy)
+{
+    for (;;)
+    {
+        FieldStar *sp = NULL;
+        char msg[1024];
+        FSPReq q;
+
+        pthread_mutex_lock (&fsplock);
+        while (fspn == 0)
+            pthread_cond_wait (&fspcond, &fsplock);
+        q = fspq[fsphead];
+        fsphead = (fsphead + 1) % FSPQLEN;
+        fspn--;
+        pthread_mutex_unlock (&fsplock);
+
+        if (q.wantusno && USNOFetch (q.ra, q.dec, q.fov, 99.0, &sp, msg) > 0)
+            free ((void *)sp);
+        (void) GSCFetch (q.ra, q.dec, q.fov, 99.0, NULL, 0, msg);
+    }
+
+    return (NULL);
+}
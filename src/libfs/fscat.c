@@ -0,0 +1,687 @@
+/* FSCSetup(): map a binary field star catalog into memory.
+ * FSCFetch(): return an array of FieldStars matching the given criteria.
+ * FSCWrite(): build such a catalog file from an array of FieldStars.
+ *
+ * The file is partitioned on the HEALPix nested scheme at some order so the
+ * stars of each cell, and of each coarser parent cell, are contiguous. Within
+ * a leaf cell the stars are sorted brightest first so a fetch can stop at the
+ * first star dimmer than the limit. Every cell at every level carries a
+ * bounding cap of the stars it holds so a cone query descends only those
+ * cells which can possibly overlap it.
+ *
+ * The whole file is mmapped once by FSCSetup() and FSCFetch() never touches
+ * the file system after that. The stars of each leaf visited are kept in the
+ * region cache with their unit vectors, and selected with FSConeSelect().
+ *
+ * File layout, all in host byte order (checked by the endian word):
+ *   FSCHeader
+ *   FSCNode  node[nnodes]   levels 0 .. order, each 12*4^level cells
+ *   float    ra[nstars]     J2000, rads
+ *   float    dec[nstars]    J2000, rads
+ *   float    mag[nstars]
+ *   char     name[nstars][14]
+ *   char     isstar[nstars]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "P_.h"
+#include "astro.h"
+#include "circum.h"
+#include "fieldstar.h"
+
+#define FSCMAGIC    "FSCAT01\n"     /* first 8 bytes of every file */
+#define FSCENDIAN   0x01020304u     /* as written by the host */
+#define FSCNAMELEN  14              /* sizeof(FieldStar.name) */
+#define FSCMAXORDER 10              /* largest order we accept */
+#define FSCPAD      1e-6            /* cap radius margin for float ra/dec, rads */
+#define FSCNINC     64              /* minimum FieldStar array growth */
+
+typedef unsigned int UI;
+
+/* file header, 60 bytes */
+typedef struct
+{
+    char magic[8];      /* FSCMAGIC */
+    UI endian;          /* FSCENDIAN */
+    UI order;           /* HEALPix order of the leaf cells */
+    UI nstars;          /* total stars */
+    UI nnodes;          /* total cells over all levels */
+    float maglim;       /* faintest mag present */
+    char src[20];       /* free text, where the stars came from */
+    char pad[12];
+} FSCHeader;
+
+/* one cell. the cap is centered on unit vector x,y,z with radius whose cos
+ * and sin are cr and sr. n == 0 means empty, cap is then meaningless.
+ */
+typedef struct
+{
+    float x, y, z;      /* cap center */
+    float cr, sr;       /* cos and sin of cap radius */
+    UI first;           /* index of first star */
+    UI n;               /* number of stars */
+} FSCNode;
+
+/* cone query criteria, trig computed once */
+typedef struct
+{
+    FSCone cone;        /* the field, for the stars */
+    double srov;        /* sin of cone.rov, for the cells */
+    double mag;         /* faintest mag */
+} FSCQuery;
+
+/* an array of FieldStar which grows geometrically */
+typedef struct
+{
+    FieldStar *mem;     /* malloced array */
+    int used;           /* number actually in use */
+    int max;            /* cells in mem[], or -1 to just count */
+} FSCArray;
+
+static int fscGetStars (FSCQuery *qp, int level, UI pix, FSCArray *ap);
+static FSRegion *fscLeaf (UI pix, FieldStar **spp, double **xyzp, int *np);
+static int fscAddStar (FSCArray *ap, FieldStar *fsp);
+static UI hpxAng2Pix (int order, double z, double phi);
+static UI hpxSpread (UI v);
+static int fscCmp (const void *p1, const void *p2);
+
+/* qsort context for fscCmp() */
+static UI *fscSortPix;
+static FieldStar *fscSortStars;
+
+/* the mapped catalog */
+static char *fscbase;       /* start of mmapped file, 0 until setup */
+static size_t fsclen;       /* bytes mapped */
+static FSCHeader *fschdr;   /* header */
+static FSCNode *fscnode;    /* node[] */
+static float *fscra, *fscdec, *fscmag;  /* star columns */
+static char *fscname, *fscisstar;
+
+/* offset to first cell at the given level */
+#define LEVELBASE(l)    (4u*((1u<<(2*(l))) - 1u))
+
+/* map the catalog file fn, replacing any previous one. fn == NULL just
+ * releases the current one.
+ * return 0 if looks ok, else -1 and reason in msg[].
+ */
+int
+FSCSetup (char *fn, char msg[])
+{
+    FSCHeader *hp;
+    struct stat st;
+    size_t need;
+    char *base;
+    int fd;
+
+    if (fscbase)
+    {
+        munmap (fscbase, fsclen);
+        fscbase = NULL;
+        FSCacheFlush (FSC_FSCAT);
+    }
+    if (!fn)
+        return (0);
+
+    fd = open (fn, O_RDONLY);
+    if (fd < 0)
+    {
+        sprintf (msg, "%s: %s", fn, strerror(errno));
+        return (-1);
+    }
+    if (fstat (fd, &st) < 0)
+    {
+        sprintf (msg, "%s: %s", fn, strerror(errno));
+        close (fd);
+        return (-1);
+    }
+    if (st.st_size < sizeof(FSCHeader))
+    {
+        sprintf (msg, "%s: too short", fn);
+        close (fd);
+        return (-1);
+    }
+    base = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (base == MAP_FAILED)
+    {
+        sprintf (msg, "%s: mmap: %s", fn, strerror(errno));
+        return (-1);
+    }
+
+    /* sanity check the header and size */
+    hp = (FSCHeader *)base;
+    if (memcmp (hp->magic, FSCMAGIC, sizeof(hp->magic)))
+    {
+        sprintf (msg, "%s: not a field star catalog", fn);
+        goto bad;
+    }
+    if (hp->endian != FSCENDIAN)
+    {
+        sprintf (msg, "%s: wrong byte order", fn);
+        goto bad;
+    }
+    if (hp->order > FSCMAXORDER || hp->nnodes != LEVELBASE(hp->order+1))
+    {
+        sprintf (msg, "%s: bad order %u", fn, hp->order);
+        goto bad;
+    }
+    need = sizeof(FSCHeader) + hp->nnodes*sizeof(FSCNode)
+           + (size_t)hp->nstars*(3*sizeof(float) + FSCNAMELEN + 1);
+    if ((size_t)st.st_size < need)
+    {
+        sprintf (msg, "%s: truncated: %ld < %ld", fn, (long)st.st_size,
+                 (long)need);
+        goto bad;
+    }
+
+    /* ok, set up the column pointers */
+    fscbase = base;
+    fsclen = st.st_size;
+    fschdr = hp;
+    fscnode = (FSCNode *)(base + sizeof(FSCHeader));
+    fscra = (float *)(fscnode + hp->nnodes);
+    fscdec = fscra + hp->nstars;
+    fscmag = fscdec + hp->nstars;
+    fscname = (char *)(fscmag + hp->nstars);
+    fscisstar = fscname + (size_t)hp->nstars*FSCNAMELEN;
+
+    return (0);
+
+bad:
+    munmap (base, st.st_size);
+    return (-1);
+}
+
+/* fetch all stars from the mapped catalog within fov of ra0/dec0 brighter
+ *   than fmag and return the new total count.
+ * if spp == NULL we don't malloc anything but just count;
+ * else *spp already has nspp FieldStar in it (it's ok if *spp == NULL).
+ * we return new total number of stars or -1 if trouble with excuse in msg[].
+ * *spp is only changed if we added any.
+ */
+int
+FSCFetch (
+    double ra0,     /* center RA, rads */
+    double dec0,    /* center Dec, rads */
+    double fov,     /* field of view, rads */
+    double fmag,    /* faintest mag */
+    FieldStar **spp,/* *spp will be a malloced array of FieldStar in region */
+    int nspp,       /* if spp: initial number of FieldStar already in *spp */
+    char msg[])     /* filled with error message if return -1 */
+{
+    FSCQuery q;
+    FSCArray sa;
+    UI pix;
+
+    if (!fscbase)
+    {
+        strcpy (msg, "FSCFetch() called before FSCSetup()");
+        return (-1);
+    }
+
+    /* collect the criteria */
+    FSConeSetup (&q.cone, ra0, dec0, fov);
+    q.srov = sin(q.cone.rov);
+    q.mag = fmag;
+
+    if (spp)
+    {
+        sa.mem = *spp;
+        sa.used = sa.max = nspp;
+    }
+    else
+    {
+        sa.mem = NULL;
+        sa.used = 0;
+        sa.max = -1;
+    }
+
+    /* descend from each of the 12 base cells */
+    for (pix = 0; pix < 12; pix++)
+        if (fscGetStars (&q, 0, pix, &sa) < 0)
+        {
+            strcpy (msg, "No more memory");
+            if (spp && sa.mem)
+                *spp = sa.mem;
+            return (-1);
+        }
+
+    if (spp && sa.mem)
+        *spp = sa.mem;
+
+    return (sa.used);
+}
+
+/* write the n stars in sp[] to a new catalog file fn partitioned at the given
+ * HEALPix order. src is a short note saved in the header.
+ * return 0 if ok, else -1 with excuse in msg[].
+ */
+int
+FSCWrite (char *fn, FieldStar *sp, int n, int order, char *src, char msg[])
+{
+    FSCHeader h;
+    FSCNode *np = NULL;
+    UI *pix = NULL, *idx = NULL;
+    double *vx = NULL;
+    UI nnodes;
+    float maglim;
+    FILE *fp = NULL;
+    int ret = -1;
+    UI i;
+    int l;
+
+    if (order < 0 || order > FSCMAXORDER)
+    {
+        sprintf (msg, "Order must be 0 .. %d", FSCMAXORDER);
+        return (-1);
+    }
+    nnodes = LEVELBASE(order+1);
+
+    np = (FSCNode *) calloc (nnodes, sizeof(FSCNode));
+    pix = (UI *) malloc ((n+1) * sizeof(UI));
+    idx = (UI *) malloc ((n+1) * sizeof(UI));
+    vx = (double *) malloc ((3*n+1) * sizeof(double));
+    if (!np || !pix || !idx || !vx)
+    {
+        sprintf (msg, "No memory for %d stars", n);
+        goto out;
+    }
+
+    /* find each star's leaf cell, then sort by cell and brightness */
+    for (i = 0; i < n; i++)
+    {
+        double phi = sp[i].ra;
+
+        range (&phi, 2*PI);
+        pix[i] = hpxAng2Pix (order, sin(sp[i].dec), phi);
+        idx[i] = i;
+    }
+    fscSortPix = pix;
+    fscSortStars = sp;
+    qsort ((void *)idx, n, sizeof(UI), fscCmp);
+
+    /* unit vectors in sorted order, as they will be read back as floats */
+    maglim = -100;
+    for (i = 0; i < n; i++)
+    {
+        FieldStar *fsp = &sp[idx[i]];
+        double ra = fsp->ra, dec = (float)fsp->dec;
+
+        range (&ra, 2*PI);
+        ra = (float)ra;
+        vx[3*i+0] = cos(dec)*cos(ra);
+        vx[3*i+1] = cos(dec)*sin(ra);
+        vx[3*i+2] = sin(dec);
+        if (fsp->mag > maglim)
+            maglim = fsp->mag;
+    }
+
+    /* leaf cell ranges */
+    for (i = 0; i < n; i++)
+    {
+        FSCNode *lp = &np[LEVELBASE(order) + pix[idx[i]]];
+        if (lp->n++ == 0)
+            lp->first = i;
+    }
+
+    /* parents cover the contiguous ranges of their 4 children */
+    for (l = order-1; l >= 0; --l)
+    {
+        UI base = LEVELBASE(l), cbase = LEVELBASE(l+1);
+        UI ncell = 12u << (2*l);
+        UI p;
+
+        for (p = 0; p < ncell; p++)
+        {
+            FSCNode *pp = &np[base + p];
+            int c;
+
+            for (c = 0; c < 4; c++)
+            {
+                FSCNode *cp = &np[cbase + 4*p + c];
+                if (cp->n == 0)
+                    continue;
+                if (pp->n == 0)
+                    pp->first = cp->first;
+                pp->n += cp->n;
+            }
+        }
+    }
+
+    /* bounding cap of each cell: mean direction and max distance from it */
+    for (i = 0; i < nnodes; i++)
+    {
+        FSCNode *cp = &np[i];
+        double x = 0, y = 0, z = 0, r, mincos;
+        UI j;
+
+        if (cp->n == 0)
+            continue;
+        for (j = cp->first; j < cp->first + cp->n; j++)
+        {
+            x += vx[3*j+0];
+            y += vx[3*j+1];
+            z += vx[3*j+2];
+        }
+        r = sqrt(x*x + y*y + z*z);
+        if (r < 1e-9)
+        {
+            /* degenerate spread, just use the whole sky */
+            x = 0; y = 0; z = 1;
+            mincos = -1;
+        }
+        else
+        {
+            x /= r; y /= r; z /= r;
+            mincos = 1;
+            for (j = cp->first; j < cp->first + cp->n; j++)
+            {
+                double c = x*vx[3*j+0] + y*vx[3*j+1] + z*vx[3*j+2];
+                if (c < mincos)
+                    mincos = c;
+            }
+        }
+        r = acos (mincos < -1 ? -1 : mincos) + FSCPAD;
+        if (r > PI)
+            r = PI;
+        cp->x = x;
+        cp->y = y;
+        cp->z = z;
+        cp->cr = cos(r);
+        cp->sr = sin(r);
+    }
+
+    fp = fopen (fn, "wb");
+    if (!fp)
+    {
+        sprintf (msg, "%s: %s", fn, strerror(errno));
+        goto out;
+    }
+
+    memset (&h, 0, sizeof(h));
+    memcpy (h.magic, FSCMAGIC, sizeof(h.magic));
+    h.endian = FSCENDIAN;
+    h.order = order;
+    h.nstars = n;
+    h.nnodes = nnodes;
+    h.maglim = maglim;
+    strncpy (h.src, src ? src : "", sizeof(h.src)-1);
+    fwrite (&h, sizeof(h), 1, fp);
+    fwrite (np, sizeof(FSCNode), nnodes, fp);
+    for (i = 0; i < n; i++)
+    {
+        double a = sp[idx[i]].ra;
+        float f;
+
+        range (&a, 2*PI);
+        f = a;
+        fwrite (&f, sizeof(f), 1, fp);
+    }
+    for (i = 0; i < n; i++)
+    {
+        float f = sp[idx[i]].dec;
+        fwrite (&f, sizeof(f), 1, fp);
+    }
+    for (i = 0; i < n; i++)
+        fwrite (&sp[idx[i]].mag, sizeof(float), 1, fp);
+    for (i = 0; i < n; i++)
+        fwrite (sp[idx[i]].name, FSCNAMELEN, 1, fp);
+    for (i = 0; i < n; i++)
+        fwrite (&sp[idx[i]].isstar, 1, 1, fp);
+
+    if (ferror(fp))
+    {
+        sprintf (msg, "%s: write: %s", fn, strerror(errno));
+        goto out;
+    }
+    if (fclose (fp) < 0)
+    {
+        fp = NULL;
+        sprintf (msg, "%s: close: %s", fn, strerror(errno));
+        goto out;
+    }
+    fp = NULL;
+    ret = 0;
+
+out:
+    if (fp)
+        fclose (fp);
+    if (np) free ((void *)np);
+    if (pix) free ((void *)pix);
+    if (idx) free ((void *)idx);
+    if (vx) free ((void *)vx);
+    return (ret);
+}
+
+/* add the stars in cell pix at the given level which satisfy qp to ap,
+ *   descending to children if the cell's cap overlaps the query cone.
+ * return 0 if ok, -1 if no more memory.
+ */
+static int
+fscGetStars (FSCQuery *qp, int level, UI pix, FSCArray *ap)
+{
+    FSCNode *np = &fscnode[LEVELBASE(level) + pix];
+    FSCone *cp = &qp->cone;
+    int idx[FSCONEBLK];
+    FSRegion *crp;
+    FieldStar *sp;
+    double *xyz;
+    double c;
+    int n, m, b;
+
+    if (np->n == 0)
+        return (0);
+
+    /* overlap iff separation <= rov + cap radius */
+    c = cp->x*np->x + cp->y*np->y + cp->z*np->z;
+    if (c < cp->crov*np->cr - qp->srov*np->sr && cp->rov + acos(np->cr) < PI)
+        return (0);
+
+    if (level < fschdr->order)
+    {
+        UI p;
+        for (p = 4*pix; p < 4*pix + 4; p++)
+            if (fscGetStars (qp, level+1, p, ap) < 0)
+                return (-1);
+        return (0);
+    }
+
+    /* leaf: brightest first so only those up to the first one too dim */
+    crp = fscLeaf (pix, &sp, &xyz, &n);
+    if (!crp)
+        return (-1);
+    for (m = 0; m < n && sp[m].mag <= qp->mag; m++)
+        continue;
+
+    /* cone test a block at a time */
+    for (b = 0; b < m; b += FSCONEBLK)
+    {
+        int nb = m - b < FSCONEBLK ? m - b : FSCONEBLK;
+        int k = FSConeSelect (cp, xyz+b, xyz+n+b, xyz+2*n+b, nb, idx);
+        int i;
+
+        for (i = 0; i < k; i++)
+            if (fscAddStar (ap, &sp[b+idx[i]]) < 0)
+            {
+                FSCacheRelease (crp);
+                return (-1);
+            }
+    }
+
+    FSCacheRelease (crp);
+    return (0);
+}
+
+/* find the stars of leaf cell pix, and their unit vectors, in the region
+ *   cache, adding them from the mapped catalog if not there yet.
+ * return a handle for FSCacheRelease() as FSCacheFind(), or NULL if no memory.
+ */
+static FSRegion *
+fscLeaf (UI pix, FieldStar **spp, double **xyzp, int *np)
+{
+    FSCNode *cp = &fscnode[LEVELBASE(fschdr->order) + pix];
+    FSRegion *crp;
+    FieldStar *sp;
+    UI i;
+
+    crp = FSCacheFind (FSC_FSCAT, pix, spp, xyzp, np);
+    if (crp)
+        return (crp);
+
+    sp = (FieldStar *) malloc (cp->n*sizeof(FieldStar));
+    if (!sp)
+        return (NULL);
+    for (i = 0; i < cp->n; i++)
+    {
+        UI j = cp->first + i;
+
+        memcpy (sp[i].name, fscname + (size_t)j*FSCNAMELEN, FSCNAMELEN);
+        sp[i].name[FSCNAMELEN-1] = '\0';
+        sp[i].isstar = fscisstar[j];
+        sp[i].ra = fscra[j];
+        sp[i].dec = fscdec[j];
+        sp[i].mag = fscmag[j];
+    }
+
+    *spp = sp;
+    *np = cp->n;
+    crp = FSCacheAdd (FSC_FSCAT, pix, spp, xyzp, np);
+    if (!crp)
+        free ((void *)sp);
+    return (crp);
+}
+
+/* add a copy of *fsp to ap, or just count it if ap->max < 0.
+ * return 0 if ok, -1 if no more memory.
+ */
+static int
+fscAddStar (FSCArray *ap, FieldStar *fsp)
+{
+    if (ap->max < 0)
+    {
+        ap->used++;
+        return (0);
+    }
+
+    if (ap->used == ap->max)
+    {
+        int newmax = ap->max < FSCNINC ? FSCNINC : 2*ap->max;
+        char *newmem = ap->mem ? realloc ((void *)ap->mem,
+                                          newmax*sizeof(FieldStar))
+                       : malloc (newmax*sizeof(FieldStar));
+        if (!newmem)
+            return (-1);
+        ap->mem = (FieldStar *)newmem;
+        ap->max = newmax;
+    }
+
+    ap->mem[ap->used++] = *fsp;
+
+    return (0);
+}
+
+/* return the HEALPix nested pixel at the given order containing the point at
+ * z = sin(dec) and phi = ra, 0 .. 2*PI.
+ * after Gorski et al, ApJ 622:759, 2005.
+ */
+static UI
+hpxAng2Pix (int order, double z, double phi)
+{
+    UI nside = 1u << order;
+    double za = fabs(z);
+    double tt = phi/(PI/2);     /* 0 .. 4 */
+    UI face, ix, iy;
+
+    if (tt >= 4)
+        tt = 0;
+
+    if (za <= 2./3.)
+    {
+        /* equatorial region */
+        double t1 = nside*(0.5 + tt);
+        double t2 = nside*z*0.75;
+        UI jp = (UI)(t1 - t2);  /* ascending edge line index */
+        UI jm = (UI)(t1 + t2);  /* descending edge line index */
+        UI ifp = jp >> order;
+        UI ifm = jm >> order;
+
+        if (ifp == ifm)
+            face = ifp | 4;
+        else if (ifp < ifm)
+            face = ifp;
+        else
+            face = ifm + 8;
+        ix = jm & (nside-1);
+        iy = nside - (jp & (nside-1)) - 1;
+    }
+    else
+    {
+        /* polar caps */
+        int ntt = (int)tt;
+        double tp, tmp;
+        UI jp, jm;
+
+        if (ntt >= 4)
+            ntt = 3;
+        tp = tt - ntt;
+        tmp = nside*sqrt(3*(1 - za));
+        jp = (UI)(tp*tmp);
+        jm = (UI)((1 - tp)*tmp);
+        if (jp >= nside)
+            jp = nside - 1;
+        if (jm >= nside)
+            jm = nside - 1;
+        if (z >= 0)
+        {
+            face = ntt;
+            ix = nside - jm - 1;
+            iy = nside - jp - 1;
+        }
+        else
+        {
+            face = ntt + 8;
+            ix = jp;
+            iy = jm;
+        }
+    }
+
+    return ((face << (2*order)) + hpxSpread(ix) + (hpxSpread(iy) << 1));
+}
+
+/* spread the low 16 bits of v into the even bits of the result */
+static UI
+hpxSpread (UI v)
+{
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return (v);
+}
+
+/* qsort helper to sort star indices by cell then brightness */
+static int
+fscCmp (const void *p1, const void *p2)
+{
+    UI i1 = *(UI *)p1, i2 = *(UI *)p2;
+    float m1, m2;
+
+    if (fscSortPix[i1] != fscSortPix[i2])
+        return (fscSortPix[i1] < fscSortPix[i2] ? -1 : 1);
+    m1 = fscSortStars[i1].mag;
+    m2 = fscSortStars[i2].mag;
+    if (m1 != m2)
+        return (m1 < m2 ? -1 : 1);
+    return (i1 < i2 ? -1 : (i1 > i2));
+}
@@ -0,0 +1,139 @@
+/* FSConeSetup() etc: cone query primitives shared by the field star catalogs.
+ *
+ * Stars are tested as 3-D unit vectors so being within the cone is just one
+ * dot product against cos(radius), with no trig per star and no special cases
+ * at the poles or where RA wraps. FSConeRARange() and FSConeDecRange() give
+ * the RA and Dec limits that bound a cone for catalogs stored in RA/Dec
+ * order, also correct over the poles and across RA 0.
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+#include "P_.h"
+#include "astro.h"
+#include "circum.h"
+#include "fieldstar.h"
+
+/* prepare *cp for a cone of diameter fov centered at ra/dec, all rads.
+ */
+void
+FSConeSetup (FSCone *cp, double ra, double dec, double fov)
+{
+    double cdec = cos(dec);
+
+    cp->ra = ra;
+    cp->dec = dec;
+    cp->rov = fov/2;
+    cp->crov = cos(cp->rov);
+    cp->x = cdec*cos(ra);
+    cp->y = cdec*sin(ra);
+    cp->z = sin(dec);
+}
+
+/* fill x[], y[] and z[] with the unit vectors of the n stars in sp[].
+ */
+void
+FSUnitVecs (FieldStar *sp, int n, double *x, double *y, double *z)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        double ra = sp[i].ra, dec = sp[i].dec;
+        double cdec = cos(dec);
+
+        x[i] = cdec*cos(ra);
+        y[i] = cdec*sin(ra);
+        z[i] = sin(dec);
+    }
+}
+
+/* put the index of each of the n unit vectors x/y/z[] within the cone into
+ *   idx[], in order, and return how many.
+ * the dot products are done a block at a time into a plain array so that loop
+ *   vectorizes, then the hits are gathered.
+ */
+int
+FSConeSelect (FSCone *cp, double *x, double *y, double *z, int n, int idx[])
+{
+    double dot[FSCONEBLK];
+    double cx = cp->x, cy = cp->y, cz = cp->z, crov = cp->crov;
+    int m = 0;
+    int b;
+
+    for (b = 0; b < n; b += FSCONEBLK)
+    {
+        int nb = n - b < FSCONEBLK ? n - b : FSCONEBLK;
+        int i;
+
+        for (i = 0; i < nb; i++)
+            dot[i] = cx*x[b+i] + cy*y[b+i] + cz*z[b+i];
+
+        for (i = 0; i < nb; i++)
+        {
+            idx[m] = b + i;
+            m += dot[i] >= crov;
+        }
+    }
+
+    return (m);
+}
+
+/* find the RA ranges, 0 .. 2*PI, which bound the cone.
+ * return the number of ranges in fr[]/lr[]: 1, or 2 if the cone straddles
+ *   RA 0 in which case the first starts at 0 and the second ends at 2*PI.
+ * a cone containing a pole spans all RA.
+ */
+int
+FSConeRARange (FSCone *cp, double fr[2], double lr[2])
+{
+    double cdec = cos(cp->dec);
+    double ra = cp->ra;
+    double s, hw;
+
+    /* half-width in RA of the cone's widest point */
+    s = cdec > 0 ? sin(cp->rov)/cdec : 2;
+    if (fabs(cp->dec) + cp->rov >= PI/2 || s >= 1)
+    {
+        fr[0] = 0;
+        lr[0] = 2*PI;
+        return (1);
+    }
+    hw = asin(s);
+
+    range (&ra, 2*PI);
+    if (ra - hw < 0)
+    {
+        fr[0] = 0;
+        lr[0] = ra + hw;
+        fr[1] = ra - hw + 2*PI;
+        lr[1] = 2*PI;
+        return (2);
+    }
+    if (ra + hw > 2*PI)
+    {
+        fr[0] = 0;
+        lr[0] = ra + hw - 2*PI;
+        fr[1] = ra - hw;
+        lr[1] = 2*PI;
+        return (2);
+    }
+
+    fr[0] = ra - hw;
+    lr[0] = ra + hw;
+    return (1);
+}
+
+/* find the Dec range which bounds the cone, clamped to the poles.
+ */
+void
+FSConeDecRange (FSCone *cp, double *fd, double *ld)
+{
+    *fd = cp->dec - cp->rov;
+    if (*fd < -PI/2)
+        *fd = -PI/2;
+    *ld = cp->dec + cp->rov;
+    if (*ld > PI/2)
+        *ld = PI/2;
+}
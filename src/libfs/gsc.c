@@ -27,6 +27,8 @@ extern void *malloc(), *realloc();
 #define SEEK_END 2
 #endif
 
+#include <pthread.h>
+
 #include "P_.h"
 #include "astro.h"
 #include "circum.h"
@@ -68,6 +70,7 @@ typedef struct
     double rov;     /* radius-of-view, rads */
     double crov;    /* cos(rov), for convenience */
     double mag;     /* limiting mag */
+    FSCone cone;    /* same cone, for FSConeSelect() */
 } Request;
 
 /* an array of FieldStar which can be grown efficiently in mults of NINC */
@@ -121,11 +124,15 @@ static int nocdrom; /* set if don't wnat to use the cdrom */
 
 static char *lmsg;  /* local ptr to user's msg buffer */
 
+/* one GSCFetch() at a time, the prefetch thread may be running one too */
+static pthread_mutex_t gsclock = PTHREAD_MUTEX_INITIALIZER;
+
 static int handleRequest P_((Request *qp, GSCArray *ap));
 static int fetchRegion P_((GSCRegion *rp, Request *qp, GSCArray *ap));
-static int inFOV P_((Request *qp, GSCEntry *ep));
-static int magOK P_((Request *qp, GSCEntry *ep));
+static int loadRegion P_((GSCRegion *rp, GSCArray *ap));
+static int magOK P_((Request *qp, FieldStar *sp));
 static int addOneStar P_((GSCArray *ap, GSCRegion *rp, GSCEntry *ep));
+static int addFieldStar P_((GSCArray *ap, FieldStar *sp));
 static int mymkdir P_((char *path));
 static int myaccess P_((char *file));
 
@@ -165,10 +172,15 @@ char *chp;
 char msg[];
 {
     /* set up the new paths and flags */
+    pthread_mutex_lock (&gsclock);
     cdpath = cdp;
     nocdrom = !cdpath;
     chpath = chp;
     nocache = !chpath;
+    pthread_mutex_unlock (&gsclock);
+
+    /* regions already in memory may have come from elsewhere */
+    FSCacheFlush (FSC_GSC);
 
     /* check whether cdpath is reasonable */
     if (cdpath)
@@ -231,21 +243,26 @@ char msg[]; /* possible return error or status message */
 {
     Request q;
     GSCArray sa;
+    int s;
 
     /* sanity checks */
+    pthread_mutex_lock (&gsclock);
     if (nocdrom && nocache)
     {
         (void) sprintf (msg, "CDROM and Cache are both disabled");
+        pthread_mutex_unlock (&gsclock);
         return (-1);
     }
     if (!nocdrom && !cdpath)
     {
         (void) sprintf (msg, "No path to CDROM");
+        pthread_mutex_unlock (&gsclock);
         return (-1);
     }
     if (!nocache && !chpath)
     {
         (void) sprintf (msg, "No path to cache");
+        pthread_mutex_unlock (&gsclock);
         return (-1);
     }
 
@@ -259,6 +276,7 @@ char msg[]; /* possible return error or status message */
     /* compute handy trig values once */
     q.cdec = cos(q.dec);
     q.sdec = sin(q.dec);
+    FSConeSetup (&q.cone, ra0, dec0, fov);
 
     /* setup local access to msg and init it */
     lmsg = msg;
@@ -280,7 +298,9 @@ char msg[]; /* possible return error or status message */
     }
 
     /* fetch the stars */
-    if (handleRequest (&q, &sa) < 0)
+    s = handleRequest (&q, &sa);
+    pthread_mutex_unlock (&gsclock);
+    if (s < 0)
     {
         /* beware of a partial collection -- array has likely moved */
         if (spp && sa.mem)
@@ -371,15 +391,79 @@ GSCArray *ap;
 }
 
 /* add stars to the GSCArray for this region and center location.
- * use cache if possible (and desired) else cdrom (if desired).
- * if no cache copy exists, create it along the way (if desired).
- * if ok return count, else put reason in lmsg and return -1.
+ * use the memory cache if it has this region, else load the whole region and
+ *   add it to the memory cache for next time.
+ * if ok return 0, else put reason in lmsg and return -1.
  */
 static int
 fetchRegion (rp, qp, ap)
 GSCRegion *rp;
 Request *qp;
 GSCArray *ap;
+{
+    int idx[FSCONEBLK];
+    FSRegion *crp;
+    FieldStar *sp;
+    double *xyz;
+    int n, b;
+
+    crp = FSCacheFind (FSC_GSC, rp->id, &sp, &xyz, &n);
+    if (!crp)
+    {
+        GSCArray ra;
+
+        ra.mem = NULL;
+        ra.max = ra.used = 0;
+        if (loadRegion (rp, &ra) < 0)
+        {
+            if (ra.mem)
+                free ((void *)ra.mem);
+            return (-1);
+        }
+        sp = ra.mem;
+        n = ra.used;
+        crp = FSCacheAdd (FSC_GSC, rp->id, &sp, &xyz, &n);
+        if (!crp)
+        {
+            if (sp)
+                free ((void *)sp);
+            (void) sprintf (lmsg, "No more memory");
+            return (-1);
+        }
+    }
+
+    /* cone test a block at a time, then magnitude */
+    for (b = 0; b < n; b += FSCONEBLK)
+    {
+        int nb = n - b < FSCONEBLK ? n - b : FSCONEBLK;
+        int m = FSConeSelect (&qp->cone, xyz+b, xyz+n+b, xyz+2*n+b, nb, idx);
+        int i;
+
+        for (i = 0; i < m; i++)
+        {
+            FieldStar *fsp = &sp[b+idx[i]];
+
+            if (magOK(qp,fsp)==0 && addFieldStar (ap, fsp) < 0)
+            {
+                FSCacheRelease (crp);
+                return (-1);
+            }
+        }
+    }
+
+    FSCacheRelease (crp);
+    return (0);
+}
+
+/* add all the stars in the given region to the GSCArray.
+ * use cache if possible (and desired) else cdrom (if desired).
+ * if no cache copy exists, create it along the way (if desired).
+ * if ok return 0, else put reason in lmsg and return -1.
+ */
+static int
+loadRegion (rp, ap)
+GSCRegion *rp;
+GSCArray *ap;
 {
     GSCRegion cr;   /* used for the cache entry */
 
@@ -391,13 +475,10 @@ GSCArray *ap;
 
         while (cacheGetNextEntry (&cr, &e) == 0)
         {
-            if (inFOV(qp,&e)==0 && magOK(qp,&e)==0)
+            if (addOneStar (ap, &cr, &e) < 0)
             {
-                if (addOneStar (ap, &cr, &e) < 0)
-                {
-                    s = -1;
-                    break;
-                }
+                s = -1;
+                break;
             }
         }
 
@@ -421,15 +502,12 @@ GSCArray *ap;
         {
             if (e.id != lastid)
             {
-                if (inFOV(qp,&e)==0 && magOK(qp,&e)==0)
+                if (s == 0 && addOneStar (ap, rp, &e) < 0)
                 {
-                    if (addOneStar (ap, rp, &e) < 0)
-                    {
-                        s = -1;
-                        /* quit unless building cache */
-                        if (cacheok < 0)
-                            break;
-                    }
+                    s = -1;
+                    /* quit unless building cache */
+                    if (cacheok < 0)
+                        break;
                 }
 
                 if (cacheok == 0)
@@ -458,39 +536,47 @@ GSCArray *ap;
     return (-1);
 }
 
-/* return 0 if the given entry is within the given request, else return -1.
- */
+/* return 0 if the given star is at least as bright as the faint limit, else -1 */
 static int
-inFOV (qp, ep)
+magOK (qp, sp)
 Request *qp;
-GSCEntry *ep;
+FieldStar *sp;
 {
-    double cr = qp->sdec*sin(ep->dec) +
-                qp->cdec*cos(ep->dec)*cos(qp->ra - ep->ra);
-    return (cr < qp->crov);
+    return (sp->mag <= qp->mag ? 0 : -1);
 }
 
-/* return 0 if the given entry is at least as bright as the faint limit, else -1 */
+/* add one GSC entry to ap[], growing if necessary.
+ * if max is -1 we just count but don't actually build the array.
+ * return 0 if ok, else put reason in lmsg and return -1
+ */
 static int
-magOK (qp, ep)
-Request *qp;
+addOneStar (ap, rp, ep)
+GSCArray *ap;
+GSCRegion *rp;
 GSCEntry *ep;
 {
-    return (ep->mag <= qp->mag ? 0 : -1);
+    FieldStar fs;
+
+    zero_mem ((void *)&fs, sizeof(fs));
+    (void) sprintf (fs.name, "GSC %04d-%04d", rp->id, ep->id);
+    fs.isstar = !ep->class;
+    fs.ra = (float)ep->ra;
+    fs.dec = (float)ep->dec;
+    fs.mag = (float)ep->mag;
+
+    return (addFieldStar (ap, &fs));
 }
 
-/* add one GSC entry to ap[], growing if necessary.
+/* add a copy of *fsp to ap[], growing if necessary.
  * if max is -1 we just count but don't actually build the array.
  * return 0 if ok, else put reason in lmsg and return -1
  */
 static int
-addOneStar (ap, rp, ep)
+addFieldStar (ap, fsp)
 GSCArray *ap;
-GSCRegion *rp;
-GSCEntry *ep;
+FieldStar *fsp;
 {
     int sz = sizeof(FieldStar);
-    FieldStar *sp;
 
     if (ap->max < 0)
     {
@@ -513,13 +599,7 @@ GSCEntry *ep;
         ap->max += NINC;
     }
 
-    sp = (FieldStar *)&ap->mem[ap->used++];
-
-    (void) sprintf (sp->name, "GSC %04d-%04d", rp->id, ep->id);
-    sp->isstar = !ep->class;
-    sp->ra = (float)ep->ra;
-    sp->dec = (float)ep->dec;
-    sp->mag = (float)ep->mag;
+    ap->mem[ap->used++] = *fsp;
 
     return (0);
 }
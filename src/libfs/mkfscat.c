@@ -0,0 +1,236 @@
+/* build a binary field star catalog for FSCSetup()/FSCFetch() from the GSC
+ * and/or USNO SA CDROMs.
+ *
+ * the sky is walked in dec bands of BANDH degrees, each cut into ra tiles about
+ * as wide as they are high. each tile is fetched as a cone just enclosing it
+ * and only the stars actually inside the tile are kept so none are duplicated.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "P_.h"
+#include "astro.h"
+#include "circum.h"
+#include "fieldstar.h"
+
+#define BANDH   4.0     /* dec band height, degrees */
+#define TILEPAD 1.05    /* cone radius margin around each tile */
+
+static int getTile (double r1, double r2, double d1, double d2, int last,
+                    FieldStar **spp, int n);
+static void usage (void);
+
+static char *pname;
+static char *gscpath;       /* GSC cdrom, if any */
+static char *cachepath;     /* GSC cache, if any */
+static char *usnopath;      /* USNO cdrom, if any */
+static double maxmag = 20.0;/* faintest star to keep */
+static int verbose;
+
+int
+main (int ac, char *av[])
+{
+    char msg[1024];
+    char src[64];
+    FieldStar *sp = NULL;
+    int order = 6;
+    double d1;
+    int n = 0;
+
+    pname = av[0];
+
+    while ((--ac > 0) && ((*++av)[0] == '-'))
+    {
+        char *s;
+        for (s = av[0]+1; *s != '\0'; s++)
+            switch (*s)
+            {
+                case 'g':
+                    if (ac < 2)
+                        usage();
+                    gscpath = *++av;
+                    ac--;
+                    break;
+                case 'h':
+                    if (ac < 2)
+                        usage();
+                    cachepath = *++av;
+                    ac--;
+                    break;
+                case 'u':
+                    if (ac < 2)
+                        usage();
+                    usnopath = *++av;
+                    ac--;
+                    break;
+                case 'm':
+                    if (ac < 2)
+                        usage();
+                    maxmag = atof (*++av);
+                    ac--;
+                    break;
+                case 'o':
+                    if (ac < 2)
+                        usage();
+                    order = atoi (*++av);
+                    ac--;
+                    break;
+                case 'v':
+                    verbose = 1;
+                    break;
+                default:
+                    usage();
+            }
+    }
+
+    /* ac remaining args starting at av[0] */
+    if (ac != 1 || (!gscpath && !cachepath && !usnopath))
+        usage();
+
+    if ((gscpath || cachepath) && GSCSetup (gscpath, cachepath, msg) < 0)
+    {
+        fprintf (stderr, "GSC: %s\n", msg);
+        exit(1);
+    }
+    if (usnopath && USNOSetup (usnopath, !gscpath && !cachepath, msg) < 0)
+    {
+        fprintf (stderr, "%s: %s\n", usnopath, msg);
+        exit(1);
+    }
+
+    /* walk the sky */
+    for (d1 = -90.0; d1 < 90.0; d1 += BANDH)
+    {
+        double d2 = d1 + BANDH;
+        double cd = cos(degrad(fabs(d1) < fabs(d2) ? d1 : d2));
+        int nt = (d1 < -90+BANDH || d2 > 90-BANDH) ? 1
+                 : (int)ceil(360.0*cd/BANDH);
+        int t;
+
+        for (t = 0; t < nt; t++)
+        {
+            double r1 = 360.0*t/nt;
+            double r2 = 360.0*(t+1)/nt;
+
+            n = getTile (r1, r2, d1, d2, d2 >= 90.0, &sp, n);
+            if (n < 0)
+                exit (1);
+        }
+
+        if (verbose)
+            fprintf (stderr, "Dec %5.1f .. %5.1f: %d stars\n", d1, d2, n);
+    }
+
+    sprintf (src, "%s%s%s", gscpath || cachepath ? "GSC" : "",
+             (gscpath || cachepath) && usnopath ? "+" : "",
+             usnopath ? "USNO" : "");
+    if (FSCWrite (av[0], sp, n, order, src, msg) < 0)
+    {
+        fprintf (stderr, "%s\n", msg);
+        exit (1);
+    }
+
+    return (0);
+}
+
+/* append to *spp all catalog stars within the given ra and dec range, degrees.
+ * the upper dec edge is included only if last.
+ * return new total, or -1 after reporting trouble.
+ */
+static int
+getTile (double r1, double r2, double d1, double d2, int last, FieldStar **spp,
+         int n)
+{
+    FieldStar *tsp = NULL;
+    double ra0, dec0, rov, s;
+    double rmin = degrad(r1), rmax = degrad(r2);
+    double dmin = degrad(d1), dmax = degrad(d2);
+    char msg[1024];
+    int nt = 0, i;
+
+    /* cone centered on the tile just reaching its farthest corner or pole */
+    ra0 = (rmin + rmax)/2;
+    dec0 = (dmin + dmax)/2;
+    if (d2 >= 90.0)
+        dec0 = PI/2;
+    else if (d1 <= -90.0)
+        dec0 = -PI/2;
+    rov = 0;
+    for (i = 0; i < 4; i++)
+    {
+        double r = (i&1) ? rmax : rmin;
+        double d = (i&2) ? dmax : dmin;
+
+        solve_sphere (r - ra0, PI/2 - d, sin(dec0), cos(dec0), &s, NULL);
+        s = acos(s);
+        if (s > rov)
+            rov = s;
+    }
+    rov *= TILEPAD;
+
+    if (usnopath)
+    {
+        nt = USNOFetch (ra0, dec0, 2*rov, maxmag, &tsp, msg);
+        if (nt < 0)
+        {
+            fprintf (stderr, "USNO: %s\n", msg);
+            return (-1);
+        }
+    }
+    if (gscpath || cachepath)
+    {
+        nt = GSCFetch (ra0, dec0, 2*rov, maxmag, &tsp, nt, msg);
+        if (nt < 0)
+        {
+            fprintf (stderr, "GSC: %s\n", msg);
+            return (-1);
+        }
+    }
+
+    /* keep just those inside the tile */
+    for (i = 0; i < nt; i++)
+    {
+        FieldStar *fsp = &tsp[i];
+        double r = fsp->ra, d = fsp->dec;
+
+        range (&r, 2*PI);
+        if (r < rmin || r >= rmax || d < dmin || d > dmax
+                || (d == dmax && !last))
+            continue;
+        if (n % 4096 == 0)
+        {
+            FieldStar *newsp = (FieldStar *) realloc ((void *)*spp,
+                               (n + 4096)*sizeof(FieldStar));
+            if (!newsp)
+            {
+                fprintf (stderr, "No memory for %d stars\n", n);
+                free ((void *)tsp);
+                return (-1);
+            }
+            *spp = newsp;
+        }
+        (*spp)[n++] = *fsp;
+    }
+
+    if (tsp)
+        free ((void *)tsp);
+    return (n);
+}
+
+static void
+usage()
+{
+    fprintf (stderr, "%s: [options] catalog.fsc\n", pname);
+    fprintf (stderr, "  -g path: GSC cdrom path\n");
+    fprintf (stderr, "  -h path: GSC cache path\n");
+    fprintf (stderr, "  -u path: USNO SA cdrom path\n");
+    fprintf (stderr, "  -m mag : faintest star to keep. default is 20\n");
+    fprintf (stderr, "  -o n   : HEALPix order of the leaf cells. default is 6\n");
+    fprintf (stderr, "  -v     : report progress\n");
+    fprintf (stderr, "at least one of -g, -h or -u is required.\n");
+
+    exit (1);
+}
@@ -9,6 +9,8 @@
 #include <errno.h>
 #include <math.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
 
 #include "P_.h"
 #include "astro.h"
@@ -17,6 +19,7 @@
 #include "fieldstar.h"
 
 /*
+ * 1.2          Bulk chunk reads, region cache, parallel swaths
  * 1.1  2/23/98 Switch to FieldStar
  * 1.0  2/15/98 Works great.
  * 0.1  2/11/98 begin work
@@ -25,11 +28,15 @@
 
 #define CATBPR  12  /* bytes per star record in .cat file */
 #define ACCBPR  30  /* bytes per record in .acc file */
+#define ACCRA   3.75    /* RA covered by each .acc record, degrees */
+#define NACC    96  /* .acc records per zone */
 
 typedef unsigned int UI;
 typedef unsigned char UC;
 
-/* an array of FieldStar which can be grown efficiently in mults of NINC */
+#define CRACKBLK 256   /* records decoded per block by crackCatRecs() */
+
+/* an array of FieldStar which grows geometrically, at least NINC at a time */
 typedef struct
 {
     FieldStar *mem; /* malloced array */
@@ -37,13 +44,32 @@ typedef struct
     int max;        /* cells in mem[] */
 } StarArray;
 
-#define NINC    16  /* grow ObjFArray array this many at a time */
+#define NINC    256 /* first allocation, FieldStars */
+
+#define NZONES  3   /* most zones a field can span */
 
-static int corner (double r0, double d0, double rov, int *nr, double fr[2],
-                   double lr[2], int *nd, double fd[2], double ld[2], int zone[2], char msg[]);
-static int fetchSwath (int zone, double maxmag, double fr, double lr,
-                       double fd, double ld, StarArray *stara, char msg[]);
-static int crackCatBuf (UC buf[CATBPR], FieldStar *sp);
+/* one zone and ra range to fetch, possibly on its own thread */
+typedef struct
+{
+    int zone;           /* zone file */
+    FSCone *cone;       /* field */
+    double maxmag;      /* faintest mag */
+    double fr, lr;      /* ra limits, degrees */
+    StarArray stara;    /* results */
+    int s;              /* fetchSwath() return */
+    char msg[1024];     /* excuse if s < 0 */
+} Swath;
+
+static void corner (FSCone *cp, int *nr, double fr[2], double lr[2], int *nd,
+                    int zone[NZONES]);
+static int fetchSwath (int zone, FSCone *cp, double maxmag, double fr,
+                       double lr, StarArray *stara, char msg[]);
+static void *swathThread (void *vp);
+static int loadChunks (int zone, int c0, int c1, int cat, char loaded[],
+                       FSRegion *crp[], FieldStar *csp[], double *cxyz[], int cn[],
+                       char msg[]);
+static int preadAll (int fd, void *buf, size_t n, off_t os);
+static int crackCatRecs (UC *buf, long nrec, FieldStar *sp);
 static int addGS (StarArray *stara, FieldStar *sp);
 
 static char *cdpath;        /* where CD rom is mounted */
@@ -75,6 +101,10 @@ USNOSetup (char *cdp, int wantgsc, char msg[])
     cdpath = malloc (strlen(cdp) + 1);
     strcpy (cdpath, cdp);
 
+    /* regions already in memory may have come from elsewhere */
+    FSCacheFlush (FSC_USNO);
+    FSCacheFlush (FSC_USNONOGSC);
+
     /* store GSC flag */
     nogsc = !wantgsc;
 
@@ -97,12 +127,15 @@ USNOFetch (
     char msg[]) /* filled with error message if return -1 */
 {
     double fr[2], lr[2];    /* first and last ra in each region, up to 2 */
-    double fd[2], ld[2];    /* first and last dec in each region, up to 2 */
-    int nr, nd;     /* number of ra and dec regions, max 2 each */
-    int zone[2];        /* zone for filename, up to 2 */
-    double rov;     /* radius of view, degrees */
-    StarArray stara;    /* malloc accumulator */
-    int i, j, s;
+    int nr, nd;     /* number of ra regions and zones */
+    int zone[NZONES];   /* zone for filename */
+    FSCone cone;        /* the field */
+    Swath sw[2*NZONES]; /* each zone and ra range */
+    pthread_t tid[2*NZONES];/* thread for each sw[] after the first */
+    char started[2*NZONES]; /* whether tid[] was started */
+    FieldStar *mem;     /* final result */
+    int nsw, n;
+    int i, j, k;
 
     /* insure there is a cdpath set up */
     if (!cdpath)
@@ -111,277 +144,464 @@ USNOFetch (
         return (-1);
     }
 
-    /* convert to cdrom units */
-    r0 = raddeg(r0);
-    d0 = raddeg(d0);
-    rov = raddeg (fov)/2;
-    if (rov >= 7.5)
+    /* the zones and ra ranges which cover the field */
+    if (fov/2 >= degrad(7.5))
     {
         strcpy (msg, "Radius must be less than 7.5 degrees");
         return (-1);
     }
+    FSConeSetup (&cone, r0, d0, fov);
+    corner (&cone, &nr, fr, lr, &nd, zone);
 
-    /* find the files to use and ranges in each */
-    i = corner (r0, d0, rov, &nr, fr, lr, &nd, fd, ld, zone, msg);
-    if (i < 0)
-        return (-1);
-
-    /* init the memory array */
-    stara.mem = NULL;
-    stara.used = 0;
-    stara.max = 0;
-
-    /* fetch each chunk, adding to stara */
+    /* one swath per zone and ra range */
+    nsw = 0;
     for (i = 0; i < nd; i++)
     {
         for (j = 0; j < nr; j++)
         {
-            s = fetchSwath(zone[i],fmag,fr[j],lr[j],fd[i],ld[i],&stara,msg);
-            if (s < 0)
+            Swath *wp = &sw[nsw++];
+
+            wp->zone = zone[i];
+            wp->cone = &cone;
+            wp->maxmag = fmag;
+            wp->fr = fr[j];
+            wp->lr = lr[j];
+            wp->stara.mem = NULL;
+            wp->stara.used = 0;
+            wp->stara.max = 0;
+        }
+    }
+
+    /* fetch all but the first on their own threads, or here if can't */
+    for (k = 1; k < nsw; k++)
+        started[k] = pthread_create (&tid[k], NULL, swathThread,
+                                     (void *)&sw[k]) == 0;
+    swathThread ((void *)&sw[0]);
+    for (k = 1; k < nsw; k++)
+    {
+        if (started[k])
+            pthread_join (tid[k], NULL);
+        else
+            swathThread ((void *)&sw[k]);
+    }
+
+    /* gather in order, naming as we go */
+    n = 0;
+    for (k = 0; k < nsw; k++)
+    {
+        if (sw[k].s < 0)
+        {
+            strcpy (msg, sw[k].msg);
+            n = -1;
+            break;
+        }
+        n += sw[k].stara.used;
+    }
+    mem = NULL;
+    if (n > 0)
+    {
+        mem = (FieldStar *) malloc (n * sizeof(FieldStar));
+        if (!mem)
+        {
+            sprintf (msg, "No memory for %d stars", n);
+            n = -1;
+        }
+    }
+    if (mem)
+    {
+        FieldStar *sp = mem;
+
+        for (k = 0; k < nsw; k++)
+        {
+            for (i = 0; i < sw[k].stara.used; i++, sp++)
             {
-                if (stara.mem)
-                    free ((void *)stara.mem);
-                return (-1);
+                *sp = sw[k].stara.mem[i];
+                sprintf (sp->name, "SA1.0 %06d", (int)(sp - mem));
             }
         }
     }
+    for (k = 0; k < nsw; k++)
+        if (sw[k].stara.mem)
+            free ((void *)sw[k].stara.mem);
 
     /* caller told not to free if return 0 */
-    if (stara.used == 0 && stara.mem != NULL)
-        free ((void *)stara.mem);
+    if (n > 0)
+        *spp = mem;
+    return (n);
+}
 
-    /* ok */
-    *spp = stara.mem;
-    return (stara.used);
+/* pthread wrapper around fetchSwath() */
+static void *
+swathThread (void *vp)
+{
+    Swath *wp = (Swath *)vp;
+
+    wp->s = fetchSwath (wp->zone, wp->cone, wp->maxmag, wp->fr, wp->lr,
+                        &wp->stara, wp->msg);
+    return (NULL);
 }
 
-static int
-corner (double r0, double d0, double rov, int *nr, double fr[2], double lr[2],
-        int *nd, double fd[2], double ld[2], int zone[2], char msg[])
+/* find the ra ranges, in degrees, and zones which cover the field *cp.
+ */
+static void
+corner (FSCone *cp, int *nr, double fr[2], double lr[2], int *nd,
+        int zone[NZONES])
 {
-    double cd = cos(degrad(d0));
-    double x1, x2;
-    int z1, z2;
-    int z, j;
-
-    /* find limits on ra, taking care if span 24h */
-    x1 = r0 - rov/cd;
-    x2 = r0 + rov/cd;
-    if (x1 < 0.0)
-    {
-        *nr = 2;
-        fr[0] = 0.0;
-        lr[0] = x2;
-        fr[1] = 360.0 + x1;
-        lr[1] = 360.0;
-    }
-    else if (x2 >= 360.0)
-    {
-        *nr = 2;
-        fr[0] = 0.0;
-        lr[0] = x2 - 360.0;
-        fr[1] = x1;
-        lr[1] = 360.0;
-    }
-    else
+    double fd, ld;
+    int z1, z2, z;
+
+    /* ra limits, taking care if span 24h or a pole */
+    *nr = FSConeRARange (cp, fr, lr);
+    for (z = 0; z < *nr; z++)
     {
-        *nr = 1;
-        fr[0] = x1;
-        lr[0] = x2;
+        fr[z] = raddeg(fr[z]);
+        lr[z] = raddeg(lr[z]);
     }
 
-    /* find dec limits and zones */
-    x1 = d0 - rov;
-    x2 = d0 + rov;
-    z1 = (int)floor((x1 + 90.0)/7.5);
-    z2 = (int)floor((x2 + 90.0)/7.5);
-    *nd = z2 - z1 + 1;
-    if (*nd > 2)
+    /* 7.5 degree dec zones, the last one includes +90 */
+    FSConeDecRange (cp, &fd, &ld);
+    z1 = (int)floor((raddeg(fd) + 90.0)/7.5);
+    z2 = (int)floor((raddeg(ld) + 90.0)/7.5);
+    if (z2 > 23)
+        z2 = 23;
+    if (z2 - z1 >= NZONES)
+        z2 = z1 + NZONES - 1;   /* can not happen if rov < 7.5 */
+    *nd = 0;
+    for (z = z1; z <= z2; z++)
+        zone[(*nd)++] = z*75;
+}
+
+/* add stars in the given zone within the given ra limits, degrees, and the
+ *   field *cp and at least as bright as maxmag to stara.
+ * each 15 minute RA chunk of the zone is decoded once and kept in the shared
+ *   region cache; those not already there are read together.
+ * return 0 if ok, else -1 with reason in msg[].
+ */
+static int
+fetchSwath (int zone, FSCone *cp, double maxmag, double fr, double lr,
+            StarArray *stara, char msg[])
+{
+    int cat = nogsc ? FSC_USNONOGSC : FSC_USNO;
+    FSRegion *crp[NACC];    /* cache handle for each chunk, if any */
+    FieldStar *csp[NACC];   /* stars in each chunk */
+    double *cxyz[NACC];     /* their unit vectors */
+    int cn[NACC];           /* n stars in each chunk */
+    char loaded[NACC];      /* whether chunk is in csp[] yet */
+    int nmiss = 0;
+    int c0, c1, c;
+    int s = 0;
+
+#ifdef TRACE_FETCH
+    fprintf (stderr, "Zone %4d RA:%6.2f..%6.2f\n", zone, fr, lr);
+#endif
+
+    /* chunks spanned */
+    c0 = (int)floor(fr/ACCRA);
+    c1 = (int)floor(lr/ACCRA);
+    if (c1 >= NACC)
+        c1 = NACC-1;
+
+    /* now want in rads */
+    fr = degrad(fr);
+    lr = degrad(lr);
+
+    /* use what is already cached, read the rest */
+    for (c = c0; c <= c1; c++)
     {
-        *nd = 2;
-        z2 = z1 + 1;
-        /*
-        sprintf (msg, "No! ndec = %d", *nd);
-        return (-1);
-        */
+        crp[c] = FSCacheFind (cat, (zone/75)*NACC + c, &csp[c], &cxyz[c],
+                              &cn[c]);
+        loaded[c] = crp[c] != NULL;
+        if (!loaded[c])
+            nmiss++;
     }
-    j = 0;
-    for (z = z1; z <= z2; z++)
+    if (nmiss > 0)
+        s = loadChunks (zone, c0, c1, cat, loaded, crp, csp, cxyz, cn, msg);
+
+    for (c = c0; c <= c1; c++)
     {
-        double dmin = z*7.5 - 90.0;
-        double dmax = dmin+7.5;
-        zone[j] = z*75;
-        fd[j] = x1 > dmin ? x1 : dmin;
-        ld[j] = x2 < dmax ? x2 : dmax;
-        j++;
+        FieldStar *sp = csp[c];
+        double *xyz = cxyz[c];
+        int n = cn[c];
+        int idx[FSCONEBLK];
+        int b;
+
+        if (!loaded[c])
+            continue;
+
+        /* cone test a block at a time. still check ra so stars are not
+         * added twice when both ra ranges touch the same chunk.
+         */
+        for (b = 0; s == 0 && b < n; b += FSCONEBLK)
+        {
+            int nb = n - b < FSCONEBLK ? n - b : FSCONEBLK;
+            int m = FSConeSelect (cp, xyz+b, xyz+n+b, xyz+2*n+b, nb, idx);
+            int i;
+
+            for (i = 0; i < m; i++)
+            {
+                FieldStar *fsp = &sp[b+idx[i]];
+
+                if (fsp->mag<=maxmag && fsp->ra>=fr && fsp->ra<=lr
+                        && addGS (stara, fsp) < 0)
+                {
+                    sprintf (msg, "No more memory");
+                    s = -1;
+                    break;
+                }
+            }
+        }
+
+        FSCacheRelease (crp[c]);
     }
 
-    return (0);
+    return (s);
 }
 
+/* read and decode each chunk c0..c1 of zone not yet loaded[], reading each run
+ *   of consecutive such chunks with one pread, and add them to the cache.
+ * set loaded[] for each one done, with its stars in csp[] and cn[], their
+ *   unit vectors in cxyz[] and cache handle in crp[].
+ * return 0 if ok, else -1 with reason in msg[].
+ */
 static int
-fetchSwath (int zone, double maxmag, double fr, double lr, double fd,
-            double ld, StarArray *stara, char msg[])
+loadChunks (int zone, int c0, int c1, int cat, char loaded[], FSRegion *crp[],
+            FieldStar *csp[], double *cxyz[], int cn[], char msg[])
 {
+    char accbuf[NACC*ACCBPR+1];
+    long frec[NACC], nrec[NACC];
     char fn[1024], *bfn;
-    char buf[ACCBPR];
-    UC catbuf[CATBPR];
-    FieldStar fs;
-    long frec;
-    off_t os;
-    FILE *fp;
-
-#ifdef TRACE_FETCH
-    fprintf (stderr, "Zone %4d RA:%6.2f..%6.2f Dec:%6.2f..%6.2f\n",
-             zone, fr, lr, fd, ld);
-#endif
+    UC *catbuf = NULL;
+    int fd, c, e;
 
-    /* read access file for position in catalog file */
+    /* read access file records for position and size of each chunk */
     sprintf (fn, "%s/zone%04d.acc", cdpath, zone);
     bfn = basenm(fn);
-    fp = fopen (fn, "r");
-    if (fp == NULL)
+    fd = open (fn, O_RDONLY);
+    if (fd < 0)
     {
         sprintf (msg, "%s: %s", bfn, strerror(errno));
         return (-1);
     }
-    os = ACCBPR*(off_t)floor(fr/3.75);
-    if (fseek (fp, os, SEEK_SET) < 0)
+    if (preadAll (fd, accbuf, (c1-c0+1)*ACCBPR, (off_t)c0*ACCBPR) < 0)
     {
-        sprintf (msg, "%s: fseek(%ld): %s", bfn, (long)os, strerror(errno));
-        fclose (fp);
+        sprintf (msg, "%s: read(@%ld): %s", bfn, (long)c0*ACCBPR,
+                 errno ? strerror(errno) : "unexpected EOF");
+        close (fd);
         return (-1);
     }
-    if (!fread (buf, ACCBPR, 1, fp))
+    close (fd);
+    for (c = c0; c <= c1; c++)
     {
-        if (ferror(fp))
-            sprintf (msg, "%s: fread(@%ld): %s", bfn, (long)os,
-                     strerror(errno));
-        else
-            sprintf (msg, "%s: unexpected EOF @ %ld", bfn, (long)os);
-        fclose (fp);
-        return (-1);
-    }
-    fclose (fp);
-    if (sscanf (buf, "%*f %ld", &frec) != 1)
-    {
-        sprintf (msg, "%s: sscanf(%s)", bfn, buf);
-        return (-1);
+        char *bp = accbuf + (c-c0)*ACCBPR;
+        char save = bp[ACCBPR];
+
+        bp[ACCBPR] = '\0';
+        e = sscanf (bp, "%*f %ld %ld", &frec[c], &nrec[c]);
+        bp[ACCBPR] = save;
+        if (e != 2)
+        {
+            sprintf (msg, "%s: sscanf(%.*s)", bfn, ACCBPR, bp);
+            return (-1);
+        }
     }
 
 #ifdef TRACE_FETCH
-    fprintf (stderr, "    frec=%6ld\n", frec);
+    fprintf (stderr, "    frec=%6ld..%6ld\n", frec[c0], frec[c1]+nrec[c1]);
 #endif
 
-    /* open and position the catalog file */
     sprintf (fn, "%s/zone%04d.cat", cdpath, zone);
     bfn = basenm(fn);
-    fp = fopen (fn, "r");
-    if (fp == NULL)
+    fd = open (fn, O_RDONLY);
+    if (fd < 0)
     {
         sprintf (msg, "%s: %s", bfn, strerror(errno));
         return (-1);
     }
-    os = (off_t)(frec-1)*CATBPR;
-    if (fseek (fp, os, SEEK_SET) < 0)
+
+    for (c = c0; c <= c1; c = e+1)
     {
-        sprintf (msg, "%s: fseek(%ld): %s", bfn, (long)os, strerror(errno));
-        fclose (fp);
-        return (-1);
-    }
+        long first, nr;
 
-    /* now want in rads */
-    fr = degrad(fr);
-    lr = degrad(lr);
-    fd = degrad(fd);
-    ld = degrad(ld);
+        /* find next run c .. e of chunks still needed */
+        if (loaded[c])
+        {
+            e = c;
+            continue;
+        }
+        for (e = c; e < c1 && !loaded[e+1]; e++)
+            continue;
 
-    /* read until find star with RA larger than lr */
-    while (fread (catbuf, CATBPR, 1, fp))
-    {
-        int cstat = crackCatBuf (catbuf, &fs);
-        int fstat = fs.mag<=maxmag && fs.ra>=fr && fs.ra<=lr
-                    && fs.dec>=fd && fs.dec<=ld;
-        os += CATBPR;
-        if (cstat==0 && fstat)
+        /* read the whole run at once */
+        first = frec[c];
+        nr = frec[e] + nrec[e] - first;
+        if (nr > 0)
         {
-            if (addGS (stara, &fs) < 0)
+            catbuf = (UC *) malloc (nr*CATBPR);
+            if (!catbuf)
             {
+                sprintf (msg, "No memory for %ld stars", nr);
+                goto bad;
+            }
+            if (preadAll (fd, catbuf, nr*CATBPR, (off_t)(first-1)*CATBPR) < 0)
+            {
+                sprintf (msg, "%s: read(@%ld): %s", bfn,
+                         (long)(first-1)*CATBPR,
+                         errno ? strerror(errno) : "unexpected EOF");
+                goto bad;
+            }
+        }
+
+        /* crack each chunk and add to cache */
+        for (; c <= e; c++)
+        {
+            FieldStar *sp = NULL;
+            int n = 0;
+
+            if (nrec[c] > 0)
+            {
+                sp = (FieldStar *) malloc (nrec[c]*sizeof(FieldStar));
+                if (!sp)
+                {
+                    sprintf (msg, "No memory for %ld stars", nrec[c]);
+                    goto bad;
+                }
+                n = crackCatRecs (catbuf + (frec[c]-first)*CATBPR, nrec[c],
+                                  sp);
+                if (n == 0)
+                {
+                    free ((void *)sp);
+                    sp = NULL;
+                }
+            }
+
+            crp[c] = FSCacheAdd (cat, (zone/75)*NACC + c, &sp, &cxyz[c], &n);
+            if (!crp[c])
+            {
+                if (sp)
+                    free ((void *)sp);
                 sprintf (msg, "No more memory");
-                fclose (fp);
-                return (-1);
+                goto bad;
             }
+            csp[c] = sp;
+            cn[c] = n;
+            loaded[c] = 1;
         }
 
-        /* sorted by ra so finished when hit upper limit */
-        if (fs.ra > lr)
-            break;
+        if (catbuf)
+        {
+            free ((void *)catbuf);
+            catbuf = NULL;
+        }
     }
 
-    if (ferror(fp))
+    close (fd);
+    return (0);
+
+bad:
+    if (catbuf)
+        free ((void *)catbuf);
+    close (fd);
+    return (-1);
+}
+
+/* read exactly n bytes at offset os of fd into buf.
+ * return 0 if ok, else -1 with errno set, or 0 if short.
+ */
+static int
+preadAll (int fd, void *buf, size_t n, off_t os)
+{
+    char *bp = (char *)buf;
+
+    while (n > 0)
     {
-        sprintf(msg,"%s: fread(@%ld): %s",bfn,(long)os,strerror(errno));
-        fclose (fp);
-        return (-1);
+        ssize_t s = pread (fd, bp, n, os);
+        if (s < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return (-1);
+        }
+        if (s == 0)
+        {
+            errno = 0;
+            return (-1);
+        }
+        bp += s;
+        os += s;
+        n -= s;
     }
 
-    /* finished */
-    fclose (fp);
-
-    /* ok*/
     return (0);
 }
 
-/* crack the star field in buf.
- * return 0 if ok, else -1.
+/* crack the nrec star records in buf into sp[], skipping unusable ones.
+ * work in blocks, first unpacking each field into plain arrays then converting
+ *   them, so the loops are simple enough for the compiler to vectorize.
+ * return number of stars put in sp[].
  */
 static int
-crackCatBuf (UC buf[CATBPR], FieldStar *sp)
+crackCatRecs (UC *buf, long nrec, FieldStar *sp)
 {
 #define BEUPACK(b) (((UI)((b)[0])<<24) | ((UI)((b)[1])<<16) | ((UI)((b)[2])<<8)\
                                 | ((UI)((b)[3])))
-    double ra, dec;
-    int red, blu;
-    UI mag;
+    static const double rascale = PI/(180.0*100.0*3600.0);  /* rads/unit */
+    static const double decscale = PI/(180.0*100.0*3600.0);
+    UI ra[CRACKBLK], dec[CRACKBLK], mag[CRACKBLK];
+    float fmag[CRACKBLK];
+    int n = 0;
+    long b;
+
+    for (b = 0; b < nrec; b += CRACKBLK)
+    {
+        int nb = nrec - b < CRACKBLK ? (int)(nrec - b) : CRACKBLK;
+        UC *bp = buf + b*CATBPR;
+        int i;
 
-    /* first 4 bytes are packed RA, big-endian */
-    ra = BEUPACK(buf)/(100.0*3600.0*15.0);
-    sp->ra = hrrad(ra);
+        /* RA, Dec and mag info are each 4 bytes packed big-endian */
+        for (i = 0; i < nb; i++)
+        {
+            ra[i] = BEUPACK(bp + i*CATBPR);
+            dec[i] = BEUPACK(bp + i*CATBPR + 4);
+            mag[i] = BEUPACK(bp + i*CATBPR + 8);
+        }
 
-    /* next 4 bytes are packed Dec, big-endian */
-    dec = BEUPACK(buf+4)/(100.0*3600.0) - 90.0;
-    sp->dec = degrad(dec);
+        /* mag info can lead to rejection, marked with fmag < 0.
+         * negative means corresponding GSC.
+         * lower 3 digits are red, next 3 up are blue, tenths of a mag.
+         */
+        for (i = 0; i < nb; i++)
+        {
+            UI m = mag[i];
+            int isgsc = (m >> 31) != 0;
+            UI red, blu;
+
+            m &= 0x7fffffff;
+            red = m % 1000u;
+            blu = (m/1000u) % 1000u;
+            fmag[i] = (red <= 250 ? red : blu)/10.0f;
+            if ((isgsc && nogsc) || m >= 1000000000u
+                    || (red > 250 && blu > 250))
+                fmag[i] = -1;
+        }
 
-    /* last 4 bytes are packed mag info -- can lead to rejection */
-    mag = BEUPACK(buf+8);
-    if (mag & (1<<31))
-    {
-        /* negative means corresponding GSC */
-        if (nogsc)
-            return (-1);
-        mag &= 0x7fffffff;  /* just chop off sign?? or negate?? */
-    }
-    if (mag >= 1000000000)
-        return (-1);    /* poor magnitudes */
-    red = mag % 1000u;  /* lower 3 digits */
-    blu = (mag/1000u)%1000u;/* next 3 digits up */
-    if (red > 250)
-    {
-        if (blu > 250)
-            return (-1);    /* poor colors */
-        else
-            sp->mag = blu/10.0;
+        /* keep the good ones */
+        for (i = 0; i < nb; i++)
+        {
+            if (fmag[i] < 0)
+                continue;
+            sp[n].ra = ra[i]*rascale;
+            sp[n].dec = dec[i]*decscale - PI/2;
+            sp[n].mag = fmag[i];
+            sp[n].isstar = 1;   /* assume it's a star */
+            n++;
+        }
     }
-    else
-        sp->mag = red/10.0;
-
-    /* assume it's a star */
-    sp->isstar = 1;
 
-    return (0);
+    return (n);
 }
 
-/* add sp to stara.
+/* add sp to stara, doubling its size when full.
+ * N.B. the name is made up later when the swaths are gathered.
  * return -1 if no more memory, else 0.
  */
 static int
@@ -391,18 +611,16 @@ addGS (StarArray *stara, FieldStar *sp)
     if (stara->used == stara->max)
     {
         char *newmem = (char *)stara->mem;
+        int newmax = stara->max ? 2*stara->max : NINC;
 
-        stara->max += NINC;
-        newmem = newmem ? realloc (newmem, stara->max*sizeof(ObjF))
-                 : malloc (NINC * sizeof(ObjF));
+        newmem = newmem ? realloc (newmem, newmax*sizeof(FieldStar))
+                 : malloc (newmax*sizeof(FieldStar));
         if (!newmem)
             return (-1);
         stara->mem = (FieldStar *)newmem;
+        stara->max = newmax;
     }
 
-    /* make up a name */
-    sprintf (sp->name, "SA1.0 %06d", stara->used);
-
     /* fill and increment count used */
     stara->mem[stara->used++] = *sp;
 
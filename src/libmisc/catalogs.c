@@ -1,5 +1,6 @@
 /* code to read xephem database files.
  * plus special handling for speedy reading of the sao catalog.
+ * plus an on-disk name index beside each other catalog, see nixSearch().
  */
 
 #include <stdio.h>
@@ -7,8 +8,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <math.h>
 
 #include "P_.h"
@@ -18,8 +23,64 @@
 #include "strops.h"
 #include "telenv.h"
 
+/* one entry in a name index.
+ * key is the whitespace- and case-folded name as checkNameMatch() compares
+ * it: any leading number designation then the rest, cut at '(' and MAXNM.
+ * a name with a designation gets a second entry with just the rest, as
+ * checkNameMatch() will match that too.
+ */
+#define NIXSUFFIX   ".nix"      /* appended to catalog file name */
+#define NIXMAGIC    "EDBNIX1"   /* first bytes of each index file */
+#define NIXKEY      24          /* key chars, NUL-padded, maybe not terminated*/
+#define NIXPERLINE  512         /* most NixRec from one 511 char line */
+typedef struct
+{
+    char key[NIXKEY];           /* folded name */
+    unsigned int off;           /* file offset of its line */
+    unsigned short sub;         /* which name on the line, 0 first */
+    unsigned char dlen;         /* leading chars of key from designation */
+    unsigned char pad;
+} NixRec;
+
+/* index file header, followed by n NixRec sorted by key then off */
+typedef struct
+{
+    char magic[8];              /* NIXMAGIC */
+    long long size;             /* st_size of the catalog indexed */
+    long long mtime;            /* st_mtime of the catalog indexed */
+    int mtimens;                /* and its nanoseconds */
+    int n;                      /* number of NixRec */
+} NixHdr;
+
+/* catalogs whose index could not be built, so we do not try again on each
+ * search unless the catalog changes.
+ */
+#define NIXNFAIL    8           /* most remembered, oldest forgotten first */
+typedef struct
+{
+    char path[1100];            /* nix path */
+    long long size;             /* st_size of the catalog then */
+    long long mtime;            /* st_mtime of the catalog then */
+} NixFail;
+static NixFail nixfail[NIXNFAIL];
+static int nnixfail;            /* total ever added, next is %NIXNFAIL */
+
+static FILE *openCatalog (char catdir[], char catalog[], char path[],
+                          char m[]);
 static int sao_catalog (FILE *fp);
 static int do_sao (FILE *fp, char name[], Obj *op, char m[]);
+static int nixSearch (char path[], FILE *fp, char source[], Obj *op);
+static char *nixDes (char *d, char des[]);
+static void nixSlash (char *d);
+static int nixKey (char key[], char des[], char rest[]);
+static int nixLineKeys (char line[], NixRec rp[], int maxr);
+static int nixFold (char *s, char key[]);
+static NixHdr *nixOpen (char path[], FILE *fp, size_t *lenp);
+static int nixBuild (char path[], char nixpath[], FILE *fp, struct stat *sp);
+static NixFail *nixFailed (char nixpath[], struct stat *sp);
+static int nixLower (NixRec *rp, int n, char key[], int len);
+static int nixRecCmp (const void *p1, const void *p2);
+static int nixOffCmp (const void *p1, const void *p2);
 
 static int caseCharCmp(char a, char b)
 {
@@ -181,8 +242,6 @@ char m[];
 {
     char path[1024];
     char buf[512];
-    struct dirent *dirent;
-    DIR *dir;
     FILE *fp;
 
     /* check for easy planet name first */
@@ -197,35 +256,9 @@ char m[];
         return (-1);
     }
 
-    /* open and scan catdir for catalog, any case */
-    dir = opendir (catdir);
-    if (!dir)
-    {
-        sprintf (m, "%s: %s", catdir, strerror(errno));
-        return (-1);
-    }
-    dirent = NULL;
-    for (fp = NULL; !fp && (dirent = readdir (dir)) != NULL; )
-    {
-        /* see if d_name works */
-        if (strcasecmp (dirent->d_name, catalog))
-        {
-            (void) sprintf (buf, "%s.edb", catalog);
-            if (strcasecmp (dirent->d_name, buf))
-                continue;
-        }
-
-        (void) sprintf (path, "%s/%s", catdir, dirent->d_name);
-        fp = telfopen (path, "r");
-    }
-
-    (void) closedir (dir);
-
+    fp = openCatalog (catdir, catalog, path, m);
     if (!fp)
-    {
-        sprintf (m, "Can not find catalog '%s' in '%s'", catalog, catdir);
         return (-1);
-    }
 
     /* first check for sao catalog */
     if (sao_catalog (fp))
@@ -235,6 +268,18 @@ char m[];
         return (s);
     }
 
+    /* then try the name index */
+    switch (nixSearch (path, fp, source, op))
+    {
+        case 0:
+            fclose (fp);
+            return (0);
+        case -1:
+            fclose (fp);
+            sprintf (m, "`%s' not found in `%s'", source, catalog);
+            return (-1);
+    }
+
     /* scan for source, ignoring whitespace and case up to MAXNM-1 chars */
     while (fgets (buf, sizeof(buf), fp) != NULL)
     {
@@ -381,6 +426,85 @@ char m[];
     return (-1);
 }
 
+/* find up to max names in the given catalog in catdir which begin with
+ * prefix, ignoring white and case as searchCatalog(), such as to complete
+ * a name as it is typed. names are copied to names[] in index order.
+ * return the number found, else fill in m and return -1.
+ */
+int
+prefixCatalog (char catdir[], char catalog[], char prefix[],
+               char names[][MAXNM], int max, char m[])
+{
+    char path[1024];
+    char buf[512];
+    char key[NIXKEY];
+    unsigned int *offs;
+    NixHdr *hp;
+    NixRec *rp;
+    size_t len;
+    FILE *fp;
+    int i, j, n, kl, nfound;
+
+    if (!catdir || catdir[0] == '\0' || !catalog || catalog[0] == '\0'
+            || !prefix || max <= 0)
+    {
+        sprintf (m, "No dir, catalog or prefix");
+        return (-1);
+    }
+    if (nixFold (prefix, key) < 0)
+        return (0);
+
+    fp = openCatalog (catdir, catalog, path, m);
+    if (!fp)
+        return (-1);
+    hp = nixOpen (path, fp, &len);
+    if (!hp)
+    {
+        sprintf (m, "%s: can not make name index", path);
+        fclose (fp);
+        return (-1);
+    }
+    offs = (unsigned int *) malloc (2 * max * sizeof(unsigned int));
+    if (!offs)
+    {
+        sprintf (m, "%s: No memory", path);
+        munmap ((void *)hp, len);
+        fclose (fp);
+        return (-1);
+    }
+    rp = (NixRec *)(hp + 1);
+    n = hp->n;
+
+    /* names are indexed with and without any designation, so skip twins */
+    kl = strnlen (key, NIXKEY);
+    nfound = 0;
+    for (i = nixLower (rp, n, key, kl);
+            i < n && nfound < max && !strncmp (rp[i].key, key, kl); i++)
+    {
+        Obj o;
+
+        for (j = 0; j < nfound; j++)
+            if (offs[2*j] == rp[i].off && offs[2*j+1] == rp[i].sub)
+                break;
+        if (j < nfound)
+            continue;
+        if (fseek (fp, (long)rp[i].off, SEEK_SET) < 0
+                || fgets (buf, sizeof(buf), fp) == NULL)
+            continue;
+        buf[strlen(buf)-1] = '\0';
+        if (db_crack_line_name (buf, &o, NULL, rp[i].sub) < 0)
+            continue;
+        offs[2*nfound] = rp[i].off;
+        offs[2*nfound+1] = rp[i].sub;
+        strcpy (names[nfound++], o.o_name);
+    }
+
+    free ((void *)offs);
+    munmap ((void *)hp, len);
+    fclose (fp);
+    return (nfound);
+}
+
 /* return 1 if file starts with SAO, else 0.
  * N.B. we always return with fp rewound.
  */
@@ -456,5 +580,505 @@ do_sao (FILE *fp, char name[], Obj *op, char m[])
     return (-1);
 }
 
+/* open catalog in catdir, allowing any case and no .edb suffix.
+ * if found return its FILE and full name in path[], else fill m and return
+ * NULL.
+ */
+static FILE *
+openCatalog (char catdir[], char catalog[], char path[], char m[])
+{
+    char buf[512];
+    struct dirent *dirent;
+    DIR *dir;
+    FILE *fp;
+
+    /* open and scan catdir for catalog, any case */
+    dir = opendir (catdir);
+    if (!dir)
+    {
+        sprintf (m, "%s: %s", catdir, strerror(errno));
+        return (NULL);
+    }
+    dirent = NULL;
+    for (fp = NULL; !fp && (dirent = readdir (dir)) != NULL; )
+    {
+        /* see if d_name works */
+        if (strcasecmp (dirent->d_name, catalog))
+        {
+            (void) sprintf (buf, "%s.edb", catalog);
+            if (strcasecmp (dirent->d_name, buf))
+                continue;
+        }
+
+        (void) sprintf (path, "%s/%s", catdir, dirent->d_name);
+        fp = telfopen (path, "r");
+    }
+
+    (void) closedir (dir);
+
+    if (!fp)
+        sprintf (m, "Can not find catalog '%s' in '%s'", catalog, catdir);
+    return (fp);
+}
+
+/* look up source in the catalog open at fp, named path, with its name index.
+ * the index just narrows the lines to try; each is then read and checked
+ * exactly as searchCatalog() scans, so the same first match is found.
+ * return 0 if found and *op filled, -1 if not in this catalog, or -2 if
+ * there is no usable index so the caller must scan (fp is then rewound).
+ */
+static int
+nixSearch (char path[], FILE *fp, char source[], Obj *op)
+{
+    char buf[512];
+    char key[2][NIXKEY];
+    char des[80];
+    unsigned int *offs;
+    char *s;
+    NixHdr *hp;
+    NixRec *rp;
+    size_t len;
+    int dlen, noffs, moffs, n, i, k, kl;
+
+    dlen = nixFold (source, key[0]);
+    if (dlen < 0 || !(hp = nixOpen (path, fp, &len)))
+    {
+        rewind (fp);
+        return (-2);
+    }
+    rp = (NixRec *)(hp + 1);
+    n = hp->n;
+
+    /* a name with a designation also matches a line whose name without its
+     * designation starts with it, compared up to MAXNM chars.
+     */
+    memcpy (key[1], key[0], NIXKEY);
+    memset (key[1] + MAXNM, 0, NIXKEY - MAXNM);
+
+    /* collect the offsets of all candidate lines */
+    offs = NULL;
+    noffs = moffs = 0;
+    for (k = 0; k < 2; k++)
+    {
+        kl = strnlen (key[k], NIXKEY);
+        if (k == 1 && (dlen == 0 || !memcmp (key[0], key[1], NIXKEY)))
+            break;
+        for (i = nixLower (rp, n, key[k], kl);
+                i < n && !strncmp (rp[i].key, key[k], kl); i++)
+        {
+            /* exact, or any with the same designation if that is all */
+            if (strncmp (rp[i].key, key[k], NIXKEY)
+                    && (k == 1 || kl != dlen || rp[i].dlen != dlen))
+                continue;
+            if (noffs == moffs)
+            {
+                unsigned int *newoffs;
+
+                moffs += 64;
+                newoffs = realloc ((void *)offs, moffs*sizeof(unsigned int));
+                if (!newoffs)
+                {
+                    if (offs)
+                        free ((void *)offs);
+                    munmap ((void *)hp, len);
+                    rewind (fp);
+                    return (-2);
+                }
+                offs = newoffs;
+            }
+            offs[noffs++] = rp[i].off;
+        }
+    }
+    munmap ((void *)hp, len);
+
+    /* the scan converts any MPC / in source on its first line, so do too */
+    for (s = source; *s && *s <= 32; s++)
+        continue;
+    nixSlash (nixDes (s, des));
+
+    /* check each in file order just as the scan would */
+    if (noffs > 1)
+        qsort ((void *)offs, noffs, sizeof(unsigned int), nixOffCmp);
+    for (i = 0; i < noffs; i++)
+    {
+        int match;
+
+        if (i > 0 && offs[i] == offs[i-1])
+            continue;
+        if (fseek (fp, (long)offs[i], SEEK_SET) < 0
+                || fgets (buf, sizeof(buf), fp) == NULL)
+            continue;
+        match = checkNameMatch(buf, source);
+        if (match)
+        {
+            buf[strlen(buf)-1] = '\0';
+            if (db_crack_line_name (buf, op, NULL, match-1) == 0)
+            {
+                free ((void *)offs);
+                return (0);
+            }
+        }
+    }
+
+    if (offs)
+        free ((void *)offs);
+    return (-1);
+}
+
+/* parse the leading number designation of a name at d into des[] as
+ * checkNameMatch(): the digits, and the next char too unless it is a blank.
+ * return the rest of the name after it.
+ */
+static char *
+nixDes (char *d, char des[])
+{
+    int nd = 0;
+
+    while (*d && isdigit(*d))
+    {
+        if (nd < 78)
+            des[nd++] = *d;
+        d++;
+    }
+    if (nd > 0)
+    {
+        if (*d != ' ')
+            des[nd++] = toupper(*d);
+        if (*d)
+            d++;
+    }
+    des[nd] = '\0';
+    return (d);
+}
+
+/* convert the second / from d on to (, as checkNameMatch() does for the MPC
+ * convention of reusing / for the discoverer.
+ */
+static void
+nixSlash (char *d)
+{
+    int first = 0;
+
+    for (; *d && *d != '(' && *d != ','; d++)
+    {
+        if (*d == '/')
+        {
+            if (first)
+            {
+                *d = '(';
+                break;
+            }
+            first = 1;
+        }
+    }
+}
+
+/* fill key[] with des then rest, NUL-padded and limited to NIXKEY.
+ * return the number of key chars from des.
+ */
+static int
+nixKey (char key[], char des[], char rest[])
+{
+    int i, j, nd;
+
+    memset (key, 0, NIXKEY);
+    for (i = 0; i < NIXKEY && des[i]; i++)
+        key[i] = des[i];
+    nd = i;
+    for (j = 0; i < NIXKEY && rest[j]; )
+        key[i++] = rest[j++];
+    return (nd);
+}
+
+/* fill rp[] with the index keys of each name in an edb line, as
+ * checkNameMatch() would compare them. set all but off.
+ * return the number of NixRec used.
+ */
+static int
+nixLineKeys (char line[], NixRec rp[], int maxr)
+{
+    char copy[512];
+    char des[80];
+    char rest[MAXNM+1];
+    char *p, *w;
+    int sub, nr, nrest;
+
+    (void) sprintf (copy, "%.*s", (int)sizeof(copy)-1, line);
+    p = copy;
+    for (sub = nr = 0; *p && *p != ',' && *p != '|' && nr+2 <= maxr; sub++)
+    {
+        w = p;
+        while (*w && *w <= 32)
+            w++;
+        w = nixDes (w, des);
+        nixSlash (w);
+
+        /* the rest, sans white, up to ( or end of this name */
+        while (*w && *w <= 32)
+            w++;
+        for (nrest = 0; *w && *w != '(' && *w != ',' && *w != '|'; w++)
+            if (*w > 32 && nrest < MAXNM)
+                rest[nrest++] = toupper(*w);
+        rest[nrest] = '\0';
+
+        rp[nr].dlen = nixKey (rp[nr].key, des, rest);
+        rp[nr].sub = sub;
+        rp[nr++].pad = 0;
+        if (des[0])
+        {
+            rp[nr].dlen = nixKey (rp[nr].key, "", rest);
+            rp[nr].sub = sub;
+            rp[nr++].pad = 0;
+        }
+
+        /* on to the next name */
+        while (*w && *w != ',' && *w != '|')
+            w++;
+        if (*w == '|')
+            w++;
+        p = w;
+    }
+
+    return (nr);
+}
+
+/* fill key[] with the index key for s, a name being looked up.
+ * return the number of key chars from its designation, or -1 if s can not
+ * be looked up by key at all.
+ */
+static int
+nixFold (char *s, char key[])
+{
+    char copy[512];
+    char des[80];
+    char rest[MAXNM+1];
+    char *t;
+    int nrest;
+
+    while (*s && *s <= 32)
+        s++;
+    (void) sprintf (copy, "%.*s", (int)sizeof(copy)-1, s);
+    t = nixDes (copy, des);
+    nixSlash (t);
+    for (nrest = 0; *t && *t != '('; t++)
+    {
+        if (*t == ',' || *t == '|')
+            return (-1);
+        if (*t > 32 && nrest < MAXNM)
+            rest[nrest++] = toupper(*t);
+    }
+    rest[nrest] = '\0';
+    if (!des[0] && !rest[0])
+        return (-1);
+
+    return (nixKey (key, des, rest));
+}
+
+/* mmap the name index for the catalog open at fp, named path, building it
+ * first if it is missing or the catalog has changed since.
+ * return the mapping and set *lenp to its size, else return NULL.
+ */
+static NixHdr *
+nixOpen (char path[], FILE *fp, size_t *lenp)
+{
+    char nixpath[1100];
+    struct stat st, nst;
+    NixHdr *hp;
+    int fd, try;
+
+    if (fstat (fileno(fp), &st) < 0)
+        return (NULL);
+    (void) sprintf (nixpath, "%s%s", path, NIXSUFFIX);
+
+    for (try = 0; try < 2; try++)
+    {
+        fd = telopen (nixpath, O_RDONLY);
+        if (fd >= 0)
+        {
+            if (fstat (fd, &nst) == 0 && nst.st_size >= sizeof(NixHdr))
+            {
+                hp = mmap (NULL, nst.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                close (fd);
+                if (hp != MAP_FAILED)
+                {
+                    if (!memcmp (hp->magic, NIXMAGIC, sizeof(NIXMAGIC))
+                            && hp->size == st.st_size
+                            && hp->mtime == st.st_mtime
+                            && hp->mtimens == st.st_mtim.tv_nsec
+                            && nst.st_size == sizeof(NixHdr)
+                            + (off_t)hp->n*sizeof(NixRec))
+                    {
+                        *lenp = nst.st_size;
+                        return (hp);
+                    }
+                    munmap ((void *)hp, nst.st_size);
+                }
+            }
+            else
+                close (fd);
+        }
+        if (try == 0 && nixFailed (nixpath, &st))
+            break;
+        if (try == 0 && nixBuild (path, nixpath, fp, &st) < 0)
+        {
+            NixFail *np = &nixfail[nnixfail++ % NIXNFAIL];
+
+            (void) strcpy (np->path, nixpath);
+            np->size = st.st_size;
+            np->mtime = st.st_mtime;
+            break;
+        }
+    }
+
+    return (NULL);
+}
+
+/* return the note that building nixpath failed for a catalog of stat *sp,
+ * else NULL.
+ */
+static NixFail *
+nixFailed (char nixpath[], struct stat *sp)
+{
+    int i, n = nnixfail < NIXNFAIL ? nnixfail : NIXNFAIL;
+
+    for (i = 0; i < n; i++)
+        if (nixfail[i].size == sp->st_size && nixfail[i].mtime == sp->st_mtime
+                && !strcmp (nixfail[i].path, nixpath))
+            return (&nixfail[i]);
+    return (NULL);
+}
+
+/* build the name index nixpath for the catalog open at fp, named path, whose
+ * stat is *sp. the new file replaces any old one all at once.
+ * return 0 if ok, else -1.
+ */
+static int
+nixBuild (char path[], char nixpath[], FILE *fp, struct stat *sp)
+{
+#define NIXCHUNK    4096        /* number of NixRec we malloc each time */
+    char tmppath[1200];
+    char buf[512];
+    NixHdr h;
+    NixRec *rp;
+    int nr, mr, ok;
+    FILE *nfp;
+    long off;
+
+    if (sp->st_size > 0xffffffffL)
+        return (-1);
+
+    /* no sense reading it all if we can not write the index */
+    (void) sprintf (tmppath, "%s.%d", nixpath, (int)getpid());
+    nfp = fopen (tmppath, "w");
+    if (!nfp)
+        return (-1);
+
+    /* a key or two for each name of each line, as searchCatalog() reads */
+    rp = NULL;
+    nr = mr = 0;
+    rewind (fp);
+    for (off = 0; fgets (buf, sizeof(buf), fp) != NULL; off = ftell (fp))
+    {
+        int i, n;
+
+        if (buf[0] == '#' || buf[0] == '!' || isspace(buf[0]))
+            continue;
+        if (nr + NIXPERLINE > mr)
+        {
+            NixRec *newrp;
+
+            mr += NIXCHUNK;
+            newrp = realloc ((void *)rp, mr * sizeof(NixRec));
+            if (!newrp)
+            {
+                if (rp)
+                    free ((void *)rp);
+                (void) fclose (nfp);
+                (void) unlink (tmppath);
+                return (-1);
+            }
+            rp = newrp;
+        }
+        n = nixLineKeys (buf, rp + nr, NIXPERLINE);
+        for (i = 0; i < n; i++)
+            rp[nr+i].off = (unsigned int)off;
+        nr += n;
+    }
+    if (nr > 1)
+        qsort ((void *)rp, nr, sizeof(NixRec), nixRecCmp);
+
+    /* write to the temp file, then rename over any old one */
+    memset ((void *)&h, 0, sizeof(h));
+    memcpy (h.magic, NIXMAGIC, sizeof(NIXMAGIC));
+    h.size = sp->st_size;
+    h.mtime = sp->st_mtime;
+    h.mtimens = sp->st_mtim.tv_nsec;
+    h.n = nr;
+    ok = fwrite ((void *)&h, sizeof(h), 1, nfp) == 1
+         && (nr == 0 || fwrite ((void *)rp, sizeof(NixRec), nr, nfp) == nr);
+    if (fclose (nfp) != 0 || !ok)
+    {
+        if (rp)
+            free ((void *)rp);
+        (void) unlink (tmppath);
+        return (-1);
+    }
+    if (rp)
+        free ((void *)rp);
+    if (rename (tmppath, nixpath) < 0)
+    {
+        (void) unlink (tmppath);
+        return (-1);
+    }
+
+    return (0);
+}
+
+/* return the first of the n sorted rp[] whose key is not less than the first
+ * len chars of key[].
+ */
+static int
+nixLower (NixRec *rp, int n, char key[], int len)
+{
+    int lo = 0, hi = n;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi)/2;
+
+        if (strncmp (rp[mid].key, key, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return (lo);
+}
+
+/* qsort compare NixRec by key then line */
+static int
+nixRecCmp (const void *p1, const void *p2)
+{
+    NixRec *r1 = (NixRec *)p1;
+    NixRec *r2 = (NixRec *)p2;
+    int c = strncmp (r1->key, r2->key, NIXKEY);
+
+    if (c)
+        return (c);
+    if (r1->off != r2->off)
+        return (r1->off < r2->off ? -1 : 1);
+    return ((int)r1->sub - (int)r2->sub);
+}
+
+/* qsort compare file offsets */
+static int
+nixOffCmp (const void *p1, const void *p2)
+{
+    unsigned int o1 = *(unsigned int *)p1;
+    unsigned int o2 = *(unsigned int *)p2;
+
+    return (o1 < o2 ? -1 : (o1 > o2 ? 1 : 0));
+}
+
 /* For RCS Only -- Do Not Edit */
 static char *rcsid[2] = {(char *)rcsid, "@(#) $RCSfile: catalogs.c,v $ $Date: 2002/03/12 16:45:41 $ $Revision: 1.2 $ $Name:  $"};
@@ -0,0 +1,144 @@
+/* csiStatOpen(): attach, or create, the shared memory csimcd counts into.
+ * csiHistAdd(): add one time to a CsiHist.
+ * csiHistDiff(): the times added to a CsiHist between two copies of it.
+ * csiHistPct(): a percentile of a CsiHist.
+ *
+ * csimcd is the only writer and just bumps counters as it goes, readers
+ * such as csimc -s copy the whole segment now and then and report the
+ * differences as rates. A copy may be torn across a few counters, which
+ * is of no consequence for rates over a second or so.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "csiutil.h"
+#include "csistats.h"
+
+static int bucket (double us);
+static double bucketHi (int i);
+
+/* attach the CsiStatShm of the csimcd serving port, and return it at *spp.
+ * if create, make it if need be and zero it, as csimcd does when it starts;
+ * else it must already exist.
+ * return 0 if ok, else -1 with errno set.
+ */
+int
+csiStatOpen (int port, int create, CsiStatShm **spp)
+{
+    key_t key = CSISTATSHMKEY + port - CSIMCPORT;
+    int len = sizeof(CsiStatShm);
+    int shmid;
+    void *addr;
+
+    shmid = shmget (key, len, create ? 0664 : 0);
+    if (shmid < 0 && create)
+    {
+        /* EINVAL means one from an older csimcd of another size */
+        if (errno == EINVAL && (shmid = shmget (key, 0, 0)) >= 0)
+        {
+            (void) shmctl (shmid, IPC_RMID, NULL);
+            errno = ENOENT;
+        }
+        if (errno == ENOENT)
+            shmid = shmget (key, len, 0664 | IPC_CREAT);
+    }
+    if (shmid < 0)
+        return (-1);
+
+    addr = shmat (shmid, NULL, create ? 0 : SHM_RDONLY);
+    if (addr == (void *)-1)
+        return (-1);
+    if (create)
+        memset (addr, 0, len);
+
+    *spp = (CsiStatShm *)addr;
+    return (0);
+}
+
+/* add us to hp */
+void
+csiHistAdd (CsiHist *hp, double us)
+{
+    if (us < 0)
+        us = 0;
+    hp->n++;
+    hp->sum += us;
+    if (us > hp->max)
+        hp->max = us;
+    hp->b[bucket(us)]++;
+}
+
+/* set diff to the times added to now since it was then */
+void
+csiHistDiff (CsiHist *now, CsiHist *then, CsiHist *diff)
+{
+    int i, top;
+
+    diff->n = now->n - then->n;
+    diff->sum = now->sum - then->sum;
+    for (i = top = 0; i < CSIHNB; i++)
+        if ((diff->b[i] = now->b[i] - then->b[i]) > 0)
+            top = i;
+
+    /* longest is only known to its bucket, unless it is a new record */
+    if (now->max > then->max)
+        diff->max = now->max;
+    else if (diff->n == 0)
+        diff->max = 0;
+    else
+        diff->max = bucketHi (top) < now->max ? bucketHi (top) : now->max;
+}
+
+/* return the time, us, pct percent of those in hp are no longer than.
+ * N.B. it is the longest of its bucket so it may be high by 1/CSIHSUB.
+ */
+double
+csiHistPct (CsiHist *hp, double pct)
+{
+    double want = pct/100.0*hp->n;
+    unsigned sum;
+    int i;
+
+    if (hp->n == 0)
+        return (0.0);
+
+    for (i = sum = 0; i < CSIHNB-1; i++)
+        if ((sum += hp->b[i]) >= want && sum > 0)
+            break;
+    return (bucketHi(i) < hp->max ? bucketHi(i) : hp->max);
+}
+
+/* return the bucket for time us */
+static int
+bucket (double us)
+{
+    unsigned v = us >= (double)(1u<<31) ? 1u<<31 : (unsigned)us;
+    int e, i;
+
+    if (v < CSIHSUB)
+        return (v);
+
+    /* e is the top bit, the next 3 pick the sub-bucket */
+    for (e = 3; e < 31 && v >> (e+1); e++)
+        continue;
+    i = (e-2)*CSIHSUB + ((v >> (e-3)) & (CSIHSUB-1));
+    return (i < CSIHNB ? i : CSIHNB-1);
+}
+
+/* return the longest time in bucket i, us */
+static double
+bucketHi (int i)
+{
+    if (i < CSIHSUB)
+        return (i);
+    if (i >= CSIHNB-1)
+        return (1e12);
+    i++;
+    return ((double)((CSIHSUB + i%CSIHSUB) << (i/CSIHSUB - 3 + 2)) - 1);
+}
@@ -0,0 +1,70 @@
+/* csistats.c: csimcd traffic counters, published in shared memory.
+ * include csiutil.h first.
+ */
+
+#ifndef CSISTATS_H
+#define CSISTATS_H
+
+/* shared memory key for the csimcd on CSIMCPORT; others add port-CSIMCPORT.
+ * N.B. bug in some ipcrm's prevents removing it if it's greater than 1<<31.
+ */
+#define CSISTATSHMKEY   0x4e56361b
+
+/* histogram of times, us. buckets are exact below CSIHSUB, then each
+ * doubling is split in CSIHSUB so any bucket is within 1/CSIHSUB of its
+ * value, up to about 8 secs; anything longer lands in the last.
+ */
+#define CSIHSUB     8       /* buckets per doubling */
+#define CSIHNB      176     /* total buckets */
+typedef struct
+{
+    unsigned n;             /* times added */
+    double sum;             /* sum of all, us */
+    unsigned max;           /* longest, us */
+    unsigned b[CSIHNB];     /* count per bucket */
+} CsiHist;
+
+/* traffic with one node */
+typedef struct
+{
+    unsigned xpkts, rpkts;  /* packets sent to it, good ones from it */
+    unsigned xbytes, rbytes;/* data bytes in them */
+    unsigned retries;       /* packets sent again for want of an ACK */
+    unsigned badchk;        /* packets from it with bad data checksum */
+    unsigned restarts;      /* times rebooted for not ACKing */
+    unsigned tokens;        /* tokens sent it */
+    unsigned toklost;       /* tokens it did not return */
+    CsiHist ackus;          /* ACK latency, us */
+    CsiHist tokus;          /* token round trip, us */
+} CsiNodeStats;
+
+/* traffic of one client, ie, one host address */
+typedef struct
+{
+    int inuse;              /* set while connected */
+    int toaddr;             /* node address */
+    int why;                /* OpenWhy */
+    unsigned xpkts, rpkts;  /* packets sent for it, good ones to it */
+    unsigned xbytes, rbytes;/* data bytes in them */
+    unsigned retries;       /* packets sent again for want of an ACK */
+    CsiHist ackus;          /* ACK latency, us */
+} CsiHostStats;
+
+/* the whole segment. all counts are since csimcd started. */
+typedef struct
+{
+    int pid;                /* csimcd pid, 0 once it exits */
+    long start;             /* time csimcd started, unix secs */
+    double update;          /* time of last change, unix secs */
+    unsigned badhdr;        /* packets with bad header checksum, any node */
+    unsigned ringtrips;     /* times the token has been around the ring */
+    CsiNodeStats node[NNODES];  /* per node address */
+    CsiHostStats host[NHOSTS];  /* per host address - NNODES */
+} CsiStatShm;
+
+extern int csiStatOpen (int port, int create, CsiStatShm **spp);
+extern void csiHistAdd (CsiHist *hp, double us);
+extern void csiHistDiff (CsiHist *now, CsiHist *then, CsiHist *diff);
+extern double csiHistPct (CsiHist *hp, double pct);
+
+#endif /* CSISTATS_H */
@@ -9,6 +9,8 @@
 #include <errno.h>
 
 #include <unistd.h>
+#include <poll.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/param.h>
@@ -116,7 +118,24 @@ csimcd_clconn (char *host, int port)
 
 /*** hi-level API connections *********************************************/
 
+#define CSIRBUF     1024    /* bytes buffered from each connection */
+#define CSIMAXREP   128     /* max bytes kept of each reply */
+
+/* one request from csi_send() */
+typedef struct
+{
+    int id;                 /* > 0 */
+    CsiReplyCB cb;          /* call with reply, else keep it for csi_poll() */
+    void *arg;              /* passed to cb */
+    double sent;            /* unix time sent */
+    double when;            /* unix time halfway from sent to reply */
+    int done;               /* set when reply is in */
+    char reply[CSIMAXREP];  /* reply, through its newline */
+} CsiReq;
+
 /* table to look up host and network addresses from file descriptor.
+ * also holds what has been read but not yet consumed, and requests
+ * awaiting replies.
  * malloced/grown as needed.
  */
 typedef struct
@@ -126,10 +145,24 @@ typedef struct
     int haddr;
     int naddr;
     OpenWhy why;
+    char rbuf[CSIRBUF];     /* bytes read from fd but not yet consumed */
+    int rlen;               /* number of them */
+    CsiReq req[CSIMAXREQ];  /* requests in order sent */
+    int nreq;               /* number of them */
+    int nextid;             /* id of the next request */
 } FDInfo;
 static FDInfo *fdinfo;
 static int nfdinfo;
 
+static char *vfmt (char buf[], int bufl, int *lp, char *fmt, va_list ap);
+static int writeAll (int fd, char *buf, int l);
+static int fill (FDInfo *fp, int block);
+static int match (FDInfo *fp);
+static int takeLine (FDInfo *fp, char buf[], int buflen, int whole);
+static double unixNow (void);
+static void abandon (int n, int fd[], int id[]);
+static void discard (int fd, int id, char *reply, void *arg);
+
 static void
 fdiAdd (int fd, int haddr, int naddr, int why)
 {
@@ -158,6 +191,9 @@ fdiAdd (int fd, int haddr, int naddr, int why)
     fp->haddr = haddr;
     fp->naddr = naddr;
     fp->why = why;
+    fp->rlen = 0;
+    fp->nreq = 0;
+    fp->nextid = 1;
 }
 
 static FDInfo *
@@ -278,10 +314,15 @@ csi_f2n (int fd)
 int
 csi_intr (int fd)
 {
+    FDInfo *fp = fdiFind (fd);
     Byte a = CSIMCD_INTR;
 
     if (!fdisShell(fd))
         return (-1);
+
+    /* whatever was said or asked before is moot now */
+    fp->rlen = 0;
+    fp->nreq = 0;
     if (write (fd, &a, 1) < 0)
         return (-1);
     if (read (fd, &a, 1) < 0)
@@ -316,37 +357,64 @@ int
 csi_w (int fd, char *fmt, ...)
 {
     va_list ap;
-    char buf[1024];
+    char sbuf[1024], *buf;
     int l;
 
     va_start (ap, fmt);
-    l = vsprintf (buf, fmt, ap);
+    buf = vfmt (sbuf, sizeof(sbuf), &l, fmt, ap);
     va_end (ap);
-
-    if (write (fd, buf, l) < 0)
+    if (!buf)
         return (-1);
 
+    if (writeAll (fd, buf, l) < 0)
+        l = -1;
+
+    if (buf != sbuf)
+        free (buf);
     return (l);
 }
 
 /* wait for and read up through the next newline or buflen-1 chars, whichever
  * comes first, into buf[]. '\0' is added to the end. Returns count, 0 if EOF,
  * or -1 if error.
+ * any requests from csi_send() still awaiting replies get theirs first.
  */
 int
 csi_r (int fd, char buf[], int buflen)
 {
+    FDInfo *fp = fdiFind (fd);
     int s, n;
 
-    for (n = 0; n < buflen-1; )
+    if (!fp)
     {
-        if ((s = read (fd, &buf[n], 1)) <= 0)
-            return (s);
-        if (buf[n++] == '\n')
+        /* not ours, so no buffer: a byte at a time so as not to overread */
+        for (n = 0; n < buflen-1; )
+        {
+            if ((s = read (fd, &buf[n], 1)) <= 0)
+                return (s);
+            if (buf[n++] == '\n')
+                break;
+        }
+
+        buf[n] = '\0';
+        return (n);
+    }
+
+    for (;;)
+    {
+        match (fp);
+        if (!(fp = fdiFind (fd)) || !fp->nreq || fp->req[fp->nreq-1].done)
             break;
+        if ((s = fill (fp, 1)) <= 0)
+            return (s);
     }
+    if (!fp)
+        return (-1);
+
+    while ((n = takeLine (fp, buf, buflen, 0)) == 0)
+        if ((s = fill (fp, 1)) <= 0)
+            return (s);
 
-    buf[n] = '\0';
     return (n);
 }
 
@@ -358,14 +426,19 @@ int
 csi_wr (int fd, char rbuf[], int rbuflen, char *fmt, ...)
 {
     va_list ap;
-    char wbuf[1024];
+    char sbuf[1024], *wbuf;
     int l;
 
     va_start (ap, fmt);
-    l = vsprintf (wbuf, fmt, ap);
+    wbuf = vfmt (sbuf, sizeof(sbuf), &l, fmt, ap);
     va_end (ap);
+    if (!wbuf)
+        return (-1);
 
-    if (write (fd, wbuf, l) < 0)
+    l = writeAll (fd, wbuf, l);
+    if (wbuf != sbuf)
+        free (wbuf);
+    if (l < 0)
         return (-1);
 
     return (csi_r (fd, rbuf, rbuflen));
@@ -379,23 +452,477 @@ int
 csi_rix (int fd, char *fmt, ...)
 {
     va_list ap;
-    char buf[1024];
+    char sbuf[1024], *buf;
     int l;
 
     va_start (ap, fmt);
-    l = vsprintf (buf, fmt, ap);
+    buf = vfmt (sbuf, sizeof(sbuf), &l, fmt, ap);
     va_end (ap);
 
-    if (write (fd, buf, l) < 0)
+    if (!buf || writeAll (fd, buf, l) < 0)
     {
-        fprintf (stderr, "csi_rix(%d, %s): %s\n", fd, buf, strerror(errno));
+        fprintf (stderr, "csi_rix(%d, %s): %s\n", fd, buf ? buf : fmt,
+                 strerror(errno));
         exit(1);
     }
+    if (buf != sbuf)
+        free (buf);
+
+    if (csi_r (fd, sbuf, sizeof(sbuf)) < 0)
+        return (-1);
+
+    return (strtol (sbuf, NULL, 0));
+}
+
+/* like csi_rix() for n nodes at once: send cmd[i] to fd[i] for every i
+ * before waiting for any reply, then gather each reply as it arrives and
+ * crack its integer into val[i]. so the whole takes about one round trip
+ * rather than n. each fd[i] must be different.
+ * if when is not NULL, set when[i] to the unix time halfway between sending
+ * cmd[i] and its reply, as the best guess of when the node evaluated it.
+ * return 0 if ok, else -1 with errno set; requests still outstanding then
+ * are abandoned, their replies will be discarded as they arrive.
+ */
+int
+csi_rixn (int n, int fd[], char *cmd[], int val[], double when[])
+{
+    struct pollfd pfd[NNODES];
+    int id[NNODES];
+    char buf[CSIMAXREP];
+    int i, m, left;
+
+    if (n < 0 || n > NNODES)
+    {
+        errno = EINVAL;
+        return (-1);
+    }
+
+    /* scatter */
+    for (i = 0; i < n; i++)
+        if ((id[i] = csi_send (fd[i], NULL, NULL, "%s", cmd[i])) < 0)
+        {
+            abandon (i, fd, id);
+            return (-1);
+        }
+
+    /* gather each reply, in whatever order */
+    for (left = n; ; )
+    {
+        for (i = m = 0; i < n; i++)
+        {
+            if (!id[i])
+                continue;
+            switch (csi_poll (fd[i], id[i], buf, sizeof(buf),
+                              when ? &when[i] : NULL))
+            {
+                case -1:
+                    id[i] = 0;  /* already forgotten, or never was */
+                    abandon (n, fd, id);
+                    return (-1);
+                case 0:
+                    pfd[m].fd = fd[i];
+                    pfd[m].events = POLLIN;
+                    m++;
+                    break;
+                default:
+                    val[i] = strtol (buf, NULL, 0);
+                    id[i] = 0;
+                    left--;
+                    break;
+            }
+        }
+        if (!left)
+            break;
+
+        if (poll (pfd, m, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            abandon (n, fd, id);
+            return (-1);
+        }
+        for (i = 0; i < m; i++)
+            if (pfd[i].revents && csi_pump (pfd[i].fd) < 0)
+            {
+                abandon (n, fd, id);
+                return (-1);
+            }
+    }
+
+    return (0);
+}
+
+/* give up on request id[i] from fd[i] for each i < n with id[i] > 0.
+ * one already answered is just forgotten; the others are left in order
+ * but with discard() as their callback, so their replies are not taken
+ * as those of later requests and each is forgotten when its reply comes,
+ * by csi_send() at the latest.
+ */
+static void
+abandon (int n, int fd[], int id[])
+{
+    int errno0 = errno;
+    FDInfo *fp;
+    int i, j;
+
+    for (i = 0; i < n; i++)
+    {
+        if (id[i] <= 0 || !(fp = fdiFind (fd[i])))
+            continue;
+        for (j = 0; j < fp->nreq; j++)
+            if (fp->req[j].id == id[i])
+                break;
+        if (j == fp->nreq)
+            continue;
+        if (fp->req[j].done)
+            memmove (&fp->req[j], &fp->req[j+1],
+                     (--fp->nreq - j)*sizeof(CsiReq));
+        else
+            fp->req[j].cb = discard;
+    }
+
+    errno = errno0;
+}
+
+/* callback for an abandoned request: nothing more to do */
+static void
+discard (int fd, int id, char *reply, void *arg)
+{
+}
+
+/* send a command to the node on fd which will answer with exactly one line,
+ * and return at once without waiting for it. several may be outstanding at
+ * a time; replies are matched to them in the order sent.
+ * if cb, it is called with the reply from within csi_pump(), csi_wait(),
+ * csi_r() or csi_rixn(), else the reply is kept until collected with
+ * csi_poll() or csi_wait().
+ * return request id > 0, else -1 with errno set.
+ */
+int
+csi_send (int fd, CsiReplyCB cb, void *arg, char *fmt, ...)
+{
+    FDInfo *fp = fdiFind (fd);
+    va_list ap;
+    char sbuf[1024], *buf;
+    CsiReq *rp;
+    int l, s;
+
+    if (!fp)
+    {
+        errno = EBADF;
+        return (-1);
+    }
+    if (fp->nreq == CSIMAXREQ && fill (fp, 0) >= 0)
+    {
+        /* maybe room once replies already here are matched, such as
+         * those of abandoned requests nobody will otherwise collect.
+         */
+        match (fp);
+        fp = fdiFind (fd);
+        if (!fp)
+        {
+            errno = EBADF;
+            return (-1);
+        }
+    }
+    if (fp->nreq == CSIMAXREQ)
+    {
+        errno = EAGAIN;
+        return (-1);
+    }
 
-    if (csi_r (fd, buf, sizeof(buf)) < 0)
+    va_start (ap, fmt);
+    buf = vfmt (sbuf, sizeof(sbuf), &l, fmt, ap);
+    va_end (ap);
+    if (!buf)
+        return (-1);
+
+    rp = &fp->req[fp->nreq];
+    rp->id = fp->nextid++;
+    if (fp->nextid <= 0)
+        fp->nextid = 1;
+    rp->cb = cb;
+    rp->arg = arg;
+    rp->done = 0;
+    rp->sent = unixNow();
+
+    s = writeAll (fd, buf, l);
+    if (buf != sbuf)
+        free (buf);
+    if (s < 0)
+        return (-1);
+
+    fp->nreq++;
+    return (rp->id);
+}
+
+/* read whatever fd has for us now, without waiting, and match complete
+ * lines to requests from csi_send(), calling their callbacks if any.
+ * return number of requests completed, else -1 if error or EOF.
+ */
+int
+csi_pump (int fd)
+{
+    FDInfo *fp = fdiFind (fd);
+
+    if (!fp)
+    {
+        errno = EBADF;
+        return (-1);
+    }
+    if (fill (fp, 0) < 0)
+        return (-1);
+    return (match (fp));
+}
+
+/* collect the reply to request id on fd if it is in, without waiting.
+ * lines already read are matched first, so callbacks may be called.
+ * if whenp, also set *whenp to the unix time halfway between sending the
+ * request and its reply.
+ * return 1 if reply is now in buf[] and id is forgotten, 0 if not in yet,
+ * -1 if no such request or error.
+ */
+int
+csi_poll (int fd, int id, char buf[], int buflen, double *whenp)
+{
+    FDInfo *fp = fdiFind (fd);
+    CsiReq *rp;
+    int i;
+
+    if (!fp)
+    {
+        errno = EBADF;
         return (-1);
+    }
+    match (fp);
+    fp = fdiFind (fd);      /* a callback may have closed it */
+    if (!fp)
+    {
+        errno = EBADF;
+        return (-1);
+    }
+
+    for (i = 0; i < fp->nreq; i++)
+        if (fp->req[i].id == id)
+            break;
+    if (i == fp->nreq)
+    {
+        errno = ENOENT;
+        return (-1);
+    }
+    rp = &fp->req[i];
+    if (!rp->done)
+        return (0);
+
+    if (buflen > 0)
+    {
+        strncpy (buf, rp->reply, buflen-1);
+        buf[buflen-1] = '\0';
+    }
+    if (whenp)
+        *whenp = rp->when;
+    memmove (rp, rp+1, (--fp->nreq - i)*sizeof(CsiReq));
+    return (1);
+}
+
+/* like csi_poll() but wait for the reply if it is not in yet.
+ * return 0 if ok, else -1.
+ */
+int
+csi_wait (int fd, int id, char buf[], int buflen, double *whenp)
+{
+    FDInfo *fp;
+    int s;
+
+    while ((s = csi_poll (fd, id, buf, buflen, whenp)) == 0)
+        if (!(fp = fdiFind (fd)) || fill (fp, 1) <= 0)
+            return (-1);
+    return (s < 0 ? -1 : 0);
+}
+
+/* return number of requests on fd not yet collected, or -1 if not ours */
+int
+csi_pending (int fd)
+{
+    FDInfo *fp = fdiFind (fd);
+
+    return (fp ? fp->nreq : -1);
+}
+
+/* return 1 if csi_r() on fd would find something without waiting, else 0,
+ * or -1 if error.
+ */
+int
+csi_ready (int fd)
+{
+    FDInfo *fp = fdiFind (fd);
+    struct pollfd pfd;
+
+    if (fp && fp->rlen > 0)
+        return (1);
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    return (poll (&pfd, 1, 0));
+}
+
+/* discard anything fd has for us now, without waiting, and forget any
+ * requests awaiting replies.
+ */
+void
+csi_drain (int fd)
+{
+    FDInfo *fp = fdiFind (fd);
+    char buf[CSIRBUF];
+
+    if (fp)
+        fp->rlen = fp->nreq = 0;
+    while (csi_ready (fd) > 0 && read (fd, buf, sizeof(buf)) > 0)
+        continue;
+}
+
+/* format fmt and ap into buf[bufl], or into malloced memory if it will not
+ * fit. set *lp to its length.
+ * return the result, which caller must free if not buf, else NULL.
+ */
+static char *
+vfmt (char buf[], int bufl, int *lp, char *fmt, va_list ap)
+{
+    va_list aq;
+    char *bp;
+    int l;
+
+    va_copy (aq, ap);
+    l = vsnprintf (buf, bufl, fmt, aq);
+    va_end (aq);
+    if (l < 0)
+        return (NULL);
+
+    bp = buf;
+    if (l >= bufl)
+    {
+        if (!(bp = malloc (l+1)))
+            return (NULL);
+        vsnprintf (bp, l+1, fmt, ap);
+    }
+
+    *lp = l;
+    return (bp);
+}
+
+/* write all l bytes of buf to fd.
+ * return 0 if ok else -1.
+ */
+static int
+writeAll (int fd, char *buf, int l)
+{
+    int s;
+
+    for (; l > 0; buf += s, l -= s)
+        if ((s = write (fd, buf, l)) < 0)
+            return (-1);
+    return (0);
+}
+
+/* read more into fp->rbuf, waiting for at least one byte if block.
+ * return bytes read, 0 if EOF, or -1 if error. 0 is also returned if !block
+ * and nothing is there, but then errno is EAGAIN.
+ */
+static int
+fill (FDInfo *fp, int block)
+{
+    int s;
+
+    if (fp->rlen == CSIRBUF)
+        return (1); /* full, let takeLine() break it */
+
+    s = recv (fp->fd, fp->rbuf+fp->rlen, CSIRBUF-fp->rlen,
+              block ? 0 : MSG_DONTWAIT);
+    if (s < 0 && !block && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return (0);
+    if (s == 0 && !block)
+    {
+        errno = ECONNRESET;
+        return (-1);
+    }
+    if (s > 0)
+        fp->rlen += s;
+    return (s);
+}
+
+/* give each complete line in fp->rbuf to the oldest request still waiting.
+ * return number completed.
+ */
+static int
+match (FDInfo *fp)
+{
+    int fd = fp->fd;
+    int n = 0;
+    int i;
+
+    for (i = 0; i < fp->nreq; i++)
+    {
+        CsiReq *rp = &fp->req[i];
+
+        if (rp->done)
+            continue;
+        if (takeLine (fp, rp->reply, sizeof(rp->reply), 1) == 0)
+            break;
+        rp->when = (rp->sent + unixNow())/2;
+        rp->done = 1;
+        n++;
+
+        if (rp->cb)
+        {
+            /* done with it before the callback, which may send more */
+            CsiReq r = *rp;
+            memmove (rp, rp+1, (--fp->nreq - i)*sizeof(CsiReq));
+            (*r.cb) (fd, r.id, r.reply, r.arg);
+            fp = fdiFind (fd);
+            if (!fp)
+                break;
+            i--;
+        }
+    }
+
+    return (n);
+}
+
+/* move the next line in fp->rbuf, through its newline, into buf[buflen]
+ * and add '\0'. a line that will not fit is cut at buflen-1, the rest left
+ * for next time unless whole. a full rbuf with no newline counts as a line.
+ * return length moved, or 0 if no complete line yet.
+ */
+static int
+takeLine (FDInfo *fp, char buf[], int buflen, int whole)
+{
+    char *nl = memchr (fp->rbuf, '\n', fp->rlen);
+    int l, n;
+
+    if (nl)
+        l = nl - fp->rbuf + 1;
+    else if (fp->rlen == CSIRBUF)
+        l = CSIRBUF;
+    else
+        return (0);
+
+    n = l < buflen-1 ? l : buflen-1;
+    memcpy (buf, fp->rbuf, n);
+    buf[n] = '\0';
+    if (!whole)
+        l = n;
+    memmove (fp->rbuf, fp->rbuf+l, fp->rlen -= l);
+    return (n);
+}
+
+/* return unix time now, secs */
+static double
+unixNow()
+{
+    struct timeval tv;
 
-    return (strtol (buf, NULL, 0));
+    gettimeofday (&tv, NULL);
+    return (tv.tv_sec + tv.tv_usec/1e6);
 }
 
 /* For RCS Only -- Do Not Edit */
@@ -122,6 +122,18 @@ extern int csi_rebootAll (char *host, int port);
 extern int csi_w (int fd, char *fmt, ...);
 extern int csi_r (int fd, char buf[], int buflen);
 extern int csi_rix (int fd, char *fmt, ...);
+extern int csi_rixn (int n, int fd[], char *cmd[], int val[], double when[]);
+
+/* async requests: reply callback, given fd, request id and the reply line */
+#define CSIMAXREQ   16      /* max requests outstanding on each connection */
+typedef void (*CsiReplyCB) (int fd, int id, char *reply, void *arg);
+extern int csi_send (int fd, CsiReplyCB cb, void *arg, char *fmt, ...);
+extern int csi_pump (int fd);
+extern int csi_poll (int fd, int id, char buf[], int buflen, double *whenp);
+extern int csi_wait (int fd, int id, char buf[], int buflen, double *whenp);
+extern int csi_pending (int fd);
+extern int csi_ready (int fd);
+extern void csi_drain (int fd);
 extern int csi_wr (int fd, char buf[], int buflen, char *fmt, ...);
 extern int csi_f2h (int fd);
 extern int csi_f2n (int fd);
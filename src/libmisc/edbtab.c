@@ -0,0 +1,553 @@
+/* edbTabLoad(): load a whole .edb catalog at once into an EdbTab.
+ * edbTabObj(): expand one of its entries into an Obj.
+ * edbTabFree(): release it.
+ *
+ * readCatalog() reads a line at a time with fgets(), gives each line to
+ * db_crack_line() and keeps every entry as a full Obj, which is several times
+ * larger than the few fields a fixed object actually has. Here the file is
+ * mmapped, cut into pieces at line boundaries and the pieces scanned in
+ * parallel. Fixed object lines are cracked directly into columns; the scan
+ * follows db_crack_line() step for step, down to the same library calls for
+ * each number, so edbTabObj() gives exactly the same Obj. An epoch is
+ * converted only when it differs from the line before. Lines of any other
+ * type are just given to db_crack_line() and kept whole.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "P_.h"
+#include "astro.h"
+#include "circum.h"
+#include "preferences.h"
+#include "telenv.h"
+#include "edbtab.h"
+
+extern int db_set_field (char bp[], int id, PrefDateFormat pref, Obj *op);
+
+#define MAXDBLINE       256             /* longest line, as dbfmt.c */
+#define MAXFLDS         20              /* most fields, as dbfmt.c */
+#define EDBT_MINCHUNK   (1L<<20)        /* fewest bytes worth a thread */
+#define EDBT_MAXTHREAD  8               /* most threads */
+#define EDBT_OCHUNK     64              /* others grown this many at a time */
+
+/* one thread's piece of the file */
+typedef struct
+{
+    char *p0, *p1;          /* whole lines from p0 up to p1 */
+    EdbTab *tp;             /* columns to fill */
+    int base;               /* first row of them for this piece */
+    int nfix;               /* rows filled */
+    Obj *other;             /* malloced others */
+    int nother, mother;     /* used and room in other[] */
+    char *kind;             /* 1 fixed, 0 other for each entry in order */
+    int nkind;              /* used in kind[], room is for every line */
+    char lastep[MAXDBLINE]; /* last epoch field text */
+    float lastepv;          /* its f_epoch */
+    int nomem;              /* set if ran out of memory */
+} EdbChunk;
+
+static void *edbtWork (void *cp);
+static void edbtLine (EdbChunk *cp, char *lp, int len);
+static int edbtFixed (EdbChunk *cp, char *line, int row);
+static double edbtSex (char *bp);
+static int edbtAlloc (EdbTab *tp, int n);
+static void edbtShrink (EdbTab *tp);
+
+/* read the .edb file fn into a new EdbTab.
+ * return it, or NULL with excuse in msg[].
+ */
+EdbTab *
+edbTabLoad (char *fn, char msg[])
+{
+    pthread_t tid[EDBT_MAXTHREAD];
+    EdbChunk chunk[EDBT_MAXTHREAD];
+    struct stat st;
+    EdbTab *tp;
+    char *base, *p;
+    long nl[EDBT_MAXTHREAD];
+    long nlines;
+    int nthr, fd, t, nf, no;
+
+    fd = telopen (fn, O_RDONLY);
+    if (fd < 0)
+    {
+        sprintf (msg, "%s: %s", fn, strerror(errno));
+        return (NULL);
+    }
+    if (fstat (fd, &st) < 0)
+    {
+        sprintf (msg, "%s: %s", fn, strerror(errno));
+        close (fd);
+        return (NULL);
+    }
+    tp = (EdbTab *) calloc (1, sizeof(EdbTab));
+    if (!tp)
+    {
+        sprintf (msg, "%s: No memory", fn);
+        close (fd);
+        return (NULL);
+    }
+    if (st.st_size == 0)
+    {
+        close (fd);
+        return (tp);
+    }
+    base = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (base == MAP_FAILED)
+    {
+        sprintf (msg, "%s: mmap: %s", fn, strerror(errno));
+        free ((void *)tp);
+        return (NULL);
+    }
+    (void) madvise (base, st.st_size, MADV_SEQUENTIAL);
+
+    /* cut into pieces at line boundaries, one per thread */
+    nthr = 1;
+    if (st.st_size >= 2*EDBT_MINCHUNK)
+    {
+        long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+        nthr = ncpu < 1 ? 1 : (ncpu > EDBT_MAXTHREAD ? EDBT_MAXTHREAD : ncpu);
+        if (nthr > st.st_size/EDBT_MINCHUNK)
+            nthr = st.st_size/EDBT_MINCHUNK;
+    }
+    memset ((void *)chunk, 0, sizeof(chunk));
+    p = base;
+    for (t = 0; t < nthr; t++)
+    {
+        char *end = base + (long)st.st_size*(t+1)/nthr;
+
+        if (t < nthr-1 && end > p)
+        {
+            char *nlp = memchr (end-1, '\n', base + st.st_size - (end-1));
+            end = nlp ? nlp+1 : base + st.st_size;
+        }
+        if (end < p)
+            end = p;
+        chunk[t].p0 = p;
+        chunk[t].p1 = end;
+        p = end;
+    }
+
+    /* room for every line */
+    nlines = 0;
+    for (t = 0; t < nthr; t++)
+    {
+        char *q;
+
+        nl[t] = 0;
+        for (q = chunk[t].p0; q < chunk[t].p1; q++)
+        {
+            q = memchr (q, '\n', chunk[t].p1 - q);
+            if (!q)
+                break;
+            nl[t]++;
+        }
+        if (chunk[t].p1 > chunk[t].p0 && chunk[t].p1[-1] != '\n')
+            nl[t]++;    /* last line has no newline */
+        chunk[t].base = (int)nlines;
+        nlines += nl[t];
+    }
+    if (nlines > 0x7fffffffL/2 || edbtAlloc (tp, (int)nlines) < 0)
+    {
+        sprintf (msg, "%s: No memory for %ld lines", fn, nlines);
+        munmap (base, st.st_size);
+        edbTabFree (tp);
+        return (NULL);
+    }
+    for (t = 0; t < nthr; t++)
+    {
+        chunk[t].tp = tp;
+        chunk[t].kind = (char *) malloc (nl[t] + 1);
+        if (!chunk[t].kind)
+            chunk[t].nomem = 1;
+    }
+
+    /* scan the pieces */
+    for (t = 1; t < nthr; t++)
+        if (pthread_create (&tid[t], NULL, edbtWork, (void *)&chunk[t]) != 0)
+            tid[t] = pthread_self();
+    edbtWork ((void *)&chunk[0]);
+    for (t = 1; t < nthr; t++)
+    {
+        if (pthread_equal (tid[t], pthread_self()))
+            edbtWork ((void *)&chunk[t]);
+        else
+            pthread_join (tid[t], NULL);
+    }
+    munmap (base, st.st_size);
+
+    /* close up the fixed rows and gather the others, in file order */
+    nf = no = 0;
+    for (t = 0; t < nthr; t++)
+    {
+        if (chunk[t].nomem)
+            goto nomem;
+        no += chunk[t].nother;
+    }
+    if (no > 0)
+    {
+        tp->other = (Obj *) malloc (no * sizeof(Obj));
+        tp->ix = (int *) malloc (nlines * sizeof(int));
+        if (!tp->other || !tp->ix)
+            goto nomem;
+    }
+    no = 0;
+    for (t = 0; t < nthr; t++)
+    {
+        EdbChunk *cp = &chunk[t];
+        int r0 = cp->base, k;
+
+#define EDBT_MOVE(col)  memmove (tp->col + nf, tp->col + r0, \
+                                        cp->nfix*sizeof(tp->col[0]))
+        if (nf != r0 && cp->nfix > 0)
+        {
+            EDBT_MOVE(name);
+            EDBT_MOVE(ra);
+            EDBT_MOVE(dec);
+            EDBT_MOVE(ep);
+            EDBT_MOVE(size);
+            EDBT_MOVE(mag);
+            EDBT_MOVE(cls);
+            EDBT_MOVE(spect);
+            EDBT_MOVE(ratio);
+            EDBT_MOVE(pa);
+        }
+#undef EDBT_MOVE
+
+        if (tp->ix)
+        {
+            int f = nf, o = no;
+
+            for (k = 0; k < cp->nkind; k++)
+                tp->ix[tp->n + k] = cp->kind[k] ? f++ : -(o++) - 1;
+            if (cp->nother > 0)
+                memcpy ((void *)(tp->other + no), (void *)cp->other,
+                        cp->nother * sizeof(Obj));
+        }
+        tp->n += cp->nkind;
+        nf += cp->nfix;
+        no += cp->nother;
+        free ((void *)cp->kind);
+        if (cp->other)
+            free ((void *)cp->other);
+    }
+    tp->nf = nf;
+    edbtShrink (tp);
+    return (tp);
+
+nomem:
+    for (t = 0; t < nthr; t++)
+    {
+        if (chunk[t].kind) free ((void *)chunk[t].kind);
+        if (chunk[t].other) free ((void *)chunk[t].other);
+    }
+    edbTabFree (tp);
+    sprintf (msg, "%s: No memory", fn);
+    return (NULL);
+}
+
+/* free an EdbTab from edbTabLoad().
+ */
+void
+edbTabFree (EdbTab *tp)
+{
+    if (!tp)
+        return;
+    if (tp->name) free ((void *)tp->name);
+    if (tp->ra) free ((void *)tp->ra);
+    if (tp->dec) free ((void *)tp->dec);
+    if (tp->ep) free ((void *)tp->ep);
+    if (tp->size) free ((void *)tp->size);
+    if (tp->mag) free ((void *)tp->mag);
+    if (tp->cls) free ((void *)tp->cls);
+    if (tp->spect) free ((void *)tp->spect);
+    if (tp->ratio) free ((void *)tp->ratio);
+    if (tp->pa) free ((void *)tp->pa);
+    if (tp->other) free ((void *)tp->other);
+    if (tp->ix) free ((void *)tp->ix);
+    free ((void *)tp);
+}
+
+/* fill *op with entry i of tp, 0 .. tp->n-1.
+ */
+void
+edbTabObj (EdbTab *tp, int i, Obj *op)
+{
+    int f = tp->ix ? tp->ix[i] : i;
+
+    if (f < 0)
+    {
+        *op = tp->other[-f-1];
+        return;
+    }
+
+    zero_mem ((void *)op, sizeof(ObjF));
+    op->o_type = FIXED;
+    memcpy (op->o_name, tp->name[f], MAXNM);
+    op->f_RA = tp->ra[f];
+    op->f_dec = tp->dec[f];
+    op->f_epoch = tp->ep[f];
+    op->f_size = tp->size[f];
+    op->f_mag = tp->mag[f];
+    op->f_class = tp->cls[f];
+    op->f_spect[0] = tp->spect[f][0];
+    op->f_spect[1] = tp->spect[f][1];
+    op->f_ratio = tp->ratio[f];
+    op->f_pa = tp->pa[f];
+}
+
+/* thread to scan one EdbChunk's lines.
+ */
+static void *
+edbtWork (void *vp)
+{
+    EdbChunk *cp = (EdbChunk *)vp;
+    char *p = cp->p0;
+
+    while (p < cp->p1 && !cp->nomem)
+    {
+        char *nlp = memchr (p, '\n', cp->p1 - p);
+        char *end = nlp ? nlp : cp->p1;
+
+        edbtLine (cp, p, end - p);
+        p = end + 1;
+    }
+
+    return (NULL);
+}
+
+/* crack the len chars at lp, one line without its newline, into cp.
+ */
+static void
+edbtLine (EdbChunk *cp, char *lp, int len)
+{
+    char line[MAXDBLINE];
+    char *q;
+    int nc;
+
+    /* same candidates as db_crack_line(), and which fit its buffer */
+    if (len == 0 || len >= MAXDBLINE || lp[0] == '#' || lp[0] == '!'
+            || isspace(lp[0]))
+        return;
+    memcpy (line, lp, len);
+    line[len] = '\0';
+
+    /* fixed objects ourselves, anything else the usual way */
+    for (nc = 0, q = line; (q = strchr (q, ',')) != NULL; q++)
+        nc++;
+    q = strchr (line, ',');
+    if (q && q[1] == 'f' && nc < MAXFLDS-1)
+    {
+        if (edbtFixed (cp, line, cp->base + cp->nfix) == 0)
+        {
+            cp->nfix++;
+            cp->kind[cp->nkind++] = 1;
+        }
+        return;
+    }
+    if (nc >= MAXFLDS-1)
+        return;
+
+    if (cp->nother == cp->mother)
+    {
+        Obj *newo = (Obj *) realloc ((void *)cp->other,
+                                     (cp->mother + EDBT_OCHUNK)*sizeof(Obj));
+        if (!newo)
+        {
+            cp->nomem = 1;
+            return;
+        }
+        cp->other = newo;
+        cp->mother += EDBT_OCHUNK;
+    }
+    if (db_crack_line (line, &cp->other[cp->nother], NULL) == 0)
+    {
+        cp->nother++;
+        cp->kind[cp->nkind++] = 0;
+    }
+}
+
+/* crack a fixed object line into row of cp's columns as db_crack_line().
+ * return 0 if ok, else -1.
+ */
+static int
+edbtFixed (EdbChunk *cp, char *line, int row)
+{
+    EdbTab *tp = cp->tp;
+    char *flds[MAXFLDS], *sflds[MAXFLDS];
+    char *ep, *s, *d;
+    Obj o;
+    int nf, nsf, l;
+
+    nf = get_fields (line, ',', flds);
+    if (nf < 5 || nf > 7)
+        return (-1);
+    zero_mem ((void *)&o, sizeof(ObjF));
+
+    nsf = get_fields (flds[1], '|', sflds);
+    if (nsf > 1)
+    {
+        switch (sflds[1][0])
+        {
+            case 'A': case 'B': case 'C': case 'D': case 'F': case 'G':
+            case 'H': case 'K': case 'J': case 'L': case 'M': case 'N':
+            case 'O': case 'P': case 'Q': case 'R': case 'S': case 'T':
+            case 'U': case 'V':
+                o.f_class = sflds[1][0];
+                break;
+            default:
+                return (-1);
+        }
+    }
+    if (nsf > 2)
+    {
+        o.f_spect[0] = sflds[2][0];
+        o.f_spect[1] = sflds[2][0] ? sflds[2][1] : '\0';
+    }
+
+    o.f_RA = (float) hrrad(edbtSex (flds[2]));
+    o.f_dec = (float) degrad(edbtSex (flds[3]));
+    set_fmag (&o, atod(flds[4]));
+
+    ep = nf > 5 && flds[5][0] ? flds[5] : "2000";
+    if (strcmp (ep, cp->lastep))
+    {
+        Obj eo;
+
+        zero_mem ((void *)&eo, sizeof(ObjF));
+        (void) db_set_field (ep, F_EPOCH, PREF_MDY, &eo);
+        cp->lastepv = eo.f_epoch;
+        strcpy (cp->lastep, ep);
+    }
+    o.f_epoch = cp->lastepv;
+
+    if (nf == 7)
+    {
+        o.f_size = (float) atod(flds[6]);
+        nsf = get_fields (flds[6], '|', sflds);
+        if (nsf == 3)
+        {
+            set_ratio(&o, o.s_size, atod(sflds[1]));
+            set_pa(&o, degrad(atod(sflds[2])));
+        }
+        else
+        {
+            set_ratio(&o, 1, 1);
+            set_pa(&o, 0.0);
+        }
+    }
+
+    /* first name, less leading white */
+    for (s = flds[0]; *s && *s <= 32; s++)
+        continue;
+    for (d = tp->name[row], l = 0; l < MAXNM-1 && s[l] && s[l] != '|'; l++)
+        d[l] = s[l];
+    memset (d + l, 0, MAXNM - l);
+
+    tp->ra[row] = o.f_RA;
+    tp->dec[row] = o.f_dec;
+    tp->ep[row] = o.f_epoch;
+    tp->size[row] = o.f_size;
+    tp->mag[row] = o.f_mag;
+    tp->cls[row] = o.f_class;
+    tp->spect[row][0] = o.f_spect[0];
+    tp->spect[row][1] = o.f_spect[1];
+    tp->ratio[row] = o.f_ratio;
+    tp->pa[row] = o.f_pa;
+    return (0);
+}
+
+/* f_scansex() with no prior value: h[:m[:s]], any part may be missing.
+ * strtod() does the same conversion as its sscanf("%lf").
+ */
+static double
+edbtSex (char *bp)
+{
+    double v[3], tmp;
+    int nneg = 0;
+    int i;
+
+    while (*bp == ' ')
+        bp++;
+    for (i = 0; i < 3; i++)
+    {
+        char *e, c;
+
+        if (*bp == '-')
+        {
+            nneg = 1;
+            bp++;
+        }
+        v[i] = strtod (bp, &e);
+        if (e == bp)
+            v[i] = 0.0;
+        while ((c = *bp) != '\0')
+        {
+            bp++;
+            if (c==':' || c=='/' || c==';' || c==',' || c=='-')
+                break;
+        }
+    }
+
+    tmp = v[2]/3600.0 + v[1]/60.0 + v[0];
+    return (nneg ? -tmp : tmp);
+}
+
+/* malloc room for n fixed rows in each column of tp.
+ * return 0 if ok, else -1.
+ */
+static int
+edbtAlloc (EdbTab *tp, int n)
+{
+    if (n < 1)
+        n = 1;
+    tp->name = malloc (n * sizeof(tp->name[0]));
+    tp->ra = (float *) malloc (n * sizeof(float));
+    tp->dec = (float *) malloc (n * sizeof(float));
+    tp->ep = (float *) malloc (n * sizeof(float));
+    tp->size = (float *) malloc (n * sizeof(float));
+    tp->mag = (short *) malloc (n * sizeof(short));
+    tp->cls = (char *) malloc (n);
+    tp->spect = malloc (n * sizeof(tp->spect[0]));
+    tp->ratio = (unsigned char *) malloc (n);
+    tp->pa = (unsigned char *) malloc (n);
+    if (!tp->name || !tp->ra || !tp->dec || !tp->ep || !tp->size
+            || !tp->mag || !tp->cls || !tp->spect || !tp->ratio || !tp->pa)
+        return (-1);
+    return (0);
+}
+
+/* give back the room for lines which were not fixed objects */
+static void
+edbtShrink (EdbTab *tp)
+{
+    int n = tp->nf > 0 ? tp->nf : 1;
+    void *p;
+
+#define EDBT_SHRINK(col)                                                \
+    if ((p = realloc ((void *)tp->col, n*sizeof(tp->col[0]))) != NULL)  \
+        tp->col = p
+    EDBT_SHRINK(name);
+    EDBT_SHRINK(ra);
+    EDBT_SHRINK(dec);
+    EDBT_SHRINK(ep);
+    EDBT_SHRINK(size);
+    EDBT_SHRINK(mag);
+    EDBT_SHRINK(cls);
+    EDBT_SHRINK(spect);
+    EDBT_SHRINK(ratio);
+    EDBT_SHRINK(pa);
+#undef EDBT_SHRINK
+}
@@ -0,0 +1,30 @@
+/* edbtab.c: load a whole .edb catalog at once into columns.
+ * include circum.h first.
+ */
+
+/* the entries of one catalog. the fixed objects, nearly all of most
+ * catalogs, are kept a field per array; any others are kept as whole Obj.
+ * edbTabObj() expands any entry to an Obj as db_crack_line() would.
+ */
+typedef struct
+{
+    int n;                  /* entries, in file order */
+    int nf;                 /* of which fixed, each array below has nf */
+    char (*name)[MAXNM];    /* o_name */
+    float *ra, *dec;        /* f_RA, f_dec, rads at epoch */
+    float *ep;              /* f_epoch, mjd */
+    float *size;            /* f_size, arc secs */
+    short *mag;             /* f_mag, mag * MAGSCALE */
+    char *cls;              /* f_class */
+    char (*spect)[2];       /* f_spect */
+    unsigned char *ratio;   /* f_ratio */
+    unsigned char *pa;      /* f_pa */
+    Obj *other;             /* the n - nf others */
+    int *ix;                /* if any others, entry i is fixed ix[i] if >= 0,
+                             * else other -ix[i]-1. NULL if none.
+                             */
+} EdbTab;
+
+extern EdbTab *edbTabLoad (char *fn, char msg[]);
+extern void edbTabFree (EdbTab *tp);
+extern void edbTabObj (EdbTab *tp, int i, Obj *op);
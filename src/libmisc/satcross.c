@@ -0,0 +1,596 @@
+/* predict which earth satellites cross a field during an exposure.
+ *
+ * a catalog of element sets is loaded once with satCatLoad(). then for each
+ * field and exposure window satCrossField() works in three passes:
+ *
+ *   1. every satellite is propagated once, to the middle of the window. while
+ *      in the field a satellite must lie in the cone of sight lines from the
+ *      site through the field, and at a distance from the earth's center
+ *      between its perigee and apogee. those whose orbit plane passes too far
+ *      from that part of the cone to reach it, allowing for the site moving
+ *      with the earth, are dropped. this leaves about one in a hundred.
+ *   2. the rest are propagated every CSTEP seconds across the window. at each
+ *      step the cone a satellite may sweep out in half a step either way,
+ *      from how fast it can move across the sky at that range, is tested
+ *      against the field.
+ *   3. each satellite which might cross during a step is followed alone in
+ *      steps small enough not to jump over the field, to find when it
+ *      enters and leaves, how close it comes to the center and whether it
+ *      is sunlit then.
+ *
+ * positions are in earth radii and minutes, as sgp4(), in its frame of the
+ * true equator and mean equinox of date.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "P_.h"
+#include "astro.h"
+#include "circum.h"
+#include "ccdcamera.h"
+#include "scan.h"
+#include "sattypes.h"
+#include "satlib.h"
+#include "satspec.h"
+#include "satcross.h"
+
+#define XKE     .743669161E-1   /* sqrt(GM), earth radii^1.5 per minute */
+#define OMEGAE  4.37526908e-3   /* earth rotation, rads per minute */
+#define EFLAT   (1/298.257)     /* earth flattening */
+#define RMARG   0.02            /* slop for perturbations, earth radii */
+#define CSTEP   5.0             /* coarse step, secs */
+#define FDIV    8               /* fine steps per field radius */
+#define MINFSTEP 0.01           /* shortest fine step, secs */
+#define MAXCAT  100000          /* most element sets in a catalog */
+#define UNIXMJD 25567.5         /* mjd of unix time 0 */
+
+struct _SatCat
+{
+    int n;                  /* element sets */
+    SatElem *el;            /* malloced elements */
+    char (*name)[25];       /* malloced names */
+    SatBatch *bp;           /* all of them ready to propagate */
+    Vec3 *pos, *vel;        /* malloced scratch, n each */
+};
+
+/* where the site is, and the field */
+typedef struct
+{
+    double rc, rs;          /* distance from earth axis and equator, e.r. */
+    double th0;             /* its sidereal angle at tm */
+    double tm;              /* middle of window, unix secs */
+    double vs;              /* its speed, e.r. per minute */
+    double ux, uy, uz;      /* field center unit vector */
+} SCGeom;
+
+static void siteAt (SCGeom *gp, double t, Vec3 *sp);
+static double sepAt (SCGeom *gp, double t, Vec3 *pp, Vec3 *vp,
+                     double h);
+static int sunlit (double t, Vec3 *pp);
+static int fineSearch (SCGeom *gp, SatCat *cp, int i, double ta, double tb,
+                       double fov, SatCross **xpp, int nx);
+static int cmpCross (const void *p1, const void *p2);
+
+/* load the element sets in the file fn, in two or three line form.
+ * return a new SatCat, or NULL with excuse in msg[].
+ */
+SatCat *
+satCatLoad (char *fn, char msg[])
+{
+    char l0[256], l1[256], l2[256], *p0 = l0, *p1 = l1, *p2 = l2, *tmp;
+    SatCat *cp;
+    FILE *fp;
+    int nmax = 0;
+
+    fp = fopen (fn, "r");
+    if (!fp)
+    {
+        sprintf (msg, "%s: %s", fn, strerror(errno));
+        return (NULL);
+    }
+
+    cp = (SatCat *) calloc (1, sizeof(SatCat));
+    if (!cp)
+    {
+        fclose (fp);
+        sprintf (msg, "No memory for catalog");
+        return (NULL);
+    }
+
+    *p0 = *p1 = *p2 = '\0';
+    while (fgets (p2, sizeof(l0), fp))
+    {
+        if (p1[0] == '1' && p1[1] == ' ' && p2[0] == '2' && p2[1] == ' '
+                && strncmp (p1+2, p2+2, 5) == 0)
+        {
+            if (cp->n == nmax)
+            {
+                SatElem *newel;
+                char (*newname)[25];
+
+                if (nmax == MAXCAT)
+                    break;
+                nmax = nmax ? 2*nmax : 1024;
+                newel = (SatElem *) realloc ((void *)cp->el,
+                                             nmax*sizeof(SatElem));
+                if (newel)
+                    cp->el = newel;
+                newname = realloc ((void *)cp->name, nmax*sizeof(*newname));
+                if (newname)
+                    cp->name = newname;
+                if (!newel || !newname)
+                {
+                    sprintf (msg, "No memory for %d element sets", nmax);
+                    fclose (fp);
+                    satCatFree (cp);
+                    return (NULL);
+                }
+            }
+
+            memset ((void *)&cp->el[cp->n], 0, sizeof(SatElem));
+            if (readtle (p1, p2, &cp->el[cp->n]) == 0)
+            {
+                char *np = cp->name[cp->n];
+
+                /* name is the line before, if it is not part of a set */
+                np[0] = '\0';
+                if (p0[0] && !((p0[0] == '1' || p0[0] == '2') && p0[1] == ' '))
+                {
+                    int l;
+
+                    strncpy (np, p0, sizeof(cp->name[0])-1);
+                    np[sizeof(cp->name[0])-1] = '\0';
+                    for (l = strlen(np); l > 0 && isspace(np[l-1]); )
+                        np[--l] = '\0';
+                }
+                cp->n++;
+            }
+            *p2 = '\0';     /* don't take set as next one's name */
+        }
+
+        tmp = p0;
+        p0 = p1;
+        p1 = p2;
+        p2 = tmp;
+    }
+    fclose (fp);
+
+    if (cp->n == 0)
+    {
+        sprintf (msg, "%s: no element sets", fn);
+        satCatFree (cp);
+        return (NULL);
+    }
+
+    cp->bp = satb_new (cp->el, cp->n);
+    cp->pos = (Vec3 *) malloc (cp->n*sizeof(Vec3));
+    cp->vel = (Vec3 *) malloc (cp->n*sizeof(Vec3));
+    if (!cp->bp || !cp->pos || !cp->vel)
+    {
+        sprintf (msg, "No memory for %d element sets", cp->n);
+        satCatFree (cp);
+        return (NULL);
+    }
+
+    return (cp);
+}
+
+/* free a catalog from satCatLoad().
+ */
+void
+satCatFree (SatCat *cp)
+{
+    if (!cp)
+        return;
+    if (cp->bp) satb_free (cp->bp);
+    if (cp->el) free ((void *)cp->el);
+    if (cp->name) free ((void *)cp->name);
+    if (cp->pos) free ((void *)cp->pos);
+    if (cp->vel) free ((void *)cp->vel);
+    free ((void *)cp);
+}
+
+/* return the number of element sets in cp.
+ */
+int
+satCatN (SatCat *cp)
+{
+    return (cp->n);
+}
+
+/* find each satellite in cp which passes within fov/2 of the apparent
+ * topocentric ra and dec of date, rads, in the dur secs starting at unix time
+ * t0, as seen from the site in *np.
+ * if any, set *xpp to a malloced list of them in order of entering the field,
+ * which the caller must free.
+ * return how many, or -1 with excuse in msg[].
+ * N.B. places agree with obj_cir() to about 0.1 degree, allow for it in fov.
+ * N.B. only one thread at a time may use a given cp.
+ */
+int
+satCrossField (SatCat *cp, Now *np, double ra, double dec, double fov,
+               double t0, double dur, SatCross **xpp, char msg[])
+{
+    SatCross *xp = NULL;
+    SatElem *cel = NULL;
+    SatBatch *cbp = NULL;
+    double *iv = NULL;
+    int *cix;
+    SCGeom g;
+    Now now;
+    Vec3 s;
+    double ha, lst, gst, cd, ss, bu, tf, smarg, half;
+    int nc, nx, nsteps, i, k;
+
+    *xpp = NULL;
+    if (fov <= 0 || fov >= PI || dur < 0)
+    {
+        sprintf (msg, "Bad field or window");
+        return (-1);
+    }
+
+    /* the site, and the field in the frame of sgp4(): its x axis is the mean
+     * equinox so use the mean sidereal angle with the apparent hour angle.
+     */
+    now = *np;
+    g.tm = t0 + dur/2;
+    now.n_mjd = UNIXMJD + g.tm/86400.0;
+    now_lst (&now, &lst);
+    ha = hrrad(lst) - ra;
+    utc_gst (mjd_day(now.n_mjd), mjd_hr(now.n_mjd), &gst);
+    g.th0 = hrrad(gst) + now.n_lng;
+    ra = g.th0 - ha;
+    cd = cos(dec);
+    g.ux = cd*cos(ra);
+    g.uy = cd*sin(ra);
+    g.uz = sin(dec);
+    {
+        double e2 = EFLAT*(2-EFLAT);
+        double sl = sin(now.n_lat), cl = cos(now.n_lat);
+        double c = 1/sqrt(1 - e2*sl*sl);
+
+        g.rc = (c + now.n_elev)*cl;
+        g.rs = ((1-e2)*c + now.n_elev)*sl;
+        g.vs = OMEGAE*g.rc;
+    }
+
+    /* pass 1: the orbit plane must come near the sight lines */
+    cix = (int *) malloc ((cp->n+1)*sizeof(int));
+    if (!cix)
+    {
+        sprintf (msg, "No memory");
+        return (-1);
+    }
+    satb_prop (cp->bp, UNIXMJD + g.tm/86400.0, cp->pos, cp->vel);
+    siteAt (&g, g.tm, &s);
+    ss = s.x*s.x + s.y*s.y + s.z*s.z;
+    bu = s.x*g.ux + s.y*g.uy + s.z*g.uz;
+    tf = tan(fov/2);
+    smarg = g.vs*dur/60/2 + RMARG;
+    for (nc = i = 0; i < cp->n; i++)
+    {
+        Vec3 *r = &cp->pos[i], *v = &cp->vel[i];
+        double hx, hy, hz, h, rr, vv, rv, a, ex, ey, ez, e, rp, rap;
+        double s1, s2, d1, d2, dmin;
+
+        rr = sqrt(r->x*r->x + r->y*r->y + r->z*r->z);
+        if (!(rr > 1))
+            continue;   /* decayed, or nonsense */
+        vv = v->x*v->x + v->y*v->y + v->z*v->z;
+        hx = r->y*v->z - r->z*v->y;
+        hy = r->z*v->x - r->x*v->z;
+        hz = r->x*v->y - r->y*v->x;
+        h = sqrt(hx*hx + hy*hy + hz*hz);
+
+        /* osculating perigee and apogee distances */
+        rv = r->x*v->x + r->y*v->y + r->z*v->z;
+        a = 1/(2/rr - vv/(XKE*XKE));
+        ex = ((vv - XKE*XKE/rr)*r->x - rv*v->x)/(XKE*XKE);
+        ey = ((vv - XKE*XKE/rr)*r->y - rv*v->y)/(XKE*XKE);
+        ez = ((vv - XKE*XKE/rr)*r->z - rv*v->z)/(XKE*XKE);
+        e = sqrt(ex*ex + ey*ey + ez*ez);
+        if (!(a > 0 && e < 1 && h > 0))
+        {
+            /* not a closed orbit, leave it to pass 2 */
+            cix[nc++] = i;
+            continue;
+        }
+        rp = a*(1-e) - RMARG;
+        rap = a*(1+e) + RMARG;
+
+        /* distances along the sight line to those radii */
+        if (rap*rap <= ss)
+            continue;
+        s1 = rp*rp > ss ? -bu + sqrt(bu*bu - ss + rp*rp) : 0;
+        s2 = -bu + sqrt(bu*bu - ss + rap*rap);
+
+        /* distance of the plane from that part of the line */
+        d1 = (hx*(s.x + s1*g.ux) + hy*(s.y + s1*g.uy) + hz*(s.z + s1*g.uz))/h;
+        d2 = (hx*(s.x + s2*g.ux) + hy*(s.y + s2*g.uy) + hz*(s.z + s2*g.uz))/h;
+        dmin = d1*d2 <= 0 ? 0 : (fabs(d1) < fabs(d2) ? fabs(d1) : fabs(d2));
+        if (dmin > s2*tf + smarg)
+            continue;
+
+        cix[nc++] = i;
+    }
+
+    /* pass 2: step the rest across the window. iv[2i..2i+1] is the time
+     * interval in which candidate i might be in the field so far, if any.
+     */
+    nx = 0;
+    if (nc == 0)
+        goto out;
+    cel = (SatElem *) malloc (nc*sizeof(SatElem));
+    iv = (double *) malloc (2*nc*sizeof(double));
+    if (!cel || !iv)
+        goto nomem;
+    for (i = 0; i < nc; i++)
+    {
+        cel[i] = cp->el[cix[i]];
+        iv[2*i] = iv[2*i+1] = -1;
+    }
+    cbp = satb_new (cel, nc);
+    if (!cbp)
+        goto nomem;
+
+    nsteps = dur > 0 ? (int)ceil(dur/CSTEP) + 1 : 1;
+    half = nsteps > 1 ? dur/(nsteps-1)/2 : 0;
+    for (k = 0; k < nsteps; k++)
+    {
+        double t = nsteps > 1 ? t0 + dur*k/(nsteps-1) : t0;
+        double lo = t - half < t0 ? t0 : t - half;
+        double hi = t + half > t0 + dur ? t0 + dur : t + half;
+
+        satb_prop (cbp, UNIXMJD + t/86400.0, cp->pos, cp->vel);
+        for (i = 0; i < nc; i++)
+        {
+            double *ip = &iv[2*i];
+
+            if (sepAt (&g, t, &cp->pos[i], &cp->vel[i], half) <= fov/2)
+            {
+                if (ip[0] < 0)
+                    ip[0] = lo;
+                ip[1] = hi;
+            }
+            else if (ip[0] >= 0)
+            {
+                nx = fineSearch (&g, cp, cix[i], ip[0], ip[1], fov, &xp, nx);
+                if (nx < 0)
+                    goto nomem;
+                ip[0] = ip[1] = -1;
+            }
+        }
+    }
+    for (i = 0; i < nc; i++)
+    {
+        if (iv[2*i] >= 0)
+        {
+            nx = fineSearch (&g, cp, cix[i], iv[2*i], iv[2*i+1], fov, &xp, nx);
+            if (nx < 0)
+                goto nomem;
+        }
+    }
+
+    if (nx > 1)
+        qsort ((void *)xp, nx, sizeof(SatCross), cmpCross);
+
+out:
+    if (cbp) satb_free (cbp);
+    if (cel) free ((void *)cel);
+    if (iv) free ((void *)iv);
+    free ((void *)cix);
+    *xpp = xp;
+    return (nx);
+
+nomem:
+    if (cbp) satb_free (cbp);
+    if (cel) free ((void *)cel);
+    if (iv) free ((void *)iv);
+    free ((void *)cix);
+    if (xp) free ((void *)xp);
+    sprintf (msg, "No memory");
+    return (-1);
+}
+
+/* find each satellite in cp which crosses the field of the scan *sp during
+ * its exposure, for a camera whose field is fov rads across, as seen from
+ * the site in *np. sp->starttm must be set to when the exposure will begin.
+ * return as satCrossField().
+ */
+int
+satCrossScan (SatCat *cp, Now *np, Scan *sp, double fov, SatCross **xpp,
+              char msg[])
+{
+    Now now;
+    Obj o;
+    double tm, alt, ha, dec, lst;
+
+    if (!sp->starttm)
+    {
+        sprintf (msg, "%s: no start time", sp->obj.o_name);
+        return (-1);
+    }
+
+    /* apparent place at mid exposure, back out of refraction */
+    tm = (double)sp->starttm + sp->dur/2;
+    now = *np;
+    now.n_mjd = UNIXMJD + tm/86400.0;
+    now.n_epoch = EOD;
+    o = sp->obj;
+    if (obj_cir (&now, &o) < 0)
+    {
+        sprintf (msg, "%s: can not compute position", o.o_name);
+        return (-1);
+    }
+    unrefract (now.n_pressure, now.n_temp, o.s_alt, &alt);
+    aa_hadec (now.n_lat, alt, o.s_az, &ha, &dec);
+    now_lst (&now, &lst);
+
+    return (satCrossField (cp, np, hrrad(lst) - ha + sp->rao, dec + sp->deco,
+                           fov, (double)sp->starttm, sp->dur, xpp, msg));
+}
+
+/* set *sp to the site position at unix time t */
+static void
+siteAt (SCGeom *gp, double t, Vec3 *sp)
+{
+    double th = gp->th0 + OMEGAE*(t - gp->tm)/60;
+
+    sp->x = gp->rc*cos(th);
+    sp->y = gp->rc*sin(th);
+    sp->z = gp->rs;
+}
+
+/* return the angle from the field center to the satellite at *pp moving at
+ * *vp at unix time t, less the most it might move across the sky in h secs,
+ * or a large number if it is behind the site.
+ */
+static double
+sepAt (SCGeom *gp, double t, Vec3 *pp, Vec3 *vp, double h)
+{
+    Vec3 s;
+    double dx, dy, dz, rng, c, sep, w, rmin;
+
+    siteAt (gp, t, &s);
+    dx = pp->x - s.x;
+    dy = pp->y - s.y;
+    dz = pp->z - s.z;
+    rng = sqrt(dx*dx + dy*dy + dz*dz);
+    if (!(rng > 0))
+        return (PI);
+    c = (dx*gp->ux + dy*gp->uy + dz*gp->uz)/rng;
+    sep = c >= 1 ? 0 : (c <= -1 ? PI : acos(c));
+    if (h <= 0)
+        return (sep);
+
+    /* speed across the line of sight is at most that of the satellite and
+     * the site together; allow a little for curvature over h.
+     */
+    w = 1.01*(sqrt(vp->x*vp->x + vp->y*vp->y + vp->z*vp->z) + gp->vs)*h/60;
+    rmin = rng - w;
+    if (rmin <= 0)
+        return (0);
+    return (sep - w/rmin);
+}
+
+/* return 1 if the satellite at *pp at unix time t is in sunlight, else 0.
+ * the earth's shadow is taken to be a cylinder.
+ */
+static int
+sunlit (double t, Vec3 *pp)
+{
+    double m = UNIXMJD + t/86400.0;
+    double lsn, rsn, bsn, ra, dec, d, pp2;
+
+    sunpos (m, &lsn, &rsn, &bsn);
+    ecl_eq (m, bsn, lsn, &ra, &dec);
+    d = pp->x*cos(dec)*cos(ra) + pp->y*cos(dec)*sin(ra) + pp->z*sin(dec);
+    if (d >= 0)
+        return (1);
+    pp2 = pp->x*pp->x + pp->y*pp->y + pp->z*pp->z;
+    return (pp2 - d*d > 1);
+}
+
+/* follow satellite i of cp from unix time ta to tb and add each pass through
+ * the field to the list at *xpp, which has nx entries so far, growing it
+ * as needed.
+ * return new count, or -1 if no memory.
+ */
+static int
+fineSearch (SCGeom *gp, SatCat *cp, int i, double ta, double tb, double fov,
+            SatCross **xpp, int nx)
+{
+    SatBatch *bp;
+    SatCross x;
+    Vec3 p, v, pmin;
+    double t, dt, sep, lastt = 0, lastsep = 0;
+    int in = 0;
+
+    bp = satb_new (&cp->el[i], 1);
+    if (!bp)
+        return (-1);
+
+    memset ((void *)&x, 0, sizeof(x));
+    for (t = ta; ; t += dt)
+    {
+        if (t > tb)
+            t = tb;
+        satb_prop (bp, UNIXMJD + t/86400.0, &p, &v);
+        sep = sepAt (gp, t, &p, &v, 0);
+
+        if (sep <= fov/2)
+        {
+            if (!in)
+            {
+                /* entered since last step, interpolate when */
+                in = 1;
+                x.t0 = t == ta ? t
+                        : lastt + (t-lastt)*(lastsep-fov/2)/(lastsep-sep);
+                x.sep = sep;
+                x.tmin = t;
+                pmin = p;
+            }
+            else if (sep < x.sep)
+            {
+                x.sep = sep;
+                x.tmin = t;
+                pmin = p;
+            }
+        }
+        if (in && (sep > fov/2 || t >= tb))
+        {
+            SatCross *newxp;
+
+            in = 0;
+            x.t1 = sep <= fov/2 ? t
+                        : lastt + (t-lastt)*(fov/2-lastsep)/(sep-lastsep);
+            x.catno = cp->el[i].se_id.catno;
+            strcpy (x.name, cp->name[i]);
+            x.lit = sunlit (x.tmin, &pmin);
+            newxp = (SatCross *) realloc ((void *)*xpp, (nx+1)*sizeof(x));
+            if (!newxp)
+            {
+                satb_free (bp);
+                return (-1);
+            }
+            *xpp = newxp;
+            newxp[nx++] = x;
+        }
+        if (t >= tb)
+            break;
+
+        /* step so as to move no more than a fraction of the field radius */
+        {
+            Vec3 s;
+            double w, rng;
+
+            siteAt (gp, t, &s);
+            rng = sqrt((p.x-s.x)*(p.x-s.x) + (p.y-s.y)*(p.y-s.y)
+                                                    + (p.z-s.z)*(p.z-s.z));
+            w = sqrt(v.x*v.x + v.y*v.y + v.z*v.z) + gp->vs;
+            dt = 60*(fov/2/FDIV)*rng/w;
+            if (dt < MINFSTEP)
+                dt = MINFSTEP;
+        }
+        lastt = t;
+        lastsep = sep;
+    }
+
+    satb_free (bp);
+    return (nx);
+}
+
+/* qsort compare by time entering the field */
+static int
+cmpCross (const void *p1, const void *p2)
+{
+    double d = ((SatCross *)p1)->t0 - ((SatCross *)p2)->t0;
+
+    return (d < 0 ? -1 : (d > 0 ? 1 : 0));
+}
@@ -0,0 +1,25 @@
+/* satcross.c: predict which earth satellites cross a field during an
+ * exposure, so a schedule can shift or split it.
+ * include circum.h and scan.h first.
+ */
+
+typedef struct _SatCat SatCat;  /* a loaded catalog of element sets */
+
+/* one pass of one satellite through a field */
+typedef struct
+{
+    int catno;          /* catalog number */
+    char name[25];      /* name line from the element file, if any */
+    double t0, t1;      /* unix times it enters and leaves the field */
+    double tmin;        /* unix time of closest approach to field center */
+    double sep;         /* that closest approach, rads */
+    int lit;            /* 1 if sunlit then, else in the earth's shadow */
+} SatCross;
+
+extern SatCat *satCatLoad (char *fn, char msg[]);
+extern void satCatFree (SatCat *cp);
+extern int satCatN (SatCat *cp);
+extern int satCrossField (SatCat *cp, Now *np, double ra, double dec,
+                          double fov, double t0, double dur, SatCross **xpp, char msg[]);
+extern int satCrossScan (SatCat *cp, Now *np, Scan *sp, double fov,
+                         SatCross **xpp, char msg[]);
@@ -0,0 +1,216 @@
+/* a static bucket grid over a set of 2-d points.
+ *
+ * the points are binned once into square cells about the size of the search
+ * radius callers expect to use, so a query only has to look at the few cells
+ * that overlap its circle instead of every point. good for matching image
+ * stars against catalog stars in pixels or xi/eta, where the naive way is
+ * O(n*m) per pass.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "starindex.h"
+
+#define MINCELLS    64      /* never bother with fewer cells than this */
+#define CELLSPERPT  4       /* nor more than this many per point */
+
+static void cellOf (StarIndex *sip, double x, double y, int *ixp, int *iyp);
+
+/* build *sip over the n points x[]/y[], with cells about cell on a side.
+ * the arrays are referenced, not copied, so must outlive *sip.
+ * the cell size is increased if need be to keep the grid a sensible size.
+ * return 0 if ok, else -1 if no memory.
+ */
+int
+starIdxBuild (StarIndex *sip, double x[], double y[], int n, double cell)
+{
+    double xmin, xmax, ymin, ymax, w, h;
+    int *count;
+    int ncells, maxcells;
+    int i;
+
+    memset ((void *)sip, 0, sizeof(*sip));
+    sip->x = x;
+    sip->y = y;
+    sip->n = n;
+
+    /* find extent */
+    xmin = ymin = 0;
+    xmax = ymax = 0;
+    for (i = 0; i < n; i++)
+    {
+        if (i == 0 || x[i] < xmin) xmin = x[i];
+        if (i == 0 || x[i] > xmax) xmax = x[i];
+        if (i == 0 || y[i] < ymin) ymin = y[i];
+        if (i == 0 || y[i] > ymax) ymax = y[i];
+    }
+    w = xmax - xmin;
+    h = ymax - ymin;
+
+    /* pick cell size */
+    maxcells = CELLSPERPT*n > MINCELLS ? CELLSPERPT*n : MINCELLS;
+    if (cell <= 0)
+        cell = 1;
+    while ((w/cell + 1)*(h/cell + 1) > maxcells)
+        cell *= 2;
+    sip->cell = cell;
+    sip->x0 = xmin;
+    sip->y0 = ymin;
+    sip->nx = (int)(w/cell) + 1;
+    sip->ny = (int)(h/cell) + 1;
+    ncells = sip->nx * sip->ny;
+
+    sip->start = (int *) calloc (ncells+1, sizeof(int));
+    sip->idx = (int *) malloc ((n > 0 ? n : 1) * sizeof(int));
+    count = (int *) calloc (ncells, sizeof(int));
+    if (!sip->start || !sip->idx || !count)
+    {
+        if (count) free ((void *)count);
+        starIdxFree (sip);
+        return (-1);
+    }
+
+    /* counting sort of point indices by cell */
+    for (i = 0; i < n; i++)
+    {
+        int ix, iy;
+
+        cellOf (sip, x[i], y[i], &ix, &iy);
+        sip->start[iy*sip->nx + ix + 1]++;
+    }
+    for (i = 0; i < ncells; i++)
+        sip->start[i+1] += sip->start[i];
+    for (i = 0; i < n; i++)
+    {
+        int ix, iy, c;
+
+        cellOf (sip, x[i], y[i], &ix, &iy);
+        c = iy*sip->nx + ix;
+        sip->idx[sip->start[c] + count[c]++] = i;
+    }
+
+    free ((void *)count);
+    return (0);
+}
+
+/* free the memory held by *sip. ok to call more than once. */
+void
+starIdxFree (StarIndex *sip)
+{
+    if (sip->start)
+        free ((void *)sip->start);
+    if (sip->idx)
+        free ((void *)sip->idx);
+    sip->start = sip->idx = NULL;
+    sip->n = 0;
+}
+
+/* return the index of the point nearest x/y that is closer than maxr, and its
+ *   distance in *dp if dp, else return -1 if there is none.
+ * ties go to the lowest index, as a linear scan would.
+ */
+int
+starIdxNearest (StarIndex *sip, double x, double y, double maxr, double *dp)
+{
+    double bestd2 = maxr*maxr;
+    int best = -1;
+    int ix0, iy0, ix1, iy1, ix, iy;
+
+    if (sip->n <= 0)
+        return (-1);
+
+    cellOf (sip, x - maxr, y - maxr, &ix0, &iy0);
+    cellOf (sip, x + maxr, y + maxr, &ix1, &iy1);
+    for (iy = iy0; iy <= iy1; iy++)
+    {
+        for (ix = ix0; ix <= ix1; ix++)
+        {
+            int c = iy*sip->nx + ix;
+            int k;
+
+            for (k = sip->start[c]; k < sip->start[c+1]; k++)
+            {
+                int i = sip->idx[k];
+                double dx = sip->x[i] - x;
+                double dy = sip->y[i] - y;
+                double d2 = dx*dx + dy*dy;
+
+                if (d2 < bestd2 || (d2 == bestd2 && best >= 0 && i < best))
+                {
+                    bestd2 = d2;
+                    best = i;
+                }
+            }
+        }
+    }
+
+    if (best >= 0 && dp)
+        *dp = sqrt(bestd2);
+    return (best);
+}
+
+/* find the points strictly closer than r to x/y.
+ * store the indices of up to maxfound of them in found[], in increasing order.
+ * return the number stored.
+ */
+int
+starIdxWithin (StarIndex *sip, double x, double y, double r, int found[],
+               int maxfound)
+{
+    double r2 = r*r;
+    int nfound = 0;
+    int ix0, iy0, ix1, iy1, ix, iy;
+    int i, j;
+
+    if (sip->n <= 0 || maxfound <= 0)
+        return (0);
+
+    cellOf (sip, x - r, y - r, &ix0, &iy0);
+    cellOf (sip, x + r, y + r, &ix1, &iy1);
+    for (iy = iy0; iy <= iy1; iy++)
+    {
+        for (ix = ix0; ix <= ix1; ix++)
+        {
+            int c = iy*sip->nx + ix;
+            int k;
+
+            for (k = sip->start[c]; k < sip->start[c+1]; k++)
+            {
+                double dx, dy;
+
+                i = sip->idx[k];
+                dx = sip->x[i] - x;
+                dy = sip->y[i] - y;
+                if (dx*dx + dy*dy >= r2)
+                    continue;
+
+                /* insert in order, keeping the lowest maxfound */
+                for (j = nfound; j > 0 && found[j-1] > i; j--)
+                    if (j < maxfound)
+                        found[j] = found[j-1];
+                if (j < maxfound)
+                {
+                    found[j] = i;
+                    if (nfound < maxfound)
+                        nfound++;
+                }
+            }
+        }
+    }
+
+    return (nfound);
+}
+
+/* find the cell containing x/y, clamped to the grid */
+static void
+cellOf (StarIndex *sip, double x, double y, int *ixp, int *iyp)
+{
+    double fx = (x - sip->x0)/sip->cell;
+    double fy = (y - sip->y0)/sip->cell;
+
+    *ixp = fx < 0 ? 0 : (fx >= sip->nx ? sip->nx-1 : (int)fx);
+    *iyp = fy < 0 ? 0 : (fy >= sip->ny ? sip->ny-1 : (int)fy);
+}
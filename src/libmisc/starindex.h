@@ -0,0 +1,22 @@
+/* starindex.c: static bucket grid over a set of 2-d points, for fast
+ * nearest neighbour and radius queries when cross-matching star lists.
+ */
+
+typedef struct
+{
+    double *x, *y;      /* caller's point arrays, NOT copied */
+    int n;              /* n points */
+    double x0, y0;      /* min corner of the grid */
+    double cell;        /* size of each square cell */
+    int nx, ny;         /* n cells in each direction */
+    int *start;         /* malloced nx*ny+1 offsets into idx[] */
+    int *idx;           /* malloced point indices, grouped by cell */
+} StarIndex;
+
+extern int starIdxBuild (StarIndex *sip, double x[], double y[], int n,
+                         double cell);
+extern void starIdxFree (StarIndex *sip);
+extern int starIdxNearest (StarIndex *sip, double x, double y, double maxr,
+                           double *dp);
+extern int starIdxWithin (StarIndex *sip, double x, double y, double r,
+                          int found[], int maxfound);
@@ -0,0 +1,134 @@
+/* telRingOpen(): attach, or create, the TelRing shared memory.
+ * telRingPut(): add a record, for telescoped only.
+ * telRingGet(): copy a record, for anyone.
+ * telRingFind(): the first record at or after a given time.
+ *
+ * telescoped is the only writer and never waits for anyone. Each slot says
+ * which record it holds and whether it is complete, so a reader copies the
+ * record then checks the slot still says the same; if not it was written
+ * over meanwhile and the reader has fallen more than TELRINGN behind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "telring.h"
+
+/* attach the TelRing, and return it at *rpp.
+ * if create, make it if need be and start it empty, as telescoped does when
+ * it starts; else it must already exist and may only be read.
+ * return 0 if ok, else -1 with errno set.
+ */
+int
+telRingOpen (int create, TelRing **rpp)
+{
+    int len = sizeof(TelRing);
+    TelRing *rp;
+    int shmid;
+    void *addr;
+
+    shmid = shmget (TELRINGSHMKEY, len, create ? 0664 : 0);
+    if (shmid < 0 && create)
+    {
+        /* EINVAL means one from an older telescoped of another size */
+        if (errno == EINVAL && (shmid = shmget (TELRINGSHMKEY, 0, 0)) >= 0)
+        {
+            (void) shmctl (shmid, IPC_RMID, NULL);
+            errno = ENOENT;
+        }
+        if (errno == ENOENT)
+            shmid = shmget (TELRINGSHMKEY, len, 0664 | IPC_CREAT);
+    }
+    if (shmid < 0)
+        return (-1);
+
+    addr = shmat (shmid, NULL, create ? 0 : SHM_RDONLY);
+    if (addr == (void *)-1)
+        return (-1);
+    rp = (TelRing *)addr;
+
+    if (create)
+    {
+        memset (addr, 0, len);
+        rp->nslots = TELRINGN;
+        rp->recsize = sizeof(TelRingRec);
+        rp->pid = getpid();
+    }
+    else if (rp->nslots != TELRINGN || rp->recsize != sizeof(TelRingRec))
+    {
+        (void) shmdt (addr);
+        errno = EINVAL;
+        return (-1);
+    }
+
+    *rpp = rp;
+    return (0);
+}
+
+/* add *recp to rp */
+void
+telRingPut (TelRing *rp, TelRingRec *recp)
+{
+    unsigned long n = atomic_load_explicit (&rp->head, memory_order_relaxed);
+    TelRingSlot *sp = &rp->slot[n % TELRINGN];
+
+    /* mark the slot busy before touching the record, complete after */
+    atomic_store_explicit (&sp->seq, 2*n+1, memory_order_relaxed);
+    atomic_thread_fence (memory_order_release);
+    memcpy (&sp->rec, recp, sizeof(TelRingRec));
+    atomic_store_explicit (&sp->seq, 2*n+2, memory_order_release);
+    atomic_store_explicit (&rp->head, n+1, memory_order_release);
+}
+
+/* copy record n of rp to *recp.
+ * return 0 if ok, -1 if it is not yet complete, 1 if it has been written
+ * over, ie, n is now too old.
+ */
+int
+telRingGet (TelRing *rp, unsigned long n, TelRingRec *recp)
+{
+    TelRingSlot *sp = &rp->slot[n % TELRINGN];
+    unsigned long seq;
+
+    seq = atomic_load_explicit (&sp->seq, memory_order_acquire);
+    if (seq != 2*n+2)
+        return (seq < 2*n+2 ? -1 : 1);
+
+    memcpy (recp, &sp->rec, sizeof(TelRingRec));
+    atomic_thread_fence (memory_order_acquire);
+    if (atomic_load_explicit (&sp->seq, memory_order_relaxed) != seq)
+        return (1);
+    return (0);
+}
+
+/* return the first record of rp still held with a time at or after mjd t,
+ * else the head if there is none yet.
+ */
+unsigned long
+telRingFind (TelRing *rp, double t)
+{
+    unsigned long hi = atomic_load_explicit (&rp->head, memory_order_acquire);
+    unsigned long lo, mid;
+    TelRingRec rec;
+    int r;
+
+    /* leave a little room for those being written over while we look */
+    lo = hi > TELRINGN - TELRINGN/64 ? hi - (TELRINGN - TELRINGN/64) : 0;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo)/2;
+        r = telRingGet (rp, mid, &rec);
+        if (r < 0 || (r == 0 && rec.hmjd >= t))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return (lo);
+}
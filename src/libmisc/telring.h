@@ -0,0 +1,63 @@
+/* telring.c: a shared memory history of the telescope axes.
+ * telescoped adds one TelRingRec each time it polls the telescope; any
+ * number of readers may follow along, or look back as far as TELRINGN
+ * records, without ever making telescoped wait.
+ */
+
+#ifndef TELRING_H
+#define TELRING_H
+
+#include <stdatomic.h>
+
+/* shared memory key; can be anything unlikely ;-)
+ * N.B. bug in some ipcrm's prevents removing it if it's greater than 1<<31.
+ */
+#define TELRINGSHMKEY   0x4e56361c
+
+#define TELRINGN    131072  /* records kept, power of 2; 43 mins at 50 Hz */
+#define TELRINGAX   3       /* axes kept, TEL_HM, TEL_DM and TEL_RM */
+
+/* one axis, as in its MotorInfo */
+typedef struct
+{
+    int raw;                /* raw count from home */
+    double when;            /* mjd raw was sampled */
+    double cpos;            /* position then, rads from home */
+    double dpos;            /* desired position now, rads from home */
+    double cvel;            /* commanded velocity, rads/sec */
+} TelRingAxis;
+
+/* the axes at one poll */
+typedef struct
+{
+    double hmjd;            /* host time of poll, mjd */
+    int telstate;           /* TelState */
+    int clock;              /* controller clock, ms, if tracking else -1 */
+    TelRingAxis ax[TELRINGAX];  /* 0 for any axis we do not have */
+} TelRingRec;
+
+/* one slot of the ring. record n is written into slot n%TELRINGN; its seq
+ * is 2n+1 while being written then 2n+2 once complete.
+ */
+typedef struct
+{
+    atomic_ulong seq;       /* see above */
+    TelRingRec rec;         /* the record */
+} TelRingSlot;
+
+/* the whole segment */
+typedef struct
+{
+    int nslots;             /* TELRINGN, to check readers agree */
+    int recsize;            /* sizeof(TelRingRec), likewise */
+    int pid;                /* pid of the telescoped that made it */
+    atomic_ulong head;      /* records ever added, ie, the next n */
+    TelRingSlot slot[TELRINGN];
+} TelRing;
+
+extern int telRingOpen (int create, TelRing **rpp);
+extern void telRingPut (TelRing *rp, TelRingRec *recp);
+extern int telRingGet (TelRing *rp, unsigned long n, TelRingRec *recp);
+extern unsigned long telRingFind (TelRing *rp, double t);
+
+#endif /* TELRING_H */
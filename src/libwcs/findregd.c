@@ -57,6 +57,7 @@
 #include "fits.h"
 #include "wcs.h"
 #include "lstsqr.h"
+#include "starindex.h"
 
 
 #define THRESH          1.5 /* discard resids > THRESH*median */
@@ -86,6 +87,7 @@ static double *gx_g;
 static double *gy_g;
 static double psx0_g, psy0_g;
 static FImage fim_g;
+static WCSTransform wcs_g;
 static int npair_g;
 
 static void init_fim (FImage *fip);
@@ -121,10 +123,6 @@ static void xy2xieta
 static void RADec2xieta (double rc, double dc, int n, double *r, double *d,
                          double *xi, double *eta);
 
-#ifdef FITS_SOLUTION_TRACE
-static int getAMDFITS (FImage *fip, double a[], double b[]);
-#endif
-
 #ifdef THRESH_TRACE
 static void xieta2RADec (double rc, double dc, int n, double *xi, double *eta,
                          double *r, double *d);
@@ -209,8 +207,9 @@ double *rp;       /* IN: max acceptable WCS residual (pixels)
     gy = (double *) malloc (ng * sizeof(double));
     init_fim (fip);
     setFITSWCS (&fim_g, t_ra, t_dc, t_th, t_sx, t_sy);
-    for (i = 0; i < ng; i++)
-        RADec2xy (&fim_g, gr[i], gd[i], &gx[i], &gy[i]);
+    setWCSTransform (&wcs_g, t_ra, t_dc, t_th, t_sx, t_sy, fim_g.sw/2.0,
+                     fim_g.sh/2.0);
+    (void) wcsRADec2XY (&wcs_g, ng, gr, gd, gx, gy);
 
 #ifdef IN_TRACE
     printf ("IN:\n");
@@ -364,8 +363,8 @@ double *rp;       /* IN: max acceptable WCS residual (pixels)
             double r2as = raddeg(1)*3600;
             /* sloppy programming to use file global variable fim_g
              * but easier than bothering to initialise another FImage
-             * structure; function chisqr always sets fim_g as required
-             * so this won't interfere
+             * structure; function chisqr no longer touches fim_g so
+             * this won't interfere
              */
             setFITSWCS (&fim_g, t_ra, t_dc, t_th, t_sx, t_sy);
             xy2RADec (&fim_g, smx[i], smy[i], &smr, &smd);
@@ -776,6 +775,213 @@ tidy:
     return (ok ? 0 : -1);
 }
 
+/* refit the WCS C* of fip, starting from a solution that is already known to
+ *   be close (to within MATCHDIST or so), such as the previous frame of a
+ *   tracking sequence moved by the telescope's own reported offset.
+ * no distance matching and no nonlinear search: just match by position then
+ *   solve the linear tangent plane model directly, culling outliers and
+ *   iterating a few times so the tangent point settles.
+ * if the max residual is <= *rp update fip, set *rp to the mean residual and
+ *   *npp to the number of pairs used, and return 0; else leave fip unchanged
+ *   and return -1.
+ */
+int
+trackRegistrationD (fip, ra0, dec0, rot0, psx0, psy0, sx, sy, ns, gr, gd, ng,
+                    pMINPAIR, pMATCHDIST, npp, rp)
+FImage *fip;        /* image header to modify IFF we find a match */
+double ra0, dec0;   /* predicted center position */
+double rot0;        /* predicted rotation */
+double psx0, psy0;  /* predicted pixel scales, rads/pixel right and down */
+double sx[], sy[];  /* test stars, image locations, pixels */
+int ns;         /* number of entries in sx[] and sy[] */
+double gr[], gd[];  /* reference stars, ra/dec, rads */
+int ng;         /* number of entries in gr[] and gd[] */
+int pMINPAIR;      /* min pairs for WCS fit */
+double pMATCHDIST; /* position match limit, arcsec */
+int *npp;         /* OUT: number of pairs in final fit */
+double *rp;       /* IN: max acceptable WCS residual (pixels)
+                     OUT: actual mean residual (pixels) */
+{
+    WCSTransform wt;
+    double t_ra = ra0, t_dc = dec0, t_th = rot0, t_sx = psx0, t_sy = psy0;
+    double xr = fip->sw/2.0 - 1, yr = fip->sh/2.0 - 1;
+    double *gx, *gy, *gxi, *geta, *resid;
+    double rmax = 0, rsum = 0;
+    int *mats, *matg, *use;
+    int npmax, npair = 0, nuse = 0, nfit = 0;
+    int ok = 0;
+    int i, j;
+
+    if (ns < pMINPAIR || ng < pMINPAIR)
+        return (-1);
+
+    npmax = ng < ns ? ng : ns;
+    gx = (double *) malloc (ng * sizeof(double));
+    gy = (double *) malloc (ng * sizeof(double));
+    gxi = (double *) malloc (npmax * sizeof(double));
+    geta = (double *) malloc (npmax * sizeof(double));
+    resid = (double *) malloc (npmax * sizeof(double));
+    mats = (int *) malloc (npmax * sizeof(int));
+    matg = (int *) malloc (npmax * sizeof(int));
+    use = (int *) malloc (npmax * sizeof(int));
+    if (!gx || !gy || !gxi || !geta || !resid || !mats || !matg || !use)
+        goto out;
+
+    /* match once using the prediction */
+    setWCSTransform (&wt, t_ra, t_dc, t_th, t_sx, t_sy, fip->sw/2.0,
+                     fip->sh/2.0);
+    (void) wcsRADec2XY (&wt, ng, gr, gd, gx, gy);
+    matchByPos (sx, sy, ns, gr, gd, gx, gy, ng,
+                raddeg(fabs(t_sx))*3600, raddeg(fabs(t_sy))*3600, pMATCHDIST,
+                npmax, mats, matg, &npair);
+    if (npair < pMINPAIR)
+        goto out;
+    for (i = 0; i < npair; i++)
+        use[i] = 1;
+    nuse = npair;
+
+    for (j = 0; j < NOUTLL; j++)
+    {
+        double m[3][3], vx[3], vy[3], det, cx[3], cy[3];
+        double A, B, C, D, E, F, cr, sr, sgn, rmed;
+        int k, n;
+
+        /* standard coords of the matched catalog stars about current center */
+        for (i = 0; i < npair; i++)
+            RADec2xieta (t_ra, t_dc, 1, &gr[matg[i]], &gd[matg[i]], &gxi[i],
+                         &geta[i]);
+
+        /* linear least squares for xi = A*u + B*v + C, eta = D*u + E*v + F
+         * where u/v are pixels from the reference pixel.
+         */
+        memset ((void *)m, 0, sizeof(m));
+        memset ((void *)vx, 0, sizeof(vx));
+        memset ((void *)vy, 0, sizeof(vy));
+        for (i = 0; i < npair; i++)
+        {
+            double f[3];
+
+            if (!use[i])
+                continue;
+            f[0] = sx[mats[i]] - xr;
+            f[1] = sy[mats[i]] - yr;
+            f[2] = 1;
+            for (k = 0; k < 3; k++)
+            {
+                for (n = 0; n < 3; n++)
+                    m[k][n] += f[k]*f[n];
+                vx[k] += f[k]*gxi[i];
+                vy[k] += f[k]*geta[i];
+            }
+        }
+        det = m[0][0]*(m[1][1]*m[2][2] - m[1][2]*m[2][1])
+              - m[0][1]*(m[1][0]*m[2][2] - m[1][2]*m[2][0])
+              + m[0][2]*(m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+        if (det == 0.0)
+            goto out;
+        for (k = 0; k < 3; k++)
+        {
+            /* Cramer's rule, replacing column k */
+            double mx[3][3], my[3][3];
+
+            memcpy ((void *)mx, (void *)m, sizeof(m));
+            memcpy ((void *)my, (void *)m, sizeof(m));
+            for (n = 0; n < 3; n++)
+            {
+                mx[n][k] = vx[n];
+                my[n][k] = vy[n];
+            }
+            cx[k] = (mx[0][0]*(mx[1][1]*mx[2][2] - mx[1][2]*mx[2][1])
+                     - mx[0][1]*(mx[1][0]*mx[2][2] - mx[1][2]*mx[2][0])
+                     + mx[0][2]*(mx[1][0]*mx[2][1] - mx[1][1]*mx[2][0]))/det;
+            cy[k] = (my[0][0]*(my[1][1]*my[2][2] - my[1][2]*my[2][1])
+                     - my[0][1]*(my[1][0]*my[2][2] - my[1][2]*my[2][0])
+                     + my[0][2]*(my[1][0]*my[2][1] - my[1][1]*my[2][0]))/det;
+        }
+        A = cx[0];
+        B = cx[1];
+        C = cx[2];
+        D = cy[0];
+        E = cy[1];
+        F = cy[2];
+
+        /* back to C* form, see setWCSTransform(): A = cr*sx, B = -sr*sy,
+         * D = sr*sx, E = cr*sy. keep the signs of the scales we started with.
+         */
+        sgn = t_sx < 0 ? -1 : 1;
+        t_sx = sgn*sqrt(A*A + D*D);
+        t_th = atan2 (D/t_sx, A/t_sx);
+        cr = cos(t_th);
+        sr = sin(t_th);
+        t_sy = fabs(cr) > fabs(sr) ? E/cr : -B/sr;
+
+        /* new center is the fitted xi/eta of the reference pixel */
+        {
+            double den = cos(t_dc) - F*sin(t_dc);
+
+            t_ra += atan2 (C, den);
+            t_dc = atan2 (sin(t_dc) + F*cos(t_dc), sqrt(C*C + den*den));
+            range (&t_ra, 2*PI);
+        }
+
+        /* residuals of all matched pairs with the new solution, pixels */
+        setWCSTransform (&wt, t_ra, t_dc, t_th, t_sx, t_sy, fip->sw/2.0,
+                         fip->sh/2.0);
+        rmax = rsum = 0;
+        for (i = n = 0; i < npair; i++)
+        {
+            double x, y;
+
+            (void) wcsRADec2XY (&wt, 1, &gr[matg[i]], &gd[matg[i]], &x, &y);
+            resid[i] = sqrt((x-sx[mats[i]])*(x-sx[mats[i]]) +
+                            (y-sy[mats[i]])*(y-sy[mats[i]]));
+            if (use[i])
+            {
+                if (resid[i] > rmax)
+                    rmax = resid[i];
+                rsum += resid[i];
+                gxi[n++] = resid[i];
+            }
+        }
+
+        nfit = n;
+
+        /* cull as in findRegistrationD() */
+        dmedian (gxi, n, &rmed);
+        rmed *= THRESH;
+        if (rmed < *rp)
+            rmed = *rp;
+        for (i = n = 0; i < npair; i++)
+            if ((use[i] = resid[i] < rmed))
+                n++;
+        if (n == nuse)
+            break;
+        nuse = n;
+        if (nuse < pMINPAIR)
+            goto out;
+    }
+
+    if (nfit >= pMINPAIR && rmax <= *rp)
+    {
+        setFITSWCS (fip, t_ra, t_dc, t_th, t_sx, t_sy);
+        *rp = rsum/nfit;
+        *npp = nfit;
+        ok = 1;
+    }
+
+out:
+    if (gx) free ((void *)gx);
+    if (gy) free ((void *)gy);
+    if (gxi) free ((void *)gxi);
+    if (geta) free ((void *)geta);
+    if (resid) free ((void *)resid);
+    if (mats) free ((void *)mats);
+    if (matg) free ((void *)matg);
+    if (use) free ((void *)use);
+
+    return (ok ? 0 : -1);
+}
+
 /* init fim_g from fip */
 static void
 init_fim (FImage *fip)
@@ -792,16 +998,16 @@ init_fim (FImage *fip)
 }
 
 
-/* compute the chisqr of the vector v with respect to fim_g.
+/* compute the chisqr of the vector v with respect to wcs_g.
  * update resid/_max/_sum/_sum2/_g[i].  (*** UNITS OF PIXELS ***)
  *
  * chisqr is version for 5 parameter WCS fit.
- * chisqr needs to call RADec2xy (cf. chisqr2).
+ * chisqr needs to project every gr_g/gd_g (cf. chisqr2), but it does so
+ * through wcs_g directly rather than a round trip through fim_g's header.
  */
 static double
 chisqr(double v[5])
 {
-    FImage *fip = &fim_g;
     double *mx, *my;
     double ra = v[0];
     double dc = v[1];
@@ -820,7 +1026,8 @@ chisqr(double v[5])
     resid_sum2 = 0;
 
     /* install trial values */
-    setFITSWCS (fip, ra, dc, th, sx, sy);
+    setWCSTransform (&wcs_g, ra, dc, th, sx, sy, fim_g.sw/2.0, fim_g.sh/2.0);
+    (void) wcsRADec2XY (&wcs_g, npair_g, gr_g, gd_g, mx, my);
 
     /* find errors compared with star list */
     c2 = 0.0;
@@ -829,8 +1036,6 @@ chisqr(double v[5])
         double ex, ey;
         double r, r2;
 
-        RADec2xy (fip, gr_g[i], gd_g[i], &mx[i], &my[i]);
-
         /* credit for small distance */
         ex = mx[i] - sx_g[i];
         ey = my[i] - sy_g[i];
@@ -1675,12 +1880,11 @@ matchByDist (double sx[], double sy[], int ns,
  * This function should then be able to match a greater number of pairs of
  * stars, which will then allow a more accurate astrometric fit to be done.
  *
- * The algorithm is currently inefficient because we want a working program
- * as soon as possible.  It can be improved in future if necessary, e.g. by
- * ordering one or more of the input arrays.
- * Currently we simply take each catalogue star in turn, and check it against
- * each image star, seeing if exactly one image star is found within
- * the distance pMATCHDIST.
+ * We take each catalogue star in turn, and check it against the image
+ * stars, seeing if exactly one image star is found within the distance
+ * pMATCHDIST.  The image stars are first binned into a StarIndex grid in
+ * the units of pMATCHDIST so each check only looks at the image stars in
+ * the few nearby cells rather than all of them.
  * At present, it isn't checked whether two catalogue stars are within
  * pMATCHDIST of the same image star.  The ip.cfg parameter FSMINSEP actually
  * imposes a minimum separation between image stars.
@@ -1708,9 +1912,10 @@ matchByPos (double sx[], double sy[], int ns,
  *  *np        number of star pairs, at most npmax
  */
 {
-    double distsq;
+    StarIndex si;   /* grid over the image stars, in pMATCHDIST units */
+    double *ssx, *ssy;  /* image stars in pMATCHDIST units */
     int nm = 0;     /* number of matches so far */
-    int i, j, im;
+    int i, j;
 
 #ifdef MATCH_TRACE
     printf ("MATCH_TRACE:\n");
@@ -1725,66 +1930,49 @@ matchByPos (double sx[], double sy[], int ns,
                 j, gx[j], gy[j], raddeg(gr[j]), raddeg(gd[j]));
 #endif
 
-    for (distsq = pow(pMATCHDIST,2), j = 0; j < ng && nm < npmax; j++)
+    ssx = (double *) malloc ((ns > 0 ? ns : 1) * sizeof(double));
+    ssy = (double *) malloc ((ns > 0 ? ns : 1) * sizeof(double));
+    if (!ssx || !ssy)
+        goto nomem;
+    for (i = 0; i < ns; i++)
     {
-        for (im = i = 0; i < ns; i++)
-        {
-            if ( pow((sx[i]-gx[j])*xsc,2) + pow((sy[i]-gy[j])*ysc,2) < distsq )
-            {
-                if (im == 0)
-                {
-                    /* if this is the first image star near this catalogue star,
-                     * provisionally accept the match (don't increment nm till really
-                     * accept match)
-                     */
-                    im=1;
-                    mats[nm]=i;
-                    matg[nm]=j;
-                }
-                else
-                {
-                    /* if this is the second image star near this catalogue star,
-                     * reject because ambiguous
-                     */
-                    im=2;
-                    break;
-                }
-            }
-        }
-        /* if all image stars have been checked, and exactly one image star found
-         * near this catalogue star, accept the match
+        ssx[i] = sx[i]*xsc;
+        ssy[i] = sy[i]*ysc;
+    }
+    if (starIdxBuild (&si, ssx, ssy, ns, pMATCHDIST) < 0)
+        goto nomem;
+
+    for (j = 0; j < ng && nm < npmax; j++)
+    {
+        int found[2];
+
+        /* accept if exactly one image star is near this catalogue star,
+         * reject as ambiguous if more than one
          */
+        if (starIdxWithin (&si, gx[j]*xsc, gy[j]*ysc, pMATCHDIST, found, 2)
+                == 1)
+        {
+            mats[nm] = found[0];
+            matg[nm] = j;
 #ifdef MATCH_TRACE
-        if (im == 1) printf ("(%i,%i) accepted\n", mats[nm],matg[nm]);
+            printf ("(%i,%i) accepted\n", mats[nm],matg[nm]);
 #endif
-        if (im == 1) nm++;
+            nm++;
+        }
     }
 
-    *np = nm;
-}
-
+    starIdxFree (&si);
+    free ((void *)ssx);
+    free ((void *)ssy);
 
-#ifdef FITS_SOLUTION_TRACE
-/* get astrometric fit parameters AMDX*, AMDY* from FITS header
- * return 0 if all found (all must be present, even if zero), else -1
- */
-static int
-getAMDFITS (FImage *fip, double a[], double b[])
-{
-    char name[7];
-    int i;
-
-    for (i = 0; i < 14; i++)
-    {
-        sprintf (name, "AMDX%i", i);
-        if (getRealFITS (fip, name, &a[i]) < 0) return (-1);
-        sprintf (name, "AMDY%i", i);
-        if (getRealFITS (fip, name, &b[i]) < 0) return (-1);
-    }
+    *np = nm;
+    return;
 
-    return (0);
+nomem:
+    if (ssx) free ((void *)ssx);
+    if (ssy) free ((void *)ssy);
+    *np = 0;
 }
-#endif
 
 
 /* Pixel coordinates to "standard coordinates" in radians,
@@ -50,6 +50,38 @@ extern int findRegistration (FImage *fip, double ra0, double dec0, double rot0,
                              double gd[], int ng, double *residp);
 #endif
 
+extern int trackRegistrationD
+(FImage *fip, double ra0, double dec0, double rot0,
+ double psx0, double psy0, double sx[], double sy[], int ns, double gr[],
+ double gd[], int ng, int minpair, double matchdist, int *npp,
+ double *residp);
+
+#define TRACKFOV    1.5     /* catalog field kept for tracking, x image fov */
+
+/* what trackWCSFITS() remembers about the last frame it solved */
+typedef struct
+{
+    int valid;          /* set when the rest is usable */
+    int sw, sh;         /* image size solved */
+    double nra, ndec;   /* telescope's nominal center of that image, rads */
+    double ra, dec;     /* solved CRVAL1/2, rads */
+    double rot;         /* solved CROTA2, rads */
+    double psx, psy;    /* solved CDELT1/2, rads/pixel */
+    double fov;         /* image fov, rads */
+    double cra, cdec;   /* center of catalog subset, rads */
+    double *gr, *gd;    /* malloced catalog subset, rads */
+    int ng;             /* n in gr[] and gd[] */
+    int npair;          /* n pairs in last fit */
+} WCSTrack;
+
+static WCSTrack track;
+
+static int imageStars (FImage *fip, int verbose, double **sxp, double **syp,
+                       int *nsp, char msg[]);
+static int fetchRefStars (int wantusno, double ra0, double dec0, double fov,
+                          int maxng, double **grp, double **gdp, int verbose, char msg[]);
+static void seedTrack (FImage *fip, int wantusno, int verbose);
+static double trackSep (double ra1, double dec1, double ra2, double dec2);
 static int spiralToFit (FImage *fip, int wantusno, double sprad, double sx[],
                         double sy[], int ns, int verbose, char msg[]);
 static int tryOneLoc (FImage *fip, int wantusno, double sx[], double sy[],
@@ -82,15 +114,9 @@ int
 setWCSFITS (FImage *fip, int wantusno, double hunt, int (*bfp)(),
             int verbose, char msg[])
 {
-    int *sx=0, *sy=0;   /* malloced star coords */
-    CamPixel *sb=0;     /* malloced star brightnest pixel */
-    double *sxd=0, *syd=0;  /* same as sx and sy but as doubles */
-    double *sbd=0;      /* same as sb but as doubles */
-    StarDfn sd;     /* used to refine star locs */
-    int ns;         /* n image stars */
+    double *sxd=0, *syd=0;  /* malloced image star coords */
     int nbs;        /* n brightest image stars we actually use */
     int ret = 0;
-    int i;
 
 #ifdef TIME_TRACE
     traceTime ("Reset clock");
@@ -141,6 +167,167 @@ setWCSFITS (FImage *fip, int wantusno, double hunt, int (*bfp)(),
     traceTime ("Loaded ip.cfg");
 #endif
 
+    /* find the image stars to work with */
+    if (imageStars (fip, verbose, &sxd, &syd, &nbs, msg) < 0)
+        return (-1);
+
+    /* hunt with this set */
+    ret = spiralToFit (fip, wantusno, hunt, sxd, syd, nbs, verbose, msg);
+
+    free ((void *)sxd);
+    free ((void *)syd);
+
+    return (ret);
+}
+
+/* solve fip as one of a sequence of frames of the same field.
+ * the first time, or whenever the telescope has obviously moved to a new
+ *   field, this is just setWCSFITS() and we remember the solution and a
+ *   generous set of reference stars around it.
+ * after that we predict the new solution by moving the last one by the same
+ *   amount the telescope says it moved (its nominal RA/DEC header fields,
+ *   which addShmFITS() copies from CJ2kRA/CJ2kDec), then just match by
+ *   position and refit the linear solution. if that can not get within
+ *   MAXRESID we fall back to the full setWCSFITS().
+ * arguments and return value are exactly as for setWCSFITS().
+ */
+int
+trackWCSFITS (FImage *fip, int wantusno, double hunt, int (*bfp)(),
+              int verbose, char msg[])
+{
+    double nra, ndec, fov, psx, psy;    /* nominal from header */
+    double pra, pdec;   /* predicted center */
+    double *sxd=0, *syd=0;  /* malloced image star coords */
+    int nbs;        /* n image stars */
+    double r;       /* fit residual, pixels */
+    int ret;
+
+#ifdef TIME_TRACE
+    traceTime ("Reset clock");
+#endif
+
+    loadIpCfg();
+    msg[0] = '\0';
+    bail_fp = bfp;
+
+    /* need a previous solution of the same sort of image */
+    if (!track.valid || fip->sw != track.sw || fip->sh != track.sh)
+        goto full;
+    if (getNominal (fip, 0, &nra, &ndec, &fov, &psx, &psy, msg) < 0)
+        goto full;
+
+    /* a jump of more than half a field is a new target, not drift */
+    if (trackSep (nra, ndec, track.nra, track.ndec) > track.fov/2)
+        goto full;
+
+    /* predict */
+    pra = track.ra + (nra - track.nra);
+    pdec = track.dec + (ndec - track.ndec);
+    if (fabs(pdec) >= PI/2)
+        goto full;
+    range (&pra, 2*PI);
+
+    /* refresh the reference stars if we are drifting off them */
+    if (trackSep (pra, pdec, track.cra, track.cdec) > (TRACKFOV-1)*track.fov/2)
+    {
+        int ng;
+
+        if (track.gr) free ((void *)track.gr);
+        if (track.gd) free ((void *)track.gd);
+        track.gr = track.gd = 0;
+        ng = fetchRefStars (wantusno, pra, pdec, TRACKFOV*track.fov,
+                            (int)(MAXCSTARS*TRACKFOV*TRACKFOV), &track.gr, &track.gd,
+                            verbose, msg);
+        if (ng < 0)
+        {
+            track.ng = 0;
+            goto full;
+        }
+        track.ng = ng;
+        track.cra = pra;
+        track.cdec = pdec;
+    }
+
+    if (imageStars (fip, verbose, &sxd, &syd, &nbs, msg) < 0)
+        return (-1);
+
+    r = MAXRESID;
+    if (trackRegistrationD (fip, pra, pdec, track.rot, track.psx, track.psy,
+                            sxd, syd, nbs, track.gr, track.gd, track.ng, MINPAIR,
+                            MATCHDIST, &track.npair, &r) < 0)
+    {
+        if (verbose)
+            printf ("Tracking fit failed, doing full solve\n");
+        free ((void *)sxd);
+        free ((void *)syd);
+        goto full;
+    }
+
+    sprintf (msg, "Fit residual: %.1f pixels", r);
+    if (verbose)
+        printf ("Tracking fit residual (mean): %.2f pixels with %d pairs\n",
+                r, track.npair);
+
+#ifdef TIME_TRACE
+    traceTime ("Tracking fit");
+#endif
+
+    /* this is now the frame to track from */
+    getRealFITS (fip, "CRVAL1", &track.ra);
+    getRealFITS (fip, "CRVAL2", &track.dec);
+    getRealFITS (fip, "CROTA2", &track.rot);
+    getRealFITS (fip, "CDELT1", &track.psx);
+    getRealFITS (fip, "CDELT2", &track.psy);
+    track.ra = degrad(track.ra);
+    track.dec = degrad(track.dec);
+    track.rot = degrad(track.rot);
+    track.psx = degrad(track.psx);
+    track.psy = degrad(track.psy);
+    track.nra = nra;
+    track.ndec = ndec;
+
+    free ((void *)sxd);
+    free ((void *)syd);
+    return (0);
+
+full:
+    track.valid = 0;
+    ret = setWCSFITS (fip, wantusno, hunt, bfp, verbose, msg);
+    if (ret == 0)
+        seedTrack (fip, wantusno, verbose);
+    return (ret);
+}
+
+/* forget any solution trackWCSFITS() is working from, so the next call does a
+ * full solve.
+ */
+void
+resetWCSTrack (void)
+{
+    if (track.gr) free ((void *)track.gr);
+    if (track.gd) free ((void *)track.gd);
+    memset ((void *)&track, 0, sizeof(track));
+}
+
+/* discover star-like things in fip, sort by brightness and centroid the
+ *   brightest few that we will actually use.
+ * if ok return 0 with malloced *sxp and *syp of *nsp entries.
+ * else return -1 with excuse in msg[].
+ */
+static int
+imageStars (FImage *fip, int verbose, double **sxp, double **syp, int *nsp,
+            char msg[])
+{
+    int *sx=0, *sy=0;   /* malloced star coords */
+    CamPixel *sb=0;     /* malloced star brightnest pixel */
+    double *sxd=0, *syd=0;  /* same as sx and sy but as doubles */
+    double *sbd=0;      /* same as sb but as doubles */
+    StarDfn sd;     /* used to refine star locs */
+    int ns;         /* n image stars */
+    int nbs;        /* n brightest image stars we actually use */
+    int ret = 0;
+    int i;
+
     /* discover star-like things in the image */
     ns = findStars (fip->image, fip->sw, fip->sh, &sx, &sy, &sb);
     if (ns < MINPAIR)
@@ -236,8 +423,10 @@ setWCSFITS (FImage *fip, int wantusno, double hunt, int (*bfp)(),
     traceTime ("Centroided");
 #endif
 
-    /* hunt with this set */
-    ret = spiralToFit (fip, wantusno, hunt, sxd, syd, nbs, verbose, msg);
+    *sxp = sxd;
+    *syp = syd;
+    *nsp = nbs;
+    sxd = syd = 0;
 
 out:
     if (sx)  free ((void *)sx);
@@ -339,7 +528,7 @@ spiralToFit (FImage *fip, int wantusno, double sprad, double sx[],
  * return  0 if find a fit and C* in fip are filled in;
  * return -1 if no good fit is found;
  * return -2 if something goes so wrong we should stop trying altogether.
- * N.B. we assume GSCSetup() and/or USNOSetup() have been called.
+ * N.B. we assume FSCSetup(), GSCSetup() and/or USNOSetup() have been called.
  *
  #if USE_DISTANCE_METHOD
  * Previously, tryOneLoc was called during the spiral search with ns0 image
@@ -361,21 +550,116 @@ tryOneLoc (FImage *fip, int wantusno, double sx[], double sy[], int ns,
            double ra0, double dec0, double rot0, double fov, double psx0, double psy0,
            int verbose, char msg[])
 {
-    FieldStar *gsc=0;   /* the array of ng GSC stars */
-    int ng;             /* n of GSC stars */
-    double *gr=0, *gd=0;/* GSC star positions for sorting */
-    double *gb=0;       /* GSC star brightnesses for sorting */
+    double *gr=0, *gd=0;/* GSC star positions */
     int nbg;            /* n brightest GCS stars we actually use */
-    char lmsg[1024];    /* catalog error message */
     double r;           /* fit residual, pixels */
     int ret = 0;        /* assume success */
-    int i;
 #if USE_DISTANCE_METHOD
     int nparam;         /* no. of astrometric fit params */
     double rh;          /* higher order fit residual, arcsec */
 #endif
 
-    /* first get USNO -- ignore any errors */
+    /* get the reference stars */
+    nbg = fetchRefStars (wantusno, ra0, dec0, fov, MAXCSTARS, &gr, &gd,
+                         verbose, msg);
+    if (nbg < 0)
+    {
+        ret = nbg;
+        goto out;
+    }
+
+    /* see if user wants to bail */
+    if (bail_fp && (*bail_fp)())
+    {
+        sprintf (msg, "User stopped");
+        ret = -2;
+        goto out;
+    }
+
+    /* try to find best fit */
+#if USE_DISTANCE_METHOD
+    r = MAXRESID;
+    rh = REJECTDIST;
+    nparam = ns > 0 ? 5 : (ORDER == 2 ? 12 : (ORDER == 3 ? 20 : 26));
+    if (findRegistrationD
+            (fip, ra0, dec0, rot0, psx0, psy0, sx, sy, abs(ns), gr, gd, nbg,
+             nparam, MINPAIR, TRYSTARS, MAXROT, MATCHDIST, &rh, &r)<0)
+    {
+        if (nparam >= 12 && rh > 0 && verbose)
+            printf ("Higher order fit residual (rms): %.2f arcsec\n", rh);
+        if (nparam >= 12 && rh < 0)
+            fprintf (stderr, "Did not find higher order fit\n");
+        sprintf (msg, "Star registration failed.");
+        ret = -1;           /* let caller keep going */
+    }
+    else
+    {
+        /* yes! */
+        sprintf (msg, "Fit residual: %.1f pixels", r);
+        if (verbose)
+            printf ("Fit residual (mean): %.2f pixels\n", r);
+        if (nparam >= 12 && rh > 0 && verbose)
+            printf ("Higher order fit residual (rms): %.2f arcsec\n", rh);
+        if (nparam >= 12 && rh < 0)
+            fprintf (stderr, "Did not find higher order fit\n");
+        sprintf (msg, "Star registration failed.");
+        ret = 0;
+    }
+#else
+    r = MAXRESID;
+    if (findRegistration (fip, ra0, dec0, rot0, psx0, psy0, sx, sy, ns,
+                          gr, gd, nbg, &r)<0)
+    {
+        sprintf (msg, "Star registration failed.");
+        ret = -1;           /* let caller keep going */
+    }
+    else
+    {
+        /* yes! */
+        sprintf (msg, "Fit residual: %.1f pixels", r);
+        if (verbose)
+            printf ("Fit residual: %.1f pixels\n", r);
+        ret = 0;
+    }
+#endif
+out:
+    if (gr) free ((void *)gr);
+    if (gd) free ((void *)gd);
+
+    return (ret);
+}
+
+/* fetch the USNO (if wantusno) and GSC stars within fov of ra0/dec0 and return
+ *   the positions of the maxng brightest that are dimmer than BRCSTAR in
+ *   malloced *grp and *gdp, brightest first.
+ * return the number of stars, -1 if not enough or trouble with the catalogs,
+ *   or -2 if something goes so wrong we should stop trying altogether, with
+ *   excuse in msg[].
+ */
+static int
+fetchRefStars (int wantusno, double ra0, double dec0, double fov, int maxng,
+               double **grp, double **gdp, int verbose, char msg[])
+{
+    FieldStar *gsc=0;   /* the array of ng GSC stars */
+    int ng;             /* n of GSC stars */
+    double *gr=0, *gd=0;/* GSC star positions for sorting */
+    double *gb=0;       /* GSC star brightnesses for sorting */
+    int nbg;            /* n brightest GCS stars we actually use */
+    char lmsg[1024];    /* catalog error message */
+    int ret;
+    int i;
+
+    /* use the mapped binary catalog if FSCSetup() has been called */
+    ng = FSCFetch (ra0, dec0, fov, wantusno ? USNOLIM : GSCLIM, &gsc, 0, lmsg);
+    if (ng >= MINPAIR)
+        goto gotem;
+    if (gsc)
+    {
+        free ((void *)gsc);
+        gsc = 0;
+    }
+
+    /* else first get USNO -- ignore any errors */
     ng = wantusno ? USNOFetch (ra0, dec0, fov, USNOLIM, &gsc, lmsg) : 0;
     if (ng <= 0)
     {
@@ -401,6 +685,7 @@ tryOneLoc (FImage *fip, int wantusno, double sx[], double sy[], int ns,
         ret = -1;
         goto out;
     }
+gotem:
     if (verbose)
     {
         char rstr[64], dstr[64];
@@ -447,64 +732,15 @@ tryOneLoc (FImage *fip, int wantusno, double sx[], double sy[], int ns,
     free ((void *)gb);
     gb = 0;
 
-    /* clamp to MAXCSTARS */
-    if (nbg > MAXCSTARS)
-        nbg = MAXCSTARS;
+    /* clamp to maxng */
+    if (nbg > maxng)
+        nbg = maxng;
 
-    /* see if user wants to bail */
-    if (bail_fp && (*bail_fp)())
-    {
-        sprintf (msg, "User stopped");
-        ret = -2;
-        goto out;
-    }
+    *grp = gr;
+    *gdp = gd;
+    gr = gd = 0;
+    ret = nbg;
 
-    /* try to find best fit */
-#if USE_DISTANCE_METHOD
-    r = MAXRESID;
-    rh = REJECTDIST;
-    nparam = ns > 0 ? 5 : (ORDER == 2 ? 12 : (ORDER == 3 ? 20 : 26));
-    if (findRegistrationD
-            (fip, ra0, dec0, rot0, psx0, psy0, sx, sy, abs(ns), gr, gd, nbg,
-             nparam, MINPAIR, TRYSTARS, MAXROT, MATCHDIST, &rh, &r)<0)
-    {
-        if (nparam >= 12 && rh > 0 && verbose)
-            printf ("Higher order fit residual (rms): %.2f arcsec\n", rh);
-        if (nparam >= 12 && rh < 0)
-            fprintf (stderr, "Did not find higher order fit\n");
-        sprintf (msg, "Star registration failed.");
-        ret = -1;           /* let caller keep going */
-    }
-    else
-    {
-        /* yes! */
-        sprintf (msg, "Fit residual: %.1f pixels", r);
-        if (verbose)
-            printf ("Fit residual (mean): %.2f pixels\n", r);
-        if (nparam >= 12 && rh > 0 && verbose)
-            printf ("Higher order fit residual (rms): %.2f arcsec\n", rh);
-        if (nparam >= 12 && rh < 0)
-            fprintf (stderr, "Did not find higher order fit\n");
-        sprintf (msg, "Star registration failed.");
-        ret = 0;
-    }
-#else
-    r = MAXRESID;
-    if (findRegistration (fip, ra0, dec0, rot0, psx0, psy0, sx, sy, ns,
-                          gr, gd, nbg, &r)<0)
-    {
-        sprintf (msg, "Star registration failed.");
-        ret = -1;           /* let caller keep going */
-    }
-    else
-    {
-        /* yes! */
-        sprintf (msg, "Fit residual: %.1f pixels", r);
-        if (verbose)
-            printf ("Fit residual: %.1f pixels\n", r);
-        ret = 0;
-    }
-#endif
 out:
     if (gsc) free ((void *)gsc);
     if (gr) free ((void *)gr);
@@ -514,6 +750,57 @@ out:
     return (ret);
 }
 
+/* fip has just been solved by setWCSFITS(): make it the frame for
+ * trackWCSFITS() to work from.
+ */
+static void
+seedTrack (FImage *fip, int wantusno, int verbose)
+{
+    double nra, ndec, fov, psx, psy;
+    double v;
+    char msg[1024];
+    int ng;
+
+    resetWCSTrack();
+
+    if (getNominal (fip, 0, &nra, &ndec, &fov, &psx, &psy, msg) < 0)
+        return;
+    if (getRealFITS (fip, "CRVAL1", &v) < 0) return;
+    track.ra = degrad(v);
+    if (getRealFITS (fip, "CRVAL2", &v) < 0) return;
+    track.dec = degrad(v);
+    if (getRealFITS (fip, "CROTA2", &v) < 0) return;
+    track.rot = degrad(v);
+    if (getRealFITS (fip, "CDELT1", &v) < 0) return;
+    track.psx = degrad(v);
+    if (getRealFITS (fip, "CDELT2", &v) < 0) return;
+    track.psy = degrad(v);
+    track.nra = nra;
+    track.ndec = ndec;
+    track.fov = fov;
+    track.sw = fip->sw;
+    track.sh = fip->sh;
+
+    ng = fetchRefStars (wantusno, track.ra, track.dec, TRACKFOV*fov,
+                        (int)(MAXCSTARS*TRACKFOV*TRACKFOV), &track.gr, &track.gd,
+                        verbose, msg);
+    if (ng < MINPAIR)
+        return;
+    track.ng = ng;
+    track.cra = track.ra;
+    track.cdec = track.dec;
+    track.valid = 1;
+}
+
+/* angular separation between two positions, all rads */
+static double
+trackSep (double ra1, double dec1, double ra2, double dec2)
+{
+    double c = sin(dec1)*sin(dec2) + cos(dec1)*cos(dec2)*cos(ra1-ra2);
+
+    return (c >= 1 ? 0.0 : acos(c));
+}
+
 /* fip has been found during the hunt so we know where it is quite well.
  * repeat one more time just to really nail it using a good inclusive field.
  */
@@ -12,8 +12,36 @@ extern int xypix(double xpos, double ypos, double xref, double yref,
                  double xrefpix, double yrefpix, double xinc, double yinc, double rot,
                  char *type, double *xpix, double *ypix);
 
+/* a WCS cracked once from a header for fast repeated conversions.
+ * see wcsxform.c. treat as opaque.
+ */
+typedef struct
+{
+    double ra0, dec0;       /* CRVAL1/2, rads */
+    double sdec0, cdec0;    /* sin/cos of dec0 */
+    double srot, crot;      /* sin/cos of CROTA2 */
+    double xinc, yinc;      /* CDELT1/2, rads/pixel */
+    double xrefpix, yrefpix;/* CRPIX1/2, 0-based */
+    int hasamd;             /* set if a[]/b[] hold a usable AMD fit */
+    double a[14], b[14];    /* AMDX0..13, AMDY0..13 */
+    double samd0, camd0;    /* sin/cos of AMDY0 */
+    double ainv[4];         /* inverse of the AMD linear terms */
+} WCSTransform;
+
+extern int compileWCS (FImage *fip, int wantamd, WCSTransform *wtp);
+extern void setWCSTransform (WCSTransform *wtp, double ra0, double dec0,
+                             double rot, double xinc, double yinc, double crpix1, double crpix2);
+extern int wcsXY2RADec (WCSTransform *wtp, int n, double x[], double y[],
+                        double ra[], double dec[]);
+extern int wcsRADec2XY (WCSTransform *wtp, int n, double ra[], double dec[],
+                        double x[], double y[]);
+extern int getAMDFITS (FImage *fip, double a[14], double b[14]);
+
 extern int setWCSFITS (FImage *fip, int tusno, double hunt, int (*bail_out)(),
                        int verbose, char msg[]);
+extern int trackWCSFITS (FImage *fip, int tusno, double hunt, int (*bail_out)(),
+                         int verbose, char msg[]);
+extern void resetWCSTrack (void);
 extern int checkWCSFITS (FImage *fip, int verbose);
 extern int delWCSFITS (FImage *fip, int verbose);
 extern int align2WCS (FImage *fip1, FImage *fip2, int *dxp,int *dyp,char msg[]);
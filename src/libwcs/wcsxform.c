@@ -0,0 +1,310 @@
+/* compiled WCS transforms.
+ *
+ * xy2RADec() and RADec2xy() dig CRVAL*, CRPIX*, CDELT*, CROTA2 and CTYPE1 out
+ * of the FITS header on every call and then go through the general purpose
+ * worldpos()/xypix(). That is fine for one star but not for overlaying a
+ * whole catalog. Here we crack the header once into a WCSTransform, with all
+ * the trig of the reference point and rotation done up front, and then
+ * convert whole arrays of positions at a time.
+ *
+ * Only the -TAN projection is handled, which is the only one setWCSFITS()
+ * ever writes. If the header also has a complete AMDX*, AMDY* higher order
+ * fit (see findregd.c and README) it may be used instead: pixels go through
+ * the polynomial to standard coordinates xi/eta about AMDX0/AMDY0, then
+ * through the analytic gnomonic inverse to RA/Dec. The reverse direction
+ * uses the analytic gnomonic projection then a few Newton steps on the
+ * polynomial, seeded from its exact linear inverse.
+ *
+ * The batch loops are kept as plain struct-of-arrays passes with no calls
+ * back into the header so the compiler is free to vectorize them on
+ * whatever machine we are built for.
+ *
+ * N.B. all x/y here are 0-based image pixels, as with xy2RADec() and
+ *   RADec2xy(). All angles are rads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+#include "P_.h"
+#include "astro.h"
+#include "fits.h"
+#include "wcs.h"
+
+#define AMDNEWTON   8       /* max Newton steps inverting AMD polynomial */
+#define AMDTOL      1e-6    /* Newton converged, pixels */
+
+static void amdXY2XiEta (WCSTransform *wtp, double x, double y, double *xip,
+                         double *etap, double jac[4]);
+
+/* fill *wtp from explicit -TAN parameters, exactly as setWCSFITS() would
+ * record them in a header.
+ * crpix1/2 are 1-based, as in the header. xinc/yinc and rot are rads.
+ * any AMD fit in *wtp is discarded.
+ */
+void
+setWCSTransform (WCSTransform *wtp, double ra0, double dec0, double rot,
+                 double xinc, double yinc, double crpix1, double crpix2)
+{
+    memset ((void *)wtp, 0, sizeof(*wtp));
+
+    wtp->ra0 = ra0;
+    wtp->dec0 = dec0;
+    wtp->sdec0 = sin(dec0);
+    wtp->cdec0 = cos(dec0);
+    wtp->srot = sin(rot);
+    wtp->crot = cos(rot);
+    wtp->xinc = xinc;
+    wtp->yinc = yinc;
+    wtp->xrefpix = crpix1 - 1;
+    wtp->yrefpix = crpix2 - 1;
+}
+
+/* get the astrometric fit parameters AMDX0..13 and AMDY0..13 from fip.
+ * return 0 if all found (all must be present, even if zero), else -1.
+ */
+int
+getAMDFITS (FImage *fip, double a[14], double b[14])
+{
+    char name[16];
+    int i;
+
+    for (i = 0; i < 14; i++)
+    {
+        sprintf (name, "AMDX%i", i);
+        if (getRealFITS (fip, name, &a[i]) < 0) return (-1);
+        sprintf (name, "AMDY%i", i);
+        if (getRealFITS (fip, name, &b[i]) < 0) return (-1);
+    }
+
+    return (0);
+}
+
+/* compile the WCS in fip into *wtp.
+ * if wantamd and fip also carries a complete, non-degenerate AMD fit, use it
+ * in preference to the plain -TAN solution.
+ * return 0 if ok, else -1 if the header has no usable -TAN WCS.
+ */
+int
+compileWCS (FImage *fip, int wantamd, WCSTransform *wtp)
+{
+    double xref, yref, xrefpix, yrefpix, xinc, yinc, rot;
+    double a[14], b[14];
+    double det;
+    char typestr[128];
+
+    if (getRealFITS (fip, "CRVAL1", &xref) < 0) return (-1);
+    if (getRealFITS (fip, "CRVAL2", &yref) < 0) return (-1);
+    if (getRealFITS (fip, "CRPIX1", &xrefpix) < 0) return (-1);
+    if (getRealFITS (fip, "CRPIX2", &yrefpix) < 0) return (-1);
+    if (getRealFITS (fip, "CDELT1", &xinc) < 0) return (-1);
+    if (getRealFITS (fip, "CDELT2", &yinc) < 0) return (-1);
+    if (getRealFITS (fip, "CROTA2", &rot) < 0) return (-1);
+    if (getStringFITS (fip, "CTYPE1", typestr) < 0) return (-1);
+    if (strncmp (typestr, "RA---TAN", 8)) return (-1);
+    if (xinc == 0.0 || yinc == 0.0) return (-1);
+
+    setWCSTransform (wtp, degrad(xref), degrad(yref), degrad(rot),
+                     degrad(xinc), degrad(yinc), xrefpix, yrefpix);
+
+    if (!wantamd || getAMDFITS (fip, a, b) < 0)
+        return (0);
+
+    /* linear part must be invertible to be of any use */
+    det = a[1]*b[1] - a[2]*b[2];
+    if (det == 0.0)
+        return (0);
+
+    memcpy ((void *)wtp->a, (void *)a, sizeof(a));
+    memcpy ((void *)wtp->b, (void *)b, sizeof(b));
+    wtp->samd0 = sin(b[0]);
+    wtp->camd0 = cos(b[0]);
+    wtp->ainv[0] =  b[1]/det;   /* x from xi */
+    wtp->ainv[1] = -a[2]/det;   /* x from eta */
+    wtp->ainv[2] = -b[2]/det;   /* y from xi */
+    wtp->ainv[3] =  a[1]/det;   /* y from eta */
+    wtp->hasamd = 1;
+
+    return (0);
+}
+
+/* convert the n pixel locations x[]/y[] to ra[]/dec[].
+ * return 0 if all ok, else -1 if any point falls outside the projection; such
+ *   points get the simple linear result, like worldpos().
+ */
+int
+wcsXY2RADec (WCSTransform *wtp, int n, double x[], double y[], double ra[],
+             double dec[])
+{
+    double ra0, s0, c0;
+    int bad = 0;
+    int i;
+
+    if (wtp->hasamd)
+    {
+        ra0 = wtp->a[0];
+        s0 = wtp->samd0;
+        c0 = wtp->camd0;
+        for (i = 0; i < n; i++)
+        {
+            double xi, eta, den;
+
+            amdXY2XiEta (wtp, x[i], y[i], &xi, &eta, NULL);
+            den = c0 - eta*s0;
+            ra[i] = ra0 + atan2 (xi, den);
+            dec[i] = atan2 (s0 + eta*c0, sqrt(xi*xi + den*den));
+        }
+    }
+    else
+    {
+        double xrefpix = wtp->xrefpix, yrefpix = wtp->yrefpix;
+        double xinc = wtp->xinc, yinc = wtp->yinc;
+        double cr = wtp->crot, sr = wtp->srot;
+
+        ra0 = wtp->ra0;
+        s0 = wtp->sdec0;
+        c0 = wtp->cdec0;
+        for (i = 0; i < n; i++)
+        {
+            double dx = (x[i] - xrefpix) * xinc;
+            double dy = (y[i] - yrefpix) * yinc;
+            double l = dx*cr - dy*sr;
+            double m = dy*cr + dx*sr;
+            double den = c0 - m*s0;
+
+            if (l*l + m*m > 1.0 || den == 0.0)
+            {
+                ra[i] = ra0 + l;
+                dec[i] = wtp->dec0 + m;
+                bad++;
+                continue;
+            }
+            ra[i] = ra0 + atan2 (l, den);
+            dec[i] = atan2 (m*c0 + s0, sqrt(l*l + den*den));
+        }
+    }
+
+    for (i = 0; i < n; i++)
+        range (&ra[i], 2*PI);
+
+    return (bad ? -1 : 0);
+}
+
+/* convert the n sky locations ra[]/dec[] to pixels x[]/y[].
+ * return 0 if all ok, else -1 if any point is on the far side of the tangent
+ *   plane; such points get the simple linear result, like xypix().
+ */
+int
+wcsRADec2XY (WCSTransform *wtp, int n, double ra[], double dec[], double x[],
+             double y[])
+{
+    double ra0, s0, c0;
+    int bad = 0;
+    int i;
+
+    ra0 = wtp->hasamd ? wtp->a[0] : wtp->ra0;
+    s0 = wtp->hasamd ? wtp->samd0 : wtp->sdec0;
+    c0 = wtp->hasamd ? wtp->camd0 : wtp->cdec0;
+
+    for (i = 0; i < n; i++)
+    {
+        double dra = ra[i] - ra0;
+        double cd = cos(dec[i]), sd = sin(dec[i]);
+        double cdra = cos(dra);
+        double den = sd*s0 + cd*c0*cdra;
+        double xi, eta;
+
+        if (den <= 0.0)
+        {
+            /* same linear fallback as xypix() */
+            double dx, dy;
+
+            if (dra > PI) dra -= 2*PI;
+            if (dra < -PI) dra += 2*PI;
+            dx = dra*wtp->crot + (dec[i]-wtp->dec0)*wtp->srot;
+            dy = (dec[i]-wtp->dec0)*wtp->crot - dra*wtp->srot;
+            x[i] = dx/wtp->xinc + wtp->xrefpix;
+            y[i] = dy/wtp->yinc + wtp->yrefpix;
+            bad++;
+            continue;
+        }
+
+        xi = cd*sin(dra)/den;
+        eta = (sd*c0 - cd*s0*cdra)/den;
+
+        if (wtp->hasamd)
+        {
+            double *ai = wtp->ainv;
+            double px, py, dxi, deta;
+            int j;
+
+            /* exact inverse of the linear terms, then polish */
+            dxi = xi - wtp->a[3];
+            deta = eta - wtp->b[3];
+            px = ai[0]*dxi + ai[1]*deta;
+            py = ai[2]*dxi + ai[3]*deta;
+            for (j = 0; j < AMDNEWTON; j++)
+            {
+                double fxi, feta, jac[4], det, ddx, ddy;
+
+                amdXY2XiEta (wtp, px, py, &fxi, &feta, jac);
+                det = jac[0]*jac[3] - jac[1]*jac[2];
+                if (det == 0.0)
+                    break;
+                dxi = xi - fxi;
+                deta = eta - feta;
+                ddx = ( jac[3]*dxi - jac[1]*deta)/det;
+                ddy = (-jac[2]*dxi + jac[0]*deta)/det;
+                px += ddx;
+                py += ddy;
+                if (fabs(ddx) < AMDTOL && fabs(ddy) < AMDTOL)
+                    break;
+            }
+            x[i] = px;
+            y[i] = py;
+        }
+        else
+        {
+            double cr = wtp->crot, sr = wtp->srot;
+
+            x[i] = (xi*cr + eta*sr)/wtp->xinc + wtp->xrefpix;
+            y[i] = (eta*cr - xi*sr)/wtp->yinc + wtp->yrefpix;
+        }
+    }
+
+    return (bad ? -1 : 0);
+}
+
+/* pixel x/y to standard coordinates xi/eta using the AMD polynomial, as per
+ * xy2xieta() in findregd.c. if jac, also return the partials
+ * d(xi)/dx, d(xi)/dy, d(eta)/dx, d(eta)/dy.
+ */
+static void
+amdXY2XiEta (WCSTransform *wtp, double x, double y, double *xip,
+             double *etap, double jac[4])
+{
+    double *a = wtp->a, *b = wtp->b;
+    double xx = x*x, yy = y*y, xy = x*y;
+    double r2 = xx + yy;
+
+    *xip  = a[1]*x + a[2]*y + a[3] + a[4]*xx + a[5]*xy + a[6]*yy +
+            a[8]*xx*x + a[9]*xx*y + a[10]*x*yy + a[11]*yy*y +
+            a[7]*r2 + a[12]*x*r2 + a[13]*x*r2*r2;
+    *etap = b[1]*y + b[2]*x + b[3] + b[4]*yy + b[5]*xy + b[6]*xx +
+            b[8]*yy*y + b[9]*x*yy + b[10]*xx*y + b[11]*xx*x +
+            b[7]*r2 + b[12]*y*r2 + b[13]*y*r2*r2;
+
+    if (!jac)
+        return;
+
+    jac[0] = a[1] + 2*a[4]*x + a[5]*y + 3*a[8]*xx + 2*a[9]*xy + a[10]*yy +
+             2*a[7]*x + a[12]*(r2 + 2*xx) + a[13]*r2*(r2 + 4*xx);
+    jac[1] = a[2] + a[5]*x + 2*a[6]*y + a[9]*xx + 2*a[10]*xy + 3*a[11]*yy +
+             2*a[7]*y + 2*a[12]*xy + 4*a[13]*xy*r2;
+    jac[2] = b[2] + b[5]*y + 2*b[6]*x + b[9]*yy + 2*b[10]*xy + 3*b[11]*xx +
+             2*b[7]*x + 2*b[12]*xy + 4*b[13]*xy*r2;
+    jac[3] = b[1] + 2*b[4]*y + b[5]*x + 3*b[8]*yy + 2*b[9]*xy + b[10]*xx +
+             2*b[7]*y + b[12]*(r2 + 2*yy) + b[13]*r2*(r2 + 4*yy);
+}
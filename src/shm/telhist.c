@@ -0,0 +1,135 @@
+/* print the history of the telescope axes telescoped keeps in its TelRing,
+ * one line per poll, optionally following along as it grows.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "telring.h"
+
+#define FOLLOWUS    20000   /* us between looks for more when following */
+
+static void initOps (int ac, char *av[]);
+static void usage (char *pname);
+static void printRec (TelRingRec *recp);
+
+static double mins = 1;     /* minutes of history to start with */
+static int follow;          /* keep printing new records as they come */
+
+int
+main (int ac, char *av[])
+{
+    TelRing *rp;
+    TelRingRec rec;
+    unsigned long n, head;
+
+    initOps (ac, av);
+
+    if (telRingOpen (0, &rp) < 0)
+    {
+        perror ("telring");
+        exit (1);
+    }
+
+    /* start mins before the newest */
+    head = atomic_load (&rp->head);
+    if (head > 0 && telRingGet (rp, head-1, &rec) == 0)
+        n = telRingFind (rp, rec.hmjd - mins/(24*60));
+    else
+        n = head;
+
+    printf ("# mjd state clock axis raw sampled cpos dpos cvel\n");
+    while (1)
+    {
+        switch (telRingGet (rp, n, &rec))
+        {
+            case 0:
+                printRec (&rec);
+                n++;
+                break;
+            case 1:
+                /* fell too far behind, pick up with the oldest left */
+                head = n;
+                n = telRingFind (rp, 0.0);
+                fprintf (stderr, "telhist: lost %lu records\n", n - head);
+                break;
+            default:
+                /* caught up; start over if telescoped has restarted */
+                if (!follow)
+                    return (0);
+                fflush (stdout);
+                if (atomic_load (&rp->head) < n)
+                    n = 0;
+                usleep (FOLLOWUS);
+                break;
+        }
+    }
+}
+
+/* look for our options.
+ * print usage and exit if bad
+ */
+static void
+initOps (int ac, char *av[])
+{
+    char *pname = av[0];
+
+    while ((--ac > 0) && ((*++av)[0] == '-'))
+    {
+        char *s;
+        for (s = av[0]+1; *s != '\0'; s++)
+            switch (*s)
+            {
+                case 'f':
+                    follow++;
+                    break;
+                case 'm':
+                    if (ac < 2)
+                        usage (pname);
+                    mins = atof (*++av);
+                    --ac;
+                    break;
+                default:
+                    usage (pname);
+            }
+    }
+
+    /* ac remaining args starting at av[0] */
+    if (ac > 0)
+        usage (pname);
+}
+
+static void
+usage (char *pname)
+{
+    fprintf (stderr, "%s: [-f] [-m mins]\n", pname);
+    fprintf (stderr, "  -f:      keep printing each new poll as it comes\n");
+    fprintf (stderr, "  -m mins: start with the last <mins> minutes; default is 1\n");
+    fprintf (stderr, "Each line is one axis at one poll of telescoped. Axes are\n");
+    fprintf (stderr, "H, D and R; positions are rads from home, CVel rads/sec.\n");
+    fprintf (stderr, "Clock is the controller clock, ms, while tracking else -1.\n");
+
+    exit (1);
+}
+
+/* print each axis of *recp we have */
+static void
+printRec (TelRingRec *recp)
+{
+    static char axname[TELRINGAX] = {'H', 'D', 'R'};
+    TelRingAxis *ap;
+    int i;
+
+    for (i = 0; i < TELRINGAX; i++)
+    {
+        ap = &recp->ax[i];
+        if (ap->when == 0)
+            continue;
+        printf ("%.9f %5d %8d %c %10d %.9f %12.9f %12.9f %12.9f\n",
+                recp->hmjd, recp->telstate, recp->clock, axname[i], ap->raw,
+                ap->when, ap->cpos, ap->dpos, ap->cvel);
+    }
+}
@@ -20,6 +20,7 @@
 #include "telenv.h"
 #include "cliserv.h"
 #include "csiutil.h"
+#include "csistats.h"
 
 #include "teled.h"
 
@@ -158,6 +159,51 @@ csiiClose (MotorInfo *mip)
     }
 }
 
+/* log csimcd's traffic with mip's node since the last time we did, to help
+ * tell a bad node from a busy or noisy network when mip loses track.
+ */
+void
+csiLogStats (MotorInfo *mip)
+{
+    static CsiNodeStats last[NNODES];
+    static unsigned lastbadhdr;
+    static long laststart;
+    static CsiStatShm *sp;
+    int addr = mip->axis;
+    CsiNodeStats *np, *lp;
+    CsiHist ack, tok;
+
+    if (is_virtual_mode() || addr < 0 || addr >= NNODES)
+        return;
+    if (!sp && csiStatOpen (port, 0, &sp) < 0)
+    {
+        tdlog ("No csimcd stats: %s\n", strerror(errno));
+        return;
+    }
+    if (sp->start != laststart)
+    {
+        /* csimcd restarted, counts start over */
+        memset (last, 0, sizeof(last));
+        lastbadhdr = 0;
+        laststart = sp->start;
+    }
+
+    np = &sp->node[addr];
+    lp = &last[addr];
+    csiHistDiff (&np->ackus, &lp->ackus, &ack);
+    csiHistDiff (&np->tokus, &lp->tokus, &tok);
+    tdlog ("Node %d: %u pkts %u retries %u bad chksums %u restarts %u lost tokens %u bad headers\n",
+           addr, np->xpkts - lp->xpkts, np->retries - lp->retries,
+           np->badchk - lp->badchk, np->restarts - lp->restarts,
+           np->toklost - lp->toklost, sp->badhdr - lastbadhdr);
+    tdlog ("Node %d: ACK ms p50 %.1f p99 %.1f max %.1f, token ms p50 %.1f p99 %.1f\n",
+           addr, csiHistPct (&ack, 50)/1e3, csiHistPct (&ack, 99)/1e3,
+           ack.max/1e3, csiHistPct (&tok, 50)/1e3, csiHistPct (&tok, 99)/1e3);
+
+    *lp = *np;
+    lastbadhdr = sp->badhdr;
+}
+
 /* return 1 if given csimcd fd can be read, else 0 */
 int
 csiIsReady (int fd)
@@ -169,14 +215,8 @@ csiIsReady (int fd)
     else
     {
 
-        struct timeval tv;
-        fd_set r;
-        int s;
-
-        FD_ZERO (&r);
-        FD_SET (fd, &r);
-        tv.tv_sec = tv.tv_usec = 0;
-        s = select(fd+1,&r,NULL,NULL,&tv);
+        /* N.B. csi_r() may already hold some in its buffer */
+        int s = csi_ready (fd);
         if (s < 0)
         {
             tdlog ("Select(%d): %s\n", fd, strerror(errno));
@@ -194,10 +234,7 @@ csiDrain (int fd)
     if (!is_virtual_mode())
     {
 
-        char buf[128];
-
-        while (csiIsReady(fd) && read (fd, buf, sizeof(buf)) > 0)
-            continue;
+        csi_drain (fd);
 
     }
 }
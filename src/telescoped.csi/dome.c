@@ -166,6 +166,8 @@ char *msg;
     {
         if (msg)
             fifoWrite (Dome_Id, 0, "Ok, but dome really not installed");
+        else
+            fifoPollIn (Dome_Id, 0);
         return;
     }
 
@@ -245,6 +247,10 @@ dome_poll ()
             nextreadmjd = mjd + POLL_DELAY;
         }
     }
+
+    /* nothing moving, so only the position read and weather check are due */
+    if (!active_func && !AD && !is_virtual_mode())
+        fifoPollIn (Dome_Id, DHAVE ? (nextreadmjd - mjd)*SPD : POLL_DELAY*SPD);
 }
 
 #define RESET_DELAY (5/SPD)
@@ -1716,7 +1722,10 @@ openChannels()
         tdlog("domeFD is %d\n",domeFD);
 #else
         if (!cfd)
+        {
             cfd = csiOpen (DOMEAXIS);
+            fifoWatch (Dome_Id, cfd);
+        }
         if (cfd < 0)
         {
             tdlog ("Error opening dome channel to addr %d\n", DOMEAXIS);
@@ -1,6 +1,7 @@
 /* manage the fifo traffic */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
@@ -15,6 +16,8 @@
 #include <sys/ipc.h>
 #include <sys/param.h>
 #include <sys/shm.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 
 #include "P_.h"
 #include "astro.h"
@@ -28,15 +31,24 @@
 
 #include "teled.h"
 
-#define MAXLINE 1024 /* max message from a fifo */
+#define MAXLINE 1024    /* max message from a fifo */
+#define POLLDT (2.0 / HZ) /* usual secs between polls, every other tick */
+#define CLOCKDT (2.0 / HZ) /* secs between telstatshmp->now updates */
+#define NCSIFD 8          /* max CSIMC fds watched for each fifo */
 
 /* info about a fifo connection */
 typedef struct
 {
-    FifoId id;    /* cross-check with symbolic code name */
-    char *name;   /* fifo name */
-    void (*fp)(); /* function to call to process input from this fifo */
-    int fd[2];    /* fifo descriptors once opened */
+    FifoId id;          /* cross-check with symbolic code name */
+    char *name;         /* fifo name */
+    void (*fp)();       /* function to call to process input from this fifo */
+    double every;       /* secs between polls unless fifoPollIn(), 0 never */
+    int fd[2];          /* fifo descriptors once opened */
+    int tfd;            /* timerfd for the next poll */
+    double due;         /* CLOCK_MONOTONIC secs tfd is set for, 0 if not */
+    int asked;          /* set when fp called fifoPollIn() */
+    int csifd[NCSIFD];  /* CSIMC fds whose replies also call for a poll */
+    int ncsifd;         /* number in use */
 } FifoInfo;
 
 /* array of info about each fifo pair we deal with.
@@ -44,20 +56,48 @@ typedef struct
  */
 static FifoInfo fifo[] =
     {
-        {Tel_Id, "Tel", tel_msg},
-        {Filter_Id, "Filter", filter_msg},
-        {Focus_Id, "Focus", focus_msg},
-        {Dome_Id, "Dome", dome_msg},
-        {Lights_Id, "Lights", lights_msg},
-        {Power_Id, "Powerfail", power_msg},
+        {Tel_Id, "Tel", tel_msg, POLLDT},
+        {Filter_Id, "Filter", filter_msg, POLLDT},
+        {Focus_Id, "Focus", focus_msg, POLLDT},
+        {Dome_Id, "Dome", dome_msg, POLLDT},
+        {Lights_Id, "Lights", lights_msg, 0},
+        {Power_Id, "Powerfail", power_msg, 0},
 };
 #define N_F (sizeof(fifo) / sizeof(fifo[0]))
 
+/* what woke us, kept in each epoll_event.data.u32 along with the fifo[]
+ * index as EVTAG(what,index).
+ */
+enum
+{
+    EV_FIFO,  /* message on fifo[].fd[0] */
+    EV_POLL,  /* fifo[].tfd expired */
+    EV_CSI,   /* reply on one of fifo[].csifd[] */
+    EV_CLOCK  /* clockfd expired */
+};
+#define EVTAG(w, i) (((w) << 8) | (i))
+#define EVWHAT(t) ((t) >> 8)
+#define EVINDEX(t) ((t)&0xff)
+
+/* why a fifo's handler is to be polled, more than one may apply */
+#define DUE_MSG 1  /* it just handled a message */
+#define DUE_POLL 2 /* its poll timer expired */
+#define DUE_CSI 4  /* a CSIMC reply arrived */
+
+static int epfd = -1;   /* epoll set of everything we wait for */
+static int clockfd = -1; /* timerfd to keep telstatshmp->now current */
+
 static void open_fifos(void);
 static void open_1fifo(FifoInfo *fip);
 static void close_1fifo(FifoInfo *fip);
 static void reopen_1fifo(FifoInfo *fip);
 static void set_shmtime(void);
+static void init_epoll(void);
+static void poll_1fifo(FifoInfo *fip, int why);
+static void set_1poll(FifoInfo *fip, double when);
+static void arm_csifds(FifoInfo *fip);
+static void forget_csifd(int fd);
+static double mono_now(void);
 
 /* write a code and new message to given fifo.
  * also log with tdlog() if code is < 0.
@@ -104,60 +144,113 @@ void close_fifos()
 /* create all the public points of contact */
 void init_fifos()
 {
+    init_epoll();
     open_fifos();
 }
 
-/* check for and dispatch all incoming messages.
- * then call all handlers for followup regardless.
- * keep telstatshmp->now_mjd as current as possible.
+/* called by a handler while being polled to say it next wants to be polled
+ * in secs, rather than after its usual interval. secs <= 0 means not until
+ * its next message or CSIMC reply.
  */
-void chk_fifos()
+void fifoPollIn(FifoId f, double secs)
 {
-    FifoInfo *fip;
-    struct timeval tv;
-    fd_set rfdset;
-    int maxfdp1;
-    int i, s;
-
-    /* initialize the select read mask of fds for which we care */
-    FD_ZERO(&rfdset);
-    maxfdp1 = 0;
-    for (i = 0; i < N_F; i++)
+    FifoInfo *fip = &fifo[f];
+
+    fip->asked = 1;
+    set_1poll(fip, secs > 0 ? mono_now() + secs : 0);
+}
+
+/* arrange for a reply from CSIMC fd to poll fifo f's handler promptly, not
+ * just at its next interval. call again whenever fd is reopened.
+ */
+void fifoWatch(FifoId f, int fd)
+{
+    FifoInfo *fip = &fifo[f];
+    struct epoll_event ev;
+
+    if (fd <= 0) /* never opened, as in virtual mode */
+        return;
+
+    /* fd may be a reused number */
+    forget_csifd(fd);
+
+    if (fip->ncsifd == NCSIFD)
     {
-        FD_SET(fifo[i].fd[0], &rfdset);
-        if (fifo[i].fd[0] > maxfdp1)
-            maxfdp1 = fifo[i].fd[0];
+        tdlog("%s: more than %d CSIMC fds to watch", fip->name, NCSIFD);
+        return;
     }
-    maxfdp1++;
 
-    /* set up the max polling delay */
-    tv.tv_sec = 0;
-    tv.tv_usec = 2 * 1000000 / HZ; /* every other tick or so */
+    /* one shot, so a reply left unread can not keep waking us */
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.u32 = EVTAG(EV_CSI, f);
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0 &&
+        (errno != EEXIST || epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0))
+    {
+        if (errno != EPERM) /* eg, /dev/null in virtual mode */
+            tdlog("%s: watch fd %d: %s", fip->name, fd, strerror(errno));
+        return;
+    }
+
+    fip->csifd[fip->ncsifd++] = fd;
+}
 
-    /* call select, waiting for commands or timeout */
-    while ((s = select(maxfdp1, &rfdset, NULL, NULL, &tv)) < 0 && errno == EINTR)
+/* wait for and dispatch all incoming messages, then poll each handler that
+ * got a message, whose poll time has come or that has a CSIMC reply waiting.
+ * meanwhile clockfd keeps telstatshmp->now current.
+ */
+void chk_fifos()
+{
+    struct epoll_event ev[3 * N_F + 1];
+    int why[N_F];
+    FifoInfo *fip;
+    uint64_t x;
+    int i, n;
+
+    /* wait for something to do */
+    while ((n = epoll_wait(epfd, ev, sizeof(ev) / sizeof(ev[0]), -1)) < 0 && errno == EINTR)
         continue;
-    if (s < 0)
+    if (n < 0)
     {
-        tdlog("select(): %s", strerror(errno));
+        tdlog("epoll_wait(): %s", strerror(errno));
         return; /* main will repeat -- we don't wanna die */
     }
 
-    /* dispatch any fifo messages */
-    for (fip = fifo; s > 0 && fip < &fifo[N_F]; fip++)
+    /* dispatch any fifo messages and note who needs polling */
+    memset(why, 0, sizeof(why));
+    for (i = 0; i < n; i++)
     {
-        if (FD_ISSET(fip->fd[0], &rfdset))
+        int tag = ev[i].data.u32;
+
+        fip = &fifo[EVINDEX(tag)];
+        switch (EVWHAT(tag))
+        {
+        case EV_CLOCK:
+            (void)read(clockfd, &x, sizeof(x));
+            set_shmtime();
+            break;
+
+        case EV_POLL:
+            /* nothing if a handler above has since rearmed it */
+            if (read(fip->tfd, &x, sizeof(x)) == sizeof(x))
+                why[fip - fifo] |= DUE_POLL;
+            break;
+
+        case EV_CSI:
+            why[fip - fifo] |= DUE_CSI;
+            break;
+
+        case EV_FIFO:
         {
             char msg[MAXLINE];
-            int n;
+            int l;
 
             /* retreive new message */
-            n = serv_read(fip->fd, msg, sizeof(msg) - 1);
-            if (n < 0)
+            l = serv_read(fip->fd, msg, sizeof(msg) - 1);
+            if (l < 0)
             {
                 tdlog("%s: read: %s", fip->name, msg);
                 reopen_1fifo(fip); /* exits if fails */
-                break;             /* need new select() */
+                break;
             }
 
             /* keep time current */
@@ -170,17 +263,16 @@ void chk_fifos()
             else
                 fifoWrite(fip->id, -1, "Power fail in progress");
 
-            /* handled this one */
-            s--;
+            why[fip - fifo] |= DUE_MSG;
+            break;
+        }
         }
     }
 
-    /* then call each handler in polling mode (ie, w/o message) */
-    for (fip = fifo; fip < &fifo[N_F]; fip++)
-    {
-        set_shmtime();    /* keep time current */
-        (*fip->fp)(NULL); /* general update poll */
-    }
+    /* then call each handler that is due in polling mode (ie, w/o message) */
+    for (i = 0; i < N_F; i++)
+        if (why[i])
+            poll_1fifo(&fifo[i], why[i]);
 }
 
 /* create and attach all the fifos */
@@ -193,12 +285,13 @@ open_fifos()
         open_1fifo(fip);
 }
 
-/* open one fifo channel.
+/* open one fifo channel and add it to epfd.
  * die() if trouble.
  */
 static void
 open_1fifo(FifoInfo *fip)
 {
+    struct epoll_event ev;
     char msg[1024];
     // tdlog("in open_1fifo %s", fip->name); ??
     if (serv_conn(fip->name, fip->fd, msg) < 0)
@@ -206,6 +299,19 @@ open_1fifo(FifoInfo *fip)
         tdlog("%s: %s", fip->name, msg);
         die();
     }
+
+    forget_csifd(fip->fd[0]);
+    ev.events = EPOLLIN;
+    ev.data.u32 = EVTAG(EV_FIFO, fip - fifo);
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fip->fd[0], &ev) < 0)
+    {
+        tdlog("%s: epoll_ctl: %s", fip->name, strerror(errno));
+        die();
+    }
+
+    /* poll soon in any case */
+    if (fip->every > 0)
+        set_1poll(fip, mono_now() + fip->every);
 }
 
 /* close fifos for this channel */
@@ -232,5 +338,146 @@ set_shmtime()
     telstatshmp->now.n_mjd = mjd_now();
 }
 
+/* create epfd, clockfd and each fifo[].tfd.
+ * exit if trouble.
+ */
+static void
+init_epoll()
+{
+    struct epoll_event ev;
+    struct itimerspec its;
+    FifoInfo *fip;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+    {
+        tdlog("epoll_create1(): %s", strerror(errno));
+        exit(1);
+    }
+
+    clockfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (clockfd < 0)
+    {
+        tdlog("timerfd_create(): %s", strerror(errno));
+        exit(1);
+    }
+    its.it_value.tv_sec = its.it_interval.tv_sec = 0;
+    its.it_value.tv_nsec = its.it_interval.tv_nsec = (long)(CLOCKDT * 1e9);
+    ev.events = EPOLLIN;
+    ev.data.u32 = EVTAG(EV_CLOCK, 0);
+    if (timerfd_settime(clockfd, 0, &its, NULL) < 0 ||
+        epoll_ctl(epfd, EPOLL_CTL_ADD, clockfd, &ev) < 0)
+    {
+        tdlog("clock timer: %s", strerror(errno));
+        exit(1);
+    }
+
+    for (fip = fifo; fip < &fifo[N_F]; fip++)
+    {
+        fip->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        ev.events = EPOLLIN;
+        ev.data.u32 = EVTAG(EV_POLL, fip - fifo);
+        if (fip->tfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, fip->tfd, &ev) < 0)
+        {
+            tdlog("%s: poll timer: %s", fip->name, strerror(errno));
+            exit(1);
+        }
+    }
+}
+
+/* call fip's handler in polling mode, for the reasons in why, then set its
+ * next poll. unless it says otherwise with fifoPollIn(), timed polls follow
+ * one another at fixed intervals, however long each takes, and any other
+ * poll brings its next no later than one interval away.
+ */
+static void
+poll_1fifo(FifoInfo *fip, int why)
+{
+    double last = fip->due;
+    double now;
+
+    set_shmtime(); /* keep time current */
+    fip->asked = 0;
+    (*fip->fp)(NULL);
+
+    if (!fip->asked)
+    {
+        now = mono_now();
+        if (fip->every <= 0)
+            set_1poll(fip, 0);
+        else if (why & DUE_POLL)
+        {
+            double when = last + fip->every;
+            set_1poll(fip, when > now ? when : now + fip->every);
+        }
+        else if (!fip->due || fip->due > now + fip->every)
+            set_1poll(fip, now + fip->every);
+    }
+
+    /* rearm the CSIMC fds, but not because of themselves, lest a reply it
+     * does not read wake us over and over
+     */
+    if (why & (DUE_MSG | DUE_POLL))
+        arm_csifds(fip);
+}
+
+/* set fip->tfd to expire at CLOCK_MONOTONIC when, or never if 0 */
+static void
+set_1poll(FifoInfo *fip, double when)
+{
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    if (when > 0)
+    {
+        its.it_value.tv_sec = (time_t)when;
+        its.it_value.tv_nsec = (long)((when - its.it_value.tv_sec) * 1e9);
+    }
+    if (timerfd_settime(fip->tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+        tdlog("%s: timerfd_settime: %s", fip->name, strerror(errno));
+    fip->due = when;
+}
+
+/* let each of fip's CSIMC fds wake us again, dropping any since closed */
+static void
+arm_csifds(FifoInfo *fip)
+{
+    struct epoll_event ev;
+    int i;
+
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.u32 = EVTAG(EV_CSI, fip - fifo);
+    for (i = 0; i < fip->ncsifd;)
+    {
+        if (epoll_ctl(epfd, EPOLL_CTL_MOD, fip->csifd[i], &ev) < 0)
+            fip->csifd[i] = fip->csifd[--fip->ncsifd];
+        else
+            i++;
+    }
+}
+
+/* remove fd from the CSIMC fds of every fifo */
+static void
+forget_csifd(int fd)
+{
+    FifoInfo *fip;
+    int i;
+
+    for (fip = fifo; fip < &fifo[N_F]; fip++)
+        for (i = 0; i < fip->ncsifd; i++)
+            if (fip->csifd[i] == fd)
+                fip->csifd[i--] = fip->csifd[--fip->ncsifd];
+}
+
+/* return CLOCK_MONOTONIC now, secs */
+static double
+mono_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
 /* For RCS Only -- Do Not Edit */
 static char *rcsid[2] = {(char *)rcsid, "@(#) $RCSfile: fifoio.c,v $ $Date: 2001/04/19 21:12:09 $ $Revision: 1.1.1.1 $ $Name:  $"};
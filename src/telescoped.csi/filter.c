@@ -116,6 +116,8 @@ char *msg;
     {
         if (msg)
             fifoWrite (Filter_Id, 0, "Ok, but filter not really installed");
+        else
+            fifoPollIn (Filter_Id, 0);
         return;
     }
 
@@ -218,6 +220,8 @@ filter_poll()
     }
     if (active_func)
         (*active_func)(0);
+    else
+        fifoPollIn (Filter_Id, 0);  /* nothing to do until told */
 }
 
 /* stop and reread config files */
@@ -270,6 +274,7 @@ filter_reset(int first)
             }
             csiiOpen (mip);
             csiSetup(mip);
+            fifoWatch (Filter_Id, MIPCFD(mip));
         }
         stopFilter(0);
         readFilter();
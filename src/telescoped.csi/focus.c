@@ -136,6 +136,8 @@ char *msg;
     {
         if (msg)
             fifoWrite (Focus_Id, 0, "Ok, but focuser not really installed");
+        else
+            fifoPollIn (Focus_Id, 0);
         return;
     }
 
@@ -195,6 +197,8 @@ focus_poll()
         (*active_func)(0);
     else if (telstatshmp->autofocus)
         autoFocus();
+    else
+        fifoPollIn (Focus_Id, 1.0);  /* just the temperature */
     /* TODO: monitor while idle? */
 }
 
@@ -227,6 +231,7 @@ focus_reset(int first)
 		else
         {
             if (!had) csiiOpen (mip);
+            fifoWatch (Focus_Id, MIPCFD(mip));
 
             // STO 2007-01-20
             // This is a concession to the implementation that places a dome on the
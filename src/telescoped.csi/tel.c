@@ -11,6 +11,7 @@
 #include <fcntl.h>
 #include <time.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "P_.h"
 #include "astro.h"
@@ -18,6 +19,7 @@
 #include "configfile.h"
 #include "strops.h"
 #include "telstatshm.h"
+#include "telring.h"
 #include "running.h"
 #include "misc.h"
 #include "telenv.h"
@@ -60,8 +62,12 @@ static void getmjd(void);
 /* helped along by these... */
 static int dbformat(char *msg, Obj *op, double *drap, double *ddecp);
 static void initCfg(void);
-static void hd2xyr(double ha, double dec, double *xp, double *yp, double *rp);
+static void hd2xyr(Now *np, double ha, double dec, double *xp, double *yp,
+                   double *rp);
 static void readRaw(void);
+static void putRing(void);
+static void setRawTime(MotorInfo *mip, double t);
+static double cposAt(MotorInfo *mip, double t);
 static void mkCook(void);
 static void dummyTarg(void);
 static void stopTel(int fast);
@@ -69,6 +75,11 @@ static int onTarget(MotorInfo **mipp);
 static int atTarget(void);
 static int trackObj(Obj *op, int first);
 static void findAxes(Now *np, Obj *op, double *xp, double *yp, double *rp);
+static void findAxes_r(AstroCtx *ac, Now *np, Obj *op, double roff,
+                       double doff, double *xp, double *yp, double *rp);
+static void loadTrack(Now *np, Obj *op, double cmjd, long cms);
+static void staleTrack(void);
+static double trackLead(void);
 static int chkLimits(int wrapok, double *xp, double *yp, double *rp);
 static void jogTrack(int first, char dircode, int velocity);
 static void jogSlew(int first, char dircode, int velocity);
@@ -82,13 +93,27 @@ static double CGUIDEVEL; /* coarse jogging motion rate, rads/sec */
 static int TRACKINT;     /* tracking interval for each e/mtrack, secs */
 
 #define PPTRACK 60 /* number of positions to e/mtrack */
+#define IDLEPOLL 0.1 /* secs between polls while stopped */
+
+/* when readRaw() sampled each axis, and how fast each is moving */
+#define MAXRAWDT 2.0        /* max secs between samples to find a rate */
+static double rawmjd[NMOT]; /* mjd each cpos was sampled */
+static double rawpos[NMOT]; /* cpos then */
+static double rawvel[NMOT]; /* rads/sec since the sample before */
+#define TRKNODES 6 /* exact positions per fitted stretch of a profile */
 
 /* offsets to apply to target object location, if any */
 static double r_offset; /* delta ra to be added */
 static double d_offset; /* delta dec to be added */
 
 #define MAXJITTER 10.0 /* max clock vs host difference */
-static double strack;  /* when current e/mtrack started */
+#define TRACKLEAD 2.0  /* secs before a profile runs out to load the next */
+static double strack;  /* host mjd when the controller clocks read 0 */
+static double ntrack;  /* host mjd when the next e/mtrack should start */
+
+/* history of each poll for the likes of tracking error analysis */
+static TelRing *telring; /* shared ring, if could open */
+static int ringclock;    /* controller clock this poll if tracking, else -1 */
 
 /* called when we receive a message from the Tel fifo.
  * as well as regularly with !msg just to update things.
@@ -161,6 +186,7 @@ void tel_msg(char *msg)
 static void
 tel_poll()
 {
+    ringclock = -1;
     if (virtual_mode)
     {
         MotorInfo *mip;
@@ -174,11 +200,14 @@ tel_poll()
         (*active_func)(0);
     else
     {
-        /* idle -- just update */
+        /* idle -- just update, less often if not moving at all */
         readRaw();
         mkCook();
         dummyTarg();
+        if (telstatshmp->telstate == TS_STOPPED)
+            fifoPollIn(Tel_Id, IDLEPOLL);
     }
+    putRing();
 }
 
 /* stop and reread config files */
@@ -218,6 +247,7 @@ tel_reset(int first)
             {
                 csiiOpen(mip);
                 csiSetup(mip);
+                fifoWatch(Tel_Id, MIPCFD(mip));
             }
         }
     }
@@ -630,7 +660,7 @@ tel_altaz(int first, ...)
         aa_hadec(lat, alt, az, &ha, &dec);
         telstatshmp->jogging_ison = 0;
         r_offset = d_offset = 0;
-        hd2xyr(ha, dec, &x, &y, &r);
+        hd2xyr(np, ha, dec, &x, &y, &r);
         if (chkLimits(1, &x, &y, &r) < 0)
         {
             active_func = NULL;
@@ -741,7 +771,7 @@ tel_hadec(int first, ...)
         /* find target axis positions once */
         telstatshmp->jogging_ison = 0;
         r_offset = d_offset = 0;
-        hd2xyr(ha, dec, &x, &y, &r);
+        hd2xyr(np, ha, dec, &x, &y, &r);
         if (chkLimits(1, &x, &y, &r) < 0)
         {
             active_func = NULL;
@@ -983,95 +1013,393 @@ dbformat(char *msg, Obj *op, double *drap, double *ddecp)
     return (db_crack_line(msg, op, NULL));
 }
 
-/* build and load an e/mtrack sequence for op.
- * time starts at np. it is ok to modify np->n_mjd.
- * N.B. we assume clocks have been set to 0
+/* one tracking profile: each axis at PPTRACK times TRACKINT/PPTRACK apart */
+typedef struct
+{
+    double start;              /* mjd of the first */
+    int gen;                   /* trackgen it was computed for */
+    double xyr[NMOT][PPTRACK]; /* positions, rads */
+    int gapm;                  /* minfo[] of first trapped in limits gap, or -1 */
+    double gapv;               /* its position then, rads */
+} TrackProf;
+
+/* the next profile is computed by trackThread() while the current one runs.
+ * everything here is guarded by tp_lock.
+ */
+enum
+{
+    TP_IDLE, TP_ASKED, TP_BUSY, TP_READY
+};
+static pthread_mutex_t tp_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tp_cond = PTHREAD_COND_INITIALIZER;
+static int tp_state;       /* one of TP_* */
+static int tp_thread;      /* set once trackThread() is running */
+static Now tp_now;         /* circumstances asked for */
+static Obj tp_obj;         /* target asked for */
+static double tp_roff;     /* r_offset asked for */
+static double tp_doff;     /* d_offset asked for */
+static TrackProf tp_next;  /* request, then result when TP_READY */
+static int trackgen;       /* changes whenever a profile in hand goes stale */
+
+/* evaluate axis i of the Chebyshev series c at x, -1 .. 1 */
+static double
+chebTrack(double c[TRKNODES][NMOT], int i, double x)
+{
+    double b1 = 0, b2 = 0, t;
+    int m;
+
+    for (m = TRKNODES - 1; m > 0; m--)
+    {
+        t = 2 * x * b1 - b2 + c[m][i];
+        b2 = b1;
+        b1 = t;
+    }
+    return (x * b1 - b2 + c[0][i]);
+}
+
+/* fill tp->xyr[][ia..ib] by fitting TRKNODES Chebyshev nodes across them,
+ * halving the span and trying again on each half if the fit is not within
+ * tol[] of the exact positions.
  */
 static void
-buildTrack(Now *np, Obj *op)
+fitTrack(AstroCtx *ac, TrackProf *tp, Now *np, Obj *op, double roff,
+         double doff, double tol[NMOT], int ia, int ib)
 {
-    double *x, *y, *r;
-    double *xyr[NMOT];
-    double mjd0;
-    MotorInfo *mip;
-    int i;
+    double dt = TRACKINT / (PPTRACK * SPD);
+    double f[TRKNODES][NMOT]; /* exact positions at each node */
+    double c[TRKNODES][NMOT]; /* Chebyshev coefficients */
+    double ea[NMOT], eb[NMOT]; /* exact positions at ia and ib */
+    double tm, h;
+    int i, j, k, m;
+    int ok;
+
+    /* few enough to just compute each */
+    if (ib - ia + 1 <= TRKNODES + 2)
+    {
+        for (k = ia; k <= ib; k++)
+        {
+            mjd = tp->start + k * dt;
+            findAxes_r(ac, np, op, roff, doff, &tp->xyr[TEL_HM][k],
+                       &tp->xyr[TEL_DM][k], &tp->xyr[TEL_RM][k]);
+        }
+        return;
+    }
 
-    /* malloc each then store so we can effectively access them via a mip */
-    x = (double *)malloc(PPTRACK * sizeof(double));
-    y = (double *)malloc(PPTRACK * sizeof(double));
-    r = (double *)malloc(PPTRACK * sizeof(double));
-    xyr[TEL_HM] = x;
-    xyr[TEL_DM] = y;
-    xyr[TEL_RM] = r;
+    /* exact at each node, no fit if any axis wraps between them */
+    tm = tp->start + (ia + ib) * dt / 2;
+    h = (ib - ia) * dt / 2;
+    ok = 1;
+    for (j = 0; j < TRKNODES; j++)
+    {
+        mjd = tm + h * cos(PI * (j + 0.5) / TRKNODES);
+        findAxes_r(ac, np, op, roff, doff, &f[j][TEL_HM], &f[j][TEL_DM],
+                   &f[j][TEL_RM]);
+        for (i = 0; j > 0 && i < NMOT; i++)
+            if (fabs(f[j][i] - f[j - 1][i]) > PI)
+                ok = 0;
+    }
 
-    /* build list of PPTRACK values beginning at mjd */
-    mjd0 = mjd;
-    for (i = 0; i < PPTRACK; i++)
+    /* coefficients, then insist the last two are already negligible */
+    for (i = 0; i < NMOT; i++)
     {
-        mjd = mjd0 + i * TRACKINT / (PPTRACK * SPD);
-        findAxes(np, op, &x[i], &y[i], &r[i]);
-        (void)chkLimits(1, &x[i], &y[i], &r[i]); /* let limit protect */
+        for (m = 0; m < TRKNODES; m++)
+        {
+            double sum = 0;
+            for (j = 0; j < TRKNODES; j++)
+                sum += f[j][i] * cos(PI * m * (j + 0.5) / TRKNODES);
+            c[m][i] = (m == 0 ? 1 : 2) * sum / TRKNODES;
+        }
+        if (fabs(c[TRKNODES - 1][i]) + fabs(c[TRKNODES - 2][i]) > tol[i] / 2)
+            ok = 0;
     }
 
-    /* send to each controller */
-    FEM(mip)
+    /* check the fit at each end, beyond the outermost nodes.
+     * these are the ends of the span so they are kept regardless.
+     */
+    mjd = tp->start + ia * dt;
+    findAxes_r(ac, np, op, roff, doff, &ea[TEL_HM], &ea[TEL_DM], &ea[TEL_RM]);
+    mjd = tp->start + ib * dt;
+    findAxes_r(ac, np, op, roff, doff, &eb[TEL_HM], &eb[TEL_DM], &eb[TEL_RM]);
+    for (i = 0; ok && i < NMOT; i++)
+        if (fabs(ea[i] - chebTrack(c, i, -1.0)) > tol[i] ||
+            fabs(eb[i] - chebTrack(c, i, 1.0)) > tol[i])
+            ok = 0;
+
+    if (!ok)
+    {
+        int mid = (ia + ib) / 2;
+        fitTrack(ac, tp, np, op, roff, doff, tol, ia, mid);
+        fitTrack(ac, tp, np, op, roff, doff, tol, mid + 1, ib);
+        return;
+    }
+
+    for (i = 0; i < NMOT; i++)
     {
-        double scale;
-        double *xyrp;
-        int cfd;
+        tp->xyr[i][ia] = ea[i];
+        tp->xyr[i][ib] = eb[i];
+        for (k = ia + 1; k < ib; k++)
+            tp->xyr[i][k] = chebTrack(c, i, -1.0 + 2.0 * (k - ia) / (ib - ia));
+    }
+}
+
+/* fill tp with the profile for op starting at tp->start.
+ * the axis paths are smooth for nearly all targets, so rather than reduce
+ * every point we fit each axis with a Chebyshev polynomial through a few
+ * exact positions and split the span only where that misses by more than
+ * one encoder (or motor) step.
+ * each point is wrapped within the limits, as chkLimits(1,...) would, but
+ * since this may run in trackThread() any point trapped in the limits gap
+ * is only noted in tp for loadTrack() to report.
+ * ok to modify np->n_mjd and *op.
+ */
+static void
+computeTrack(AstroCtx *ac, TrackProf *tp, Now *np, Obj *op, double roff,
+             double doff)
+{
+    double tol[NMOT];
+    int i, j;
+
+    for (i = 0; i < NMOT; i++)
+    {
+        MotorInfo *mip = &telstatshmp->minfo[TEL_HM + i];
+        tol[i] = mip->have ? (2 * PI) / (mip->haveenc ? mip->estep : mip->step)
+                           : 2 * PI;
+    }
+
+    fitTrack(ac, tp, np, op, roff, doff, tol, 0, PPTRACK - 1);
+
+    /* let limit protect */
+    tp->gapm = -1;
+    for (i = TEL_HM; i <= TEL_RM; i++)
+    {
+        MotorInfo *mip = &telstatshmp->minfo[i];
 
         if (!mip->have)
             continue;
-
-        if (virtual_mode)
+        for (j = 0; j < PPTRACK; j++)
         {
+            double *vp = &tp->xyr[i][j];
 
-            xyrp = xyr[mip - telstatshmp->minfo];
-            //      tdlog ("Creating track profile:");
-            vmcSetTrackPath(mip->axis, PPTRACK, 0, 1000.0 * TRACKINT / PPTRACK + 0.5, xyrp);
+            while (*vp <= mip->neglim)
+                *vp += 2 * PI;
+            while (*vp >= mip->poslim)
+                *vp -= 2 * PI;
+            if (tp->gapm < 0 && (*vp <= mip->neglim || *vp >= mip->poslim))
+            {
+                tp->gapm = i;
+                tp->gapv = *vp;
+            }
+        }
+    }
+}
+
+/* thread to compute each profile asked for by askTrack().
+ */
+/* ARGSUSED */
+static void *
+trackThread(void *dummy)
+{
+    AstroCtx ac;
+
+    astro_ctx_init(&ac);
+
+    pthread_mutex_lock(&tp_lock);
+    while (1)
+    {
+        TrackProf tp;
+        Now now;
+        Obj o;
+        double roff, doff;
+
+        while (tp_state != TP_ASKED)
+            pthread_cond_wait(&tp_cond, &tp_lock);
+        tp_state = TP_BUSY;
+        tp = tp_next;
+        now = tp_now;
+        o = tp_obj;
+        roff = tp_roff;
+        doff = tp_doff;
+        pthread_mutex_unlock(&tp_lock);
+
+        computeTrack(&ac, &tp, &now, &o, roff, doff);
+
+        pthread_mutex_lock(&tp_lock);
+        tp_next = tp;
+        tp_state = TP_READY;
+        pthread_cond_broadcast(&tp_cond);
+    }
+
+    return (NULL);
+}
+
+/* start computing the profile for op beginning at start in the background.
+ */
+static void
+askTrack(Now *np, Obj *op, double start)
+{
+    pthread_mutex_lock(&tp_lock);
+    if (!tp_thread)
+    {
+        pthread_t tid;
+
+        if (pthread_create(&tid, NULL, trackThread, NULL) == 0)
+        {
+            pthread_detach(tid);
+            tp_thread = 1;
         }
         else
+            tdlog("Can not start tracking thread: %s", strerror(errno));
+    }
+    while (tp_state == TP_ASKED || tp_state == TP_BUSY)
+        pthread_cond_wait(&tp_cond, &tp_lock);
+    if (tp_thread)
+    {
+        tp_now = *np;
+        tp_obj = *op;
+        tp_roff = r_offset;
+        tp_doff = d_offset;
+        tp_next.start = start;
+        tp_next.gen = trackgen;
+        tp_state = TP_ASKED;
+        pthread_cond_broadcast(&tp_cond);
+    }
+    pthread_mutex_unlock(&tp_lock);
+}
+
+/* fill tp with the profile for op beginning at tp->start, from the background
+ * if it has it, else now.
+ */
+static void
+getTrack(Now *np, Obj *op, TrackProf *tp)
+{
+    Now now = *np;
+    Obj o = *op;
+    int ok;
+
+    pthread_mutex_lock(&tp_lock);
+    while (tp_state == TP_ASKED || tp_state == TP_BUSY)
+        pthread_cond_wait(&tp_cond, &tp_lock);
+    ok = tp_state == TP_READY && tp_next.gen == trackgen
+         && tp_next.start == tp->start;
+    if (ok)
+        *tp = tp_next;
+    tp_state = TP_IDLE;
+    pthread_mutex_unlock(&tp_lock);
+
+    if (!ok)
+        computeTrack(astro_defctx(), tp, &now, &o, r_offset, d_offset);
+}
+
+/* forget any profile computed ahead, such as when the target or config
+ * changes. also waits so the thread is not using anything about to change.
+ */
+static void
+staleTrack()
+{
+    pthread_mutex_lock(&tp_lock);
+    while (tp_state == TP_ASKED || tp_state == TP_BUSY)
+        pthread_cond_wait(&tp_cond, &tp_lock);
+    tp_state = TP_IDLE;
+    trackgen++;
+    pthread_mutex_unlock(&tp_lock);
+}
+
+/* send one axis its profile as an etrack or mtrack command starting at
+ * controller clock t0, in as few writes as possible.
+ */
+static void
+sendTrack(MotorInfo *mip, long t0, double *xyrp)
+{
+    char buf[1000];
+    int cfd = MIPCFD(mip);
+    double scale;
+    int i, l;
+
+    if (mip->haveenc)
+        scale = mip->esign * mip->estep / (2 * PI);
+    else
+        scale = mip->sign * mip->step / (2 * PI);
+    l = sprintf(buf, "%s(%ld,%.0f", mip->haveenc ? "etrack" : "mtrack", t0,
+                1000. * TRACKINT / PPTRACK + .5);
+
+    for (i = 0; i < PPTRACK; i++)
+    {
+        if (l > sizeof(buf) - 32)
         {
+            csi_w(cfd, "%s", buf);
+            l = 0;
+        }
+        l += sprintf(buf + l, ",%.0f", scale * xyrp[i] + .5);
+    }
+    csi_w(cfd, "%s);", buf);
+}
 
-            xyrp = xyr[mip - telstatshmp->minfo];
-            cfd = MIPCFD(mip);
-            //      tdlog ("Creating track profile:");
-            if (mip->haveenc)
-            {
-                scale = mip->esign * mip->estep / (2 * PI);
-                csi_w(cfd, "etrack");
-                //      printf ("etrack");
-            }
-            else
-            {
-                scale = mip->sign * mip->step / (2 * PI);
-                csi_w(cfd, "mtrack");
-                //      printf ("mtrack");
-            }
-            csi_w(cfd, "(0,%.0f", 1000. * TRACKINT / PPTRACK + .5);
-            //      printf ("(0,%.0f", 1000.*TRACKINT/PPTRACK+.5);
+/* secs before ntrack to load the next profile: TRACKLEAD, or less if the
+ * points are closer together than that.
+ */
+static double
+trackLead()
+{
+    double half = TRACKINT / (2. * PPTRACK);
 
-            /* TODO: pack into longer commands */
-            for (i = 0; i < PPTRACK; i++)
-            {
-                csi_w(cfd, ",%.0f", scale * xyrp[i] + .5);
-                //      printf (",%.0f", scale*xyrp[i]+.5);
-            }
-            csi_w(cfd, ");");
-            //      printf (");\n");
+    return (TRACKLEAD < half ? TRACKLEAD : half);
+}
+
+/* load the profile starting at ntrack for op into each controller, then
+ * advance ntrack and start computing the one after in the background.
+ * the controller clocks read cms at host time cmjd.
+ * each profile starts at the last point of the one before, and is loaded
+ * a little ahead of then, so the controllers never run out of points.
+ * N.B. we assume clocks have been set to 0 at some time, then left to run.
+ */
+static void
+loadTrack(Now *np, Obj *op, double cmjd, long cms)
+{
+    TrackProf tp;
+    MotorInfo *mip;
+    long t0;
 
-        } // !virtual_mode
+    tp.start = ntrack;
+    getTrack(np, op, &tp);
+    if (tp.gapm >= 0)
+    {
+        char str[64];
+
+        fs_sexa(str, raddeg(tp.gapv), 4, 3600);
+        fifoWrite(Tel_Id, -4, "Axis %d: %s trapped within limits gap",
+                  telstatshmp->minfo[tp.gapm].axis, str);
     }
-    fflush(stdout);
 
-    /* done */
-    free((void *)x);
-    free((void *)y);
-    free((void *)r);
+    /* start on the controller clock, realigned with the host each time */
+    t0 = (long)floor(cms + (ntrack - cmjd) * SPD * 1000. + .5);
+    strack = ntrack - t0 / (SPD * 1000.);
+
+    FEM(mip)
+    {
+        double *xyrp = tp.xyr[mip - telstatshmp->minfo];
+
+        if (!mip->have)
+            continue;
+
+        if (virtual_mode)
+        {
+            vmcSetTimeout(mip->axis, TRACKINT * 1000);
+            vmcSetTrackPath(mip->axis, PPTRACK, t0, 1000.0 * TRACKINT / PPTRACK + 0.5, xyrp);
+        }
+        else
+        {
+            /* N.B. use MIPSFD to insure precedes main loop clock reads */
+            csi_w(MIPSFD(mip), "timeout=%d;", TRACKINT * 1000);
+            sendTrack(mip, t0, xyrp);
+        }
+    }
+
+    ntrack += (PPTRACK - 1) * TRACKINT / (PPTRACK * SPD);
+    askTrack(np, op, ntrack);
 }
 
-/* if first or TRACKINT has expired and needs refreshed compute and load a new
- *   tracking profile.
+/* if first, or the current tracking profile is about to run out, load a new
+ *   one.
  * also always handle jogginf, limit checks, telstat info, whether on track.
  * return -1 when tracking is just not possible, 0 when ok to keep trying.
  */
@@ -1085,9 +1413,12 @@ trackObj(Obj *op, int first)
     int clocknow;
     MotorInfo *mip;
 
-    /* download tracking profile if new or expired */
-    if (first || mjd > strack + TRACKINT / SPD)
+    /* start afresh if new */
+    if (first)
     {
+        /* anything computed ahead was for something else */
+        staleTrack();
+
         /* sync all clocks to 0 */
         /* N.B. use MIPSFD to insure precedes main loop clock reads */
         FEM(mip)
@@ -1105,56 +1436,37 @@ trackObj(Obj *op, int first)
             }
         }
 
-        /* record when this TRACKINT began */
-        strack = now.n_mjd;
+        /* record when clocks read 0, also when the first profile starts */
+        strack = ntrack = now.n_mjd;
 
-        /* set all timeouts to TRACKINT */
+        /* reset any lingering track offset */
         FEM(mip)
         {
             if (mip->have)
             {
-                if (virtual_mode)
+                // make sure we're homed to begin with
+                char buf[128];
+                if (axisHomedCheck(mip, buf))
                 {
-                    vmcSetTimeout(mip->axis, TRACKINT * 1000);
+                    active_func = NULL;
+                    stopTel(0);
+                    fifoWrite(Tel_Id, -1, "Error: %s", buf);
+                    toTTS("Error: %s", buf);
+                    return -1;
                 }
-                else
+                if (virtual_mode)
                 {
-                    csi_w(MIPSFD(mip), "timeout=%d;", TRACKINT * 1000);
+                    vmcSetTrackingOffset(mip->axis, 0);
                 }
-            }
-        }
-
-        /* if just starting, reset any lingering track offset */
-        if (first)
-        {
-            FEM(mip)
-            {
-                if (mip->have)
+                else
                 {
-                    // make sure we're homed to begin with
-                    char buf[128];
-                    if (axisHomedCheck(mip, buf))
-                    {
-                        active_func = NULL;
-                        stopTel(0);
-                        fifoWrite(Tel_Id, -1, "Error: %s", buf);
-                        toTTS("Error: %s", buf);
-                        return -1;
-                    }
-                    if (virtual_mode)
-                    {
-                        vmcSetTrackingOffset(mip->axis, 0);
-                    }
-                    else
-                    {
-                        csi_w(MIPSFD(mip), "toffset=0;");
-                    }
+                    csi_w(MIPSFD(mip), "toffset=0;");
                 }
             }
         }
 
-        /* now build and install tracking profiles */
-        buildTrack(&now, op);
+        /* now build and install the first tracking profiles */
+        loadTrack(&now, op, strack, 0L);
     }
 
     /* quick, get current value of typical clock.
@@ -1169,6 +1481,11 @@ trackObj(Obj *op, int first)
     {
         clocknow = csi_rix(MIPSFD(mip), "=clock;");
     }
+    ringclock = clocknow;
+
+    /* load the next profiles, computed ahead, shortly before these run out */
+    if (!first && mjd > ntrack - trackLead() / SPD)
+        loadTrack(&now, op, mjd, (long)clocknow);
 
     /* update actual position info */
     readRaw();
@@ -1228,6 +1545,7 @@ trackObj(Obj *op, int first)
         if (!telstatshmp->jogging_ison && onTarget(&mip) < 0)
         {
             fifoWrite(Tel_Id, 4, "Axis %d lost tracking lock", mip->axis);
+            csiLogStats(mip);
             toTTS("The telescope has lost tracking lock.");
             telstatshmp->telstate = TS_HUNTING;
         }
@@ -1247,23 +1565,32 @@ trackObj(Obj *op, int first)
  */
 static void
 findAxes(Now *np, Obj *op, double *xp, double *yp, double *rp)
+{
+    findAxes_r(astro_defctx(), np, op, r_offset, d_offset, xp, yp, rp);
+}
+
+/* findAxes() for any thread: libastro context ac, offsets roff and doff.
+ */
+static void
+findAxes_r(AstroCtx *ac, Now *np, Obj *op, double roff, double doff,
+           double *xp, double *yp, double *rp)
 {
     double ha, dec;
     Obj fobj;
 
-    if (r_offset || d_offset)
+    if (roff || doff)
     {
         /* find offsets to op as a fixed object */
         double ra, dec;
 
         epoch = J2000;
-        obj_cir(np, op);
+        obj_cir_r(ac, np, op);
         ra = op->s_ra;
         dec = op->s_dec;
 
         /* apply offsets */
-        ra += r_offset;
-        dec += d_offset;
+        ra += roff;
+        dec += doff;
 
         op = &fobj;
         op->o_type = FIXED;
@@ -1273,16 +1600,16 @@ findAxes(Now *np, Obj *op, double *xp, double *yp, double *rp)
     }
 
     epoch = EOD;
-    obj_cir(np, op);
-    aa_hadec(lat, op->s_alt, op->s_az, &ha, &dec);
-    hd2xyr(ha, dec, xp, yp, rp);
+    obj_cir_r(ac, np, op);
+    aa_hadec_r(ac, lat, op->s_alt, op->s_az, &ha, &dec);
+    hd2xyr(np, ha, dec, xp, yp, rp);
 }
 
 /* convert an ha/dec to scope x/y/r, allowing for mesh corrections.
  * in many ways, this is the reverse of mkCook().
  */
 static void
-hd2xyr(double ha, double dec, double *xp, double *yp, double *rp)
+hd2xyr(Now *np, double ha, double dec, double *xp, double *yp, double *rp)
 {
     TelAxes *tap = &telstatshmp->tax;
     double mdha, mddec;
@@ -1300,7 +1627,6 @@ hd2xyr(double ha, double dec, double *xp, double *yp, double *rp)
     // tdlog("tel_ideal2realxy changes these to x=%.4lf  y=%.4lf\n",x,y);
     if (RMOT->have)
     {
-        Now *np = &telstatshmp->now;
         tel_hadec2PA(ha, dec, tap, lat, &r);
         r += tap->R0 * RMOT->sign;
     }
@@ -1324,10 +1650,10 @@ mkCook()
     double mdha, mddec;
     double x, y, r;
 
-    /* handy axis values */
-    x = HMOT->cpos;
-    y = DMOT->cpos;
-    r = RMOT->cpos;
+    /* handy axis values, each brought to the same moment */
+    x = cposAt(HMOT, mjd);
+    y = cposAt(DMOT, mjd);
+    r = cposAt(RMOT, mjd);
 
     /* back out non-ideal axes info */
     tel_realxy2ideal(tap, &x, &y);
@@ -1369,42 +1695,146 @@ mkCook()
     telstatshmp->CPA = r;
 }
 
-/* read the raw values */
+/* read the raw values.
+ * all axes are asked at once, and when each was sampled goes in rawmjd[].
+ */
 static void
 readRaw()
 {
     MotorInfo *mip;
+    int fd[NMOT], val[NMOT];
+    char *cmd[NMOT];
+    double when[NMOT];
+    int i, n;
+
+    if (virtual_mode)
+    {
+        FEM(mip)
+        {
+            if (!mip->have)
+                continue;
+            mip->raw = vmcGetPosition(mip->axis);
+            mip->cpos = (2 * PI) * mip->sign * mip->raw / mip->step;
+            setRawTime(mip, mjd_now());
+        }
+        return;
+    }
 
+    n = 0;
     FEM(mip)
     {
         if (!mip->have)
             continue;
+        fd[n] = MIPSFD(mip);
+        cmd[n] = mip->haveenc ? "=epos;" : "=mpos;";
+        n++;
+    }
+    if (csi_rixn(n, fd, cmd, val, when) < 0)
+    {
+        /* keep the last positions but stop extrapolating them */
+        tdlog("readRaw: %s", strerror(errno));
+        memset(rawvel, 0, sizeof(rawvel));
+        return;
+    }
 
-        if (virtual_mode)
+    i = 0;
+    FEM(mip)
+    {
+        if (!mip->have)
+            continue;
+        if (mip->haveenc)
         {
-            mip->raw = vmcGetPosition(mip->axis);
-            mip->cpos = (2 * PI) * mip->sign * mip->raw / mip->step;
+            double draw;
+            int raw = val[i];
+
+            /* just change by half-step if encoder changed by 1 */
+            draw = abs(raw - mip->raw) == 1 ? (raw + mip->raw) / 2.0 : raw;
+            mip->raw = raw;
+            mip->cpos = (2 * PI) * mip->esign * draw / mip->estep;
         }
         else
         {
-            if (mip->haveenc)
-            {
-                double draw;
-                int raw;
-
-                /* just change by half-step if encoder changed by 1 */
-                raw = csi_rix(MIPSFD(mip), "=epos;");
-                draw = abs(raw - mip->raw) == 1 ? (raw + mip->raw) / 2.0 : raw;
-                mip->raw = raw;
-                mip->cpos = (2 * PI) * mip->esign * draw / mip->estep;
-            }
-            else
-            {
-                mip->raw = csi_rix(MIPSFD(mip), "=mpos;");
-                mip->cpos = (2 * PI) * mip->sign * mip->raw / mip->step;
-            }
+            mip->raw = val[i];
+            mip->cpos = (2 * PI) * mip->sign * mip->raw / mip->step;
+        }
+        setRawTime(mip, 25567.5 + when[i] / SPD);
+        i++;
+    }
+}
+
+/* add the state of the mount axes as of this poll to telring.
+ * the ring is created the first time; if that fails we just carry on.
+ */
+static void
+putRing()
+{
+    static int tried;
+    TelRingRec rec;
+    MotorInfo *mip;
+    int i;
+
+    if (!telring)
+    {
+        if (tried)
+            return;
+        tried = 1;
+        if (telRingOpen(1, &telring) < 0)
+        {
+            tdlog("Can not create axis history ring: %s", strerror(errno));
+            return;
         }
     }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.hmjd = telstatshmp->now.n_mjd;
+    rec.telstate = telstatshmp->telstate;
+    rec.clock = ringclock;
+    for (i = 0; i < TELRINGAX; i++)
+    {
+        mip = &telstatshmp->minfo[TEL_HM + i];
+        if (!mip->have)
+            continue;
+        rec.ax[i].raw = mip->raw;
+        rec.ax[i].when = rawmjd[mip - HMOT];
+        rec.ax[i].cpos = mip->cpos;
+        rec.ax[i].dpos = mip->dpos;
+        rec.ax[i].cvel = mip->cvel;
+    }
+    telRingPut(telring, &rec);
+}
+
+/* note mip->cpos was sampled at mjd t, and update its rate from the
+ * previous sample.
+ */
+static void
+setRawTime(MotorInfo *mip, double t)
+{
+    int i = mip - HMOT;
+    double dt = (t - rawmjd[i]) * SPD;
+
+    if (dt > 0 && dt < MAXRAWDT)
+        rawvel[i] = (mip->cpos - rawpos[i]) / dt;
+    else
+        rawvel[i] = 0;
+    rawmjd[i] = t;
+    rawpos[i] = mip->cpos;
+}
+
+/* return mip->cpos as of mjd t, allowing for its rate since sampled but
+ * for no longer than MAXRAWDT.
+ */
+static double
+cposAt(MotorInfo *mip, double t)
+{
+    int i = mip - HMOT;
+    double dt;
+
+    if (!mip->have)
+        return (mip->cpos);
+    dt = (t - rawmjd[i]) * SPD;
+    if (dt > MAXRAWDT)
+        dt = MAXRAWDT;
+    return (mip->cpos + rawvel[i] * dt);
 }
 
 /* issue a stop to all telescope axes */
@@ -1907,11 +2337,20 @@ initCfg()
             {"LARGEXP", CFG_INT, &LARGEXP},
         };
 
+    static double EPHCTOL;
+    static CfgEntry tdcfg2[] =
+        {
+            {"EPHCTOL", CFG_DBL, &EPHCTOL},
+        };
+
     MotorInfo *mip;
     TelAxes *tap;
     int n;
     int oldhomed;
 
+    /* let any tracking profile being computed finish with the old values */
+    staleTrack();
+
     /* read in everything */
     n = readCfgFile(1, tdcfn, tdcfg, NTDCFG);
     if (n != NTDCFG)
@@ -1935,6 +2374,11 @@ initCfg()
         XP += (PI / 2);
     }
 
+    /* optional Sun, Moon and planet cache for each day's tracking */
+    EPHCTOL = 0;
+    (void)readCfgFile(1, tdcfn, tdcfg2, 1);
+    (void)ephc_setup(0.0, EPHCTOL > 0 ? 1.0 : 0.0, EPHCTOL);
+
     /* misc checks */
     if (TRACKINT <= 0)
     {
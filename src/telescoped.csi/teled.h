@@ -38,6 +38,7 @@ extern void csiiClose (MotorInfo *mip);
 extern int csiOpen (int addr);
 extern int csiClose (int addr);
 extern int csiIsReady (int fd);
+extern void csiLogStats (MotorInfo *mip);
 
 /* dome.c */
 extern void dome_msg (char *msg);
@@ -46,6 +47,8 @@ extern void dome_msg (char *msg);
 extern void fifoWrite (FifoId f, int code, char *fmt, ...);
 extern void init_fifos(void);
 extern void chk_fifos(void);
+extern void fifoPollIn (FifoId f, double secs);
+extern void fifoWatch (FifoId f, int fd);
 extern void close_fifos(void);
 
 /* filter.c */